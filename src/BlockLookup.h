@@ -0,0 +1,73 @@
+#ifndef BLOCKLOOKUP_H
+#define BLOCKLOOKUP_H
+
+#include <algorithm>
+#include <vector>
+
+// Time -> block lookups on the block edges of a loaded sequence.
+// edges[i] is the start of block i and edges[N] the end of the last block (N = edges.size() - 1);
+// the edges are non-decreasing, zero-duration blocks repeat an edge. All lookups are binary
+// searches, so their cost does not grow with the length of the sequence.
+// Edges may be any random-access container of doubles (QVector<double>, std::vector<double>).
+
+namespace BlockLookup {
+
+// Block containing t (edges[i] <= t < edges[i+1]), -1 if t is outside the sequence.
+// Zero-duration blocks never contain a time point.
+template <typename Edges>
+int blockAt(const Edges& edges, double t)
+{
+    if (edges.size() < 2) return -1;
+    const auto begin = edges.begin();
+    const int idx = int(std::upper_bound(begin, edges.end(), t) - begin) - 1;
+    return (idx >= 0 && idx < int(edges.size()) - 1) ? idx : -1;
+}
+
+// Blocks overlapping the open interval (tStart, tEnd): first is the first block ending after
+// tStart, last the last block starting before tEnd. False if no block overlaps the interval.
+template <typename Edges>
+bool blockRange(const Edges& edges, double tStart, double tEnd, int& first, int& last)
+{
+    first = 0; last = -1;
+    if (edges.size() < 2) return false;
+    const auto begin = edges.begin();
+    const auto lastEdge = edges.end() - 1;
+    first = int(std::upper_bound(begin + 1, edges.end(), tStart) - (begin + 1));
+    last = int(std::lower_bound(begin, lastEdge, tEnd) - begin) - 1;
+    return first <= last;
+}
+
+// Edges inside the closed interval [tStart, tEnd] as the index range [first, end).
+template <typename Edges>
+void edgeRange(const Edges& edges, double tStart, double tEnd, int& first, int& end)
+{
+    const auto begin = edges.begin();
+    first = int(std::lower_bound(begin, edges.end(), tStart) - begin);
+    end = std::max(first, int(std::upper_bound(begin, edges.end(), tEnd) - begin));
+}
+
+// For each time, the block whose start is closest to it (the lowest index on ties, 0 without blocks).
+// Non-decreasing times are matched in a single merge walk over the edges.
+template <typename Edges>
+void closestBlockStarts(const Edges& edges, const std::vector<double>& times, std::vector<int>& blocks)
+{
+    blocks.assign(times.size(), 0);
+    const int blockCount = int(edges.size()) - 1;
+    if (blockCount <= 0) return;
+    const auto begin = edges.begin();
+    int next = 0; // first block starting at or after the current time
+    for (size_t j = 0; j < times.size(); ++j)
+    {
+        const double t = times[j];
+        if (j > 0 && t < times[j - 1]) next = 0; // unsorted input: restart the walk
+        while (next < blockCount && edges[next] < t) ++next;
+        if (next == 0) { blocks[j] = 0; continue; }
+        if (next < blockCount && edges[next] - t < t - edges[next - 1]) { blocks[j] = next; continue; }
+        // first of the (zero-duration) blocks sharing the start before t
+        blocks[j] = int(std::lower_bound(begin, begin + (next - 1), edges[next - 1]) - begin);
+    }
+}
+
+} // namespace BlockLookup
+
+#endif // BLOCKLOOKUP_H
@@ -0,0 +1,610 @@
+#ifndef DECIMATIONKERNELS_H
+#define DECIMATIONKERNELS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+// Waveform decimation for the plots: bucketed min/max envelopes and LTTB (largest triangle three
+// buckets). The inner loops -- argmin/argmax over a bucket and the triangle-area search -- have
+// SSE4.2 and AVX2 paths picked at runtime from the CPU, with a scalar fallback on other CPUs and
+// compilers. Every path returns the same indices as the scalar loop (NaN samples are skipped, ties
+// keep the first index), so the path in use never changes what is drawn.
+// Containers may be QVector or std::vector.
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SEQEYES_DECIMATION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define SEQEYES_DECIMATION_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SEQEYES_DECIMATION_TARGET(isa)
+#endif
+#endif
+
+namespace DecimationKernels {
+
+enum class Isa { Scalar, Sse42, Avx2 };
+
+inline const char* isaName(Isa isa)
+{
+    switch (isa) {
+    case Isa::Avx2: return "avx2";
+    case Isa::Sse42: return "sse4.2";
+    default: return "scalar";
+    }
+}
+
+// Best path the CPU (and the OS, for the AVX registers) supports
+inline Isa detectIsa()
+{
+#if defined(SEQEYES_DECIMATION_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse42 = (info[2] & (1 << 20)) != 0;
+    const bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (avx && maxLeaf >= 7) { __cpuidex(info, 7, 0); avx2 = (info[1] & (1 << 5)) != 0; }
+    return avx2 ? Isa::Avx2 : sse42 ? Isa::Sse42 : Isa::Scalar;
+#elif defined(SEQEYES_DECIMATION_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Isa::Avx2;
+    if (__builtin_cpu_supports("sse4.2")) return Isa::Sse42;
+    return Isa::Scalar;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+inline Isa supportedIsa()
+{
+    static const Isa isa = detectIsa();
+    return isa;
+}
+
+namespace detail {
+inline std::atomic<Isa>& isaSlot()
+{
+    static std::atomic<Isa> isa {supportedIsa()};
+    return isa;
+}
+} // namespace detail
+
+inline Isa activeIsa() { return detail::isaSlot().load(std::memory_order_relaxed); }
+
+// Force a path (benchmarks), clamped to what the CPU supports. Returns the path now in use.
+inline Isa setActiveIsa(Isa isa)
+{
+    if (int(isa) > int(supportedIsa())) isa = supportedIsa();
+    detail::isaSlot().store(isa, std::memory_order_relaxed);
+    return isa;
+}
+
+namespace detail {
+
+// Scalar argmin/argmax over [begin, end), continuing from (mn, iMin) / (mx, iMax).
+// Comparisons with NaN are false, so NaN samples are skipped; strict comparisons keep the first index.
+template <typename T>
+inline void minMaxScan(const T* v, int begin, int end, T& mn, int& iMin, T& mx, int& iMax)
+{
+    for (int i = begin; i < end; ++i) {
+        const T x = v[i];
+        if (x < mn) { mn = x; iMin = i; }
+        if (x > mx) { mx = x; iMax = i; }
+    }
+}
+
+// Fold per-lane winners (lane index < 0: lane never updated) into one, lowest index on ties
+template <typename T, typename I>
+inline void reduceLanes(const T* val, const I* idx, int lanes, bool lowest, T& best, int& iBest)
+{
+    for (int k = 0; k < lanes; ++k) {
+        if (idx[k] < 0) continue;
+        const int i = int(idx[k]);
+        const bool better = lowest ? val[k] < best : val[k] > best;
+        if (iBest < 0 || better || (val[k] == best && i < iBest)) { best = val[k]; iBest = i; }
+    }
+}
+
+// Triangle area (doubled) of the previous point a, candidate b and next-bucket point c, as LTTB uses it
+inline double triangleArea(double ax, double ay, double bx, double by, double cx, double cy)
+{
+    return std::abs((ax - cx) * (by - ay) - (ax - bx) * (cy - ay));
+}
+
+template <typename T>
+inline void minMaxIndexScalar(const T* v, int n, int& iMin, int& iMax)
+{
+    T mn = std::numeric_limits<T>::infinity(), mx = -std::numeric_limits<T>::infinity();
+    iMin = -1; iMax = -1;
+    minMaxScan(v, 0, n, mn, iMin, mx, iMax);
+}
+
+// First index of the largest area over [begin, end), begin if every area is NaN.
+// XAt(i) gives the x of sample i, y[i] its value.
+template <typename XAt, typename Y>
+inline int maxAreaIndexScalar(XAt xAt, const Y* y, int begin, int end, double ax, double ay, double cx, double cy)
+{
+    double maxArea = -1.0; int maxIndex = begin;
+    for (int i = begin; i < end; ++i) {
+        const double area = triangleArea(ax, ay, xAt(i), double(y[i]), cx, cy);
+        if (area > maxArea) { maxArea = area; maxIndex = i; }
+    }
+    return maxIndex;
+}
+
+#ifdef SEQEYES_DECIMATION_X86
+
+// The vector loops below keep one running winner per lane (index -1 until the lane sees a value),
+// fold the lanes and finish the remainder with the scalar loop. Indices are carried as int32 for
+// floats and as exact doubles for doubles. No FMA: products and sums round like the scalar code.
+
+SEQEYES_DECIMATION_TARGET("sse4.2")
+inline void minMaxIndexSse42(const float* v, int n, int& iMin, int& iMax)
+{
+    float mn = std::numeric_limits<float>::infinity(), mx = -mn;
+    iMin = -1; iMax = -1;
+    int i = 0;
+    if (n >= 4) {
+        __m128 vMin = _mm_set1_ps(mn), vMax = _mm_set1_ps(mx);
+        __m128 iVMin = _mm_castsi128_ps(_mm_set1_epi32(-1)), iVMax = iVMin;
+        __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i step = _mm_set1_epi32(4);
+        for (; i + 4 <= n; i += 4) {
+            const __m128 x = _mm_loadu_ps(v + i);
+            const __m128 lt = _mm_cmplt_ps(x, vMin);
+            const __m128 gt = _mm_cmpgt_ps(x, vMax);
+            vMin = _mm_blendv_ps(vMin, x, lt);
+            vMax = _mm_blendv_ps(vMax, x, gt);
+            iVMin = _mm_blendv_ps(iVMin, _mm_castsi128_ps(idx), lt);
+            iVMax = _mm_blendv_ps(iVMax, _mm_castsi128_ps(idx), gt);
+            idx = _mm_add_epi32(idx, step);
+        }
+        alignas(16) float lMin[4], lMax[4];
+        alignas(16) int liMin[4], liMax[4];
+        _mm_store_ps(lMin, vMin); _mm_store_ps(lMax, vMax);
+        _mm_store_si128(reinterpret_cast<__m128i*>(liMin), _mm_castps_si128(iVMin));
+        _mm_store_si128(reinterpret_cast<__m128i*>(liMax), _mm_castps_si128(iVMax));
+        reduceLanes(lMin, liMin, 4, true, mn, iMin);
+        reduceLanes(lMax, liMax, 4, false, mx, iMax);
+    }
+    minMaxScan(v, i, n, mn, iMin, mx, iMax);
+}
+
+SEQEYES_DECIMATION_TARGET("sse4.2")
+inline void minMaxIndexSse42(const double* v, int n, int& iMin, int& iMax)
+{
+    double mn = std::numeric_limits<double>::infinity(), mx = -mn;
+    iMin = -1; iMax = -1;
+    int i = 0;
+    if (n >= 2) {
+        __m128d vMin = _mm_set1_pd(mn), vMax = _mm_set1_pd(mx);
+        __m128d iVMin = _mm_set1_pd(-1.0), iVMax = iVMin;
+        __m128d idx = _mm_setr_pd(0.0, 1.0);
+        const __m128d step = _mm_set1_pd(2.0);
+        for (; i + 2 <= n; i += 2) {
+            const __m128d x = _mm_loadu_pd(v + i);
+            const __m128d lt = _mm_cmplt_pd(x, vMin);
+            const __m128d gt = _mm_cmpgt_pd(x, vMax);
+            vMin = _mm_blendv_pd(vMin, x, lt);
+            vMax = _mm_blendv_pd(vMax, x, gt);
+            iVMin = _mm_blendv_pd(iVMin, idx, lt);
+            iVMax = _mm_blendv_pd(iVMax, idx, gt);
+            idx = _mm_add_pd(idx, step);
+        }
+        alignas(16) double lMin[2], lMax[2], liMin[2], liMax[2];
+        _mm_store_pd(lMin, vMin); _mm_store_pd(lMax, vMax);
+        _mm_store_pd(liMin, iVMin); _mm_store_pd(liMax, iVMax);
+        reduceLanes(lMin, liMin, 2, true, mn, iMin);
+        reduceLanes(lMax, liMax, 2, false, mx, iMax);
+    }
+    minMaxScan(v, i, n, mn, iMin, mx, iMax);
+}
+
+SEQEYES_DECIMATION_TARGET("avx2")
+inline void minMaxIndexAvx2(const float* v, int n, int& iMin, int& iMax)
+{
+    float mn = std::numeric_limits<float>::infinity(), mx = -mn;
+    iMin = -1; iMax = -1;
+    int i = 0;
+    if (n >= 8) {
+        __m256 vMin = _mm256_set1_ps(mn), vMax = _mm256_set1_ps(mx);
+        __m256 iVMin = _mm256_castsi256_ps(_mm256_set1_epi32(-1)), iVMax = iVMin;
+        __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i step = _mm256_set1_epi32(8);
+        for (; i + 8 <= n; i += 8) {
+            const __m256 x = _mm256_loadu_ps(v + i);
+            const __m256 lt = _mm256_cmp_ps(x, vMin, _CMP_LT_OQ);
+            const __m256 gt = _mm256_cmp_ps(x, vMax, _CMP_GT_OQ);
+            vMin = _mm256_blendv_ps(vMin, x, lt);
+            vMax = _mm256_blendv_ps(vMax, x, gt);
+            iVMin = _mm256_blendv_ps(iVMin, _mm256_castsi256_ps(idx), lt);
+            iVMax = _mm256_blendv_ps(iVMax, _mm256_castsi256_ps(idx), gt);
+            idx = _mm256_add_epi32(idx, step);
+        }
+        alignas(32) float lMin[8], lMax[8];
+        alignas(32) int liMin[8], liMax[8];
+        _mm256_store_ps(lMin, vMin); _mm256_store_ps(lMax, vMax);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(liMin), _mm256_castps_si256(iVMin));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(liMax), _mm256_castps_si256(iVMax));
+        reduceLanes(lMin, liMin, 8, true, mn, iMin);
+        reduceLanes(lMax, liMax, 8, false, mx, iMax);
+    }
+    minMaxScan(v, i, n, mn, iMin, mx, iMax);
+}
+
+SEQEYES_DECIMATION_TARGET("avx2")
+inline void minMaxIndexAvx2(const double* v, int n, int& iMin, int& iMax)
+{
+    double mn = std::numeric_limits<double>::infinity(), mx = -mn;
+    iMin = -1; iMax = -1;
+    int i = 0;
+    if (n >= 4) {
+        __m256d vMin = _mm256_set1_pd(mn), vMax = _mm256_set1_pd(mx);
+        __m256d iVMin = _mm256_set1_pd(-1.0), iVMax = iVMin;
+        __m256d idx = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+        const __m256d step = _mm256_set1_pd(4.0);
+        for (; i + 4 <= n; i += 4) {
+            const __m256d x = _mm256_loadu_pd(v + i);
+            const __m256d lt = _mm256_cmp_pd(x, vMin, _CMP_LT_OQ);
+            const __m256d gt = _mm256_cmp_pd(x, vMax, _CMP_GT_OQ);
+            vMin = _mm256_blendv_pd(vMin, x, lt);
+            vMax = _mm256_blendv_pd(vMax, x, gt);
+            iVMin = _mm256_blendv_pd(iVMin, idx, lt);
+            iVMax = _mm256_blendv_pd(iVMax, idx, gt);
+            idx = _mm256_add_pd(idx, step);
+        }
+        alignas(32) double lMin[4], lMax[4], liMin[4], liMax[4];
+        _mm256_store_pd(lMin, vMin); _mm256_store_pd(lMax, vMax);
+        _mm256_store_pd(liMin, iVMin); _mm256_store_pd(liMax, iVMax);
+        reduceLanes(lMin, liMin, 4, true, mn, iMin);
+        reduceLanes(lMax, liMax, 4, false, mx, iMax);
+    }
+    minMaxScan(v, i, n, mn, iMin, mx, iMax);
+}
+
+// Largest-area search with x = tStart + i * dt and float samples (uniform raster shapes)
+SEQEYES_DECIMATION_TARGET("sse4.2")
+inline int maxAreaIndexUniformSse42(const float* y, int begin, int end, double tStart, double dt,
+                                    double ax, double ay, double cx, double cy)
+{
+    double best = -1.0; int iBest = -1;
+    int i = begin;
+    if (end - begin >= 2) {
+        const __m128d acx = _mm_set1_pd(ax - cx), cay = _mm_set1_pd(cy - ay);
+        const __m128d vax = _mm_set1_pd(ax), vay = _mm_set1_pd(ay);
+        const __m128d t0 = _mm_set1_pd(tStart), vdt = _mm_set1_pd(dt);
+        const __m128d sign = _mm_set1_pd(-0.0), step = _mm_set1_pd(2.0);
+        __m128d idx = _mm_setr_pd(double(i), double(i + 1));
+        __m128d vBest = _mm_set1_pd(-1.0), iVBest = vBest;
+        for (; i + 2 <= end; i += 2) {
+            const __m128d bx = _mm_add_pd(t0, _mm_mul_pd(idx, vdt));
+            const __m128d by = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + i))));
+            const __m128d d = _mm_sub_pd(_mm_mul_pd(acx, _mm_sub_pd(by, vay)), _mm_mul_pd(_mm_sub_pd(vax, bx), cay));
+            const __m128d area = _mm_andnot_pd(sign, d);
+            const __m128d gt = _mm_cmpgt_pd(area, vBest);
+            vBest = _mm_blendv_pd(vBest, area, gt);
+            iVBest = _mm_blendv_pd(iVBest, idx, gt);
+            idx = _mm_add_pd(idx, step);
+        }
+        alignas(16) double lBest[2], liBest[2];
+        _mm_store_pd(lBest, vBest); _mm_store_pd(liBest, iVBest);
+        reduceLanes(lBest, liBest, 2, false, best, iBest);
+    }
+    for (; i < end; ++i) {
+        const double area = triangleArea(ax, ay, tStart + i * dt, double(y[i]), cx, cy);
+        if (area > best) { best = area; iBest = i; }
+    }
+    return iBest < 0 ? begin : iBest;
+}
+
+SEQEYES_DECIMATION_TARGET("avx2")
+inline int maxAreaIndexUniformAvx2(const float* y, int begin, int end, double tStart, double dt,
+                                   double ax, double ay, double cx, double cy)
+{
+    double best = -1.0; int iBest = -1;
+    int i = begin;
+    if (end - begin >= 4) {
+        const __m256d acx = _mm256_set1_pd(ax - cx), cay = _mm256_set1_pd(cy - ay);
+        const __m256d vax = _mm256_set1_pd(ax), vay = _mm256_set1_pd(ay);
+        const __m256d t0 = _mm256_set1_pd(tStart), vdt = _mm256_set1_pd(dt);
+        const __m256d sign = _mm256_set1_pd(-0.0), step = _mm256_set1_pd(4.0);
+        __m256d idx = _mm256_setr_pd(double(i), double(i + 1), double(i + 2), double(i + 3));
+        __m256d vBest = _mm256_set1_pd(-1.0), iVBest = vBest;
+        for (; i + 4 <= end; i += 4) {
+            const __m256d bx = _mm256_add_pd(t0, _mm256_mul_pd(idx, vdt));
+            const __m256d by = _mm256_cvtps_pd(_mm_loadu_ps(y + i));
+            const __m256d d = _mm256_sub_pd(_mm256_mul_pd(acx, _mm256_sub_pd(by, vay)), _mm256_mul_pd(_mm256_sub_pd(vax, bx), cay));
+            const __m256d area = _mm256_andnot_pd(sign, d);
+            const __m256d gt = _mm256_cmp_pd(area, vBest, _CMP_GT_OQ);
+            vBest = _mm256_blendv_pd(vBest, area, gt);
+            iVBest = _mm256_blendv_pd(iVBest, idx, gt);
+            idx = _mm256_add_pd(idx, step);
+        }
+        alignas(32) double lBest[4], liBest[4];
+        _mm256_store_pd(lBest, vBest); _mm256_store_pd(liBest, iVBest);
+        reduceLanes(lBest, liBest, 4, false, best, iBest);
+    }
+    for (; i < end; ++i) {
+        const double area = triangleArea(ax, ay, tStart + i * dt, double(y[i]), cx, cy);
+        if (area > best) { best = area; iBest = i; }
+    }
+    return iBest < 0 ? begin : iBest;
+}
+
+// Largest-area search over explicit (x, y) samples
+SEQEYES_DECIMATION_TARGET("sse4.2")
+inline int maxAreaIndexSse42(const double* x, const double* y, int begin, int end,
+                             double ax, double ay, double cx, double cy)
+{
+    double best = -1.0; int iBest = -1;
+    int i = begin;
+    if (end - begin >= 2) {
+        const __m128d acx = _mm_set1_pd(ax - cx), cay = _mm_set1_pd(cy - ay);
+        const __m128d vax = _mm_set1_pd(ax), vay = _mm_set1_pd(ay);
+        const __m128d sign = _mm_set1_pd(-0.0), step = _mm_set1_pd(2.0);
+        __m128d idx = _mm_setr_pd(double(i), double(i + 1));
+        __m128d vBest = _mm_set1_pd(-1.0), iVBest = vBest;
+        for (; i + 2 <= end; i += 2) {
+            const __m128d bx = _mm_loadu_pd(x + i);
+            const __m128d by = _mm_loadu_pd(y + i);
+            const __m128d d = _mm_sub_pd(_mm_mul_pd(acx, _mm_sub_pd(by, vay)), _mm_mul_pd(_mm_sub_pd(vax, bx), cay));
+            const __m128d area = _mm_andnot_pd(sign, d);
+            const __m128d gt = _mm_cmpgt_pd(area, vBest);
+            vBest = _mm_blendv_pd(vBest, area, gt);
+            iVBest = _mm_blendv_pd(iVBest, idx, gt);
+            idx = _mm_add_pd(idx, step);
+        }
+        alignas(16) double lBest[2], liBest[2];
+        _mm_store_pd(lBest, vBest); _mm_store_pd(liBest, iVBest);
+        reduceLanes(lBest, liBest, 2, false, best, iBest);
+    }
+    for (; i < end; ++i) {
+        const double area = triangleArea(ax, ay, x[i], y[i], cx, cy);
+        if (area > best) { best = area; iBest = i; }
+    }
+    return iBest < 0 ? begin : iBest;
+}
+
+SEQEYES_DECIMATION_TARGET("avx2")
+inline int maxAreaIndexAvx2(const double* x, const double* y, int begin, int end,
+                            double ax, double ay, double cx, double cy)
+{
+    double best = -1.0; int iBest = -1;
+    int i = begin;
+    if (end - begin >= 4) {
+        const __m256d acx = _mm256_set1_pd(ax - cx), cay = _mm256_set1_pd(cy - ay);
+        const __m256d vax = _mm256_set1_pd(ax), vay = _mm256_set1_pd(ay);
+        const __m256d sign = _mm256_set1_pd(-0.0), step = _mm256_set1_pd(4.0);
+        __m256d idx = _mm256_setr_pd(double(i), double(i + 1), double(i + 2), double(i + 3));
+        __m256d vBest = _mm256_set1_pd(-1.0), iVBest = vBest;
+        for (; i + 4 <= end; i += 4) {
+            const __m256d bx = _mm256_loadu_pd(x + i);
+            const __m256d by = _mm256_loadu_pd(y + i);
+            const __m256d d = _mm256_sub_pd(_mm256_mul_pd(acx, _mm256_sub_pd(by, vay)), _mm256_mul_pd(_mm256_sub_pd(vax, bx), cay));
+            const __m256d area = _mm256_andnot_pd(sign, d);
+            const __m256d gt = _mm256_cmp_pd(area, vBest, _CMP_GT_OQ);
+            vBest = _mm256_blendv_pd(vBest, area, gt);
+            iVBest = _mm256_blendv_pd(iVBest, idx, gt);
+            idx = _mm256_add_pd(idx, step);
+        }
+        alignas(32) double lBest[4], liBest[4];
+        _mm256_store_pd(lBest, vBest); _mm256_store_pd(liBest, iVBest);
+        reduceLanes(lBest, liBest, 4, false, best, iBest);
+    }
+    for (; i < end; ++i) {
+        const double area = triangleArea(ax, ay, x[i], y[i], cx, cy);
+        if (area > best) { best = area; iBest = i; }
+    }
+    return iBest < 0 ? begin : iBest;
+}
+
+#endif // SEQEYES_DECIMATION_X86
+
+} // namespace detail
+
+// Indices of the smallest and largest of v[0..n), first occurrence on ties, NaN skipped.
+// -1 when no sample is below +inf (iMin) or above -inf (iMax).
+template <typename T>
+inline void minMaxIndex(const T* v, int n, int& iMin, int& iMax)
+{
+#ifdef SEQEYES_DECIMATION_X86
+    switch (activeIsa()) {
+    case Isa::Avx2: detail::minMaxIndexAvx2(v, n, iMin, iMax); return;
+    case Isa::Sse42: detail::minMaxIndexSse42(v, n, iMin, iMax); return;
+    default: break;
+    }
+#endif
+    detail::minMaxIndexScalar(v, n, iMin, iMax);
+}
+
+// LTTB candidate in [begin, end) spanning the largest triangle with a = (ax, ay) and c = (cx, cy);
+// sample i lies at (tStart + i * dt, y[i]). First index on ties, begin if every area is NaN.
+inline int maxAreaIndexUniform(const float* y, int begin, int end, double tStart, double dt,
+                               double ax, double ay, double cx, double cy)
+{
+#ifdef SEQEYES_DECIMATION_X86
+    switch (activeIsa()) {
+    case Isa::Avx2: return detail::maxAreaIndexUniformAvx2(y, begin, end, tStart, dt, ax, ay, cx, cy);
+    case Isa::Sse42: return detail::maxAreaIndexUniformSse42(y, begin, end, tStart, dt, ax, ay, cx, cy);
+    default: break;
+    }
+#endif
+    return detail::maxAreaIndexScalar([&](int i) { return tStart + i * dt; }, y, begin, end, ax, ay, cx, cy);
+}
+
+// As maxAreaIndexUniform, sample i at (x[i], y[i])
+inline int maxAreaIndex(const double* x, const double* y, int begin, int end,
+                        double ax, double ay, double cx, double cy)
+{
+#ifdef SEQEYES_DECIMATION_X86
+    switch (activeIsa()) {
+    case Isa::Avx2: return detail::maxAreaIndexAvx2(x, y, begin, end, ax, ay, cx, cy);
+    case Isa::Sse42: return detail::maxAreaIndexSse42(x, y, begin, end, ax, ay, cx, cy);
+    default: break;
+    }
+#endif
+    return detail::maxAreaIndexScalar([&](int i) { return x[i]; }, y, begin, end, ax, ay, cx, cy);
+}
+
+// Per-bucket argmin/argmax of a uniformly sampled shape: sample indices of the min and max in each of
+// `buckets` equal index ranges (the range start if a bucket holds only NaN). Every index when the
+// shape has no more than two samples per bucket.
+template <typename Src, typename Idx>
+void bucketMinMax(const Src& src, int buckets, Idx& outIdxMin, Idx& outIdxMax)
+{
+    outIdxMin.clear(); outIdxMax.clear();
+    const int n = int(src.size());
+    if (n == 0 || buckets <= 0) return;
+    if (n <= 2 * buckets) {
+        outIdxMin.reserve(n); outIdxMax.reserve(n);
+        for (int i = 0; i < n; ++i) { outIdxMin.push_back(i); outIdxMax.push_back(i); }
+        return;
+    }
+    outIdxMin.reserve(buckets); outIdxMax.reserve(buckets);
+    const double bw = double(n) / double(buckets);
+    for (int b = 0; b < buckets; ++b) {
+        const double start = b * bw;
+        const double end = (b + 1 == buckets) ? n : (b + 1) * bw;
+        int i0 = int(std::floor(start));
+        int i1 = int(std::floor(end));
+        if (i0 >= n) i0 = n - 1;
+        if (i1 <= i0) i1 = std::min(n, i0 + 1);
+        int iMin, iMax;
+        minMaxIndex(src.data() + i0, i1 - i0, iMin, iMax);
+        outIdxMin.push_back(iMin < 0 ? i0 : i0 + iMin);
+        outIdxMax.push_back(iMax < 0 ? i0 : i0 + iMax);
+    }
+}
+
+// LTTB of a uniformly sampled shape (sample i at tStart + i * dt) down to targetPoints points.
+// The first and last samples are always kept; each bucket keeps the sample spanning the largest
+// triangle with the previously kept sample and the average of the next bucket.
+template <typename Src, typename Out>
+void lttbUniform(const Src& src, double tStart, double dt, int targetPoints, Out& tOut, Out& vOut)
+{
+    tOut.clear(); vOut.clear();
+    const int n = int(src.size());
+    if (n <= 0 || targetPoints <= 0) return;
+    if (n <= targetPoints) {
+        tOut.reserve(n); vOut.reserve(n);
+        for (int i = 0; i < n; ++i) { tOut.push_back(tStart + i * dt); vOut.push_back(double(src[i])); }
+        return;
+    }
+    tOut.reserve(targetPoints); vOut.reserve(targetPoints);
+    tOut.push_back(tStart); vOut.push_back(double(src[0]));
+    if (targetPoints == 1) return;
+    if (targetPoints == 2) {
+        tOut.push_back(tStart + (n - 1) * dt); vOut.push_back(double(src[n - 1]));
+        return;
+    }
+    const int buckets = targetPoints - 2;
+    int bucketSize = (n - 2) / buckets;
+    if (bucketSize <= 0) bucketSize = 1;
+    int a = 0; // previously kept sample
+    for (int b = 0; b < buckets; ++b) {
+        const int start = 1 + b * bucketSize;
+        const int end = (b == buckets - 1 ? n - 1 : std::min(n - 1, start + bucketSize));
+        // average of the next bucket
+        const int nextStart = end;
+        const int nextEnd = (b == buckets - 1 ? n - 1 : std::min(n - 1, end + bucketSize));
+        double avgX = 0.0, avgY = 0.0; int count = 0;
+        for (int i = nextStart; i < nextEnd; ++i) { avgX += (tStart + i * dt); avgY += double(src[i]); ++count; }
+        if (count == 0) { avgX = tStart + nextStart * dt; avgY = double(src[std::min(nextStart, n - 1)]); }
+        const int maxIndex = maxAreaIndexUniform(src.data(), start, end, tStart, dt,
+                                                 tStart + a * dt, double(src[a]), avgX, avgY);
+        tOut.push_back(tStart + maxIndex * dt);
+        vOut.push_back(double(src[maxIndex]));
+        a = maxIndex;
+    }
+    tOut.push_back(tStart + (n - 1) * dt);
+    vOut.push_back(double(src[n - 1]));
+}
+
+// LTTB of an explicit (time, value) series down to targetPoints points. Bucket i is scored against
+// sample i - 1 and the first sample of the next bucket.
+template <typename Vec>
+void lttb(const Vec& time, const Vec& values, int targetPoints, Vec& sampledTime, Vec& sampledValues)
+{
+    if (time.empty() || values.empty() || time.size() != values.size()) {
+        sampledTime.clear();
+        sampledValues.clear();
+        return;
+    }
+    const int n = int(time.size());
+    if (targetPoints <= 0) targetPoints = 2;
+    if (targetPoints > n) targetPoints = n;
+    if (n <= targetPoints) {
+        sampledTime = time;
+        sampledValues = values;
+        return;
+    }
+    sampledTime.clear();
+    sampledValues.clear();
+    sampledTime.reserve(targetPoints);
+    sampledValues.reserve(targetPoints);
+    sampledTime.push_back(time.front());
+    sampledValues.push_back(values.front());
+    if (targetPoints <= 2) {
+        if (targetPoints == 2) {
+            sampledTime.push_back(time.back());
+            sampledValues.push_back(values.back());
+        }
+        return;
+    }
+    const int bucketSize = (n - 2) / (targetPoints - 2);
+    for (int i = 1; i < targetPoints - 1; ++i) {
+        const int bucketStart = (i - 1) * bucketSize + 1;
+        const int bucketEnd = std::min(bucketStart + bucketSize, n - 1);
+        const int maxIndex = maxAreaIndex(time.data(), values.data(), bucketStart, bucketEnd,
+                                          time[i - 1], values[i - 1], time[bucketEnd], values[bucketEnd]);
+        sampledTime.push_back(time[maxIndex]);
+        sampledValues.push_back(values[maxIndex]);
+    }
+    sampledTime.push_back(time.back());
+    sampledValues.push_back(values.back());
+}
+
+// Min/max per time bucket of an explicit (time, value) series with non-decreasing times: up to two
+// points (min, then max if different) per bucket of equal duration, NaN breaks skipped. The series itself when it has no more
+// than two samples per bucket or spans no time.
+template <typename Vec>
+void minMaxByTime(const Vec& time, const Vec& values, int pixelBuckets, Vec& outTime, Vec& outValues)
+{
+    outTime.clear(); outValues.clear();
+    if (time.empty() || values.empty() || time.size() != values.size() || pixelBuckets <= 0) return;
+    const int n = int(time.size());
+    if (n <= 2 * pixelBuckets) { outTime = time; outValues = values; return; }
+    const double tMin = time.front();
+    const double tMax = time.back();
+    if (tMax <= tMin) { outTime = time; outValues = values; return; }
+    outTime.reserve(2 * pixelBuckets);
+    outValues.reserve(2 * pixelBuckets);
+    const double bucketW = (tMax - tMin) / pixelBuckets;
+    int idx = 0;
+    for (int b = 0; b < pixelBuckets; ++b) {
+        const double bx0 = tMin + b * bucketW;
+        const double bx1 = (b == pixelBuckets - 1) ? tMax : (bx0 + bucketW);
+        while (idx < n && time[idx] < bx0) ++idx;
+        const int j = int(std::upper_bound(time.begin() + idx, time.end(), bx1) - time.begin());
+        int iMin, iMax;
+        minMaxIndex(values.data() + idx, j - idx, iMin, iMax);
+        if (iMin >= 0) {
+            const double ymin = values[idx + iMin];
+            const double ymax = iMax >= 0 ? values[idx + iMax] : -std::numeric_limits<double>::infinity();
+            outTime.push_back(time[idx + iMin]); outValues.push_back(ymin);
+            if (ymax != ymin) { outTime.push_back(iMax >= 0 ? time[idx + iMax] : bx0); outValues.push_back(ymax); }
+        }
+        idx = j;
+    }
+}
+
+} // namespace DecimationKernels
+
+#endif // DECIMATIONKERNELS_H
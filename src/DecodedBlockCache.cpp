@@ -0,0 +1,68 @@
+#include "DecodedBlockCache.h"
+#include "ExternalSequence.h"
+#include <algorithm>
+
+void DecodedBlockCache::setResident(const std::vector<SeqBlock*>* blocks)
+{
+    clear();
+    m_resident = blocks;
+}
+
+void DecodedBlockCache::setLazy(std::shared_ptr<ExternalSequence> seq, int blockCount, int capacity)
+{
+    clear();
+    m_seq = std::move(seq);
+    m_blockCount = m_seq ? std::max(0, blockCount) : 0;
+    m_capacity = std::max(1, capacity);
+}
+
+void DecodedBlockCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+    m_seq.reset();
+    m_blockCount = 0;
+}
+
+int DecodedBlockCache::size() const
+{
+    if (m_seq) return m_blockCount;
+    return m_resident ? int(m_resident->size()) : 0;
+}
+
+int DecodedBlockCache::cachedCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return int(m_entries.size());
+}
+
+std::shared_ptr<SeqBlock> DecodedBlockCache::block(int index) const
+{
+    if (index < 0 || index >= size()) return nullptr;
+    if (!m_seq)
+    {
+        // Resident blocks are owned by the loader: alias them without taking ownership
+        return std::shared_ptr<SeqBlock>(std::shared_ptr<SeqBlock>(), (*m_resident)[index]);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(index);
+    if (it != m_entries.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lruPos);
+        return it->second.block;
+    }
+
+    // Shapes come from the sequence's shape pool, so decoding a block is mostly library lookups
+    std::shared_ptr<SeqBlock> decoded(m_seq->GetBlock(index));
+    if (!decoded || !m_seq->decodeBlock(decoded.get())) return nullptr;
+    m_lru.push_front(index);
+    m_entries.emplace(index, Entry{decoded, m_lru.begin()});
+    while (int(m_entries.size()) > m_capacity)
+    {
+        m_entries.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+    return decoded;
+}
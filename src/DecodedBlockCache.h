@@ -0,0 +1,55 @@
+#ifndef DECODEDBLOCKCACHE_H
+#define DECODEDBLOCKCACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class ExternalSequence;
+class SeqBlock;
+
+// The decoded blocks of the loaded sequence, indexed like the block table.
+// An eager load decodes every block up front; they stay resident in a vector owned by PulseqLoader,
+// which this class only views. A lazy load keeps just the parsed block table: a block is decoded the
+// first time it is asked for and kept in a least-recently-used list of at most `capacity` blocks, so
+// the memory held by decoded blocks no longer grows with the file.
+// block() hands out shared pointers, so a block evicted while a caller still uses it stays alive.
+class DecodedBlockCache
+{
+public:
+    // View blocks decoded up front (not owned); the vector may be refilled later
+    void setResident(const std::vector<SeqBlock*>* blocks);
+    // Decode blocks [0, blockCount) of seq on demand
+    void setLazy(std::shared_ptr<ExternalSequence> seq, int blockCount, int capacity);
+    // Drop the lazy state and all cached blocks, back to viewing the resident vector
+    void clear();
+
+    bool isLazy() const { return m_seq != nullptr; }
+    int size() const;
+    bool empty() const { return size() == 0; }
+    // Decoded block, or null if index is out of range or the block fails to decode
+    std::shared_ptr<SeqBlock> block(int index) const;
+    // Blocks currently decoded in lazy mode
+    int cachedCount() const;
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<SeqBlock> block;
+        std::list<int>::iterator lruPos;
+    };
+
+    const std::vector<SeqBlock*>* m_resident {nullptr};
+    std::shared_ptr<ExternalSequence> m_seq;
+    int m_blockCount {0};
+    int m_capacity {0};
+
+    // Lazy mode: render worker and GUI thread both fetch blocks
+    mutable std::mutex m_mutex;
+    mutable std::list<int> m_lru; // most recently used first
+    mutable std::unordered_map<int, Entry> m_entries;
+};
+
+#endif // DECODEDBLOCKCACHE_H
@@ -1,6 +1,8 @@
 #include "ExtensionPlotter.h"
 
 #include "PulseqLoader.h"
+#include "LabelStore.h"
+#include "SequenceTable.h"
 #include "Settings.h"
 #include "ExtensionStyleMap.h"
 
@@ -210,7 +212,7 @@ void ExtensionPlotter::rebuildCacheIfNeeded(PulseqLoader* loader)
         return;
 
     void* seqPtr = static_cast<void*>(seq);
-    const int blockCount = static_cast<int>(loader->getDecodedSeqBlocks().size());
+    const int blockCount = loader->getBlockCount();
     if (seqPtr == m_lastSeqPtr && blockCount == m_lastBlockCount)
         return;
 
@@ -230,10 +232,6 @@ void ExtensionPlotter::rebuildCacheIfNeeded(PulseqLoader* loader)
     if (edges.size() < 2)
         return;
 
-    // Track current label state (known IDs only; ignore unknown IDs >= NUM_LABELS/NUM_FLAGS).
-    QVector<int> counterVal(NUM_LABELS, 0);
-    QVector<bool> flagVal(NUM_FLAGS, false);
-
     auto specs = supportedSpecs();
     // Initialize series with a starting point at time 0
     for (const Spec& s : specs)
@@ -243,108 +241,50 @@ void ExtensionPlotter::rebuildCacheIfNeeded(PulseqLoader* loader)
         sc.used = false;
     }
 
-    auto appendPoint = [&](const Spec& s, double t, double newVal) {
-        SeriesCache& sc = m_cacheByName[s.name];
-        if (!sc.valid)
-            return;
-        // Avoid duplicate timestamps
-        if (!sc.t.isEmpty() && sc.t.last() == t)
-        {
-            sc.v.last() = newVal;
-            return;
-        }
-        sc.t.push_back(t);
-        sc.v.push_back(newVal);
-    };
-
-    // Track whether each label ever appeared; only plot after it appeared at least once (SeqPlot.m's label_defined semantics).
-    QVector<bool> usedCounters(NUM_LABELS, false);
-    QVector<bool> usedFlags(NUM_FLAGS, false);
+    // Label values come from the loader's change-point store and ADC times from its sequence table,
+    // so no block is decoded here. Record values ONLY at ADC events (SeqPlot.m behavior); a block's
+    // label events apply before its ADC.
+    const LabelStore& labels = loader->getLabelStore();
+    const SequenceTable::AdcColumns& adc = loader->getSequenceTable().adc;
+    const double tFactor = loader->getTFactor();
+    const int nBlocks = std::min(labels.blockCount(), static_cast<int>(edges.size() - 1));
 
-    // Walk blocks, apply label events, and record values ONLY at ADC events (SeqPlot.m behavior).
-    const auto& blocks = loader->getDecodedSeqBlocks();
-    const int nBlocks = std::min(static_cast<int>(blocks.size()), static_cast<int>(edges.size() - 1));
-    for (int i = 0; i < nBlocks; ++i)
+    for (const Spec& s : specs)
     {
-        SeqBlock* blk = blocks[i];
-        if (!blk)
+        SeriesCache& sc = m_cacheByName[s.name];
+        const LabelStore::Track& track = s.isFlag ? labels.flagTrack(s.id) : labels.counterTrack(s.id);
+        // Only plot labels/flags that have appeared at least once (SeqPlot.m's label_defined semantics);
+        // the first change point is the first label event touching it.
+        if (track.size() == 0)
             continue;
 
-        // Apply labelset then labelinc (SeqPlot.m behavior)
-        if (blk->isLabel())
+        // ADC rows are in block order, so one cursor walks the track alongside them
+        int k = 0;
+        for (int r = 0; r < adc.size(); ++r)
         {
-            const auto& sets = blk->GetLabelSetEvents();
-            for (const auto& e : sets)
-            {
-                const int lblId = e.numVal.first;
-                const int val = e.numVal.second;
-                const int flagId = e.flagVal.first;
-                const bool fval = e.flagVal.second;
-
-                if (lblId >= 0 && lblId < NUM_LABELS && lblId != LABEL_UNKNOWN)
-                {
-                    counterVal[lblId] = val;
-                    usedCounters[lblId] = true;
-                }
-                if (flagId >= 0 && flagId < NUM_FLAGS && flagId != FLAG_UNKNOWN)
-                {
-                    flagVal[flagId] = fval;
-                    usedFlags[flagId] = true;
-                }
-            }
-            const auto& incs = blk->GetLabelIncEvents();
-            for (const auto& e : incs)
-            {
-                const int lblId = e.numVal.first;
-                const int val = e.numVal.second;
-                if (lblId >= 0 && lblId < NUM_LABELS && lblId != LABEL_UNKNOWN)
-                {
-                    counterVal[lblId] += val;
-                    usedCounters[lblId] = true;
-                }
-            }
-        }
+            const int block = adc.block[r];
+            if (block >= nBlocks)
+                break;
+            while (k < track.size() && track.block[k] <= block)
+                ++k;
+            if (k == 0)
+                continue;
+            sc.used = true;
 
-        if (blk->isADC())
-        {
             // ADC center time: blockStart + adc.delay + (numSamples-1)/2*dwell
-            const ADCEvent& adc = blk->GetADCEvent();
-            const double tStart = edges[i];
-            const double tDelay = adc.delay * loader->getTFactor(); // us -> internal
-            const double dwellUs = adc.dwellTime / 1000.0;          // ns -> us
-            const double dt = dwellUs * loader->getTFactor();
-            const double mid = (adc.numSamples > 0 ? (adc.numSamples - 1) * 0.5 * dt : 0.0);
-            const double tAdc = tStart + tDelay + mid;
-
-            for (const Spec& s : specs)
+            const double dt = adc.dwell[r] / 1000.0 * tFactor; // ns -> us -> internal
+            const double mid = (adc.numSamples[r] > 0 ? (adc.numSamples[r] - 1) * 0.5 * dt : 0.0);
+            const double tAdc = edges[block] + adc.delay[r] * tFactor + mid;
+            const double v = static_cast<double>(track.value[k - 1]);
+
+            // Avoid duplicate timestamps
+            if (!sc.t.isEmpty() && sc.t.last() == tAdc)
             {
-                // Only plot labels/flags that have appeared at least once.
-                if (s.isFlag)
-                {
-                    if (s.id >= 0 && s.id < usedFlags.size() && !usedFlags[s.id])
-                        continue;
-                    m_cacheByName[s.name].used = true;
-                }
-                else
-                {
-                    if (s.id >= 0 && s.id < usedCounters.size() && !usedCounters[s.id])
-                        continue;
-                    m_cacheByName[s.name].used = true;
-                }
-
-                double v = 0.0;
-                if (s.isFlag)
-                {
-                    if (s.id >= 0 && s.id < NUM_FLAGS)
-                        v = flagVal[s.id] ? 1.0 : 0.0;
-                }
-                else
-                {
-                    if (s.id >= 0 && s.id < NUM_LABELS)
-                        v = static_cast<double>(counterVal[s.id]);
-                }
-                appendPoint(s, tAdc, v);
+                sc.v.last() = v;
+                continue;
             }
+            sc.t.push_back(tAdc);
+            sc.v.push_back(v);
         }
     }
 }
@@ -92,14 +92,8 @@ void InteractionHandler::dropEvent(QDropEvent* event)
         QList<QUrl> urlList = mimeData->urls();
         QString sPulseqFilePath = urlList.at(0).toLocalFile();
 
-        // Delegate to PulseqLoader
-        if (!m_mainWindow->getPulseqLoader()->LoadPulseqFile(sPulseqFilePath))
-        {
-            std::stringstream sLog;
-            sLog << "Load " << sPulseqFilePath.toStdString() << " failed!";
-            QMessageBox::critical(m_mainWindow, "File Error", sLog.str().c_str());
-            return;
-        }
+        // Delegate to PulseqLoader (loads in the background and reports errors itself)
+        m_mainWindow->getPulseqLoader()->LoadPulseqFileAsync(sPulseqFilePath);
         m_mainWindow->getPulseqLoader()->setPulseqFilePathCache(sPulseqFilePath);
     }
 }
@@ -230,27 +224,10 @@ void InteractionHandler::onMouseMove(QMouseEvent* event)
 
 	double xCoord = m_mainWindow->ui->customPlot->xAxis->pixelToCoord(event->pos().x());
 	PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-	if (!loader || loader->getDecodedSeqBlocks().empty()) return;
+	if (!loader || loader->getBlockCount() == 0) return;
 
-	const auto& edges = loader->getBlockEdges();
-	int start = loader->getBlockRangeStart();
-	int end = loader->getBlockRangeEnd();
-	int blockIdx = -1;
-	for (int i = start; i <= end && i + 1 < edges.size(); ++i)
-	{
-		if (xCoord >= edges[i] && xCoord < edges[i+1]) { blockIdx = i; break; }
-	}
-	// Whole-sequence mode can cover more than the active block window; fall back to
-	// a global search so the status bar stays accurate instead of reporting -1.
-	if (blockIdx < 0 && edges.size() > 1)
-	{
-		auto upper = std::upper_bound(edges.begin(), edges.end(), xCoord);
-		int candidate = static_cast<int>(upper - edges.begin()) - 1;
-		if (candidate >= 0 && candidate < loader->getDecodedSeqBlocks().size())
-		{
-			blockIdx = candidate;
-		}
-	}
+	// Global binary search: whole-sequence mode can cover more than the active block window
+	int blockIdx = loader->findBlockAt(xCoord);
 
 	// Use mouse x position directly for the guide line to avoid snapping to sparse keys.
 	double guideX = xCoord;
@@ -404,7 +381,7 @@ void InteractionHandler::onMouseMove(QMouseEvent* event)
 
 	if (blockIdx < 0) return;
 
-	const auto& blk = loader->getDecodedSeqBlocks()[blockIdx];
+	const std::shared_ptr<SeqBlock> blk = loader->getDecodedBlock(blockIdx);
 	double t0 = edges[blockIdx];
 	double tFactor = loader->getTFactor();
 
@@ -438,7 +415,7 @@ void InteractionHandler::onMouseMove(QMouseEvent* event)
     }
 
 	// Trigger tooltip
-	if (blk->isTrigger())
+	if (blk && blk->isTrigger())
 	{
 		const TriggerEvent& trg = blk->GetTriggerEvent();
 		double tTrig = t0 + trg.delay * tFactor;
@@ -576,15 +553,7 @@ void InteractionHandler::showRawBlockData()
     PulseqLoader* loader = m_mainWindow->getPulseqLoader();
     if (!loader) return;
 
-    int currentBlock = -1;
-    const auto& edges = loader->getBlockEdges();
-    if (edges.size() > 1)
-    {
-        auto upper = std::upper_bound(edges.begin(), edges.end(), x);
-        int candidate = static_cast<int>(upper - edges.begin()) - 1;
-        if (candidate >= 0 && candidate < static_cast<int>(loader->getDecodedSeqBlocks().size()))
-            currentBlock = candidate;
-    }
+    int currentBlock = loader->findBlockAt(x);
     if (currentBlock < 0) return;
 
     if (!m_pBlockInfoDialog)
@@ -782,16 +751,7 @@ void InteractionHandler::showBlockInformation()
     if (found)
     {
         PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-        int currentBlock = -1;
-        const auto& vecBlockEdges = loader->getBlockEdges();
-        for (int i = 0; i < vecBlockEdges.size() - 1; ++i)
-        {
-            if (closestX >= vecBlockEdges[i] && closestX < vecBlockEdges[i + 1])
-            {
-                currentBlock = i;
-                break;
-            }
-        }
+        int currentBlock = loader->findBlockAt(closestX);
 
         if (currentBlock != -1)
         {
@@ -1192,13 +1152,7 @@ bool InteractionHandler::eventFilter(QObject* obj, QEvent* event)
             if (!trStart || !trEnd || !trInc)
                 return false;
 
-            bool okInc = false;
-            int incVal = trInc->text().toInt(&okInc);
-            int step = okInc ? std::abs(incVal) : 1;
-            if (step <= 0)
-                step = 1;
-
-            step *= trStepSign;
+            int step = trm->trStepSize() * trStepSign;
 
             bool okS = false, okE = false;
             int startTr = trStart->text().toInt(&okS);
@@ -1,13 +1,14 @@
 #include "KSpaceTrajectory.h"
 
-#include "SeriesBuilder.h"
+#include "DecodedBlockCache.h"
 #include "ExternalSequence.h"
 
 #include <algorithm>
+#include <atomic>
 #include <complex>
 #include <cmath>
 #include <limits>
-#include <numeric>
+#include <thread>
 #include <QtGlobal>
 #include "Settings.h"
 #include <QDebug>
@@ -16,6 +17,11 @@ namespace KSpaceTrajectory
 {
 namespace
 {
+    const double kTimeAccuracySec = 1e-10; // times are rounded to this grid
+    // Emitted points integrated at once, and segments per task of the integration threads
+    const int kPointsPerBatch = 1 << 16;
+    const int kSegmentsPerTask = 16;
+
     double internalToSeconds(double value, double tFactor)
     {
         if (tFactor == 0.0)
@@ -24,6 +30,23 @@ namespace
         return microseconds * 1e-6;
     }
 
+    double roundAcc(double sec)
+    {
+        if (!std::isfinite(sec))
+            return sec;
+        return kTimeAccuracySec * std::llround(sec / kTimeAccuracySec);
+    }
+
+    double clampNonNegative(double sec)
+    {
+        return sec < 0.0 ? 0.0 : sec;
+    }
+
+    double internalToSecRounded(double internal, double tFactor)
+    {
+        return clampNonNegative(roundAcc(internalToSeconds(internal, tFactor)));
+    }
+
     double rfCenterUs(SeqBlock* blk, const RFEvent& rf)
     {
         if (!blk)
@@ -146,572 +169,543 @@ namespace
         return 'r';
     }
 
-    double sampleGradientAt(const QVector<double>& times, const QVector<double>& values, double t, int& cursor)
+    // A gradient corner: the waveform is linear between consecutive corners of a channel and zero outside
+    // the first..last corner; two corners at one time make a jump
+    struct Corner
     {
-        // Robust sampling with clamped endpoints and safe neighbor lookup.
-        if (times.isEmpty() || values.isEmpty())
-            return 0.0;
-        if (times.size() == 1)
-            return values.first();
-        // Endpoint clamps
-        if (t <= times.first())
-            return values.first();
-        if (t >= times.last())
-            return values.last();
-
-        // Find first index where times[i] >= t
-        auto it = std::lower_bound(times.begin(), times.end(), t);
-        int i1 = static_cast<int>(it - times.begin());
-        int i0 = std::max(0, i1 - 1);
-        // Cache cursor near current neighborhood for subsequent calls
-        cursor = i0;
-
-        double t0 = times[i0];
-        double t1 = times[i1];
-        double v0 = values[i0];
-        double v1 = values[i1];
-        if (t1 <= t0)
-            return v1;
-        double alpha = (t - t0) / (t1 - t0);
-        alpha = std::clamp(alpha, 0.0, 1.0);
-        return v0 + (v1 - v0) * alpha;
-    }
+        double sec;
+        double value; // Hz/m
+    };
 
-    void sanitizeGradientSeries(QVector<double>& times, QVector<double>& values)
+    void gradientCorners(SeqBlock& blk, int channel, double blockStartSec, double rasterSec, std::vector<Corner>& corners)
     {
-        if (times.size() != values.size())
+        corners.clear();
+        if (!(blk.isTrapGradient(channel) || blk.isArbitraryGradient(channel) || blk.isExtTrapGradient(channel)))
+            return;
+        const GradEvent& grad = blk.GetGradEvent(channel);
+        const double startSec = blockStartSec + static_cast<double>(grad.delay) * 1e-6;
+        const double amp = static_cast<double>(grad.amplitude);
+        if (blk.isTrapGradient(channel))
         {
-            int n = std::min(times.size(), values.size());
-            times.resize(n);
-            values.resize(n);
+            const double rampUpSec = static_cast<double>(grad.rampUpTime) * 1e-6;
+            const double flatSec = static_cast<double>(grad.flatTime) * 1e-6;
+            const double rampDownSec = static_cast<double>(grad.rampDownTime) * 1e-6;
+            corners = { {startSec, 0.0},
+                        {startSec + rampUpSec, amp},
+                        {startSec + rampUpSec + flatSec, amp},
+                        {startSec + rampUpSec + flatSec + rampDownSec, 0.0} };
         }
-        int writeIdx = 0;
-        double prevTime = -std::numeric_limits<double>::infinity();
-        for (int i = 0; i < times.size(); ++i)
+        else if (blk.isArbitraryGradient(channel))
         {
-            double val = values[i];
-            double t = times[i];
-            if (!std::isfinite(t))
-                continue;
-
-            bool isBreak = !std::isfinite(val);
-            if (writeIdx > 0)
+            const int numSamples = blk.GetArbGradNumSamples(channel);
+            const float* shapePtr = blk.GetArbGradShapePtr(channel);
+            if (numSamples <= 0 || !shapePtr)
+                return;
+            if (numSamples == 1)
             {
-                if (t < prevTime - 1e-15)
-                    continue;
-                if (std::abs(t - prevTime) <= 1e-15)
-                {
-                    // Preserve duplicate timestamps if one of them is a break marker.
-                    bool prevBreak = !std::isfinite(values[writeIdx - 1]);
-                    if (isBreak && prevBreak)
-                        continue;
-                    if (isBreak || prevBreak)
-                    {
-                        times[writeIdx] = t;
-                        values[writeIdx] = isBreak ? std::numeric_limits<double>::quiet_NaN() : val;
-                        prevTime = t;
-                        ++writeIdx;
-                        continue;
-                    }
-                    times[writeIdx - 1] = t;
-                    values[writeIdx - 1] = val;
-                    prevTime = t;
-                    continue;
-                }
+                // A single sample holds for one raster step
+                const double v = static_cast<double>(shapePtr[0]) * amp;
+                corners = { {startSec, v}, {startSec + rasterSec, v} };
+                return;
             }
-            times[writeIdx] = t;
-            values[writeIdx] = isBreak ? std::numeric_limits<double>::quiet_NaN() : val;
-            prevTime = t;
-            ++writeIdx;
+            corners.reserve(numSamples);
+            for (int j = 0; j < numSamples; ++j)
+                corners.push_back({startSec + j * rasterSec, static_cast<double>(shapePtr[j]) * amp});
         }
-        times.resize(writeIdx);
-        values.resize(writeIdx);
-    }
-
-    double trapezoidGradientValue(const GradEvent& grad, double localSec)
-    {
-        if (localSec < 0.0)
-            return 0.0;
-        double rampUpSec = static_cast<double>(grad.rampUpTime) * 1e-6;
-        double flatSec = static_cast<double>(grad.flatTime) * 1e-6;
-        double rampDownSec = static_cast<double>(grad.rampDownTime) * 1e-6;
-        double totalSec = rampUpSec + flatSec + rampDownSec;
-        if (localSec > totalSec || totalSec <= 0.0)
-            return 0.0;
-        double amp = static_cast<double>(grad.amplitude);
-        if (localSec <= rampUpSec && rampUpSec > 0.0)
-            return amp * (localSec / rampUpSec);
-        if (localSec <= rampUpSec + flatSec)
-            return amp;
-        if (rampDownSec > 0.0)
+        else
         {
-            double t = localSec - rampUpSec - flatSec;
-            if (t <= rampDownSec)
-                return amp * (1.0 - t / rampDownSec);
+            const std::vector<long>& timesUs = blk.GetExtTrapGradTimes(channel);
+            const std::vector<float>& shape = blk.GetExtTrapGradShape(channel);
+            if (timesUs.empty() || timesUs.size() != shape.size())
+                return;
+            corners.reserve(timesUs.size());
+            for (size_t j = 0; j < timesUs.size(); ++j)
+                corners.push_back({startSec + static_cast<double>(timesUs[j]) * 1e-6, static_cast<double>(shape[j]) * amp});
         }
-        return 0.0;
     }
 
-    double arbitraryGradientValue(SeqBlock* blk, int channel, const GradEvent& grad, double localSec, double gradientRasterUs)
+    void rotateGradient(const RotationEvent& rot, double g[3])
     {
-        if (localSec < 0.0)
-            return 0.0;
-        int numSamples = blk->GetArbGradNumSamples(channel);
-        const float* shapePtr = blk->GetArbGradShapePtr(channel);
-        if (numSamples <= 0 || !shapePtr)
-            return 0.0;
-        double rasterUs = (gradientRasterUs > 0.0 ? gradientRasterUs : 10.0);
-        double rasterSec = rasterUs * 1e-6;
-        if (numSamples == 1)
-        {
-            double durationSec = rasterSec;
-            if (localSec <= durationSec)
-                return static_cast<double>(shapePtr[0]) * static_cast<double>(grad.amplitude);
-            return 0.0;
-        }
-        double totalSec = rasterSec * static_cast<double>(numSamples - 1);
-        if (localSec > totalSec)
-            return 0.0;
-        double pos = localSec / rasterSec;
-        int idx0 = static_cast<int>(std::floor(pos));
-        if (idx0 >= numSamples - 1)
-            return static_cast<double>(shapePtr[numSamples - 1]) * static_cast<double>(grad.amplitude);
-        double frac = pos - idx0;
-        int idx1 = idx0 + 1;
-        double v0 = static_cast<double>(shapePtr[idx0]);
-        double v1 = static_cast<double>(shapePtr[idx1]);
-        return (v0 + (v1 - v0) * frac) * static_cast<double>(grad.amplitude);
+        const double w = rot.rotQuaternion[0];
+        const double x = rot.rotQuaternion[1];
+        const double y = rot.rotQuaternion[2];
+        const double z = rot.rotQuaternion[3];
+
+        // Quaternion to 3x3 Rotation Matrix
+        const double R00 = 1.0 - 2.0*y*y - 2.0*z*z;
+        const double R01 = 2.0*x*y - 2.0*w*z;
+        const double R02 = 2.0*x*z + 2.0*w*y;
+
+        const double R10 = 2.0*x*y + 2.0*w*z;
+        const double R11 = 1.0 - 2.0*x*x - 2.0*z*z;
+        const double R12 = 2.0*y*z - 2.0*w*x;
+
+        const double R20 = 2.0*x*z - 2.0*w*y;
+        const double R21 = 2.0*y*z + 2.0*w*x;
+        const double R22 = 1.0 - 2.0*x*x - 2.0*y*y;
+
+        const double lgx = g[0], lgy = g[1], lgz = g[2];
+        g[0] = R00*lgx + R01*lgy + R02*lgz;
+        g[1] = R10*lgx + R11*lgy + R12*lgz;
+        g[2] = R20*lgx + R21*lgy + R22*lgz;
     }
+}
 
-    double extTrapGradientValue(SeqBlock* blk, int channel, const GradEvent& grad, double localSec)
-    {
-        if (localSec < 0.0)
-            return 0.0;
-        const std::vector<long>& timesUs = blk->GetExtTrapGradTimes(channel);
-        const std::vector<float>& shape = blk->GetExtTrapGradShape(channel);
-        if (timesUs.empty() || shape.empty() || timesUs.size() != shape.size())
-            return 0.0;
-        double localUs = localSec * 1e6;
-        if (localUs <= static_cast<double>(timesUs.front()))
-            return static_cast<double>(shape.front()) * static_cast<double>(grad.amplitude);
-        if (localUs >= static_cast<double>(timesUs.back()))
-            return static_cast<double>(shape.back()) * static_cast<double>(grad.amplitude);
-        int idx1 = -1;
-        for (int j = 1; j < static_cast<int>(timesUs.size()); ++j)
-        {
-            if (localUs <= static_cast<double>(timesUs[j]))
-            {
-                idx1 = j;
-                break;
-            }
-        }
-        if (idx1 <= 0)
-            return static_cast<double>(shape.front()) * static_cast<double>(grad.amplitude);
-        int idx0 = idx1 - 1;
-        double t0 = static_cast<double>(timesUs[idx0]) * 1e-6;
-        double t1 = static_cast<double>(timesUs[idx1]) * 1e-6;
-        double span = t1 - t0;
-        if (span <= 0.0)
-            return static_cast<double>(shape[idx1]) * static_cast<double>(grad.amplitude);
-        double alpha = (localSec - t0) / span;
-        alpha = std::clamp(alpha, 0.0, 1.0);
-        double v0 = static_cast<double>(shape[idx0]);
-        double v1 = static_cast<double>(shape[idx1]);
-        return (v0 + (v1 - v0) * alpha) * static_cast<double>(grad.amplitude);
-    }
+RfUseScanner::RfUseScanner(double tFactor, bool supportsRfUseMetadata, double b0Tesla, double gammaHzPerT)
+    : m_tFactor(tFactor),
+      m_supportsRfUseMetadata(supportsRfUseMetadata),
+      m_b0Tesla(b0Tesla),
+      m_gammaHzPerT(gammaHzPerT)
+{
+}
 
-    double gradientValueFromBlock(SeqBlock* blk, int channel, double timeSec, double blockStartSec, double gradientRasterUs)
-    {
-        if (!blk)
-            return 0.0;
-        if (!(blk->isTrapGradient(channel) || blk->isArbitraryGradient(channel) || blk->isExtTrapGradient(channel)))
-            return 0.0;
-        const GradEvent& grad = blk->GetGradEvent(channel);
-        double eventStartSec = blockStartSec + static_cast<double>(grad.delay) * 1e-6;
-        double localSec = timeSec - eventStartSec;
-        if (blk->isTrapGradient(channel))
-            return trapezoidGradientValue(grad, localSec);
-        if (blk->isArbitraryGradient(channel))
-            return arbitraryGradientValue(blk, channel, grad, localSec, gradientRasterUs);
-        if (blk->isExtTrapGradient(channel))
-            return extTrapGradientValue(blk, channel, grad, localSec);
-        return 0.0;
-    }
+void RfUseScanner::begin(int blockCount)
+{
+    m_result = Result();
+    m_result.rfUsePerBlock.fill(0, blockCount);
+    m_lastUse = 0;
+    m_guessedAny = false;
+}
+
+void RfUseScanner::consume(int i, SeqBlock& block, double blockStart)
+{
+    m_lastUse = 0;
+    if (!block.isRF())
+        return;
+    const RFEvent& rf = block.GetRFEvent();
+    bool guessed = false;
+    char useChar = classifyRfUse(&block, rf, m_supportsRfUseMetadata, guessed, m_b0Tesla, m_gammaHzPerT);
+    m_guessedAny |= guessed;
+    m_lastUse = useChar ? useChar : 'u';
+    m_result.rfUsePerBlock[i] = m_lastUse;
+
+    double centerUs = rfCenterUs(&block, rf);
+    m_lastCenterInternal = blockStart + (rf.delay + centerUs) * m_tFactor;
+    if (useChar == 'e' || useChar == 'E')
+        m_result.excitationTimesInternal.append(m_lastCenterInternal);
+    else if (useChar == 'r' || useChar == 'R')
+        m_result.refocusingTimesInternal.append(m_lastCenterInternal);
+}
 
-    void mergeTimeVectors(QVector<double>& base, const QVector<double>& extra, double tFactor)
+void RfUseScanner::finish()
+{
+    m_result.rfUseGuessed = m_guessedAny;
+    if (m_guessedAny)
     {
-        for (double v : extra)
-        {
-            double sec = internalToSeconds(v, tFactor);
-            base.append(sec);
-        }
+        m_result.warning = QStringLiteral("No RF use in seq file, probably seq file version is older than v1.5.0. Now we have to guess RF use, the trajectory may not be accurate.");
     }
 }
 
-Result compute(const Input& input)
+Result RfUseScanner::takeResult()
 {
-    Result result;
-    if (input.blocks.empty() || input.blockEdges.size() < 2)
-        return result;
+    return std::move(m_result);
+}
 
-    const double tacc = 1e-10;
-    auto roundAcc = [&](double sec) -> double {
-        if (!std::isfinite(sec))
-            return sec;
-        return tacc * std::llround(sec / tacc);
-    };
-    auto clampNonNegative = [](double sec) -> double {
-        return sec < 0.0 ? 0.0 : sec;
-    };
-    auto internalToSecRounded = [&](double internal) -> double {
-        double sec = internalToSeconds(internal, input.tFactor);
-        return clampNonNegative(roundAcc(sec));
-    };
+Integrator::Integrator(double tFactor, double gradientRasterUs, double rfRasterUs, bool supportsRfUseMetadata, double b0Tesla)
+    : m_tFactor(tFactor),
+      m_gradientRasterUs(gradientRasterUs),
+      m_rfRasterSec(rfRasterUs > 0.0 ? rfRasterUs * 1e-6 : 0.0),
+      m_rfUses(tFactor, supportsRfUseMetadata, b0Tesla, Settings::getInstance().getGamma())
+{
+}
 
-    QVector<double> gxTime, gxValue;
-    QVector<double> gyTime, gyValue;
-    QVector<double> gzTime, gzValue;
-    SeriesBuilder::buildGradientSeries(input.blocks, input.blockEdges, input.tFactor, 0, gxTime, gxValue, input.gradientRasterUs);
-    SeriesBuilder::buildGradientSeries(input.blocks, input.blockEdges, input.tFactor, 1, gyTime, gyValue, input.gradientRasterUs);
-    SeriesBuilder::buildGradientSeries(input.blocks, input.blockEdges, input.tFactor, 2, gzTime, gzValue, input.gradientRasterUs);
-    sanitizeGradientSeries(gxTime, gxValue);
-    sanitizeGradientSeries(gyTime, gyValue);
-    sanitizeGradientSeries(gzTime, gzValue);
-
-    QVector<double> gxTimeSec(gxTime.size());
-    QVector<double> gyTimeSec(gyTime.size());
-    QVector<double> gzTimeSec(gzTime.size());
-    for (int i = 0; i < gxTime.size(); ++i) gxTimeSec[i] = internalToSeconds(gxTime[i], input.tFactor);
-    for (int i = 0; i < gyTime.size(); ++i) gyTimeSec[i] = internalToSeconds(gyTime[i], input.tFactor);
-    for (int i = 0; i < gzTime.size(); ++i) gzTimeSec[i] = internalToSeconds(gzTime[i], input.tFactor);
-
-    QVector<double> excitationSecondsRounded;
-    QVector<double> refocusSecondsRounded;
-    bool guessedAny = false;
-
-    double gammaHzPerT = Settings::getInstance().getGamma();
-    QVector<char> rfUsePerBlock;
-    rfUsePerBlock.resize(static_cast<int>(input.blocks.size()));
-    std::fill(rfUsePerBlock.begin(), rfUsePerBlock.end(), 0);
-    for (int i = 0; i < input.blocks.size(); ++i)
-    {
-        SeqBlock* blk = input.blocks[i];
-        if (!blk)
-            continue;
-        if (!blk->isRF())
-        {
-            rfUsePerBlock[i] = 0;
-            continue;
-        }
+void Integrator::begin(int blockCount)
+{
+    m_blockCount = blockCount;
+    m_result = Result();
+    m_rfUses.begin(blockCount);
+    m_pending.clear();
+    m_pieces.clear();
+    m_pieceScan = 0;
+    m_points.clear();
+    m_segments.clear();
+    m_nanPoints.clear();
+    const double zero[3] = {0.0, 0.0, 0.0};
+    openSegment(0.0, zero, zero);
+    m_endInternal = 0.0;
+    m_pointsTaken = 0;
+    addTime(0.0);
+}
 
-        const RFEvent& rf = blk->GetRFEvent();
-        bool guessed = false;
-        char useChar = classifyRfUse(blk, rf, input.supportsRfUseMetadata, guessed,
-                                     input.b0Tesla, gammaHzPerT);
-        guessedAny |= guessed;
-        rfUsePerBlock[i] = useChar ? useChar : 'u';
+void Integrator::addTime(double sec, quint8 flags)
+{
+    if (!std::isfinite(sec))
+        return;
+    m_pending.append({clampNonNegative(roundAcc(sec)), flags});
+}
 
-        double centerUs = rfCenterUs(blk, rf);
-        double internalTime = input.blockEdges[i] + (rf.delay + centerUs) * input.tFactor;
+void Integrator::consume(int i, SeqBlock& block, double blockStart)
+{
+    SeqBlock* blk = &block;
+    const double blockStartSec = internalToSeconds(blockStart, m_tFactor);
+    m_endInternal = blockStart + blk->GetDuration() * m_tFactor;
+    const double blockEndSec = internalToSeconds(m_endInternal, m_tFactor);
+
+    m_rfUses.consume(i, block, blockStart);
+    const char useChar = m_rfUses.lastUse();
+    if (useChar != 0)
+    {
+        const double sec = internalToSecRounded(m_rfUses.lastCenterInternal(), m_tFactor);
 
         if (useChar == 'e' || useChar == 'E')
         {
-            result.excitationTimesInternal.append(internalTime);
-            excitationSecondsRounded.append(internalToSecRounded(internalTime));
+            addTime(sec, ExcitationTime);
+            if (m_rfRasterSec > 0.0)
+            {
+                addTime(clampNonNegative(sec - m_rfRasterSec));
+                addTime(clampNonNegative(sec - 2.0 * m_rfRasterSec));
+            }
         }
         else if (useChar == 'r' || useChar == 'R')
         {
-            result.refocusingTimesInternal.append(internalTime);
-            refocusSecondsRounded.append(internalToSecRounded(internalTime));
+            addTime(sec, RefocusingTime);
+            if (m_rfRasterSec > 0.0)
+                addTime(clampNonNegative(sec - m_rfRasterSec));
         }
     }
 
-    result.rfUseGuessed = guessedAny;
-    if (guessedAny)
+    if (blk->isADC())
     {
-        result.warning = QStringLiteral("No RF use in seq file, probably seq file version is older than v1.5.0. Now we have to guess RF use, the trajectory may not be accurate.");
-    }
-    result.rfUsePerBlock = rfUsePerBlock;
-
-    double rfRasterSec = input.rfRasterUs > 0.0 ? input.rfRasterUs * 1e-6 : 0.0;
-    double gradRasterSec = input.gradientRasterUs > 0.0 ? input.gradientRasterUs * 1e-6 : 0.0;
-    double totalDurationSec = internalToSecRounded(input.blockEdges.last());
-
-    QVector<double> adcSecondsRounded;
-    adcSecondsRounded.reserve(input.adcEventTimesInternal.size());
-    for (double v : input.adcEventTimesInternal)
-    {
-        adcSecondsRounded.append(internalToSecRounded(v));
+        const ADCEvent& adc = blk->GetADCEvent();
+        if (adc.numSamples > 0 && adc.dwellTime > 0)
+        {
+            const double dwellInternal = static_cast<double>(adc.dwellTime) * 1e-3 * m_tFactor; // ns -> us -> internal
+            const double startInternal = blockStart + adc.delay * m_tFactor + 0.5 * dwellInternal;
+            for (int sample = 0; sample < adc.numSamples; ++sample)
+                addTime(internalToSecRounded(startInternal + sample * dwellInternal, m_tFactor), AdcTime);
+        }
     }
-    result.t_adc = adcSecondsRounded;
 
-    QVector<double> timeCandidates;
-    timeCandidates.reserve(gxTimeSec.size() + gyTimeSec.size() + gzTimeSec.size()
-                           + excitationSecondsRounded.size() * 3
-                           + refocusSecondsRounded.size() * 2
-                           + adcSecondsRounded.size() + 4);
+    addGradientPieces(block, blockStartSec, blockEndSec);
 
-    auto addCandidate = [&](double sec){
-        if (!std::isfinite(sec))
-            return;
-        sec = roundAcc(sec);
-        sec = clampNonNegative(sec);
-        timeCandidates.append(sec);
-    };
-
-    // Use only breaks (gradient series time points) + events — no dense ramp sampling
-    for (double sec : gxTimeSec) addCandidate(sec);
-    for (double sec : gyTimeSec) addCandidate(sec);
-    for (double sec : gzTimeSec) addCandidate(sec);
-
-    addCandidate(0.0);
-    addCandidate(totalDurationSec);
+    // Later blocks start at blockEndSec or later; their earliest times are RF raster steps before an RF center
+    emitBefore(blockEndSec - 2.0 * m_rfRasterSec - 2.0 * kTimeAccuracySec);
+    if (m_points.size() >= kPointsPerBatch)
+        flush();
+}
 
-    for (double sec : excitationSecondsRounded)
+void Integrator::addGradientPieces(SeqBlock& block, double blockStartSec, double blockEndSec)
+{
+    const double rasterSec = (m_gradientRasterUs > 0.0 ? m_gradientRasterUs : 10.0) * 1e-6;
+    std::vector<Corner> corners[3];
+    std::vector<double> cuts;
+    for (int ch = 0; ch < 3; ++ch)
     {
-        addCandidate(sec);
-        if (rfRasterSec > 0.0)
+        gradientCorners(block, ch, blockStartSec, rasterSec, corners[ch]);
+        for (const Corner& c : corners[ch])
         {
-            addCandidate(clampNonNegative(sec - rfRasterSec));
-            addCandidate(clampNonNegative(sec - 2.0 * rfRasterSec));
+            addTime(c.sec);
+            cuts.push_back(std::clamp(c.sec, blockStartSec, std::max(blockStartSec, blockEndSec)));
         }
     }
-    for (double sec : refocusSecondsRounded)
-    {
-        addCandidate(sec);
-        if (rfRasterSec > 0.0)
-            addCandidate(clampNonNegative(sec - rfRasterSec));
-    }
-    for (double sec : adcSecondsRounded) addCandidate(sec);
-
-    std::sort(timeCandidates.begin(), timeCandidates.end());
-    QVector<double> timeGrid;
-    timeGrid.reserve(timeCandidates.size());
-    for (double v : timeCandidates)
-    {
-        if (timeGrid.isEmpty() || std::abs(v - timeGrid.back()) > tacc * 0.5)
-            timeGrid.append(v);
-    }
-    if (timeGrid.size() < 2)
+    if (cuts.empty())
+        return;
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+    // Between consecutive cuts every channel is linear: take its values at both ends from the segment
+    // holding the midpoint
+    size_t cursor[3] = {0, 0, 0};
+    for (size_t j = 1; j < cuts.size(); ++j)
     {
-        double extra = timeGrid.isEmpty() ? tacc : (timeGrid.back() + tacc);
-        timeGrid.append(extra);
-    }
-    result.t = timeGrid;
-
-    QVector<double> blockEdgesSec(input.blockEdges.size());
-    for (int i = 0; i < input.blockEdges.size(); ++i)
-        blockEdgesSec[i] = internalToSecRounded(input.blockEdges[i]);
-
-    auto gradientAtSec = [&](double sec, double& gx, double& gy, double& gz) {
-        gx = 0.0; gy = 0.0; gz = 0.0;
-        if (blockEdgesSec.size() < 2)
-            return;
-        if (sec < blockEdgesSec.front() || sec >= blockEdgesSec.back())
-            return;
-        auto it = std::upper_bound(blockEdgesSec.begin(), blockEdgesSec.end(), sec);
-        if (it == blockEdgesSec.begin())
-            return;
-        int blockIdx = static_cast<int>(it - blockEdgesSec.begin()) - 1;
-        if (blockIdx < 0 || blockIdx >= static_cast<int>(input.blocks.size()))
-            return;
-            
-        SeqBlock* blk = input.blocks[blockIdx];
-        double blockStartSec = blockEdgesSec[blockIdx];
-        
-        double lgx = gradientValueFromBlock(blk, 0, sec, blockStartSec, input.gradientRasterUs);
-        double lgy = gradientValueFromBlock(blk, 1, sec, blockStartSec, input.gradientRasterUs);
-        double lgz = gradientValueFromBlock(blk, 2, sec, blockStartSec, input.gradientRasterUs);
-        
-        if (blk && blk->isRotation())
+        const double t0 = cuts[j - 1], t1 = cuts[j];
+        const double mid = 0.5 * (t0 + t1);
+        Piece piece {t0, t1, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+        bool any = false;
+        for (int ch = 0; ch < 3; ++ch)
         {
-            const RotationEvent& rot = blk->GetRotationEvent();
-            double w = rot.rotQuaternion[0];
-            double x = rot.rotQuaternion[1];
-            double y = rot.rotQuaternion[2];
-            double z = rot.rotQuaternion[3];
-            
-            // Quaternion to 3x3 Rotation Matrix
-            double R00 = 1.0 - 2.0*y*y - 2.0*z*z;
-            double R01 = 2.0*x*y - 2.0*w*z;
-            double R02 = 2.0*x*z + 2.0*w*y;
-            
-            double R10 = 2.0*x*y + 2.0*w*z;
-            double R11 = 1.0 - 2.0*x*x - 2.0*z*z;
-            double R12 = 2.0*y*z - 2.0*w*x;
-            
-            double R20 = 2.0*x*z - 2.0*w*y;
-            double R21 = 2.0*y*z + 2.0*w*x;
-            double R22 = 1.0 - 2.0*x*x - 2.0*y*y;
-            
-            gx = R00*lgx + R01*lgy + R02*lgz;
-            gy = R10*lgx + R11*lgy + R12*lgz;
-            gz = R20*lgx + R21*lgy + R22*lgz;
+            const std::vector<Corner>& c = corners[ch];
+            if (c.size() < 2 || mid < c.front().sec || mid > c.back().sec)
+                continue;
+            size_t& k = cursor[ch];
+            while (k + 2 < c.size() && c[k + 1].sec <= mid)
+                ++k;
+            const double span = c[k + 1].sec - c[k].sec;
+            if (span <= 0.0)
+                continue;
+            const double slope = (c[k + 1].value - c[k].value) / span;
+            piece.g0[ch] = c[k].value + slope * (t0 - c[k].sec);
+            piece.g1[ch] = c[k].value + slope * (t1 - c[k].sec);
+            any = any || piece.g0[ch] != 0.0 || piece.g1[ch] != 0.0;
         }
-        else
+        if (!any)
+            continue;
+        if (block.isRotation())
         {
-            gx = lgx;
-            gy = lgy;
-            gz = lgz;
+            rotateGradient(block.GetRotationEvent(), piece.g0);
+            rotateGradient(block.GetRotationEvent(), piece.g1);
         }
-    };
+        m_pieces.append(piece);
+    }
+}
+
+void Integrator::emitBefore(double sec)
+{
+    std::sort(m_pending.begin(), m_pending.end(),
+              [](const PendingTime& a, const PendingTime& b) { return a.sec < b.sec; });
 
-    QVector<double> kxData(timeGrid.size(), 0.0);
-    QVector<double> kyData(timeGrid.size(), 0.0);
-    QVector<double> kzData(timeGrid.size(), 0.0);
-    for (int i = 1; i < timeGrid.size(); ++i)
+    const double half = kTimeAccuracySec * 0.5;
+    int i = 0;
+    while (i < m_pending.size() && m_pending[i].sec < sec)
     {
-        double dt = timeGrid[i] - timeGrid[i - 1];
-        if (dt <= 0.0)
+        // Times within half the accuracy of the first one are one output point
+        const double t = m_pending[i].sec;
+        int end = i;
+        quint8 flags = 0;
+        while (end < m_pending.size() && std::abs(m_pending[end].sec - t) <= half)
+            flags |= m_pending[end++].flags;
+
+        if ((flags & ExcitationTime) && !m_result.t.isEmpty())
         {
-            kxData[i] = kxData[i - 1];
-            kyData[i] = kyData[i - 1];
-            kzData[i] = kzData[i - 1];
-            continue;
+            // k restarts from zero at an excitation; break the plotted line just before it
+            closeSegment();
+            const double zero[3] = {0.0, 0.0, 0.0};
+            openSegment(t, zero, zero);
+            m_nanPoints.append(m_result.t.size() - 1);
         }
-        double mid = timeGrid[i - 1] + 0.5 * dt;
-        double gxMid = 0.0, gyMid = 0.0, gzMid = 0.0;
-        gradientAtSec(mid, gxMid, gyMid, gzMid);
-        
-        kxData[i] = kxData[i - 1] + gxMid * dt;
-        kyData[i] = kyData[i - 1] + gyMid * dt;
-        kzData[i] = kzData[i - 1] + gzMid * dt;
-    }
 
-    auto indexForSeconds = [&](double sec) -> int {
-        double target = roundAcc(sec);
-        auto it = std::lower_bound(timeGrid.begin(), timeGrid.end(), target - tacc * 0.5);
-        while (it != timeGrid.end())
+        int adcCount = 0;
+        for (int j = i; j < end; ++j)
         {
-            if (std::abs(*it - target) <= tacc * 0.5)
-                return static_cast<int>(it - timeGrid.begin());
-            if (*it > target + tacc * 0.5)
-                break;
-            ++it;
+            if (!(m_pending[j].flags & AdcTime))
+                continue;
+            m_result.t_adc.append(m_pending[j].sec);
+            ++adcCount;
         }
-        return -1;
-    };
-
-    QVector<int> excitationIdx;
-    for (double sec : excitationSecondsRounded)
-    {
-        int idx = indexForSeconds(sec);
-        if (idx >= 0)
-            excitationIdx.append(idx);
+        m_points.append({t, flags, adcCount});
+        m_result.t.append(t);
+        i = end;
     }
-    std::sort(excitationIdx.begin(), excitationIdx.end());
-    excitationIdx.erase(std::unique(excitationIdx.begin(), excitationIdx.end()), excitationIdx.end());
+    m_pending.remove(0, i);
+}
 
-    QVector<int> refocusIdx;
-    for (double sec : refocusSecondsRounded)
-    {
-        int idx = indexForSeconds(sec);
-        if (idx >= 0)
-            refocusIdx.append(idx);
-    }
-    std::sort(refocusIdx.begin(), refocusIdx.end());
-    refocusIdx.erase(std::unique(refocusIdx.begin(), refocusIdx.end()), refocusIdx.end());
-
-    QVector<int> boundaries;
-    boundaries.append(0);
-    boundaries += excitationIdx;
-    boundaries += refocusIdx;
-    boundaries.append(timeGrid.size() - 1);
-    std::sort(boundaries.begin(), boundaries.end());
-    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
-
-    double dkX = -kxData[0];
-    double dkY = -kyData[0];
-    double dkZ = -kzData[0];
-    int ptrExc = 0;
-    int ptrRef = 0;
-    for (int seg = 0; seg < boundaries.size() - 1; ++seg)
+void Integrator::openSegment(double startSec, const double k[3], const double dk[3])
+{
+    m_open = Segment();
+    m_open.startSec = startSec;
+    std::copy(k, k + 3, m_open.k);
+    std::copy(dk, dk + 3, m_open.dk);
+    m_open.pointFirst = m_points.size();
+    m_open.outFirst = m_result.t.size();
+    m_open.adcFirst = m_result.t_adc.size();
+}
+
+void Integrator::closeSegment()
+{
+    m_open.pointEnd = m_points.size();
+    if (m_open.pointEnd == m_open.pointFirst)
+        return;
+    // Pieces overlapping [startSec, last point]; later segments start later, so the scan only moves on
+    const double endSec = m_points.last().sec;
+    while (m_pieceScan < m_pieces.size() && m_pieces[m_pieceScan].t1 <= m_open.startSec)
+        ++m_pieceScan;
+    m_open.pieceFirst = m_pieceScan;
+    m_open.pieceEnd = m_pieceScan;
+    while (m_open.pieceEnd < m_pieces.size() && m_pieces[m_open.pieceEnd].t0 < endSec)
+        ++m_open.pieceEnd;
+    m_segments.append(m_open);
+}
+
+void Integrator::integrateSegment(Segment& segment, const Outputs& out) const
+{
+    double* k = segment.k;
+    double* dk = segment.dk;
+    double sec = segment.startSec;
+    int piece = segment.pieceFirst;
+    int outIdx = segment.outFirst;
+    int adcIdx = segment.adcFirst;
+    for (int i = segment.pointFirst; i < segment.pointEnd; ++i)
     {
-        int start = boundaries[seg];
-        int endIdx = boundaries[seg + 1];
-        bool isExc = (ptrExc < excitationIdx.size() && excitationIdx[ptrExc] == start);
-        bool isRef = (ptrRef < refocusIdx.size() && refocusIdx[ptrRef] == start);
+        const Point& point = m_points[i];
 
-        if (isExc)
+        // Each piece is linear, so its integral over [a, b] is the trapezoid area
+        while (piece < segment.pieceEnd)
         {
-            dkX = -kxData[start];
-            dkY = -kyData[start];
-            dkZ = -kzData[start];
-            ++ptrExc;
+            const Piece& p = m_pieces[piece];
+            if (p.t0 >= point.sec)
+                break;
+            const double a = std::max(p.t0, sec);
+            const double b = std::min(p.t1, point.sec);
+            if (b > a)
+            {
+                const double span = p.t1 - p.t0;
+                const double wa = (a - p.t0) / span;
+                const double wb = (b - p.t0) / span;
+                for (int ch = 0; ch < 3; ++ch)
+                {
+                    const double ga = p.g0[ch] + (p.g1[ch] - p.g0[ch]) * wa;
+                    const double gb = p.g0[ch] + (p.g1[ch] - p.g0[ch]) * wb;
+                    k[ch] += 0.5 * (ga + gb) * (b - a);
+                }
+            }
+            if (p.t1 > point.sec)
+                break;
+            ++piece;
         }
-        else if (isRef)
+        sec = std::max(sec, point.sec);
+
+        // An excitation only ever opens a segment (k is zero there) and takes precedence over refocusing;
+        // a refocusing pulse mirrors k through the origin
+        if ((point.flags & RefocusingTime) && !(point.flags & ExcitationTime))
         {
-            dkX = -2.0 * kxData[start] - dkX;
-            dkY = -2.0 * kyData[start] - dkY;
-            dkZ = -2.0 * kzData[start] - dkZ;
-            ++ptrRef;
+            for (int ch = 0; ch < 3; ++ch)
+                dk[ch] = -2.0 * k[ch] - dk[ch];
         }
-
-        for (int idx = start; idx < endIdx; ++idx)
+        const double kx = k[0] + dk[0];
+        const double ky = k[1] + dk[1];
+        const double kz = k[2] + dk[2];
+        out.kx[outIdx] = kx;
+        out.ky[outIdx] = ky;
+        out.kz[outIdx] = kz;
+        ++outIdx;
+        for (int j = 0; j < point.adcCount; ++j, ++adcIdx)
         {
-            kxData[idx] += dkX;
-            kyData[idx] += dkY;
-            kzData[idx] += dkZ;
+            out.kxAdc[adcIdx] = kx;
+            out.kyAdc[adcIdx] = ky;
+            out.kzAdc[adcIdx] = kz;
         }
     }
+}
 
-    if (!boundaries.isEmpty())
+void Integrator::flush()
+{
+    // The open segment goes along up to its last point and carries on from there afterwards
+    const bool continueOpen = m_points.size() > m_open.pointFirst;
+    if (continueOpen)
+        closeSegment();
+
+    m_result.kx.resize(m_result.t.size());
+    m_result.ky.resize(m_result.t.size());
+    m_result.kz.resize(m_result.t.size());
+    m_result.kx_adc.resize(m_result.t_adc.size());
+    m_result.ky_adc.resize(m_result.t_adc.size());
+    m_result.kz_adc.resize(m_result.t_adc.size());
+    // Raw pointers taken before the workers start: they write disjoint ranges
+    const Outputs out { m_result.kx.data(), m_result.ky.data(), m_result.kz.data(),
+                        m_result.kx_adc.data(), m_result.ky_adc.data(), m_result.kz_adc.data() };
+
+    const int segmentCount = m_segments.size();
+    const int taskCount = (segmentCount + kSegmentsPerTask - 1) / kSegmentsPerTask;
+    const int threadCount = std::min(int(std::max(1u, std::thread::hardware_concurrency())), taskCount);
+    std::atomic<int> nextTask{0};
+    auto integrateNextTask = [&]() -> bool {
+        const int task = nextTask.fetch_add(1);
+        if (task >= taskCount) return false;
+        const int end = std::min(segmentCount, (task + 1) * kSegmentsPerTask);
+        for (int i = task * kSegmentsPerTask; i < end; ++i)
+            integrateSegment(m_segments[i], out);
+        return true;
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(std::max(0, threadCount - 1));
+    for (int t = 1; t < threadCount; ++t)
+        workers.emplace_back([&]() { while (integrateNextTask()) {} });
+    while (integrateNextTask()) {}
+    for (std::thread& worker : workers)
+        worker.join();
+
+    for (int idx : m_nanPoints)
     {
-        int last = boundaries.back();
-        kxData[last] += dkX;
-        kyData[last] += dkY;
-        kzData[last] += dkZ;
+        m_result.kx[idx] = qQNaN();
+        m_result.ky[idx] = qQNaN();
+        m_result.kz[idx] = qQNaN();
     }
+    m_nanPoints.clear();
 
-    QVector<double> kxPlot = kxData;
-    QVector<double> kyPlot = kyData;
-    QVector<double> kzPlot = kzData;
-    for (int idx : excitationIdx)
+    if (continueOpen)
     {
-        if (idx > 0)
-        {
-            kxPlot[idx - 1] = qQNaN();
-            kyPlot[idx - 1] = qQNaN();
-            kzPlot[idx - 1] = qQNaN();
-        }
+        const Segment& done = m_segments.last();
+        const double startSec = m_points.last().sec;
+        m_points.clear();
+        openSegment(startSec, done.k, done.dk);
     }
+    else
+    {
+        m_points.clear();
+        m_open.pointFirst = 0;
+    }
+    m_segments.clear();
+
+    // Drop the pieces that end before the open segment
+    int firstKept = 0;
+    while (firstKept < m_pieces.size() && m_pieces[firstKept].t1 <= m_open.startSec)
+        ++firstKept;
+    m_pieces.remove(0, firstKept);
+    m_pieceScan = 0;
+}
 
-    result.kx = kxPlot;
-    result.ky = kyPlot;
-    result.kz = kzPlot;
-
-    result.kx_adc.resize(adcSecondsRounded.size());
-    result.ky_adc.resize(adcSecondsRounded.size());
-    result.kz_adc.resize(adcSecondsRounded.size());
-
-    auto interpolateK = [&](const QVector<double>& data, double ta) -> double {
-        if (timeGrid.size() == 1)
-            return data.first();
-        auto it = std::lower_bound(timeGrid.begin(), timeGrid.end(), ta);
-        if (it == timeGrid.begin())
-            return data.first();
-        if (it == timeGrid.end())
-            return data.last();
-        int idx1 = static_cast<int>(it - timeGrid.begin());
-        if (std::abs(*it - ta) <= tacc * 0.5)
-            return data[idx1];
-        int idx0 = idx1 - 1;
-        double t0 = timeGrid[idx0];
-        double t1 = timeGrid[idx1];
-        if (t1 <= t0)
-            return data[idx1];
-        double alpha = (ta - t0) / (t1 - t0);
-        return data[idx0] + (data[idx1] - data[idx0]) * alpha;
-    };
-
-    for (int ai = 0; ai < adcSecondsRounded.size(); ++ai)
+void Integrator::finish()
+{
+    if (m_blockCount <= 0)
     {
-        double ta = adcSecondsRounded[ai];
-        result.kx_adc[ai] = interpolateK(kxData, ta);
-        result.ky_adc[ai] = interpolateK(kyData, ta);
-        result.kz_adc[ai] = interpolateK(kzData, ta);
+        m_result = Result();
+        return;
     }
+    addTime(internalToSecRounded(m_endInternal, m_tFactor));
+    emitBefore(std::numeric_limits<double>::infinity());
+    if (m_pointsTaken + m_result.t.size() < 2)
+    {
+        addTime(m_result.t.isEmpty() ? kTimeAccuracySec : (m_result.t.last() + kTimeAccuracySec));
+        emitBefore(std::numeric_limits<double>::infinity());
+    }
+    flush();
+    m_pieces.clear();
+    m_rfUses.finish();
+}
+
+Result Integrator::takeResult()
+{
+    Result rfUses = m_rfUses.takeResult();
+    m_result.excitationTimesInternal = std::move(rfUses.excitationTimesInternal);
+    m_result.refocusingTimesInternal = std::move(rfUses.refocusingTimesInternal);
+    m_result.rfUsePerBlock = std::move(rfUses.rfUsePerBlock);
+    m_result.rfUseGuessed = rfUses.rfUseGuessed;
+    m_result.warning = std::move(rfUses.warning);
+    return std::move(m_result);
+}
 
-    return result;
+Result Integrator::takeIntegrated()
+{
+    flush();
+    Result part;
+    const int points = std::max(0, int(m_result.t.size()) - 1);
+    const int adcSamples = m_result.t_adc.size();
+    part.t = m_result.t.mid(0, points);
+    part.kx = m_result.kx.mid(0, points);
+    part.ky = m_result.ky.mid(0, points);
+    part.kz = m_result.kz.mid(0, points);
+    m_result.t.remove(0, points);
+    m_result.kx.remove(0, points);
+    m_result.ky.remove(0, points);
+    m_result.kz.remove(0, points);
+    // ADC samples never get a plot break, so all of them are final
+    part.t_adc.swap(m_result.t_adc);
+    part.kx_adc.swap(m_result.kx_adc);
+    part.ky_adc.swap(m_result.ky_adc);
+    part.kz_adc.swap(m_result.kz_adc);
+
+    // flush() left only the open segment, which starts at the end of the arrays
+    m_open.outFirst -= points;
+    m_open.adcFirst -= adcSamples;
+    m_pointsTaken += points;
+    return part;
+}
+
+Result compute(const Input& input)
+{
+    if (input.blocks.empty() || input.blockEdges.size() < 2)
+        return Result();
+
+    Integrator integrator(input.tFactor, input.gradientRasterUs, input.rfRasterUs,
+                          input.supportsRfUseMetadata, input.b0Tesla);
+    integrator.begin(input.blocks.size());
+    for (int i = 0; i < input.blocks.size(); ++i)
+    {
+        const std::shared_ptr<SeqBlock> blockRef = input.blocks.block(i);
+        if (blockRef)
+            integrator.consume(i, *blockRef, input.blockEdges[i]);
+    }
+    integrator.finish();
+    return integrator.takeResult();
 }
-} // namespace KSpaceTrajectory
\ No newline at end of file
+} // namespace KSpaceTrajectory
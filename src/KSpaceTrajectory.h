@@ -3,22 +3,23 @@
 
 #include <QVector>
 #include <QString>
+#include <QtGlobal>
 #include <vector>
+#include "LoadPipeline.h"
 
-class SeqBlock;
+class DecodedBlockCache;
 
 namespace KSpaceTrajectory
 {
 
 struct Input
 {
-    const std::vector<SeqBlock*>& blocks;
+    const DecodedBlockCache& blocks;
     const QVector<double>& blockEdges;
     double tFactor = 1.0;
     bool supportsRfUseMetadata = false;
     double rfRasterUs = 1.0;       // microseconds
     double gradientRasterUs = -1.0; // microseconds
-    QVector<double> adcEventTimesInternal;
     // Optional system parameters for RF-use guessing (v1.4.x fallback)
     double b0Tesla = 0.0;          // If 0, ppm fallback from freqOffset is disabled
 };
@@ -40,6 +41,123 @@ struct Result
     QString warning;
 };
 
+// Classifies the RF pulse of each block (its rf.use, or a guess from the flip angle and off-resonance in
+// files without RF use metadata) and collects the excitation and refocusing centers. Cheap enough for the
+// load pass, so the TE overlay and the RF use of a block do not wait for the trajectory.
+class RfUseScanner : public BlockConsumer
+{
+public:
+    RfUseScanner(double tFactor, bool supportsRfUseMetadata, double b0Tesla, double gammaHzPerT);
+    void begin(int blockCount) override;
+    void consume(int index, SeqBlock& block, double blockStart) override;
+    void finish() override;
+    // Use of the RF pulse of the block consumed last ('u' if unclassified, 0 without RF) and its center
+    char lastUse() const { return m_lastUse; }
+    double lastCenterInternal() const { return m_lastCenterInternal; }
+    // Result with only the RF use fields set, after finish(); moves them out
+    Result takeResult();
+
+private:
+    double m_tFactor;
+    bool m_supportsRfUseMetadata;
+    double m_b0Tesla;
+    double m_gammaHzPerT;
+    char m_lastUse = 0;
+    double m_lastCenterInternal = 0.0;
+    bool m_guessedAny = false;
+    Result m_result;
+};
+
+// Integrates the trajectory while the blocks stream past, in block order. Each block's gradients become
+// piecewise-linear pieces (trapezoid corners, extended trapezoid corners, arbitrary gradient samples),
+// rotated and integrated in closed form up to the next output time. Output times are the gradient corners,
+// the RF centers (and the raster steps before them) and the ADC samples; they are emitted as soon as no
+// later block can precede them. Only the pending pieces and times of the last block or two are held, so no
+// merged gradient series or global time grid is built.
+// k restarts from zero at each excitation, so the output splits into independent segments, one per
+// excitation. Emitted points are integrated in batches with the segments spread over a pool of threads;
+// each segment is integrated serially from its start, so the result does not depend on the thread count.
+// takeIntegrated() hands out the points integrated so far, so the caller feeding the blocks (a worker
+// thread of PulseqLoader) can publish the trajectory while it grows.
+class Integrator : public BlockConsumer
+{
+public:
+    Integrator(double tFactor, double gradientRasterUs, double rfRasterUs, bool supportsRfUseMetadata, double b0Tesla);
+    Integrator(const Integrator&) = delete;
+    Integrator& operator=(const Integrator&) = delete;
+    void begin(int blockCount) override;
+    void consume(int index, SeqBlock& block, double blockStart) override;
+    void finish() override;
+    // The trajectory of the blocks consumed, after finish(); moves it out (less what takeIntegrated took)
+    Result takeResult();
+    // Integrates the points emitted so far and moves out those not taken yet (k and time fields only).
+    // The last point stays behind: a plot break before a later excitation may still land on it.
+    Result takeIntegrated();
+
+private:
+    enum TimeFlag : quint8 { ExcitationTime = 1, RefocusingTime = 2, AdcTime = 4 };
+    struct PendingTime
+    {
+        double sec;
+        quint8 flags;
+    };
+    // Lab-frame gradient, linear from g0 at t0 to g1 at t1 (seconds, Hz/m); zero between pieces
+    struct Piece
+    {
+        double t0, t1;
+        double g0[3], g1[3];
+    };
+    // An emitted output point waiting for its k value
+    struct Point
+    {
+        double sec;
+        quint8 flags;
+        int adcCount;  // ADC samples at this point
+    };
+    // Output points integrated serially from a known k: one excitation's share of a batch
+    struct Segment
+    {
+        double startSec;
+        double k[3];   // raw integral at startSec (at the end once integrated)
+        double dk[3];  // refocusing offset at startSec (likewise)
+        int pointFirst, pointEnd;  // in m_points
+        int pieceFirst, pieceEnd;  // in m_pieces
+        int outFirst, adcFirst;    // in the result arrays
+    };
+    struct Outputs
+    {
+        double *kx, *ky, *kz;
+        double *kxAdc, *kyAdc, *kzAdc;
+    };
+
+    void addTime(double sec, quint8 flags = 0);
+    void addGradientPieces(SeqBlock& block, double blockStartSec, double blockEndSec);
+    // Emits the pending times before sec as output points
+    void emitBefore(double sec);
+    void openSegment(double startSec, const double k[3], const double dk[3]);
+    void closeSegment();
+    // Integrates the closed segments and the emitted part of the open one
+    void flush();
+    void integrateSegment(Segment& segment, const Outputs& out) const;
+
+    double m_tFactor;
+    double m_gradientRasterUs;
+    double m_rfRasterSec;
+
+    QVector<PendingTime> m_pending;
+    QVector<Piece> m_pieces;
+    int m_pieceScan = 0;          // first piece that can still overlap a segment to close
+    QVector<Point> m_points;
+    QVector<Segment> m_segments;  // closed, not integrated yet
+    Segment m_open {};
+    QVector<int> m_nanPoints;     // plot breaks before excitations, set after integration
+    int m_blockCount = 0;
+    double m_endInternal = 0.0;   // end of the last block consumed
+    int m_pointsTaken = 0;        // output points moved out by takeIntegrated
+    RfUseScanner m_rfUses;
+    Result m_result;              // from the first point not taken
+};
+
 Result compute(const Input& input);
 
 } // namespace KSpaceTrajectory
@@ -0,0 +1,87 @@
+#include "LabelStore.h"
+#include "ExternalSequence.h"
+#include <cstdlib>
+
+void LabelStore::reset(int blockCount)
+{
+    clear();
+    m_blockCount = blockCount;
+    m_counters.resize(NUM_LABELS);
+    m_flags.resize(NUM_FLAGS);
+}
+
+void LabelStore::record(Track& track, int blockIdx, int value)
+{
+    // Several events of one block collapse into one change point; the first event of a counter always
+    // leaves a point, so the first point also marks where the label is defined
+    if (!track.block.isEmpty() && track.block.back() == blockIdx)
+    {
+        track.value.back() = value;
+        return;
+    }
+    if (!track.value.isEmpty() && track.value.back() == value)
+        return;
+    track.block.append(blockIdx);
+    track.value.append(value);
+}
+
+bool LabelStore::setCounter(int blockIdx, int id, int value)
+{
+    if (id < 0 || id >= m_counters.size() || id == LABEL_UNKNOWN) return false;
+    record(m_counters[id], blockIdx, value);
+    m_maxAbsCounter = std::max(m_maxAbsCounter, std::abs(value));
+    return true;
+}
+
+bool LabelStore::incrementCounter(int blockIdx, int id, int delta)
+{
+    if (id < 0 || id >= m_counters.size() || id == LABEL_UNKNOWN) return false;
+    Track& track = m_counters[id];
+    const int value = (track.value.isEmpty() ? 0 : track.value.back()) + delta;
+    record(track, blockIdx, value);
+    m_maxAbsCounter = std::max(m_maxAbsCounter, std::abs(value));
+    return true;
+}
+
+bool LabelStore::setFlag(int blockIdx, int id, bool value)
+{
+    if (id < 0 || id >= m_flags.size() || id == FLAG_UNKNOWN) return false;
+    record(m_flags[id], blockIdx, value ? 1 : 0);
+    return true;
+}
+
+int LabelStore::valueAfter(const Track& track, int blockIdx)
+{
+    const int k = track.pointsUpTo(blockIdx);
+    return k > 0 ? track.value[k - 1] : 0;
+}
+
+bool LabelStore::counterAfterBlock(int blockIdx, int id, int& value) const
+{
+    value = 0;
+    if (blockIdx < 0 || blockIdx >= m_blockCount) return false;
+    if (id < 0 || id >= m_counters.size()) return false;
+    value = valueAfter(m_counters[id], blockIdx);
+    return true;
+}
+
+bool LabelStore::flagAfterBlock(int blockIdx, int id, bool& value) const
+{
+    value = false;
+    if (blockIdx < 0 || blockIdx >= m_blockCount) return false;
+    if (id < 0 || id >= m_flags.size()) return false;
+    value = valueAfter(m_flags[id], blockIdx) != 0;
+    return true;
+}
+
+const LabelStore::Track& LabelStore::counterTrack(int id) const
+{
+    static const Track empty;
+    return (id >= 0 && id < m_counters.size()) ? m_counters[id] : empty;
+}
+
+const LabelStore::Track& LabelStore::flagTrack(int id) const
+{
+    static const Track empty;
+    return (id >= 0 && id < m_flags.size()) ? m_flags[id] : empty;
+}
@@ -0,0 +1,56 @@
+#ifndef LABELSTORE_H
+#define LABELSTORE_H
+
+#include <QVector>
+#include <algorithm>
+
+// Label counter and flag values after each block, stored as change points: per counter (and per flag)
+// the sorted blocks where a label event touched it and the value it had after that block. Labels change
+// on a small fraction of blocks, so this stays small where a full snapshot per block grew with
+// blocks x labels. A value after block b is a binary search for the last change point at or before b.
+class LabelStore
+{
+public:
+    struct Track
+    {
+        QVector<int> block; // ascending
+        QVector<int> value; // value after block[k] (flags: 0/1)
+        int size() const { return int(block.size()); }
+        // Change points at or before blockIdx, i.e. the index one past the point in effect
+        int pointsUpTo(int blockIdx) const
+        {
+            return int(std::upper_bound(block.begin(), block.end(), blockIdx) - block.begin());
+        }
+    };
+
+    // Start recording a sequence of blockCount blocks
+    void reset(int blockCount);
+    void clear() { *this = LabelStore(); }
+    int blockCount() const { return m_blockCount; }
+
+    // Label events of block blockIdx, in block order (set before inc, as in the Pulseq interpreter).
+    // Unknown IDs are ignored; false if the ID is not a known counter/flag.
+    bool setCounter(int blockIdx, int id, int value);
+    bool incrementCounter(int blockIdx, int id, int delta);
+    bool setFlag(int blockIdx, int id, bool value);
+
+    // Value after block blockIdx (0/false before the first label event); false if blockIdx or id is out of range
+    bool counterAfterBlock(int blockIdx, int id, int& value) const;
+    bool flagAfterBlock(int blockIdx, int id, bool& value) const;
+
+    const Track& counterTrack(int id) const;
+    const Track& flagTrack(int id) const;
+    // Largest |counter value| reached anywhere in the sequence
+    int maxAbsCounter() const { return m_maxAbsCounter; }
+
+private:
+    static void record(Track& track, int blockIdx, int value);
+    static int valueAfter(const Track& track, int blockIdx);
+
+    int m_blockCount {0};
+    QVector<Track> m_counters;
+    QVector<Track> m_flags;
+    int m_maxAbsCounter {0};
+};
+
+#endif // LABELSTORE_H
@@ -0,0 +1,40 @@
+#include "LoadPipeline.h"
+#include "DecodedBlockCache.h"
+#include "ExternalSequence.h"
+
+int LoadPipeline::run(const DecodedBlockCache& blocks, double tFactor, QVector<double>& blockEdges)
+{
+    const int blockCount = blocks.size();
+    begin(blockCount, tFactor, blockEdges);
+    for (int i = 0; i < blockCount; ++i)
+    {
+        const std::shared_ptr<SeqBlock> blk = blocks.block(i);
+        if (!blk) return i;
+        consume(i, *blk);
+    }
+    finish();
+    return -1;
+}
+
+void LoadPipeline::begin(int blockCount, double tFactor, QVector<double>& blockEdges)
+{
+    m_tFactor = tFactor;
+    m_blockEdges = &blockEdges;
+    blockEdges.clear();
+    blockEdges.resize(blockCount + 1, 0);
+    for (BlockConsumer* consumer : m_consumers) consumer->begin(blockCount);
+}
+
+void LoadPipeline::consume(int index, SeqBlock& block)
+{
+    QVector<double>& blockEdges = *m_blockEdges;
+    // Block edges: serial prefix sum over the block durations
+    blockEdges[index + 1] = blockEdges[index] + block.GetDuration() * m_tFactor;
+    for (BlockConsumer* consumer : m_consumers) consumer->consume(index, block, blockEdges[index]);
+}
+
+void LoadPipeline::finish()
+{
+    for (BlockConsumer* consumer : m_consumers) consumer->finish();
+    m_blockEdges = nullptr;
+}
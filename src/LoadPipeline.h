@@ -0,0 +1,44 @@
+#ifndef LOADPIPELINE_H
+#define LOADPIPELINE_H
+
+#include <QVector>
+#include <vector>
+
+class DecodedBlockCache;
+class SeqBlock;
+
+// One analysis run over the decoded blocks at load. The pipeline hands every block to each registered
+// consumer in turn, in block order, while the block is still hot in cache; a new analysis registers a
+// consumer instead of adding another pass over the blocks.
+class BlockConsumer
+{
+public:
+    virtual ~BlockConsumer() = default;
+    virtual void begin(int blockCount) { (void)blockCount; }
+    // blockStart: block start in internal time units (the block edges up to this block are final)
+    virtual void consume(int index, SeqBlock& block, double blockStart) = 0;
+    virtual void finish() {}
+};
+
+class LoadPipeline
+{
+public:
+    // Consumers see each block in registration order, so one may read what an earlier one stored for it
+    void add(BlockConsumer& consumer) { m_consumers.push_back(&consumer); }
+    // Streams all blocks through the consumers once and fills blockEdges (block count + 1 entries).
+    // Returns the first block that failed to decode (the pass stops there), or -1.
+    int run(const DecodedBlockCache& blocks, double tFactor, QVector<double>& blockEdges);
+
+    // The pass of run() for callers that decode the blocks themselves: begin, every block in order
+    // through consume, then finish. blockEdges must outlive the pass.
+    void begin(int blockCount, double tFactor, QVector<double>& blockEdges);
+    void consume(int index, SeqBlock& block);
+    void finish();
+
+private:
+    std::vector<BlockConsumer*> m_consumers;
+    double m_tFactor {1.0};
+    QVector<double>* m_blockEdges {nullptr};
+};
+
+#endif // LOADPIPELINE_H
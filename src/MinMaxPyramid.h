@@ -0,0 +1,146 @@
+#ifndef MINMAXPYRAMID_H
+#define MINMAXPYRAMID_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Multi-resolution min/max envelope of one waveform channel over time.
+// Level 0 splits [tStart, tEnd) into equal bins holding the min and max value drawn in each bin;
+// every further level halves the number of bins. A viewport spanning many bins per pixel is
+// answered from the coarsest level still finer than a pixel, so the cost follows the pixel
+// count instead of the number of blocks or samples in view.
+class MinMaxPyramid
+{
+public:
+    void reset(double tStart, double tEnd, int baseBins)
+    {
+        m_min.clear(); m_max.clear();
+        m_tStart = tStart;
+        const int bins = std::max(1, baseBins);
+        m_binWidth = (tEnd > tStart) ? (tEnd - tStart) / bins : 1.0;
+        m_min.emplace_back(bins, std::numeric_limits<float>::infinity());
+        m_max.emplace_back(bins, -std::numeric_limits<float>::infinity());
+        m_ready = false;
+    }
+
+    void clear() { m_min.clear(); m_max.clear(); m_ready = false; }
+    bool isReady() const { return m_ready; }
+    double baseBinWidth() const { return m_binWidth; }
+
+    // Level-0 bin containing t (clamped to the covered span) and the start time of a bin
+    int binAt(double t) const
+    {
+        const double pos = std::floor((t - m_tStart) / m_binWidth);
+        const int last = int(m_min[0].size()) - 1;
+        if (!(pos > 0)) return 0;
+        return pos >= last ? last : int(pos);
+    }
+    double binStart(int b) const { return m_tStart + b * m_binWidth; }
+
+    // Values in [vMin, vMax] drawn somewhere in [t0, t1]
+    void addRange(double t0, double t1, double vMin, double vMax)
+    {
+        if (m_min.empty() || !(vMin <= vMax)) return;
+        const int first = binAt(t0), last = binAt(t1);
+        std::vector<float>& mn = m_min[0];
+        std::vector<float>& mx = m_max[0];
+        for (int b = first; b <= last; ++b) {
+            mn[b] = std::min(mn[b], float(vMin));
+            mx[b] = std::max(mx[b], float(vMax));
+        }
+    }
+
+    // Straight line from (t0, v0) to (t1, v1), t0 <= t1; exact per bin
+    void addLine(double t0, double v0, double t1, double v1)
+    {
+        if (m_min.empty() || std::isnan(v0) || std::isnan(v1)) return;
+        const int first = binAt(t0), last = binAt(t1);
+        if (first == last) { addToBin(first, v0, v1); return; }
+        const double slope = (t1 > t0) ? (v1 - v0) / (t1 - t0) : 0.0;
+        double vPrev = v0;
+        for (int b = first; b < last; ++b) {
+            const double vEdge = v0 + slope * (binStart(b + 1) - t0);
+            addToBin(b, vPrev, vEdge);
+            vPrev = vEdge;
+        }
+        addToBin(last, vPrev, v1);
+    }
+
+    // Build the coarser levels once all values have been added
+    void finalize()
+    {
+        if (m_min.empty()) return;
+        m_min.resize(1); m_max.resize(1);
+        while (m_min.back().size() > 1) {
+            const std::vector<float>& mn = m_min.back();
+            const std::vector<float>& mx = m_max.back();
+            const size_t n = (mn.size() + 1) / 2;
+            std::vector<float> upMin(n), upMax(n);
+            for (size_t i = 0; i < n; ++i) {
+                const size_t j = std::min(2 * i + 1, mn.size() - 1);
+                upMin[i] = std::min(mn[2 * i], mn[j]);
+                upMax[i] = std::max(mx[2 * i], mx[j]);
+            }
+            m_min.push_back(std::move(upMin));
+            m_max.push_back(std::move(upMax));
+        }
+        m_ready = true;
+    }
+
+    // True if the pyramid is at least as fine as one pixel of the viewport
+    bool resolves(double tStart, double tEnd, int pixels) const
+    {
+        return m_ready && pixels > 0 && (tEnd - tStart) / pixels >= m_binWidth;
+    }
+
+    // Envelope of [tStart, tEnd] on a pixel grid: a (min, max) pair at the centre of each pixel
+    // holding values, a NaN break where a run of pixels holds none.
+    template <typename Out>
+    void query(double tStart, double tEnd, int pixels, Out& tOut, Out& vOut) const
+    {
+        if (!resolves(tStart, tEnd, pixels)) return;
+        const double pixelWidth = (tEnd - tStart) / pixels;
+        int level = 0;
+        while (level + 1 < int(m_min.size()) && levelWidth(level + 1) <= pixelWidth) ++level;
+        const std::vector<float>& mn = m_min[level];
+        const std::vector<float>& mx = m_max[level];
+        const double width = levelWidth(level);
+        const int bins = int(mn.size());
+        bool gap = true;
+        for (int p = 0; p < pixels; ++p) {
+            const double a = tStart + p * pixelWidth;
+            const int first = std::max(0, int(std::floor((a - m_tStart) / width)));
+            const int last = std::min(bins - 1, int(std::ceil((a + pixelWidth - m_tStart) / width)) - 1);
+            float lo = std::numeric_limits<float>::infinity();
+            float hi = -std::numeric_limits<float>::infinity();
+            for (int b = first; b <= last; ++b) { lo = std::min(lo, mn[b]); hi = std::max(hi, mx[b]); }
+            if (lo <= hi) {
+                const double t = a + 0.5 * pixelWidth;
+                tOut.push_back(t); vOut.push_back(lo);
+                tOut.push_back(t); vOut.push_back(hi);
+                gap = false;
+            } else if (!gap) {
+                tOut.push_back(a); vOut.push_back(std::numeric_limits<double>::quiet_NaN());
+                gap = true;
+            }
+        }
+    }
+
+private:
+    void addToBin(int b, double va, double vb)
+    {
+        m_min[0][b] = std::min(m_min[0][b], float(std::min(va, vb)));
+        m_max[0][b] = std::max(m_max[0][b], float(std::max(va, vb)));
+    }
+    double levelWidth(int level) const { return std::ldexp(m_binWidth, level); }
+
+    double m_tStart {0.0};
+    double m_binWidth {1.0};
+    std::vector<std::vector<float>> m_min;
+    std::vector<std::vector<float>> m_max;
+    bool m_ready {false};
+};
+
+#endif // MINMAXPYRAMID_H
@@ -7,6 +7,8 @@
 #include "KSpaceTrajectory.h"
 #include "InteractionHandler.h"
 #include "Settings.h"
+#include "DecimationKernels.h"
+#include "LoadPipeline.h"
 #include <QCryptographicHash>
 
 #include <QFileDialog>
@@ -21,6 +23,13 @@
 #include <algorithm>
 #include <utility>
 #include <QSet>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <QThread>
+#include <QPushButton>
 
 #define SAFE_DELETE(p) { if(p) { delete p; p = nullptr; } }
 
@@ -40,6 +49,7 @@ PulseqLoader::PulseqLoader(MainWindow* mainWindow)
       tFactor(1e-3)
 {
     m_listRecentPulseqFilePaths.resize(10);
+    m_decodedBlocks.setResident(&m_vecDecodeSeqBlocks);
     updateTimeUnitFromSettings();
     
     // Load last open directory from settings
@@ -49,6 +59,11 @@ PulseqLoader::PulseqLoader(MainWindow* mainWindow)
 PulseqLoader::~PulseqLoader()
 {
     ClearPulseqCache();
+    // Load threads post back to this object; let the ones still parsing run out first
+    for (const QPointer<QThread>& thread : m_loadThreads)
+    {
+        if (thread) thread->wait();
+    }
 }
 
 void PulseqLoader::OpenPulseqFile()
@@ -70,11 +85,8 @@ void PulseqLoader::OpenPulseqFile()
         m_sLastOpenDirectory = fileInfo.absolutePath();
         saveLastOpenDirectory();
         
-        if (!LoadPulseqFile(m_sPulseqFilePath))
-        {
-            m_sPulseqFilePath.clear();
-            std::cout << "LoadPulseqFile failed!\n";
-        }
+        // Loads in the background and reports errors itself
+        LoadPulseqFileAsync(m_sPulseqFilePath);
         m_sPulseqFilePathCache = m_sPulseqFilePath;
     }
 }
@@ -88,6 +100,19 @@ void PulseqLoader::ReOpenPulseqFile()
     }
 }
 
+void PulseqLoader::ReOpenPulseqFileAsync()
+{
+    if (m_sPulseqFilePathCache.size() > 0)
+    {
+        LoadPulseqFileAsync(m_sPulseqFilePathCache);
+    }
+}
+
+void PulseqLoader::CancelPulseqFileLoad()
+{
+    if (m_loadJob) ClearPulseqCache();
+}
+
 bool PulseqLoader::ClosePulseqFile()
 {
     ClearPulseqCache();
@@ -96,6 +121,11 @@ bool PulseqLoader::ClosePulseqFile()
 
 void PulseqLoader::ClearPulseqCache()
 {
+    QMutexLocker viewportLock(&m_viewportMutex);
+    if (m_mainWindow && m_mainWindow->getWaveformDrawer()) m_mainWindow->getWaveformDrawer()->discardViewportRender();
+    stopLoadJob();
+    stopTrajectoryJob();
+
     if (m_mainWindow)
     {
         m_mainWindow->clearLoadedFileTitle();
@@ -119,6 +149,10 @@ void PulseqLoader::ClearPulseqCache()
     m_rfAmpCache.clear();
     m_rfPhCache.clear();
     m_gradShapeCache.clear();
+    m_rfPhaseMin = std::numeric_limits<double>::infinity();
+    m_rfPhaseMax = -std::numeric_limits<double>::infinity();
+    m_sequenceTable.clear();
+    m_decodedBlocks.clear(); // lazily decoded blocks hold on to the sequence
     m_supportsRfUseMetadata = false;
     m_hasEchoTimeDefinition = false;
     m_teTime_us = 0.0;
@@ -128,17 +162,12 @@ void PulseqLoader::ClearPulseqCache()
     m_rfUseGuessed = false;
     m_warnedRfUseGuess = false;
     m_rfGuessWarning.clear();
-    m_kTrajectoryReady = false;
-    m_kTrajectoryX.clear();
-    m_kTrajectoryY.clear();
-    m_kTrajectoryZ.clear();
-    m_kTimeSec.clear();
-    m_kTrajectoryXAdc.clear();
-    m_kTrajectoryYAdc.clear();
-    m_kTrajectoryZAdc.clear();
-    m_kTimeAdcSec.clear();
     m_usedExtensions.clear();
+    m_labels.clear(); // a failed load pass may have filled part of these
+    m_adcTime.clear(); m_adcValues.clear();
     m_adcPhaseCache.valid = false;
+    clearWaveformPyramids();
+    clearViewportSegments();
 
     if (m_mainWindow && m_mainWindow->getTRManager())
     {
@@ -162,6 +191,158 @@ void PulseqLoader::ClearPulseqCache()
     if (m_mainWindow) { m_mainWindow->setWindowFilePath(""); }
 }
 
+namespace
+{
+// Blocks are handed out to the decode threads in chunks to keep the atomic counter off the hot path
+constexpr int64_t kDecodeChunkSize = 4096;
+// Blocks decoded before the first paint of a background load: the first TR if defined, else a fixed count
+constexpr int64_t kPreviewBlocksWithoutTr = 4096;
+constexpr int64_t kMaxPreviewBlocks = 65536;
+// Blocks kept decoded after a lazy load (a few MB of events; the shape samples are pooled per sequence)
+constexpr int kDecodedBlockCacheCapacity = 16384;
+// The background trajectory hands over what it has integrated at most this often
+constexpr int kTrajectoryPublishIntervalMs = 200;
+
+// Parsed sequences are cached next to the .seq file ("name.seqcache") so that reopening skips the text parser
+std::string seqCachePathFor(const QString& sPulseqFilePath)
+{
+    const QFileInfo fileInfo(sPulseqFilePath);
+    return QDir(fileInfo.absolutePath()).filePath(fileInfo.completeBaseName() + ".seqcache").toStdString();
+}
+
+// Decode blocks [firstBlock, blocks.size()) of seq on a pool of threads.
+// The sequence libraries are read-only once load() returned, so GetBlock/decodeBlock may run concurrently
+// (decompressed shapes go through the sequence's locked shape pool). onProgress(decodedBlocks) runs on the
+// calling thread after each of its chunks and may return false to cancel. On a decode error the lowest
+// failing block index is returned in failedBlockIndex (-1 otherwise). blocks[i] receives sequence block
+// blockOffset + i; failedBlockIndex is a sequence block index.
+bool decodeBlocks(ExternalSequence* seq, std::vector<SeqBlock*>& blocks, int64_t firstBlock,
+                  const std::function<bool(int64_t)>& onProgress, int64_t& failedBlockIndex,
+                  int64_t blockOffset = 0)
+{
+    failedBlockIndex = -1;
+    const int64_t blockCount = int64_t(blocks.size());
+    if (firstBlock >= blockCount) return true;
+
+    const int64_t chunkCount = (blockCount - firstBlock + kDecodeChunkSize - 1) / kDecodeChunkSize;
+    const int threadCount = int(std::min<int64_t>(std::max(1u, std::thread::hardware_concurrency()), chunkCount));
+    const int64_t noFailure = std::numeric_limits<int64_t>::max();
+
+    std::atomic<int64_t> nextChunk{0};
+    std::atomic<int64_t> decodedBlocks{firstBlock};
+    std::atomic<int64_t> firstFailure{noFailure};
+    std::atomic<bool> canceled{false};
+
+    // Returns false once no chunk is left, a block failed or the decode was canceled
+    auto decodeNextChunk = [&]() -> bool {
+        const int64_t chunk = nextChunk.fetch_add(1);
+        if (chunk >= chunkCount || firstFailure.load() != noFailure || canceled.load()) return false;
+        const int64_t begin = firstBlock + chunk * kDecodeChunkSize;
+        const int64_t end = std::min(blockCount, begin + kDecodeChunkSize);
+        for (int64_t i = begin; i < end; ++i)
+        {
+            blocks[i] = seq->GetBlock(int(blockOffset + i));
+            if (!seq->decodeBlock(blocks[i]))
+            {
+                int64_t expected = firstFailure.load();
+                while (i < expected && !firstFailure.compare_exchange_weak(expected, i)) {}
+                return false;
+            }
+        }
+        decodedBlocks.fetch_add(end - begin);
+        return true;
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount - 1);
+    for (int t = 1; t < threadCount; ++t)
+        workers.emplace_back([&]() { while (decodeNextChunk()) {} });
+
+    // The calling thread decodes as well and is the only one reporting progress
+    while (decodeNextChunk())
+    {
+        if (onProgress && !onProgress(decodedBlocks.load()))
+            canceled.store(true);
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    if (firstFailure.load() != noFailure)
+        failedBlockIndex = blockOffset + firstFailure.load();
+    return failedBlockIndex < 0 && !canceled.load();
+}
+
+// Min/max pyramids: kPyramidBinsPerBlock base bins per block, at most kMaxPyramidBins (~4 MB per channel with all levels)
+constexpr int kMaxPyramidBins = 1 << 18;
+constexpr int kPyramidBinsPerBlock = 4;
+// Per-block viewport segments: parameter sets kept per channel (panning set plus prefetched zoom levels)
+constexpr int kViewportSegmentSets = 4;
+
+// Range of the phases in [lo, hi] once wrapped to [-pi, pi]: the full circle if the interval wraps
+void wrappedPhaseBounds(double lo, double hi, double& wrappedLo, double& wrappedHi)
+{
+    wrappedLo = -M_PI; wrappedHi = M_PI;
+    if (!(hi - lo < 2.0 * M_PI)) return;
+    const double start = std::atan2(std::sin(lo), std::cos(lo));
+    if (start + (hi - lo) > M_PI) return;
+    wrappedLo = start;
+    wrappedHi = start + (hi - lo);
+}
+
+// Appends the trajectory points of part (k and time fields) to those of to
+void appendTrajectoryPart(KSpaceTrajectory::Result& to, KSpaceTrajectory::Result&& part)
+{
+    if (to.t.isEmpty() && to.t_adc.isEmpty())
+    {
+        to = std::move(part);
+        return;
+    }
+    to.t += std::move(part.t); to.kx += std::move(part.kx); to.ky += std::move(part.ky); to.kz += std::move(part.kz);
+    to.t_adc += std::move(part.t_adc); to.kx_adc += std::move(part.kx_adc);
+    to.ky_adc += std::move(part.ky_adc); to.kz_adc += std::move(part.kz_adc);
+}
+} // namespace
+
+// State shared between the GUI thread and the thread of a background load (LoadPulseqFileAsync)
+struct PulseqLoader::LoadJob
+{
+    QString path;
+    std::shared_ptr<ExternalSequence> seq;
+    QPointer<QThread> thread;
+    std::vector<SeqBlock*> blocks;      // written by the load thread; owned here until the loader takes them over
+    std::atomic<bool> cancel {false};
+    int64_t previewBlocks {0};          // blocks [0, previewBlocks) are final once the preview is posted
+    int64_t failedBlockIndex {-1};      // decode error, or -1 if parsing failed
+    bool librariesPublished {false};    // GUI thread only: seq is shared with the GUI
+    bool lazy {false};                  // blocks are decoded on demand after the load (DecodedBlockCache)
+    double tFactor {1.0};               // time unit and gamma of the load pass, taken when the load started
+    double gammaHzPerT {0.0};
+    LoadTables previewTables;           // load pass over the preview blocks; the GUI takes it once posted
+    LoadTables tables;                  // load pass over all blocks; the GUI takes it once posted
+
+    ~LoadJob()
+    {
+        for (SeqBlock* blk : blocks)
+            delete blk;
+    }
+};
+
+// State shared between the GUI thread and the thread integrating the trajectory (startTrajectoryJob)
+struct PulseqLoader::TrajectoryJob
+{
+    QPointer<QThread> thread;
+    std::atomic<bool> cancel {false};
+    QVector<double> blockEdges;         // copy: a time unit change rescales the loader's edges meanwhile
+    std::shared_ptr<ExternalSequence> seq; // lazy load: the blocks are decoded in windows from it, not from the cache
+    std::unique_ptr<KSpaceTrajectory::Integrator> integrator; // trajectory thread only
+    int64_t failedBlockIndex {-1};      // block that failed to decode; the trajectory ends before it
+    std::mutex mutex;                   // guards the fields below
+    KSpaceTrajectory::Result published; // integrated and not yet taken by the GUI thread
+    int progress {0};                   // percent of the blocks integrated
+    bool finished {false};
+    bool posted {false};                // an onTrajectoryJobProgress call is queued
+};
+
 /**
  * @brief Read version information from Pulseq file without loading the full file
  * @param filename Path to the .seq file
@@ -249,36 +430,69 @@ std::pair<int, int> PulseqLoader::ReadFileVersion(const std::string& filename)
     return std::make_pair(-1, -1);
 }
 
-bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
+std::shared_ptr<ExternalSequence> PulseqLoader::createSequenceForFile(const QString& sPulseqFilePath)
 {
-    m_mainWindow->setEnabled(false);
-
     // First, read version information without loading the full file
     std::pair<int, int> version = ReadFileVersion(sPulseqFilePath.toStdString());
     if (version.first == -1 || version.second == -1)
     {
-        m_mainWindow->setEnabled(true);
         std::stringstream sLog;
         sLog << "Failed to read version information from: " << sPulseqFilePath.toStdString();
         if (m_silentMode) { qWarning() << sLog.str().c_str(); }
         else { QMessageBox::critical(m_mainWindow, "Load Error", sLog.str().c_str()); }
-        return false;
+        return nullptr;
     }
 
     int version_major = version.first;
     int version_minor = version.second;
 
     // Create appropriate loader based on file version
-    m_spPulseqSeq = CreateLoaderForVersion(version_major, version_minor);
-    if (!m_spPulseqSeq)
+    std::shared_ptr<ExternalSequence> seq = CreateLoaderForVersion(version_major, version_minor);
+    if (!seq)
     {
-        m_mainWindow->setEnabled(true);
         std::stringstream sLog;
         sLog << "Unsupported Pulseq file version " << version_major << "." << version_minor << " for: " << sPulseqFilePath.toStdString();
         if (m_silentMode) { qWarning() << sLog.str().c_str(); }
         else { QMessageBox::critical(m_mainWindow, "Load Error", sLog.str().c_str()); }
+        return nullptr;
+    }
+
+    return seq;
+}
+
+void PulseqLoader::reportLoadFailure(const QString& sPulseqFilePath)
+{
+    std::stringstream sLog;
+    sLog << "Failed to load Pulseq file: " << sPulseqFilePath.toStdString() << "\n\n";
+    sLog << "Possible causes:\n";
+    sLog << "1. Missing required definitions for:\n";
+    sLog << "   - AdcRasterTime (ADC sampling raster time)\n";
+    sLog << "   - GradientRasterTime (Gradient raster time)\n";
+    sLog << "   - RadiofrequencyRasterTime (RF raster time)\n";
+    sLog << "   - BlockDurationRaster (Block duration raster time)\n\n";
+    sLog << "2. File format issues or corruption\n";
+    sLog << "3. Unsupported Pulseq version\n\n";
+    sLog << "Please check the console output for detailed error messages.";
+    
+    if (m_silentMode) { qWarning() << sLog.str().c_str(); }
+    else { QMessageBox::critical(m_mainWindow, "Pulseq Load Error", sLog.str().c_str()); }
+}
+
+bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
+{
+    QMutexLocker viewportLock(&m_viewportMutex);
+    // A synchronous load replaces a background load still in progress
+    if (m_loadJob) ClearPulseqCache();
+
+    m_mainWindow->setEnabled(false);
+
+    std::shared_ptr<ExternalSequence> seq = createSequenceForFile(sPulseqFilePath);
+    if (!seq)
+    {
+        m_mainWindow->setEnabled(true);
         return false;
     }
+    m_spPulseqSeq = seq;
 
     // ============================================================================
     // PULSEQ FILE LOADING WITH ERROR HANDLING
@@ -311,25 +525,72 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
     // Setup time units and factor before loading
     updateTimeUnitFromSettings();
 
-    if (!m_spPulseqSeq->load(sPulseqFilePath.toStdString()))
+    if (!m_spPulseqSeq->loadWithCache(sPulseqFilePath.toStdString(), seqCachePathFor(sPulseqFilePath)))
     {
         m_mainWindow->setEnabled(true);
-        std::stringstream sLog;
-        sLog << "Failed to load Pulseq file: " << sPulseqFilePath.toStdString() << "\n\n";
-        sLog << "Possible causes:\n";
-        sLog << "1. Missing required definitions for:\n";
-        sLog << "   - AdcRasterTime (ADC sampling raster time)\n";
-        sLog << "   - GradientRasterTime (Gradient raster time)\n";
-        sLog << "   - RadiofrequencyRasterTime (RF raster time)\n";
-        sLog << "   - BlockDurationRaster (Block duration raster time)\n\n";
-        sLog << "2. File format issues or corruption\n";
-        sLog << "3. Unsupported Pulseq version\n\n";
-        sLog << "Please check the console output for detailed error messages.";
-        
-        if (m_silentMode) { qWarning() << sLog.str().c_str(); }
-        else { QMessageBox::critical(m_mainWindow, "Pulseq Load Error", sLog.str().c_str()); }
+        reportLoadFailure(sPulseqFilePath);
+        return false;
+    }
+    if (!acceptLoadedSequence())
+    {
+        m_mainWindow->setEnabled(true);
+        return false;
+    }
+
+    const int64_t lSeqBlockNum = m_spPulseqSeq->GetNumberOfBlocks();
+    std::cout << lSeqBlockNum << " blocks detected!\n";
+    for (SeqBlock* blk : m_vecDecodeSeqBlocks) delete blk; // blocks of a previously loaded file
+    m_vecDecodeSeqBlocks.clear();
+    QProgressBar* progressBar = m_mainWindow->getProgressBar();
+    progressBar->show();
+    progressBar->setValue(0);
+    LoadTables tables;
+    if (Settings::getInstance().getLazyBlockDecoding())
+    {
+        // Blocks are decoded when first drawn or sampled; the load pass decodes them once, in windows
+        m_decodedBlocks.setLazy(m_spPulseqSeq, int(lSeqBlockNum), kDecodedBlockCacheCapacity);
+        if (!runLoadPass(m_spPulseqSeq.get(), nullptr, lSeqBlockNum, tFactor, Settings::getInstance().getGamma(),
+                         tables, [&](int64_t blocksDone) {
+                             progressBar->setValue(int(blocksDone * 100 / lSeqBlockNum));
+                             return true;
+                         }))
+        {
+            reportDecodeFailure(tables.failedBlockIndex);
+            ClearPulseqCache();
+            m_mainWindow->setEnabled(true);
+            return false;
+        }
+        const bool applied = applyDecodedBlocks(sPulseqFilePath, true, tables, tFactor);
+        m_mainWindow->setEnabled(true);
+        return applied;
+    }
+    m_vecDecodeSeqBlocks.assign(lSeqBlockNum, nullptr);
+    m_decodedBlocks.setResident(&m_vecDecodeSeqBlocks);
+    int lastProgress = 0;
+    int64_t failedBlockIndex = -1;
+    const bool decoded = decodeBlocks(m_spPulseqSeq.get(), m_vecDecodeSeqBlocks, 0,
+        [&](int64_t decodedBlocks) {
+            // At most one progress bar update per percent
+            const int progress = int(decodedBlocks * 100 / lSeqBlockNum);
+            if (progress != lastProgress) { progressBar->setValue(progress); lastProgress = progress; }
+            return true;
+        }, failedBlockIndex);
+    if (!decoded)
+    {
+        reportDecodeFailure(failedBlockIndex);
+        ClearPulseqCache();
+        m_mainWindow->setEnabled(true);
         return false;
     }
+    runLoadPass(m_spPulseqSeq.get(), &m_vecDecodeSeqBlocks, lSeqBlockNum, tFactor, Settings::getInstance().getGamma(),
+                tables, nullptr);
+    const bool applied = applyDecodedBlocks(sPulseqFilePath, true, tables, tFactor);
+    m_mainWindow->setEnabled(true);
+    return applied;
+}
+
+bool PulseqLoader::acceptLoadedSequence()
+{
     // Do not use setWindowFilePath for the main window title, because it can auto-compose
     // "file - AppName" which conflicts with our explicit "SeqEyes - file.seq" title.
     if (m_mainWindow) { m_mainWindow->setWindowFilePath(QString()); }
@@ -340,7 +601,6 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
         bool ok = !gradDef.empty() && std::isfinite(gradDef[0]) && gradDef[0] > 0.0;
         if (!ok)
         {
-            m_mainWindow->setEnabled(true);
             const char* msg = "Missing required definition: GradientRasterTime (seconds)\n\n"
                               "The sequence lacks GradientRasterTime in [DEFINITIONS].\n"
                               "Please add e.g. 'GradientRasterTime = 1e-5' and reload.";
@@ -409,31 +669,279 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
     // Do not show redundant version label in status bar; keep cached string only
     if (m_mainWindow->getVersionLabel()) m_mainWindow->getVersionLabel()->setVisible(false);
 
-    const int64_t& lSeqBlockNum = m_spPulseqSeq->GetNumberOfBlocks();
-    std::cout << lSeqBlockNum << " blocks detected!\n";
-    m_vecDecodeSeqBlocks.resize(lSeqBlockNum);
-    m_mainWindow->getProgressBar()->show();
-    m_mainWindow->getProgressBar()->setValue(0);
-    vecBlockEdges.clear();
-    vecBlockEdges.resize(lSeqBlockNum + 1, 0);
-    for (int64_t ushBlockIndex = 0; ushBlockIndex < lSeqBlockNum; ushBlockIndex++)
-    {
-        m_vecDecodeSeqBlocks[ushBlockIndex] = m_spPulseqSeq->GetBlock(ushBlockIndex);
-        if (!m_spPulseqSeq->decodeBlock(m_vecDecodeSeqBlocks[ushBlockIndex]))
+    return true;
+}
+
+// Label/flag change points for fast UI queries (Information window) and the extensions the sequence uses
+class PulseqLoader::LabelStoreBuilder : public BlockConsumer
+{
+public:
+    LabelStoreBuilder(LoadTables& tables, ExternalSequence* seq) : m_tables(tables), m_seq(seq) {}
+
+    void begin(int blockCount) override
+    {
+        m_tables.labels.reset(blockCount);
+        m_tables.usedExtensions.clear();
+    }
+
+    // Do NOT call pulseq's LabelStateAndBookkeeping::updateLabelValues here because
+    // it can crash on unknown label IDs (>=1000) for LABELINC events. We apply events ourselves with bounds checks.
+    void consume(int i, SeqBlock& block, double) override
+    {
+        if (!block.isLabel())
+            return;
+
+        LabelStore& labels = m_tables.labels;
+        QSet<QString>& usedExtensions = m_tables.usedExtensions;
+        ExternalSequence* seq = m_seq;
+        auto markCounterUsed = [&](int id) {
+            if (!seq) return;
+            const std::string s = seq->getCounterIdAsString(id);
+            if (!s.empty()) { usedExtensions.insert(QString::fromStdString(s).toUpper()); return; }
+            const std::string u = seq->GetUnknownLabelName(id);
+            if (!u.empty()) { usedExtensions.insert(QString::fromStdString(u).toUpper()); return; }
+            usedExtensions.insert(QString("LABEL[%1]").arg(id).toUpper());
+        };
+        auto markFlagUsed = [&](int id) {
+            if (!seq) return;
+            const std::string s = seq->getFlagIdAsString(id);
+            if (!s.empty()) { usedExtensions.insert(QString::fromStdString(s).toUpper()); return; }
+            usedExtensions.insert(QString("FLAG[%1]").arg(id).toUpper());
+        };
+
+        // Apply LABELSET first, then LABELINC (same semantics as SeqPlot.m and pulseq runtime).
+        for (const auto& e : block.GetLabelSetEvents())
         {
-            std::stringstream sLog;
-            sLog << "Decode SeqBlock failed, block index: " << ushBlockIndex;
-            if (m_silentMode) { qWarning() << sLog.str().c_str(); }
-            else { QMessageBox::critical(m_mainWindow, "File Error", sLog.str().c_str()); }
-            ClearPulseqCache();
-            m_mainWindow->setEnabled(true);
-            return false;
+            if (labels.setCounter(i, e.numVal.first, e.numVal.second))
+                markCounterUsed(e.numVal.first);
+            if (labels.setFlag(i, e.flagVal.first, e.flagVal.second))
+                markFlagUsed(e.flagVal.first);
+        }
+        for (const auto& e : block.GetLabelIncEvents())
+        {
+            if (labels.incrementCounter(i, e.numVal.first, e.numVal.second))
+                markCounterUsed(e.numVal.first);
+        }
+    }
+
+private:
+    LoadTables& m_tables;
+    ExternalSequence* m_seq;
+};
+
+// Per-shape scale aggregates for the global RF/gradient Y ranges. Runs after the SequenceTable builder
+// in the load pass and reads the rows it just stored for the block; the block itself is only used for
+// the samples of a shape seen for the first time.
+class PulseqLoader::ShapeAggregateBuilder : public BlockConsumer
+{
+public:
+    explicit ShapeAggregateBuilder(LoadTables& tables) : m_tables(tables) {}
+
+    void begin(int) override
+    {
+        LoadTables& l = m_tables;
+        l.rfAgg.clear();
+        l.rfPhaseMin = std::numeric_limits<double>::infinity();
+        l.rfPhaseMax = -std::numeric_limits<double>::infinity();
+        for (int c = 0; c < 3; ++c) {
+            l.gradAgg[c].clear();
+            l.gradTrapMaxPosScale[c] = 0.0;
+            l.gradTrapMinNegScale[c] = 0.0;
+            l.gradExtTrapGlobalMin[c] = std::numeric_limits<double>::infinity();
+            l.gradExtTrapGlobalMax[c] = -std::numeric_limits<double>::infinity();
+        }
+    }
+
+    void consume(int i, SeqBlock& block, double) override
+    {
+        LoadTables& l = m_tables;
+        const SequenceTable& table = l.sequenceTable;
+        const int r = table.rfRow[i];
+        if (r >= 0 && table.rf.length[r] > 0) {
+            const SequenceTable::RfColumns& rfRows = table.rf;
+            const int RFLength = rfRows.length[r];
+            ScaleAgg& ag = l.rfAgg[shapeKey(rfRows.magShape[r], rfRows.timeShape[r])];
+            if (!ag.hasShape) {
+                const RFAmpEntry& eA = ensureRfAmpCached(l.rfAmpCache, block.GetRFAmplitudePtr(), RFLength, rfRows.magShape[r], rfRows.timeShape[r]);
+                ag.updateShape(eA.ampMin, eA.ampMax);
+            }
+            ag.updateScale(double(rfRows.amplitude[r]));
+            // Cache the phase shape too and keep the range over all of them for getRfGlobalRangePh
+            const quint64 phKey = shapeKey(rfRows.phaseShape[r], rfRows.timeShape[r]);
+            auto cached = l.rfPhCache.constFind(phKey);
+            if (cached == l.rfPhCache.constEnd() || cached.value().length != RFLength) {
+                const RFPhEntry& eP = ensureRfPhCached(l.rfPhCache, block.GetRFPhasePtr(), RFLength, rfRows.phaseShape[r], rfRows.timeShape[r]);
+                l.rfPhaseMin = std::min(l.rfPhaseMin, eP.phMin);
+                l.rfPhaseMax = std::max(l.rfPhaseMax, eP.phMax);
+            }
+        }
+
+        for (int ch = 0; ch < 3; ++ch) {
+            const int e = table.gradRow[ch][i];
+            if (e < 0) continue;
+            const SequenceTable::GradColumns& events = table.grad[ch];
+            if (events.kind[e] == SequenceTable::GradTrap) {
+                double s = events.amplitude[e];
+                if (s >= 0) l.gradTrapMaxPosScale[ch] = std::max(l.gradTrapMaxPosScale[ch], s);
+                else        l.gradTrapMinNegScale[ch] = std::min(l.gradTrapMinNegScale[ch], s);
+                continue;
+            }
+            if (events.kind[e] == SequenceTable::GradArbitrary) {
+                ScaleAgg& ag = l.gradAgg[ch][shapeKey(events.waveShape[e], events.timeShape[e])];
+                if (!ag.hasShape) {
+                    const GradShapeEntry& entry = ensureGradCached(l.gradShapeCache, block.GetArbGradShapePtr(ch), events.numSamples[e], events.waveShape[e], events.timeShape[e]);
+                    ag.updateShape(entry.vMin, entry.vMax);
+                }
+                ag.updateScale(events.amplitude[e]);
+                continue;
+            }
+            // Extended trapezoid: the corner value range is in the table (NaN corners skipped)
+            double cands[2] = { events.vMin[e], events.vMax[e] };
+            if (!std::isfinite(cands[0]) || !std::isfinite(cands[1])) { cands[0] = 0.0; cands[1] = 0.0; }
+            for (double v : cands) {
+                if (v < l.gradExtTrapGlobalMin[ch]) l.gradExtTrapGlobalMin[ch] = v;
+                if (v > l.gradExtTrapGlobalMax[ch]) l.gradExtTrapGlobalMax[ch] = v;
+            }
+        }
+    }
+
+private:
+    LoadTables& m_tables;
+};
+
+// Single pass over the blocks: block edges, the columnar sequence table for the hot loops and the
+// viewport/pyramid builders, the merged ADC series, label store, shape scale aggregates and the RF use
+// of each block. Runs on the load thread of a background load and touches no member: everything goes
+// into tables, which the GUI thread swaps in (installLoadTables). With resident == nullptr (lazy load)
+// the blocks are decoded in windows on the decode pool and dropped once consumed. The k-space
+// trajectory is integrated afterwards on a thread of its own.
+bool PulseqLoader::runLoadPass(ExternalSequence* seq, const std::vector<SeqBlock*>* resident, int64_t blockCount,
+                               double tFactor, double gammaHzPerT, LoadTables& tables,
+                               const std::function<bool(int64_t)>& onProgress)
+{
+    tables.failedBlockIndex = -1;
+    double gradRaster_us = 0.0;
+    std::vector<double> def = seq->GetDefinition("GradientRasterTime");
+    if (!def.empty() && std::isfinite(def[0]) && def[0] > 0.0) gradRaster_us = def[0] * 1e6;
+    const int version = seq->GetVersion();
+    const int versionMajor = version / 1000000L;
+    const int versionMinor = (version / 1000L) % 1000L;
+    const bool supportsRfUseMetadata = (versionMajor > 1) || (versionMajor == 1 && versionMinor >= 5);
+
+    SequenceTable::Builder tableBuilder(tables.sequenceTable, gradRaster_us);
+    SeriesBuilder::ADCSeriesBuilder adcSeries(tFactor, tables.adcTime, tables.adcValues);
+    LabelStoreBuilder labelStore(tables, seq);
+    ShapeAggregateBuilder shapeAggregates(tables);
+    KSpaceTrajectory::RfUseScanner rfUses(tFactor, supportsRfUseMetadata, b0TeslaFor(seq), gammaHzPerT);
+    LoadPipeline pipeline;
+    pipeline.add(tableBuilder);
+    pipeline.add(shapeAggregates); // after tableBuilder
+    pipeline.add(adcSeries);
+    pipeline.add(labelStore);
+    pipeline.add(rfUses);
+    pipeline.begin(int(blockCount), tFactor, tables.blockEdges);
+
+    if (resident)
+    {
+        for (int64_t i = 0; i < blockCount; ++i)
+        {
+            pipeline.consume(int(i), *(*resident)[i]);
+            if ((i + 1) % kDecodeChunkSize == 0 && onProgress && !onProgress(i + 1)) return false;
+        }
+    }
+    else
+    {
+        const int64_t windowSize = kDecodeChunkSize * std::max(1u, std::thread::hardware_concurrency());
+        std::vector<SeqBlock*> window;
+        for (int64_t first = 0; first < blockCount; first += windowSize)
+        {
+            window.assign(size_t(std::min(windowSize, blockCount - first)), nullptr);
+            int64_t failedBlockIndex = -1;
+            const bool decoded = decodeBlocks(seq, window, 0, nullptr, failedBlockIndex, first);
+            if (decoded)
+            {
+                for (size_t j = 0; j < window.size(); ++j)
+                    pipeline.consume(int(first + int64_t(j)), *window[j]);
+            }
+            for (SeqBlock* block : window) delete block;
+            if (!decoded)
+            {
+                tables.failedBlockIndex = failedBlockIndex;
+                return false;
+            }
+            if (onProgress && !onProgress(first + int64_t(window.size()))) return false;
         }
-        int progress = (ushBlockIndex + 1) * 100 / lSeqBlockNum;
-        m_mainWindow->getProgressBar()->setValue(progress);
-        vecBlockEdges[ushBlockIndex + 1] = vecBlockEdges[ushBlockIndex] + m_vecDecodeSeqBlocks[ushBlockIndex]->GetDuration() * tFactor;
     }
+    pipeline.finish();
+
+    KSpaceTrajectory::Result rfUseResult = rfUses.takeResult();
+    tables.excitationCenters = std::move(rfUseResult.excitationTimesInternal);
+    tables.refocusingCenters = std::move(rfUseResult.refocusingTimesInternal);
+    tables.rfUsePerBlock = std::move(rfUseResult.rfUsePerBlock);
+    tables.rfUseGuessed = rfUseResult.rfUseGuessed;
+    tables.rfGuessWarning = rfUseResult.warning;
+    return true;
+}
+
+// Takes over the tables of a load pass. Their times are in the unit of the pass, which the user may have
+// changed while a background pass ran.
+void PulseqLoader::installLoadTables(LoadTables& tables, double passTFactor)
+{
+    if (passTFactor != tFactor)
+    {
+        const double ratio = tFactor / passTFactor;
+        for (double& t : tables.blockEdges) t *= ratio;
+        for (double& t : tables.adcTime) t *= ratio;
+        for (double& t : tables.excitationCenters) t *= ratio;
+        for (double& t : tables.refocusingCenters) t *= ratio;
+    }
+    vecBlockEdges.swap(tables.blockEdges);
+    std::swap(m_sequenceTable, tables.sequenceTable);
+    m_adcTime.swap(tables.adcTime);
+    m_adcValues.swap(tables.adcValues);
+    std::swap(m_labels, tables.labels);
+    m_usedExtensions.swap(tables.usedExtensions);
+    m_rfAmpCache.swap(tables.rfAmpCache);
+    m_rfPhCache.swap(tables.rfPhCache);
+    m_gradShapeCache.swap(tables.gradShapeCache);
+    m_rfAgg.swap(tables.rfAgg);
+    for (int c = 0; c < 3; ++c)
+    {
+        m_gradAgg[c].swap(tables.gradAgg[c]);
+        m_gradTrapMaxPosScale[c] = tables.gradTrapMaxPosScale[c];
+        m_gradTrapMinNegScale[c] = tables.gradTrapMinNegScale[c];
+        m_gradExtTrapGlobalMin[c] = tables.gradExtTrapGlobalMin[c];
+        m_gradExtTrapGlobalMax[c] = tables.gradExtTrapGlobalMax[c];
+    }
+    m_rfPhaseMin = tables.rfPhaseMin;
+    m_rfPhaseMax = tables.rfPhaseMax;
+    m_excitationCentersAxis.swap(tables.excitationCenters);
+    m_refocusingCentersAxis.swap(tables.refocusingCenters);
+    m_rfUsePerBlock.swap(tables.rfUsePerBlock);
+    m_rfUseGuessed = tables.rfUseGuessed;
+    m_rfGuessWarning = tables.rfGuessWarning;
+    m_adcPhaseCache.valid = false;
+}
+
+// Everything derived from the decoded blocks. A background load runs this twice: for the preview of the
+// first blocks (complete == false) and once all blocks are decoded. The tables were built by the load
+// pass (runLoadPass), on the load thread for a background load; here they are only swapped in.
+bool PulseqLoader::applyDecodedBlocks(const QString& sPulseqFilePath, bool complete, LoadTables& tables, double passTFactor)
+{
+    QMutexLocker viewportLock(&m_viewportMutex);
+    const int64_t lSeqBlockNum = int64_t(m_decodedBlocks.size());
+    const int shVersion = m_spPulseqSeq->GetVersion();
+    const int shVersionMajor = shVersion / 1000000L;
+    const int shVersionMinor = (shVersion / 1000L) % 1000L;
+
     updateEchoAndExcitationMetadata(shVersionMajor, shVersionMinor);
+    double trajectoryGradRasterUs = -1.0, trajectoryRfRasterUs = -1.0;
+    readTrajectoryDefinitions(trajectoryGradRasterUs, trajectoryRfRasterUs); // also B0, for the phase offsets
+    installLoadTables(tables, passTFactor);
+
+    // The preview's blocks are replaced once the load completes; integrate the complete set only
+    if (complete)
+        startTrajectoryJob();
 
     // Prefer explicit TotalDuration from definitions if available
     // Otherwise, fall back to accumulated block edges
@@ -448,7 +956,7 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
         m_dTotalDuration_us = vecBlockEdges[lSeqBlockNum] / tFactor;
     }
     std::cout << "Sequence total duration: " << m_dTotalDuration_us / 1e6 << " seconds" << std::endl;
-    m_mainWindow->getProgressBar()->hide();
+    if (complete) m_mainWindow->getProgressBar()->hide();
 
     // Build merged series once at load time (no zero padding, only NaN on real gaps)
     // Phase 1 optimization: skip building merged RF arrays (expensive for large sequences).
@@ -460,22 +968,20 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
     m_gyTime.clear(); m_gyValues.clear();
     m_gzTime.clear(); m_gzValues.clear();
     
-    // Build merged ADC series
-    SeriesBuilder::buildADCSeries(m_vecDecodeSeqBlocks, vecBlockEdges, tFactor, m_adcTime, m_adcValues);
-
-    // Cache label/flag values after each block for fast UI queries (Information window).
-    buildLabelSnapshotCache();
+    // The merged ADC series, label store and shape scale aggregates came with the load pass tables
 
     nBlockRangeStart = 0;
     nBlockRangeEnd = std::min(int(lSeqBlockNum - 1), 10);
 
-    // Precompute per-shape scale aggregates for RF/Gradients (single pass over blocks)
-    buildShapeScaleAggregates();
+    // Pyramids are rebuilt from the blocks now loaded the next time a zoomed-out view needs them
+    clearWaveformPyramids();
+    clearViewportSegments();
 
     WaveformDrawer* drawer = m_mainWindow->getWaveformDrawer();
     // Compute fixed Y-axis ranges based on full-sequence data to avoid per-TR/window autoscale jitter.
     // This keeps comparisons consistent when toggling TRs or panning/zooming.
     if (drawer) drawer->computeAndLockYAxisRanges();
+    if (complete) emit aggregatesReady();
     
         // Simple LOD system - no precomputation needed
     
@@ -516,9 +1022,21 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
             }
         }
 
+        // Keep the range the user navigated to while the rest of a background load was decoding
+        QCPRange viewRange(initialStartTime, initialEndTime);
+        if (complete && m_bPreviewViewSet && drawer && !drawer->getRects().isEmpty())
+        {
+            const QCPRange current = drawer->getRects()[0]->axis(QCPAxis::atBottom)->range();
+            if (current.lower != m_dPreviewViewLower || current.upper != m_dPreviewViewUpper)
+                viewRange = current;
+        }
+        m_bPreviewViewSet = !complete;
+        m_dPreviewViewLower = viewRange.lower;
+        m_dPreviewViewUpper = viewRange.upper;
+
         // Single-point sync instead of per-rect setRange to avoid N cascaded updates
         if (auto* ih = m_mainWindow->getInteractionHandler()) {
-            ih->synchronizeXAxes(QCPRange(initialStartTime, initialEndTime));
+            ih->synchronizeXAxes(viewRange);
         }
 
         // Save initial view state for reset functionality
@@ -558,31 +1076,14 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
     if (m_bHasRepetitionTime)
     {
         m_nTrCount = static_cast<int>(std::ceil(m_dTotalDuration_us / m_dRepetitionTime_us));
-        m_vecTrBlockIndices.clear();
-        for (int tr = 0; tr < m_nTrCount; ++tr)
-        {
-            double trStartTime = tr * m_dRepetitionTime_us * tFactor;
-            int closestBlock = 0;
-            double minDistance = std::numeric_limits<double>::max();
-            for (int i = 0; i < lSeqBlockNum; ++i)
-            {
-                double blockStartTime = vecBlockEdges[i];
-                double distance = std::abs(blockStartTime - trStartTime);
-                if (distance < minDistance)
-                {
-                    minDistance = distance;
-                    closestBlock = i;
-                }
-            }
-            m_vecTrBlockIndices.push_back(closestBlock);
-        }
+        buildTrBlockIndices();
     }
     else
     {
         m_vecTrBlockIndices.clear();
         for (int i = 0; i < lSeqBlockNum; ++i)
         {
-            if (m_vecDecodeSeqBlocks[i]->isADC())
+            if (m_sequenceTable.adcRow[i] >= 0)
             {
                 m_vecTrBlockIndices.push_back(i);
             }
@@ -606,115 +1107,260 @@ bool PulseqLoader::LoadPulseqFile(const QString& sPulseqFilePath)
         // Show "SeqEyes - file.seq" only after a successful load.
         m_mainWindow->setLoadedFileTitle(sPulseqFilePath);
     }
-    m_mainWindow->setEnabled(true);
     return true;
 }
 
-void PulseqLoader::buildLabelSnapshotCache()
+void PulseqLoader::reportDecodeFailure(int64_t blockIndex)
 {
-    m_labelSnapshots.clear();
-    m_usedExtensions.clear();
-    m_maxAccumulatedCounter = 0;
-    const int nBlocks = static_cast<int>(m_vecDecodeSeqBlocks.size());
-    if (nBlocks <= 0)
+    std::stringstream sLog;
+    sLog << "Decode SeqBlock failed, block index: " << blockIndex;
+    if (m_silentMode) { qWarning() << sLog.str().c_str(); }
+    else { QMessageBox::critical(m_mainWindow, "File Error", sLog.str().c_str()); }
+}
+
+void PulseqLoader::LoadPulseqFileAsync(const QString& sPulseqFilePath)
+{
+    ClearPulseqCache();
+
+    std::shared_ptr<ExternalSequence> seq = createSequenceForFile(sPulseqFilePath);
+    if (!seq)
+    {
+        emit loadFinished(false);
         return;
+    }
+    // Setup time units and factor before loading
+    updateTimeUnitFromSettings();
 
-    // Do NOT call pulseq's LabelStateAndBookkeeping::updateLabelValues here because
-    // it can crash on unknown label IDs (>=1000) for LABELINC events. We apply events ourselves with bounds checks.
-    QVector<int>  counterVal(NUM_LABELS, 0);
-    QVector<bool> flagVal(NUM_FLAGS, false);
+    auto job = std::make_shared<LoadJob>();
+    job->path = sPulseqFilePath;
+    job->seq = seq;
+    job->lazy = Settings::getInstance().getLazyBlockDecoding();
+    job->tFactor = tFactor;
+    job->gammaHzPerT = Settings::getInstance().getGamma();
+    m_loadJob = job;
+
+    if (auto pb = m_mainWindow->getProgressBar()) { pb->setValue(0); pb->show(); }
+    if (auto btn = m_mainWindow->getCancelLoadButton()) { btn->show(); }
+
+    QThread* thread = QThread::create([this, job]() { runLoadJob(job); });
+    job->thread = thread;
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    m_loadThreads.removeAll(QPointer<QThread>());
+    m_loadThreads.append(thread);
+    thread->start();
+}
 
-    m_labelSnapshots.resize(nBlocks);
-    for (int i = 0; i < nBlocks; ++i)
+// Load thread: only touches the job; results are handed to the GUI thread through queued calls
+void PulseqLoader::runLoadJob(std::shared_ptr<LoadJob> job)
+{
+    auto post = [this, job](void (PulseqLoader::*handler)(const std::shared_ptr<LoadJob>&)) {
+        QMetaObject::invokeMethod(this, [this, job, handler]() { (this->*handler)(job); }, Qt::QueuedConnection);
+    };
+
+    ExternalSequence* seq = job->seq.get();
+    if (!seq->loadWithCache(job->path.toStdString(), seqCachePathFor(job->path)))
     {
-        SeqBlock* blk = m_vecDecodeSeqBlocks[i];
-        if (blk && blk->isLabel())
-        {
-            auto seq = m_spPulseqSeq;
-            auto markCounterUsed = [&](int id) {
-                if (!seq) return;
-                const std::string s = seq->getCounterIdAsString(id);
-                if (!s.empty()) { m_usedExtensions.insert(QString::fromStdString(s).toUpper()); return; }
-                const std::string u = seq->GetUnknownLabelName(id);
-                if (!u.empty()) { m_usedExtensions.insert(QString::fromStdString(u).toUpper()); return; }
-                m_usedExtensions.insert(QString("LABEL[%1]").arg(id).toUpper());
-            };
-            auto markFlagUsed = [&](int id) {
-                if (!seq) return;
-                const std::string s = seq->getFlagIdAsString(id);
-                if (!s.empty()) { m_usedExtensions.insert(QString::fromStdString(s).toUpper()); return; }
-                m_usedExtensions.insert(QString("FLAG[%1]").arg(id).toUpper());
-            };
+        post(&PulseqLoader::onLoadJobFailed);
+        return;
+    }
+    post(&PulseqLoader::onLoadJobLibrariesParsed);
+    if (job->cancel) return;
 
-            // Apply LABELSET first, then LABELINC (same semantics as SeqPlot.m and pulseq runtime).
-            const auto& sets = blk->GetLabelSetEvents();
-            for (const auto& e : sets)
-            {
-                const int lblId = e.numVal.first;
-                const int val = e.numVal.second;
-                const int flagId = e.flagVal.first;
-                const bool fval = e.flagVal.second;
+    const int64_t lSeqBlockNum = seq->GetNumberOfBlocks();
+    if (!job->lazy) job->blocks.assign(lSeqBlockNum, nullptr);
 
-                if (lblId >= 0 && lblId < NUM_LABELS && lblId != LABEL_UNKNOWN)
-                {
-                    counterVal[lblId] = val;
-                    markCounterUsed(lblId);
-                }
-                if (flagId >= 0 && flagId < NUM_FLAGS && flagId != FLAG_UNKNOWN)
-                {
-                    flagVal[flagId] = fval;
-                    markFlagUsed(flagId);
-                }
-            }
-            const auto& incs = blk->GetLabelIncEvents();
-            for (const auto& e : incs)
-            {
-                const int lblId = e.numVal.first;
-                const int val = e.numVal.second;
-                if (lblId >= 0 && lblId < NUM_LABELS && lblId != LABEL_UNKNOWN)
-                {
-                    counterVal[lblId] += val;
-                    markCounterUsed(lblId);
-                }
-            }
+    // Preview: decode the first TR (or the first blocks) serially so it can be drawn right away.
+    // A lazy load keeps none of them decoded: its preview only needs the block durations to start.
+    int64_t previewBlocks = std::min(lSeqBlockNum, kPreviewBlocksWithoutTr);
+    std::vector<double> repTimeDef = seq->GetDefinition("RepetitionTime");
+    if (repTimeDef.empty()) repTimeDef = seq->GetDefinition("TR");
+    const double trDuration_us = repTimeDef.empty() ? 0.0 : repTimeDef[0] * 1e6;
+    double elapsed_us = 0.0;
+    for (int64_t i = 0; i < lSeqBlockNum; ++i)
+    {
+        if (trDuration_us > 0.0 ? (elapsed_us >= trDuration_us || i >= kMaxPreviewBlocks) : i >= previewBlocks)
+        {
+            previewBlocks = i;
+            break;
         }
+        if (job->cancel) return;
+        if (job->lazy)
+        {
+            elapsed_us += seq->GetBlockDuration(int(i));
+            previewBlocks = i + 1;
+            continue;
+        }
+        job->blocks[i] = seq->GetBlock(int(i));
+        if (!seq->decodeBlock(job->blocks[i]))
+        {
+            job->failedBlockIndex = i;
+            post(&PulseqLoader::onLoadJobFailed);
+            return;
+        }
+        elapsed_us += job->blocks[i]->GetDuration();
+        previewBlocks = i + 1;
+    }
+    job->previewBlocks = previewBlocks;
+    if (previewBlocks > 0 &&
+        !runLoadPass(seq, job->lazy ? nullptr : &job->blocks, previewBlocks, job->tFactor, job->gammaHzPerT,
+                     job->previewTables, [&job](int64_t) { return !job->cancel; }))
+    {
+        if (job->cancel) return;
+        job->failedBlockIndex = job->previewTables.failedBlockIndex;
+        post(&PulseqLoader::onLoadJobFailed);
+        return;
+    }
+    post(&PulseqLoader::onLoadJobPreviewDecoded);
 
-        LabelSnapshot snap;
-        snap.counters = counterVal;
-        snap.flags = flagVal;
-        m_labelSnapshots[i] = snap;
+    // The progress bar covers the decode (eager load) and the load pass over all blocks.
+    // At most one progress update per percent.
+    int lastProgress = -1;
+    auto reportProgress = [&](int64_t blocksDone, int percentFrom, int percentTo) {
+        const int progress = percentFrom + int(blocksDone * (percentTo - percentFrom) / std::max<int64_t>(lSeqBlockNum, 1));
+        if (progress != lastProgress)
+        {
+            lastProgress = progress;
+            QMetaObject::invokeMethod(this, [this, job, progress]() { onLoadJobProgress(job, progress); }, Qt::QueuedConnection);
+        }
+        return !job->cancel;
+    };
+    const int passPercentFrom = job->lazy ? 0 : 50;
+    if (!job->lazy)
+    {
+        int64_t failedBlockIndex = -1;
+        const bool decoded = decodeBlocks(seq, job->blocks, previewBlocks,
+            [&](int64_t decodedBlocks) { return reportProgress(decodedBlocks, 0, passPercentFrom); }, failedBlockIndex);
+        if (job->cancel) return;
+        if (!decoded)
+        {
+            job->failedBlockIndex = failedBlockIndex;
+            post(&PulseqLoader::onLoadJobFailed);
+            return;
+        }
+    }
+    // A lazy load decodes the blocks once here, in windows that are dropped after the pass
+    if (!runLoadPass(seq, job->lazy ? nullptr : &job->blocks, lSeqBlockNum, job->tFactor, job->gammaHzPerT,
+                     job->tables, [&](int64_t blocksDone) { return reportProgress(blocksDone, passPercentFrom, 100); }))
+    {
+        if (job->cancel) return;
+        job->failedBlockIndex = job->tables.failedBlockIndex;
+        post(&PulseqLoader::onLoadJobFailed);
+        return;
+    }
+    post(&PulseqLoader::onLoadJobDecoded);
+}
 
-        // Track max accumulated counter value across all blocks (used for ADC Y-range)
-        for (int c : counterVal)
-            m_maxAccumulatedCounter = std::max(m_maxAccumulatedCounter, std::abs(c));
+void PulseqLoader::onLoadJobLibrariesParsed(const std::shared_ptr<LoadJob>& job)
+{
+    if (job != m_loadJob) return;
+    QMutexLocker viewportLock(&m_viewportMutex);
+    job->librariesPublished = true;
+    m_spPulseqSeq = job->seq;
+    if (!acceptLoadedSequence())
+    {
+        emit loadFinished(false);
+        return;
     }
+    std::cout << m_spPulseqSeq->GetNumberOfBlocks() << " blocks detected!\n";
+    emit librariesParsed();
 }
 
-const PulseqLoader::LabelSnapshot* PulseqLoader::labelSnapshotAfterBlock(int blockIdx) const
+void PulseqLoader::onLoadJobProgress(const std::shared_ptr<LoadJob>& job, int progress)
 {
-    if (blockIdx < 0 || blockIdx >= m_labelSnapshots.size())
-        return nullptr;
-    return &m_labelSnapshots[blockIdx];
+    if (job != m_loadJob) return;
+    if (auto pb = m_mainWindow->getProgressBar()) { pb->setValue(progress); }
+}
+
+void PulseqLoader::onLoadJobPreviewDecoded(const std::shared_ptr<LoadJob>& job)
+{
+    if (job != m_loadJob || job->previewBlocks <= 0) return;
+    QMutexLocker viewportLock(&m_viewportMutex);
+    if (job->lazy)
+    {
+        m_decodedBlocks.setLazy(job->seq, int(job->previewBlocks), kDecodedBlockCacheCapacity);
+    }
+    else
+    {
+        // The load thread only writes blocks behind the preview from now on
+        m_vecDecodeSeqBlocks.assign(job->blocks.begin(), job->blocks.begin() + job->previewBlocks);
+        m_decodedBlocks.setResident(&m_vecDecodeSeqBlocks);
+        m_bBlocksBorrowedFromLoadJob = true;
+    }
+    if (!applyDecodedBlocks(job->path, false, job->previewTables, job->tFactor))
+    {
+        emit loadFinished(false);
+        return;
+    }
+    emit firstBlocksDecoded(int(job->previewBlocks));
+}
+
+void PulseqLoader::onLoadJobDecoded(const std::shared_ptr<LoadJob>& job)
+{
+    if (job != m_loadJob) return;
+    QMutexLocker viewportLock(&m_viewportMutex);
+    // Take over the blocks; the load thread is done with them
+    if (job->lazy)
+    {
+        m_decodedBlocks.setLazy(job->seq, job->seq->GetNumberOfBlocks(), kDecodedBlockCacheCapacity);
+    }
+    else
+    {
+        m_vecDecodeSeqBlocks.swap(job->blocks);
+        job->blocks.clear();
+        m_decodedBlocks.setResident(&m_vecDecodeSeqBlocks);
+    }
+    m_bBlocksBorrowedFromLoadJob = false;
+    m_loadJob.reset();
+    if (auto btn = m_mainWindow->getCancelLoadButton()) { btn->hide(); }
+    emit blocksDecoded();
+
+    emit loadFinished(applyDecodedBlocks(job->path, true, job->tables, job->tFactor));
+}
+
+void PulseqLoader::onLoadJobFailed(const std::shared_ptr<LoadJob>& job)
+{
+    if (job != m_loadJob) return;
+    if (job->failedBlockIndex < 0)
+    {
+        reportLoadFailure(job->path);
+    }
+    else
+    {
+        reportDecodeFailure(job->failedBlockIndex);
+    }
+    ClearPulseqCache();
+    emit loadFinished(false);
+}
+
+void PulseqLoader::stopLoadJob()
+{
+    QMutexLocker viewportLock(&m_viewportMutex);
+    std::shared_ptr<LoadJob> job = std::move(m_loadJob);
+    m_loadJob.reset();
+    if (auto btn = m_mainWindow ? m_mainWindow->getCancelLoadButton() : nullptr) { btn->hide(); }
+    if (!job) return;
+
+    job->cancel = true;
+    // Once the libraries are shared with the GUI the decode threads must be gone before the sequence
+    // is reset; a job still parsing owns its sequence alone and is left to finish on its own.
+    if (job->librariesPublished && job->thread)
+        job->thread->wait();
+    if (m_bBlocksBorrowedFromLoadJob)
+    {
+        m_vecDecodeSeqBlocks.clear(); // owned and deleted by the job
+        m_bBlocksBorrowedFromLoadJob = false;
+    }
+    m_bPreviewViewSet = false;
 }
 
 bool PulseqLoader::getCounterValueAfterBlock(int blockIdx, int counterId, int& outVal) const
 {
-    outVal = 0;
-    const LabelSnapshot* s = labelSnapshotAfterBlock(blockIdx);
-    if (!s) return false;
-    if (counterId < 0 || counterId >= s->counters.size()) return false;
-    outVal = s->counters[counterId];
-    return true;
+    return m_labels.counterAfterBlock(blockIdx, counterId, outVal);
 }
 
 bool PulseqLoader::getFlagValueAfterBlock(int blockIdx, int flagId, bool& outVal) const
 {
-    outVal = false;
-    const LabelSnapshot* s = labelSnapshotAfterBlock(blockIdx);
-    if (!s) return false;
-    if (flagId < 0 || flagId >= s->flags.size()) return false;
-    outVal = s->flags[flagId];
-    return true;
+    return m_labels.flagAfterBlock(blockIdx, flagId, outVal);
 }
 
 void PulseqLoader::setBlockInfoContent(EventBlockInfoDialog* dialog, int currentBlock)
@@ -729,7 +1375,8 @@ void PulseqLoader::setBlockInfoContent(EventBlockInfoDialog* dialog, int current
         .arg(vecBlockEdges[currentBlock + 1])
         .arg(TimeUnits);
 
-    const auto& pSeqBlock = m_vecDecodeSeqBlocks[currentBlock];
+    const std::shared_ptr<SeqBlock> pSeqBlock = m_decodedBlocks.block(currentBlock);
+    if (!pSeqBlock) return;
     if (pSeqBlock->isRF())
     {
         blockInfo += QString("|-----------------------------------------------------------------------------------------------|\n");
@@ -825,9 +1472,9 @@ void PulseqLoader::setBlockInfoContent(EventBlockInfoDialog* dialog, int current
 void PulseqLoader::setRawBlockInfoContent(EventBlockInfoDialog* dialog, int currentBlock)
 {
     if (!dialog) return;
-    if (currentBlock < 0 || currentBlock >= static_cast<int>(m_vecDecodeSeqBlocks.size())) return;
+    if (currentBlock < 0 || currentBlock >= static_cast<int>(m_decodedBlocks.size())) return;
 
-    SeqBlock* blk = m_vecDecodeSeqBlocks[currentBlock];
+    const std::shared_ptr<SeqBlock> blk = m_decodedBlocks.block(currentBlock);
     if (!blk) return;
 
     QString s;
@@ -881,24 +1528,16 @@ void PulseqLoader::setManualRepetitionTime(double trValue)
 
     m_nTrCount = static_cast<int>(std::ceil(m_dTotalDuration_us / m_dRepetitionTime_us));
 
-    m_vecTrBlockIndices.clear();
+    buildTrBlockIndices();
+}
+
+// TR index: the block starting closest to each TR start (n * RepetitionTime)
+void PulseqLoader::buildTrBlockIndices()
+{
+    std::vector<double> trStartTimes(std::max(0, m_nTrCount));
     for (int tr = 0; tr < m_nTrCount; ++tr)
-    {
-        double trStartTime = tr * m_dRepetitionTime_us * tFactor;
-        int closestBlock = 0;
-        double minDistance = std::numeric_limits<double>::max();
-        for (int i = 0; i < m_vecDecodeSeqBlocks.size(); ++i)
-        {
-            double blockStartTime = vecBlockEdges[i];
-            double distance = std::abs(blockStartTime - trStartTime);
-            if (distance < minDistance)
-            {
-                minDistance = distance;
-                closestBlock = i;
-            }
-        }
-        m_vecTrBlockIndices.push_back(closestBlock);
-    }
+        trStartTimes[tr] = tr * m_dRepetitionTime_us * tFactor;
+    BlockLookup::closestBlockStarts(vecBlockEdges, trStartTimes, m_vecTrBlockIndices);
 }
 
 bool PulseqLoader::IsBlockRf(const float* fAmp, const float* fPhase, const int& iSamples)
@@ -937,112 +1576,239 @@ void PulseqLoader::updateEchoAndExcitationMetadata(int versionMajor, int version
         m_teTime_us = teDef[0] * 1e6;
         m_teDurationAxis = m_teTime_us * tFactor;
     }
+}
 
-    if (m_vecDecodeSeqBlocks.empty() || vecBlockEdges.size() < 2)
-        return;
 
-    computeKSpaceTrajectory();
+void PulseqLoader::readTrajectoryDefinitions(double& gradRasterUs, double& rfRasterUs)
+{
+    gradRasterUs = -1.0;
+    rfRasterUs = -1.0;
+    if (m_spPulseqSeq) {
+        std::vector<double> def = m_spPulseqSeq->GetDefinition("GradientRasterTime");
+        if (!def.empty() && std::isfinite(def[0]) && def[0] > 0.0) {
+            gradRasterUs = def[0] * 1e6; // seconds -> microseconds
+        }
+        def = m_spPulseqSeq->GetDefinition("RadiofrequencyRasterTime");
+        if (!def.empty() && std::isfinite(def[0]) && def[0] > 0.0) {
+            rfRasterUs = def[0] * 1e6;
+        }
+    }
+
+    if (m_spPulseqSeq)
+        m_b0Tesla = b0TeslaFor(m_spPulseqSeq.get()); // Store for phase computation
+}
+
+double PulseqLoader::b0TeslaFor(ExternalSequence* seq)
+{
+    // Read B0 from [DEFINITIONS] if available (needed to detect fat-sat RF use in v1.4.x files)
+    double b0Tesla = 0.0;
+    std::vector<double> defB0 = seq->GetDefinition("B0");
+    if (!defB0.empty())
+        b0Tesla = defB0[0];
+    // If B0 is undefined, assume 3.0T (standard high field) for PPM calculations
+    // This maintains compatibility with sequences that use PPM but don't define B0,
+    // while remaining safe for legacy files (where freqPPM will be 0 anyway).
+    if (b0Tesla == 0.0) {
+        b0Tesla = 3.0; // Default to 3.0T to match KSpaceTrajectory
+        // qWarning() << "B0 not defined in sequence [DEFINITIONS]. Assuming 3.0T for PPM calculations.";
+    }
+    return b0Tesla;
 }
 
+void PulseqLoader::startTrajectoryJob()
+{
+    stopTrajectoryJob();
+    if (m_decodedBlocks.empty() || vecBlockEdges.size() < 2)
+    {
+        m_kTrajectoryReady = true; // nothing to integrate
+        return;
+    }
 
-void PulseqLoader::computeKSpaceTrajectory()
-{
     double gradRasterUs = -1.0;
     double rfRasterUs = -1.0;
-    if (m_spPulseqSeq) {
-        std::vector<double> def = m_spPulseqSeq->GetDefinition("GradientRasterTime");
-        if (!def.empty() && std::isfinite(def[0]) && def[0] > 0.0) {
-            gradRasterUs = def[0] * 1e6; // seconds -> microseconds
-        }
-        def = m_spPulseqSeq->GetDefinition("RadiofrequencyRasterTime");
-        if (!def.empty() && std::isfinite(def[0]) && def[0] > 0.0) {
-            rfRasterUs = def[0] * 1e6;
-        }
-    }
+    readTrajectoryDefinitions(gradRasterUs, rfRasterUs);
+    auto job = std::make_shared<TrajectoryJob>();
+    job->blockEdges = vecBlockEdges;
+    if (m_decodedBlocks.isLazy()) job->seq = m_spPulseqSeq;
+    job->integrator = std::make_unique<KSpaceTrajectory::Integrator>(tFactor, gradRasterUs, rfRasterUs,
+                                                                     m_supportsRfUseMetadata, m_b0Tesla);
+    m_trajectoryJob = job;
+
+    QThread* thread = QThread::create([this, job]() { runTrajectoryJob(job); });
+    job->thread = thread;
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start();
+}
 
-    QVector<double> adcEventTimes;
-    if (!m_vecDecodeSeqBlocks.empty() && vecBlockEdges.size() >= 2) {
-        qsizetype totalSamples = 0;
-        for (SeqBlock* blk : m_vecDecodeSeqBlocks) {
-            if (!blk || !blk->isADC())
-                continue;
-            const ADCEvent& adc = blk->GetADCEvent();
-            if (adc.numSamples > 0)
-                totalSamples += adc.numSamples;
+// Trajectory thread: integrates the blocks in order and publishes the integrated part every
+// kTrajectoryPublishIntervalMs, so the plot fills in TR by TR while the rest is computed.
+// After a lazy load the blocks are decoded in windows on the decode pool (as in runLoadPass)
+// rather than through the decoded-block cache, which keeps the viewport's blocks.
+void PulseqLoader::runTrajectoryJob(std::shared_ptr<TrajectoryJob> job)
+{
+    auto publish = [this, job](KSpaceTrajectory::Result part, int progress, bool finished) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        appendTrajectoryPart(job->published, std::move(part));
+        job->progress = progress;
+        job->finished = finished;
+        // One queued call takes everything published until it runs
+        if (job->posted) return;
+        job->posted = true;
+        QMetaObject::invokeMethod(this, [this, job]() { onTrajectoryJobProgress(job); }, Qt::QueuedConnection);
+    };
+
+    KSpaceTrajectory::Integrator& integrator = *job->integrator;
+    const int blockCount = int(job->blockEdges.size()) - 1;
+    integrator.begin(blockCount);
+    auto lastPublish = std::chrono::steady_clock::now();
+    auto consumed = [&](int i) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastPublish >= std::chrono::milliseconds(kTrajectoryPublishIntervalMs))
+        {
+            lastPublish = now;
+            publish(integrator.takeIntegrated(), int(int64_t(i + 1) * 100 / blockCount), false);
         }
-        if (totalSamples > 0)
-            adcEventTimes.reserve(totalSamples);
+    };
 
-        for (int i = 0; i < static_cast<int>(m_vecDecodeSeqBlocks.size()); ++i) {
-            SeqBlock* blk = m_vecDecodeSeqBlocks[i];
-            if (!blk || !blk->isADC())
-                continue;
-            const ADCEvent& adc = blk->GetADCEvent();
-            if (adc.numSamples <= 0 || adc.dwellTime <= 0)
-                continue;
-            double dwellUs = static_cast<double>(adc.dwellTime) * 1e-3; // ns -> us
-            double dwellInternal = dwellUs * tFactor;
-            double startInternal = vecBlockEdges[i] + adc.delay * tFactor + 0.5 * dwellInternal;
-            for (int sample = 0; sample < adc.numSamples; ++sample) {
-                adcEventTimes.append(startInternal + sample * dwellInternal);
+    if (job->seq)
+    {
+        const int64_t windowSize = kDecodeChunkSize * std::max(1u, std::thread::hardware_concurrency());
+        std::vector<SeqBlock*> window;
+        for (int64_t first = 0; first < blockCount; first += windowSize)
+        {
+            if (job->cancel) return;
+            window.assign(size_t(std::min<int64_t>(windowSize, blockCount - first)), nullptr);
+            int64_t failedBlockIndex = -1;
+            const bool decoded = decodeBlocks(job->seq.get(), window, 0,
+                                              [&job](int64_t) { return !job->cancel; }, failedBlockIndex, first);
+            if (decoded)
+            {
+                for (size_t j = 0; j < window.size(); ++j)
+                {
+                    const int i = int(first + int64_t(j));
+                    integrator.consume(i, *window[j], job->blockEdges.at(i));
+                    consumed(i);
+                }
+            }
+            for (SeqBlock* block : window) delete block;
+            if (failedBlockIndex >= 0)
+            {
+                job->failedBlockIndex = failedBlockIndex;
+                break;
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < blockCount; ++i)
+        {
+            if (job->cancel) return;
+            const std::shared_ptr<SeqBlock> block = m_decodedBlocks.block(i);
+            if (!block)
+            {
+                job->failedBlockIndex = i;
+                break;
             }
+            integrator.consume(i, *block, job->blockEdges.at(i));
+            consumed(i);
         }
     }
+    if (job->cancel) return;
+    integrator.finish();
+    publish(integrator.takeResult(), 100, true);
+}
 
-    // Read B0 from [DEFINITIONS] if available (needed to detect fat-sat RF use in v1.4.x files)
-    double b0Tesla = 0.0;
-    if (m_spPulseqSeq) {
-        std::vector<double> defB0 = m_spPulseqSeq->GetDefinition("B0");
-        if (!defB0.empty())
-            b0Tesla = defB0[0];
+void PulseqLoader::onTrajectoryJobProgress(const std::shared_ptr<TrajectoryJob>& job)
+{
+    if (job != m_trajectoryJob) return;
+    KSpaceTrajectory::Result part;
+    int progress = 0;
+    bool finished = false;
+    int64_t failedBlockIndex = -1;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        part = std::move(job->published);
+        job->published = KSpaceTrajectory::Result();
+        progress = job->progress;
+        finished = job->finished;
+        failedBlockIndex = job->failedBlockIndex;
+        job->posted = false;
+    }
+
+    m_kTrajectoryX += std::move(part.kx);
+    m_kTrajectoryY += std::move(part.ky);
+    m_kTrajectoryZ += std::move(part.kz);
+    m_kTimeSec += std::move(part.t);
+    m_kTrajectoryXAdc += std::move(part.kx_adc);
+    m_kTrajectoryYAdc += std::move(part.ky_adc);
+    m_kTrajectoryZAdc += std::move(part.kz_adc);
+    m_kTimeAdcSec += std::move(part.t_adc);
+    if (auto pb = m_mainWindow ? m_mainWindow->getProgressBar() : nullptr)
+    {
+        if (finished) { pb->hide(); pb->setFormat("%p%"); }
+        else { pb->setFormat("k-space %p%"); pb->setValue(progress); pb->show(); }
     }
-    // If B0 is undefined, assume 3.0T (standard high field) for PPM calculations
-    // This maintains compatibility with sequences that use PPM but don't define B0,
-    // while remaining safe for legacy files (where freqPPM will be 0 anyway).
-    if (b0Tesla == 0.0) {
-        b0Tesla = 3.0; // Default to 3.0T to match KSpaceTrajectory
-        // qWarning() << "B0 not defined in sequence [DEFINITIONS]. Assuming 3.0T for PPM calculations.";
+    if (finished)
+    {
+        m_trajectoryJob.reset();
+        m_kTrajectoryReady = true; // also after a decode error: the blocks up to it are shown
+        if (failedBlockIndex >= 0) reportDecodeFailure(failedBlockIndex);
     }
-    m_b0Tesla = b0Tesla; // Store for phase computation
-
-    KSpaceTrajectory::Input input { m_vecDecodeSeqBlocks,
-                                    vecBlockEdges,
-                                    tFactor,
-                                    m_supportsRfUseMetadata,
-                                    rfRasterUs,
-                                    gradRasterUs,
-                                    std::move(adcEventTimes),
-                                    b0Tesla };
-    KSpaceTrajectory::Result result = KSpaceTrajectory::compute(input);
-
-    m_excitationCentersAxis = result.excitationTimesInternal;
-    m_refocusingCentersAxis = result.refocusingTimesInternal;
-    m_kTrajectoryX = result.kx;
-    m_kTrajectoryY = result.ky;
-    m_kTrajectoryZ = result.kz;
-    m_kTimeSec      = result.t;
-    m_kTrajectoryXAdc = result.kx_adc;
-    m_kTrajectoryYAdc = result.ky_adc;
-    m_kTrajectoryZAdc = result.kz_adc;
-    m_kTimeAdcSec     = result.t_adc;
-    m_rfUseGuessed = result.rfUseGuessed;
-    m_rfGuessWarning = result.warning;
-    m_rfUsePerBlock = result.rfUsePerBlock;
-    m_kTrajectoryReady = true;
+    emit trajectoryProgress(progress);
+    if (finished) emit trajectoryFinished();
 }
 
-void PulseqLoader::ensureTrajectoryPrepared()
+void PulseqLoader::stopTrajectoryJob()
 {
-    if (!m_kTrajectoryReady)
+    std::shared_ptr<TrajectoryJob> job = std::move(m_trajectoryJob);
+    m_trajectoryJob.reset();
+    if (job)
     {
-        computeKSpaceTrajectory();
+        job->cancel = true;
+        // The thread reads the decoded blocks, which the caller is about to replace
+        if (job->thread) job->thread->wait();
+        if (auto pb = m_mainWindow ? m_mainWindow->getProgressBar() : nullptr) { pb->hide(); pb->setFormat("%p%"); }
     }
+
+    // A stopped trajectory never completes; drop the part published so far
+    m_kTrajectoryReady = false;
+    m_kTrajectoryX.clear();
+    m_kTrajectoryY.clear();
+    m_kTrajectoryZ.clear();
+    m_kTimeSec.clear();
+    m_kTrajectoryXAdc.clear();
+    m_kTrajectoryYAdc.clear();
+    m_kTrajectoryZAdc.clear();
+    m_kTimeAdcSec.clear();
+}
+
+void PulseqLoader::ensureTrajectoryPrepared()
+{
+    // During a background load the blocks are still borrowed; the load starts the trajectory when it completes
+    if (!m_kTrajectoryReady && !m_trajectoryJob && !m_loadJob)
+        startTrajectoryJob();
+}
+
+void PulseqLoader::waitForTrajectory()
+{
+    ensureTrajectoryPrepared();
+    std::shared_ptr<TrajectoryJob> job = m_trajectoryJob;
+    if (!job) return;
+    if (job->thread) job->thread->wait();
+    // Take the rest now; the queued call finds the job gone
+    onTrajectoryJobProgress(job);
+}
+
+double PulseqLoader::trajectoryAvailableUntilSec() const
+{
+    if (m_kTrajectoryReady) return std::numeric_limits<double>::infinity();
+    return m_kTimeSec.isEmpty() ? 0.0 : m_kTimeSec.last();
 }
 
 QVector<double> PulseqLoader::getKxKyZeroTimes() const
 {
     QVector<double> result;
-    if (!m_kTrajectoryReady || m_kTrajectoryX.isEmpty() || m_kTrajectoryY.isEmpty() || m_kTimeSec.isEmpty())
+    if (m_kTrajectoryX.isEmpty() || m_kTrajectoryY.isEmpty() || m_kTimeSec.isEmpty())
         return result;
 
     // Calculate tolerance based on FOV (deltak = 1/FOV)
@@ -1359,17 +2125,14 @@ QVector<double> PulseqLoader::getKxKyZeroTimes() const
     // Filter: only keep times that are within ADC blocks
     // Build list of ADC block time ranges (in seconds)
     QVector<QPair<double, double>> adcBlockRanges;
-    if (!m_vecDecodeSeqBlocks.empty() && vecBlockEdges.size() >= 2)
+    if (!m_decodedBlocks.empty() && vecBlockEdges.size() >= 2)
     {
-        for (int i = 0; i < static_cast<int>(m_vecDecodeSeqBlocks.size()); ++i)
+        const SequenceTable::AdcColumns& adcRows = m_sequenceTable.adc;
+        for (int r = 0; r < adcRows.size(); ++r)
         {
-            SeqBlock* blk = m_vecDecodeSeqBlocks[i];
-            if (!blk || !blk->isADC())
-                continue;
-            
-            const ADCEvent& adc = blk->GetADCEvent();
-            if (adc.numSamples <= 0 || adc.dwellTime <= 0)
+            if (adcRows.numSamples[r] <= 0 || adcRows.dwell[r] <= 0)
                 continue;
+            const int i = adcRows.block[r];
             
             // Convert block time range from internal units to seconds
             double blockStartInternal = vecBlockEdges[i];
@@ -1445,6 +2208,7 @@ void PulseqLoader::rescaleTimeUnit()
 
     if (oldFactor == newFactor) return; // no effective change
     if (vecBlockEdges.empty()) return;  // no file loaded
+    QMutexLocker viewportLock(&m_viewportMutex);
 
     double ratio = newFactor / oldFactor;
 
@@ -1455,6 +2219,8 @@ void PulseqLoader::rescaleTimeUnit()
     // Rescale pre-built ADC time series
     for (auto& t : m_adcTime)
         t *= ratio;
+    clearWaveformPyramids();
+    clearViewportSegments();
 
     // Rescale TE overlay data (excitation/refocusing centers are in axis units)
     m_teDurationAxis *= ratio;
@@ -1513,22 +2279,12 @@ void PulseqLoader::loadLastOpenDirectory()
     }
 }
 // --- RF shape cache helpers ---
-QString PulseqLoader::rfAmpKey(int magShapeId, int timeShapeId, int len) const
-{
-    return QString("rfA:%1:%2#%3").arg(magShapeId).arg(timeShapeId).arg(len);
-}
-
-QString PulseqLoader::rfPhKey(int phaseShapeId, int timeShapeId, int len) const
-{
-    return QString("rfP:%1:%2#%3").arg(phaseShapeId).arg(timeShapeId).arg(len);
-}
-
-const PulseqLoader::RFAmpEntry& PulseqLoader::ensureRfAmpCached(const float* amp, int len,
+const PulseqLoader::RFAmpEntry& PulseqLoader::ensureRfAmpCached(QHash<quint64, RFAmpEntry>& cache, const float* amp, int len,
                                                                int magShapeId, int timeShapeId)
 {
-    QString key = rfAmpKey(magShapeId, timeShapeId, len);
-    auto it = m_rfAmpCache.find(key);
-    if (it != m_rfAmpCache.end()) return it.value();
+    const quint64 key = shapeKey(magShapeId, timeShapeId);
+    auto it = cache.find(key);
+    if (it != cache.end() && it.value().length == len) return it.value();
     RFAmpEntry e; e.length = len; e.ampNorm.resize(len);
     double mnA = std::numeric_limits<double>::infinity();
     double mxA = -std::numeric_limits<double>::infinity();
@@ -1547,16 +2303,16 @@ const PulseqLoader::RFAmpEntry& PulseqLoader::ensureRfAmpCached(const float* amp
     } else {
         e.peakIndex = -1;
     }
-    auto ins = m_rfAmpCache.insert(key, e);
+    auto ins = cache.insert(key, e);
     return ins.value();
 }
 
-const PulseqLoader::RFPhEntry& PulseqLoader::ensureRfPhCached(const float* phase, int len,
+const PulseqLoader::RFPhEntry& PulseqLoader::ensureRfPhCached(QHash<quint64, RFPhEntry>& cache, const float* phase, int len,
                                                              int phaseShapeId, int timeShapeId)
 {
-    QString key = rfPhKey(phaseShapeId, timeShapeId, len);
-    auto it = m_rfPhCache.find(key);
-    if (it != m_rfPhCache.end()) return it.value();
+    const quint64 key = shapeKey(phaseShapeId, timeShapeId);
+    auto it = cache.find(key);
+    if (it != cache.end() && it.value().length == len) return it.value();
     RFPhEntry e; e.length = len; e.phNorm.resize(len);
     double mnP = std::numeric_limits<double>::infinity();
     double mxP = -std::numeric_limits<double>::infinity();
@@ -1574,21 +2330,16 @@ const PulseqLoader::RFPhEntry& PulseqLoader::ensureRfPhCached(const float* phase
     if (!std::isfinite(mnP) || !std::isfinite(mxP)) { mnP = 0.0; mxP = 0.0; }
     e.phMin = mnP; e.phMax = mxP;
     e.isRealLike = isReal;
-    auto ins = m_rfPhCache.insert(key, e);
+    auto ins = cache.insert(key, e);
     return ins.value();
 }
 
-QString PulseqLoader::gradKey(int waveShapeId, int timeShapeId, int len) const
-{
-    return QString("grad:%1:%2#%3").arg(waveShapeId).arg(timeShapeId).arg(len);
-}
-
-const PulseqLoader::GradShapeEntry& PulseqLoader::ensureGradCached(const float* shape, int len,
+const PulseqLoader::GradShapeEntry& PulseqLoader::ensureGradCached(QHash<quint64, GradShapeEntry>& cache, const float* shape, int len,
                                                                   int waveShapeId, int timeShapeId)
 {
-    QString key = gradKey(waveShapeId, timeShapeId, len);
-    auto it = m_gradShapeCache.find(key);
-    if (it != m_gradShapeCache.end()) return it.value();
+    const quint64 key = shapeKey(waveShapeId, timeShapeId);
+    auto it = cache.find(key);
+    if (it != cache.end() && it.value().length == len) return it.value();
     GradShapeEntry e; e.length = len; e.norm.resize(len);
     double mn = std::numeric_limits<double>::infinity();
     double mx = -std::numeric_limits<double>::infinity();
@@ -1598,99 +2349,205 @@ const PulseqLoader::GradShapeEntry& PulseqLoader::ensureGradCached(const float*
     }
     if (!std::isfinite(mn) || !std::isfinite(mx)) { mn = 0.0; mx = 0.0; }
     e.vMin = mn; e.vMax = mx;
-    auto ins = m_gradShapeCache.insert(key, e);
+    auto ins = cache.insert(key, e);
     return ins.value();
 }
 
+bool PulseqLoader::ViewportSegmentParams::matches(const ViewportSegmentParams& other) const
+{
+    // A pan shifts both ends of the window, so its span may differ in the last bits
+    return pixelWidth == other.pixelWidth && decimate == other.decimate && gamma == other.gamma
+        && std::abs(window - other.window) <= 1e-9 * window;
+}
+
+template <typename Segment>
+QHash<int, Segment>& PulseqLoader::viewportSegments(QList<ViewportSegmentSet<Segment>>& sets, const ViewportSegmentParams& params)
+{
+    for (int i = 0; i < sets.size(); ++i)
+    {
+        if (!sets[i].params.matches(params)) continue;
+        if (i > 0) sets.move(i, 0);
+        return sets.first().blocks;
+    }
+    sets.prepend(ViewportSegmentSet<Segment>{params, {}});
+    while (sets.size() > kViewportSegmentSets) sets.removeLast();
+    return sets.first().blocks;
+}
+
+// Keep the blocks of the window and up to one window width on either side (where a pan goes next)
+template <typename Segment>
+void PulseqLoader::pruneViewportSegments(QHash<int, Segment>& blocks, int startBlock, int endBlock)
+{
+    const int span = endBlock - startBlock + 1;
+    for (auto it = blocks.begin(); it != blocks.end(); )
+    {
+        if (it.key() < startBlock - span || it.key() > endBlock + span) it = blocks.erase(it);
+        else ++it;
+    }
+}
+
+void PulseqLoader::clearViewportSegments()
+{
+    m_rfSegmentSets.clear();
+    for (auto& sets : m_gradSegmentSets) sets.clear();
+}
+
 void PulseqLoader::getGradViewportDecimated(int channel, double visibleStart, double visibleEnd, int pixelWidth,
                                             QVector<double>& tOut, QVector<double>& vOut)
 {
+    QMutexLocker viewportLock(&m_viewportMutex);
     tOut.clear(); vOut.clear();
-    if (m_vecDecodeSeqBlocks.empty() || vecBlockEdges.isEmpty() || pixelWidth <= 0) return;
+    if (m_decodedBlocks.empty() || vecBlockEdges.isEmpty() || pixelWidth <= 0) return;
 
     // Find visible block range
-    int startBlock = 0;
-    int endBlock = int(vecBlockEdges.size()) - 2;
-    for (int i = 0; i < vecBlockEdges.size() - 1; ++i) {
-        if (vecBlockEdges[i + 1] > visibleStart) { startBlock = i; break; }
-    }
-    for (int i = int(vecBlockEdges.size()) - 2; i >= startBlock; --i) {
-        if (vecBlockEdges[i] < visibleEnd) { endBlock = i; break; }
+    int startBlock = 0, endBlock = -1;
+    if (!findBlockRange(visibleStart, visibleEnd, startBlock, endBlock)) return;
+
+    // More blocks than pixels in view: per-pixel envelope from the min/max pyramid
+    if (const MinMaxPyramid* pyramid = waveformPyramid(PyramidGx + channel, visibleStart, visibleEnd, pixelWidth, endBlock - startBlock + 1, 0.0))
+    {
+        pyramid->query(visibleStart, visibleEnd, pixelWidth, tOut, vOut);
+        return;
     }
-    if (startBlock > endBlock) return;
 
     const double window = std::max(1e-9, visibleEnd - visibleStart);
 
+    // Gradient events of the channel in the visible blocks
+    const SequenceTable::GradColumns& events = m_sequenceTable.grad[channel];
+    const int firstEvent = int(std::lower_bound(events.block.begin(), events.block.end(), startBlock) - events.block.begin());
+    const int endEvent = int(std::upper_bound(events.block.begin(), events.block.end(), endBlock) - events.block.begin());
+
     bool haveLast = false; double lastT=0.0, lastV=0.0;
     // Global decimation gating for gradients (heavy-only)
     const int DECIMATE_TOTAL_THRESHOLD_GRAD = 150000;
-    long long totalGradSamples = 0;
-    for (int i = startBlock; i <= endBlock; ++i) {
-        SeqBlock* blk = m_vecDecodeSeqBlocks[i]; if (!blk) continue;
-        if (blk->isArbitraryGradient(channel)) totalGradSamples += std::max(0, blk->GetArbGradNumSamples(channel));
-        else if (blk->isExtTrapGradient(channel)) totalGradSamples += (int)blk->GetExtTrapGradTimes(channel).size();
-        else if (blk->isTrapGradient(channel)) totalGradSamples += 4;
-    }
+    const long long totalGradSamples = events.samplesBefore.isEmpty() ? 0 : events.samplesBefore[endEvent] - events.samplesBefore[firstEvent];
     bool allowDecimateGrad = (totalGradSamples > DECIMATE_TOTAL_THRESHOLD_GRAD);
     if (pixelWidth > 0) {
         double pppTotal = double(std::max<long long>(1, totalGradSamples)) / double(pixelWidth);
         if (pppTotal <= 2.0) allowDecimateGrad = false;
     }
 
-    for (int i = startBlock; i <= endBlock; ++i) {
-        SeqBlock* blk = m_vecDecodeSeqBlocks[i]; if (!blk) continue;
-        bool hasGradient = blk->isTrapGradient(channel) || blk->isArbitraryGradient(channel) || blk->isExtTrapGradient(channel);
-        if (!hasGradient) continue;
-        const GradEvent& grad = blk->GetGradEvent(channel);
-        const double tStart = vecBlockEdges[i] + grad.delay * tFactor;
+    // Decimated arbitrary gradients of blocks still in view since an earlier viewport with the same widths
+    QHash<int, GradViewportSegment>& segments =
+        viewportSegments(m_gradSegmentSets[channel], ViewportSegmentParams{window, pixelWidth, allowDecimateGrad, 0.0});
+    pruneViewportSegments(segments, startBlock, endBlock);
+
+    // Use sequence GradientRasterTime (seconds) for arbitrary gradients — required by loader
+    double gradRaster_us = 0.0;
+    if (m_spPulseqSeq) {
+        std::vector<double> def = m_spPulseqSeq->GetDefinition("GradientRasterTime");
+        if (!def.empty() && std::isfinite(def[0]) && def[0] > 0.0) gradRaster_us = def[0] * 1e6;
+    }
+
+    // Append one block's samples; continuity at block start, else a NaN break
+    auto appendBlock = [&](const double* tBlk, const double* vBlk, int n) {
+        if (n <= 0) return;
+        if (haveLast) {
+            double dtTol = 1e-9; double dvTol = 1e-12;
+            bool continuous = (std::abs(tBlk[0] - lastT) <= dtTol) && (std::abs(vBlk[0] - lastV) <= dvTol);
+            if (!continuous) {
+                // Keep x monotonic: duplicate last x as a NaN break marker.
+                // This avoids generating a break time that is > lastT when the next segment starts at the same timestamp.
+                tOut.append(lastT);
+                vOut.append(std::numeric_limits<double>::quiet_NaN());
+            }
+        }
+        for (int k = 0; k < n; ++k) { tOut.append(tBlk[k]); vOut.append(vBlk[k]); }
+        lastT = tBlk[n - 1]; lastV = vBlk[n - 1]; haveLast = true;
+    };
 
-        if (blk->isTrapGradient(channel)) {
-            double rampUpTime = grad.rampUpTime * tFactor;
-            double flatTime = grad.flatTime * tFactor;
-            double rampDownTime = grad.rampDownTime * tFactor;
+    // Trapezoids narrower than a pixel that share a pixel are drawn as one envelope spanning their
+    // closed-form value range; a lone event in its pixel keeps its exact corners.
+    const double pixelSpan = window / pixelWidth;
+    struct PixelEnvelope {
+        long long pixel {-1};
+        int count {0};
+        double lo {0.0}, hi {0.0};
+        double vFirst {0.0}, tLast {0.0}, vLast {0.0};
+        QVector<double> t, v; // corners drawn so far
+    } envelope;
+    auto flushEnvelope = [&]() {
+        if (envelope.count == 1) {
+            appendBlock(envelope.t.constData(), envelope.v.constData(), int(envelope.t.size()));
+        } else if (envelope.count > 1) {
+            const double tFirst = envelope.t.first();
+            const double tMid = 0.5 * (tFirst + envelope.tLast);
+            const double t[4] = {tFirst, tMid, tMid, envelope.tLast};
+            const double v[4] = {envelope.vFirst, envelope.lo, envelope.hi, envelope.vLast};
+            appendBlock(t, v, 4);
+        }
+        envelope.count = 0; envelope.pixel = -1;
+        envelope.t.clear(); envelope.v.clear();
+    };
+    // Corners (t, v) of an event spanning [t0, t3] with values in [lo, hi]
+    auto addEvent = [&](const double* t, const double* v, int n, double lo, double hi) {
+        const double t0 = t[0], t3 = t[n - 1];
+        const long long pixel = (t3 - t0 < pixelSpan && lo <= hi) ? (long long)std::floor((t0 - visibleStart) / pixelSpan) : -1;
+        if (pixel < 0 || pixel != envelope.pixel) {
+            flushEnvelope();
+            if (pixel < 0) { appendBlock(t, v, n); return; }
+            envelope.pixel = pixel;
+            envelope.lo = lo; envelope.hi = hi; envelope.vFirst = v[0];
+            for (int k = 0; k < n; ++k) { envelope.t.append(t[k]); envelope.v.append(v[k]); }
+        } else {
+            envelope.lo = std::min(envelope.lo, lo); envelope.hi = std::max(envelope.hi, hi);
+        }
+        envelope.tLast = t3; envelope.vLast = v[n - 1];
+        ++envelope.count;
+    };
+
+    QVector<double> extT, extV;
+    for (int e = firstEvent; e < endEvent; ++e) {
+        const int i = events.block[e];
+        const double tStart = vecBlockEdges[i] + events.delay[e] * tFactor;
+
+        if (events.kind[e] == SequenceTable::GradTrap) {
             double t0 = tStart;
-            double t1 = tStart + rampUpTime;
-            double t2 = t1 + flatTime;
-            double t3 = t2 + rampDownTime;
+            double t1 = tStart + events.rampUp[e] * tFactor;
+            double t2 = t1 + events.flat[e] * tFactor;
+            double t3 = t2 + events.rampDown[e] * tFactor;
             if (t3 <= visibleStart || t0 >= visibleEnd) continue;
-            // Build block arrays
-            QVector<double> tt{t0,t1,t2,t3};
-            QVector<double> vv{0.0, grad.amplitude, grad.amplitude, 0.0};
-            // Continuity at block start
-            if (!tt.isEmpty()) {
-                if (haveLast) {
-                    double dtTol = 1e-9;
-                    double dvTol = 1e-12;
-                    bool continuous = (std::abs(tt.first() - lastT) <= dtTol) && (std::abs(vv.first() - lastV) <= dvTol);
-                    if (!continuous) {
-                        // Keep x monotonic: duplicate last x as a NaN break marker.
-                        // This avoids generating a break time that is > lastT when the next segment starts at the same timestamp.
-                        tOut.append(lastT);
-                        vOut.append(std::numeric_limits<double>::quiet_NaN());
-                    }
-                }
-                tOut += tt; vOut += vv;
-                lastT = tt.last(); lastV = vv.last(); haveLast = true;
+            const double amp = events.amplitude[e];
+            const double t[4] = {t0, t1, t2, t3};
+            const double v[4] = {0.0, amp, amp, 0.0};
+            addEvent(t, v, 4, events.vMin[e], events.vMax[e]);
+            continue;
+        }
+
+        if (events.kind[e] == SequenceTable::GradExtTrap) {
+            const int first = events.extFirst[e], n = events.extCount[e];
+            if (n <= 0) continue;
+            const double t0 = tStart + events.extTime[first] * tFactor;
+            const double t3 = tStart + events.extTime[first + n - 1] * tFactor;
+            if (t3 <= visibleStart || t0 >= visibleEnd) continue;
+            extT.resize(n); extV.resize(n);
+            for (int j = 0; j < n; ++j) {
+                extT[j] = tStart + events.extTime[first + j] * tFactor;
+                extV[j] = events.extValue[first + j];
             }
+            addEvent(extT.constData(), extV.constData(), n, events.vMin[e], events.vMax[e]);
             continue;
         }
 
-        if (blk->isArbitraryGradient(channel)) {
-            int numSamples = blk->GetArbGradNumSamples(channel);
-            const float* shapePtr = blk->GetArbGradShapePtr(channel);
-            if (numSamples <= 0 || !shapePtr) continue;
+        // Arbitrary gradient
+        flushEnvelope();
+        const std::shared_ptr<SeqBlock> blk = m_decodedBlocks.block(i); if (!blk) continue;
+        const GradEvent& grad = blk->GetGradEvent(channel);
+        int numSamples = blk->GetArbGradNumSamples(channel);
+        const float* shapePtr = blk->GetArbGradShapePtr(channel);
+        if (numSamples <= 0 || !shapePtr) continue;
+        if (gradRaster_us <= 0.0) return; // do not render without definition
+        double dt = gradRaster_us * tFactor;
+        double duration = numSamples * dt;
+        if (tStart >= visibleEnd || (tStart + duration) <= visibleStart) continue;
+        auto cached = segments.constFind(i);
+        if (cached == segments.constEnd()) {
             const GradShapeEntry& entry = ensureGradCached(shapePtr, numSamples, grad.waveShape, grad.timeShape);
-            // Use sequence GradientRasterTime (seconds) — required by loader
-            if (!m_spPulseqSeq) return; // defensive: loader guarantees presence
-            std::vector<double> def = m_spPulseqSeq->GetDefinition("GradientRasterTime");
-            if (def.empty() || !std::isfinite(def[0]) || def[0] <= 0.0) return; // do not render without definition
-            double gradRaster_us = def[0] * 1e6;
-            double dt = gradRaster_us * tFactor;
-            double duration = numSamples * dt;
-            if (tStart >= visibleEnd || (tStart + duration) <= visibleStart) continue;
             int pxForBlock = std::max(1, int(std::round(duration / window * pixelWidth)));
             // Prefer LTTB decimation for shape fidelity
-            QVector<double> tBlk, vBlk;
+            GradViewportSegment segment;
+            QVector<double>& tBlk = segment.t;
+            QVector<double>& vBlk = segment.v;
             double ppp = (pxForBlock > 0) ? double(numSamples) / double(pxForBlock) : double(numSamples);
             if (!allowDecimateGrad || numSamples <= 64 || ppp <= 1.2) {
                 tBlk.reserve(numSamples); vBlk.reserve(numSamples);
@@ -1714,50 +2571,11 @@ void PulseqLoader::getGradViewportDecimated(int channel, double visibleStart, do
                     tBlk = dT; vBlk.reserve(dV.size()); for (double val: dV){ vBlk.append(val * double(grad.amplitude)); }
                 }
             }
-            if (!tBlk.isEmpty()) {
-                if (haveLast) {
-                    double dtTol = 1e-9; double dvTol = 1e-12;
-                    bool continuous = (std::abs(tBlk.first() - lastT) <= dtTol) && (std::abs(vBlk.first() - lastV) <= dvTol);
-                    if (!continuous) {
-                        // Duplicate last x for NaN break to keep x monotonic.
-                        tOut.append(lastT);
-                        vOut.append(std::numeric_limits<double>::quiet_NaN());
-                    }
-                }
-                tOut += tBlk; vOut += vBlk; lastT = tBlk.last(); lastV = vBlk.last(); haveLast = true;
-            }
-            continue;
-        }
-
-        if (blk->isExtTrapGradient(channel)) {
-            const std::vector<long>& times = blk->GetExtTrapGradTimes(channel);
-            const std::vector<float>& shape = blk->GetExtTrapGradShape(channel);
-            if (times.empty() || shape.empty() || times.size() != shape.size()) continue;
-            // Build and decimate via buckets in time domain
-            // We’ll do a simple min-max on the resampled sequence by index mapping similar to arbitrary
-            int n = int(times.size());
-            // Estimate dt average for epsilon
-            double dtAvg = (n>1 ? (times.back()-times.front())/(double)(n-1) * tFactor : 1e-6);
-            QVector<double> tBlk; QVector<double> vBlk; tBlk.reserve(n); vBlk.reserve(n);
-            for (int j = 0; j < n; ++j) {
-                double t = tStart + times[j] * tFactor;
-                tBlk.append(t); vBlk.append(double(shape[j]) * double(grad.amplitude));
-            }
-            if (!tBlk.isEmpty()) {
-                if (haveLast) {
-                    double dtTol = 1e-9; double dvTol = 1e-12;
-                    bool continuous = (std::abs(tBlk.first() - lastT) <= dtTol) && (std::abs(vBlk.first() - lastV) <= dvTol);
-                    if (!continuous) {
-                        // Duplicate last x for NaN break to keep x monotonic.
-                        tOut.append(lastT);
-                        vOut.append(std::numeric_limits<double>::quiet_NaN());
-                    }
-                }
-                tOut += tBlk; vOut += vBlk; lastT = tBlk.last(); lastV = vBlk.last(); haveLast = true;
-            }
-            continue;
+            cached = segments.insert(i, segment);
         }
+        appendBlock(cached->t.constData(), cached->v.constData(), int(cached->t.size()));
     }
+    flushEnvelope();
 }
 
 QPair<double,double> PulseqLoader::getGradGlobalRange(int channel)
@@ -1791,10 +2609,11 @@ QPair<double,double> PulseqLoader::getGradGlobalRange(int channel)
 
 bool PulseqLoader::sampleRFAtTime(double time, int blockIdx, double& ampHzOut, double& phaseRadOut) const
 {
+    QMutexLocker viewportLock(&m_viewportMutex);
     ampHzOut = 0.0; phaseRadOut = 0.0;
     if (blockIdx < 0 || blockIdx + 1 >= vecBlockEdges.size()) return false;
-    if (blockIdx >= static_cast<int>(m_vecDecodeSeqBlocks.size())) return false;
-    SeqBlock* blk = m_vecDecodeSeqBlocks[blockIdx];
+    if (blockIdx >= static_cast<int>(m_decodedBlocks.size())) return false;
+    const std::shared_ptr<SeqBlock> blk = m_decodedBlocks.block(blockIdx);
     if (!blk || !blk->isRF()) return false;
 
     const RFEvent& rf = blk->GetRFEvent();
@@ -1814,12 +2633,12 @@ bool PulseqLoader::sampleRFAtTime(double time, int blockIdx, double& ampHzOut, d
     // However, cached entry should exist if rendered. If not, we can't update cache.
     // Solution: Look up in cache directly. If missing, default to safe assumption (not real-like) or re-scan.
     // For status bar (mouse hover), it's likely already rendered.
-    QString key = rfPhKey(rf.phaseShape, rf.timeShape, RFLength);
+    const quint64 key = shapeKey(rf.phaseShape, rf.timeShape);
     bool isRealLike = false; // Default safe
     // We need access to m_rfPhCache. It is mutable? No.
     // We can cast away constness if we really need to update cache, but cleaner to check if exists.
     auto it = m_rfPhCache.find(key);
-    if (it != m_rfPhCache.end()) {
+    if (it != m_rfPhCache.end() && it.value().length == RFLength) {
         isRealLike = it.value().isRealLike;
     } else {
         // If not cached, do quick scan? Or just assume complex?
@@ -1877,8 +2696,8 @@ bool PulseqLoader::sampleGradAtTime(int channel, double time, int blockIdx, doub
 {
     gradOutHzPerM = 0.0;
     if (blockIdx < 0 || blockIdx + 1 >= vecBlockEdges.size()) return false;
-    if (blockIdx >= static_cast<int>(m_vecDecodeSeqBlocks.size())) return false;
-    SeqBlock* blk = m_vecDecodeSeqBlocks[blockIdx];
+    if (blockIdx >= static_cast<int>(m_decodedBlocks.size())) return false;
+    const std::shared_ptr<SeqBlock> blk = m_decodedBlocks.block(blockIdx);
     if (!blk) return false;
     bool hasGradient = blk->isTrapGradient(channel) || blk->isArbitraryGradient(channel) || blk->isExtTrapGradient(channel);
     if (!hasGradient) return false;
@@ -1966,103 +2785,36 @@ bool PulseqLoader::sampleGradAtTime(int channel, double time, int blockIdx, doub
 
 void PulseqLoader::downsampleMinMax(const QVector<float>& src, int buckets, QVector<int>& outIdxMin, QVector<int>& outIdxMax) const
 {
-    outIdxMin.clear(); outIdxMax.clear();
-    int n = src.size();
-    if (n == 0 || buckets <= 0) return;
-    if (n <= 2 * buckets) {
-        outIdxMin.reserve(n); outIdxMax.reserve(n);
-        for (int i = 0; i < n; ++i) { outIdxMin.append(i); outIdxMax.append(i); }
-        return;
-    }
-    double bw = double(n) / double(buckets);
-    int idx = 0;
-    for (int b = 0; b < buckets; ++b) {
-        double start = b * bw;
-        double end = (b + 1 == buckets) ? n : (b + 1) * bw;
-        int i0 = int(std::floor(start));
-        int i1 = int(std::floor(end));
-        if (i0 >= n) i0 = n - 1;
-        if (i1 <= i0) i1 = std::min(n, i0 + 1);
-        float mn = std::numeric_limits<float>::infinity(); int iMin = i0;
-        float mx = -std::numeric_limits<float>::infinity(); int iMax = i0;
-        for (int i = i0; i < i1; ++i) {
-            float v = src[i];
-            if (std::isnan(v)) continue;
-            if (v < mn) { mn = v; iMin = i; }
-            if (v > mx) { mx = v; iMax = i; }
-        }
-        outIdxMin.append(iMin);
-        outIdxMax.append(iMax);
-        idx = i1;
-    }
+    DecimationKernels::bucketMinMax(src, buckets, outIdxMin, outIdxMax);
 }
 
 void PulseqLoader::lttbDownsampleUniform(const QVector<float>& src, double tStart, double dt, int targetPoints,
                                QVector<double>& tOut, QVector<double>& vOut) const
 {
-    tOut.clear(); vOut.clear();
-    int n = src.size();
-    if (n <= 0 || targetPoints <= 0) return;
-    if (n <= targetPoints) {
-        tOut.reserve(n); vOut.reserve(n);
-        for (int i=0;i<n;++i){ tOut.append(tStart + i*dt); vOut.append(double(src[i])); }
-        return;
-    }
-    tOut.reserve(targetPoints); vOut.reserve(targetPoints);
-    // Always include first point
-    tOut.append(tStart); vOut.append(double(src[0]));
-    if (targetPoints == 1) return;
-    if (targetPoints == 2) {
-        tOut.append(tStart + (n-1)*dt); vOut.append(double(src[n-1]));
-        return;
-    }
-    int buckets = targetPoints - 2;
-    int bucketSize = (n - 2) / (buckets == 0 ? 1 : buckets);
-    if (bucketSize <= 0) bucketSize = 1;
-    int a = 0; // prev chosen index
-    for (int b = 0; b < buckets; ++b) {
-        int start = 1 + b*bucketSize;
-        int end = (b==buckets-1 ? n-1 : std::min(n-1, start + bucketSize));
-        // Next bucket avg index
-        int nextStart = end;
-        int nextEnd = (b==buckets-1 ? n-1 : std::min(n-1, end + bucketSize));
-        double avgX = 0.0, avgY = 0.0; int count = 0;
-        for (int i = nextStart; i < nextEnd; ++i) { avgX += (tStart + i*dt); avgY += double(src[i]); ++count; }
-        if (count == 0) { avgX = tStart + (nextStart)*dt; avgY = double(src[std::min(nextStart, n-1)]); }
-        double maxArea = -1.0; int maxIndex = start;
-        double ax = tStart + a*dt; double ay = double(src[a]);
-        for (int i = start; i < end; ++i) {
-            double bx = tStart + i*dt; double by = double(src[i]);
-            double cx = avgX; double cy = avgY;
-            double area = std::abs((ax - cx)*(by - ay) - (ax - bx)*(cy - ay));
-            if (area > maxArea) { maxArea = area; maxIndex = i; }
-        }
-        tOut.append(tStart + maxIndex*dt);
-        vOut.append(double(src[maxIndex]));
-        a = maxIndex;
-    }
-    // include last
-    tOut.append(tStart + (n-1)*dt);
-    vOut.append(double(src[n-1]));
+    DecimationKernels::lttbUniform(src, tStart, dt, targetPoints, tOut, vOut);
 }
 
 void PulseqLoader::getRfViewportDecimated(double visibleStart, double visibleEnd, int pixelWidth,
                                           QVector<double>& tAmp, QVector<double>& vAmp,
-                                          QVector<double>& tPh, QVector<double>& vPh)
+                                          QVector<double>& tPh, QVector<double>& vPh, double gamma)
 {
+    QMutexLocker viewportLock(&m_viewportMutex);
     tAmp.clear(); vAmp.clear(); tPh.clear(); vPh.clear();
-    if (m_vecDecodeSeqBlocks.empty() || vecBlockEdges.isEmpty() || pixelWidth <= 0) return;
+    if (m_decodedBlocks.empty() || vecBlockEdges.isEmpty() || pixelWidth <= 0) return;
 
     // Find visible block range
-    int startBlock = 0;
-    int endBlock = int(vecBlockEdges.size()) - 2;
-    for (int i = 0; i < vecBlockEdges.size() - 1; ++i) {
-        if (vecBlockEdges[i + 1] > visibleStart) { startBlock = i; break; }
-    }
-    for (int i = int(vecBlockEdges.size()) - 2; i >= startBlock; --i) {
-        if (vecBlockEdges[i] < visibleEnd) { endBlock = i; break; }
+    int startBlock = 0, endBlock = -1;
+    if (!findBlockRange(visibleStart, visibleEnd, startBlock, endBlock)) return;
+
+    // More blocks than pixels in view: per-pixel envelopes from the min/max pyramids
+    const MinMaxPyramid* ampPyramid = waveformPyramid(PyramidRfAmp, visibleStart, visibleEnd, pixelWidth, endBlock - startBlock + 1, gamma);
+    const MinMaxPyramid* phPyramid = ampPyramid ? waveformPyramid(PyramidRfPhase, visibleStart, visibleEnd, pixelWidth, endBlock - startBlock + 1, gamma) : nullptr;
+    if (ampPyramid && phPyramid)
+    {
+        ampPyramid->query(visibleStart, visibleEnd, pixelWidth, tAmp, vAmp);
+        phPyramid->query(visibleStart, visibleEnd, pixelWidth, tPh, vPh);
+        return;
     }
-    if (startBlock > endBlock) return;
 
     const double window = std::max(1e-9, visibleEnd - visibleStart);
 
@@ -2072,12 +2824,10 @@ void PulseqLoader::getRfViewportDecimated(double visibleStart, double visibleEnd
 
     // Global decimation gating (heavy-only):
     const int DECIMATE_TOTAL_THRESHOLD_RF = 120000; // conservative; for very large windows
-    long long totalRfSamples = 0;
-    for (int i = startBlock; i <= endBlock; ++i) {
-        SeqBlock* blk = m_vecDecodeSeqBlocks[i];
-        if (!blk || !blk->isRF()) continue;
-        totalRfSamples += std::max(0, blk->GetRFLength());
-    }
+    const SequenceTable::RfColumns& rfRows = m_sequenceTable.rf;
+    int firstRow = 0, endRow = 0;
+    SequenceTable::rowRange(rfRows, startBlock, endBlock, firstRow, endRow);
+    const long long totalRfSamples = SequenceTable::samplesIn(rfRows, firstRow, endRow);
     bool allowDecimateRF = (totalRfSamples > DECIMATE_TOTAL_THRESHOLD_RF);
     // Zoom-in gating: if overall points-per-pixel is low, render full detail regardless of total
     if (pixelWidth > 0) {
@@ -2085,52 +2835,120 @@ void PulseqLoader::getRfViewportDecimated(double visibleStart, double visibleEnd
         if (pppTotal <= 2.0) allowDecimateRF = false;
     }
 
-    for (int i = startBlock; i <= endBlock; ++i) {
-        SeqBlock* blk = m_vecDecodeSeqBlocks[i];
-        if (!blk || !blk->isRF()) continue;
-        RFEvent& rf = blk->GetRFEvent();
-        int RFLength = blk->GetRFLength();
+    // Decimated RF of blocks still in view since an earlier viewport with the same widths (and gamma)
+    QHash<int, RfViewportSegment>& segments =
+        viewportSegments(m_rfSegmentSets, ViewportSegmentParams{window, pixelWidth, allowDecimateRF, gamma});
+    pruneViewportSegments(segments, startBlock, endBlock);
+
+    for (int r = firstRow; r < endRow; ++r) {
+        const int i = rfRows.block[r];
+        const int RFLength = rfRows.length[r];
         if (RFLength <= 0) continue;
-        float dwell = blk->GetRFDwellTime();
-        float* rfList = blk->GetRFAmplitudePtr();
-        float* phaseList = blk->GetRFPhasePtr();
-        const double tStart = vecBlockEdges[i] + rf.delay * tFactor;
+        const float dwell = rfRows.dwell[r];
+        const double amplitude = double(rfRows.amplitude[r]);
+        const double tStart = vecBlockEdges[i] + rfRows.delay[r] * tFactor;
         const double dt = dwell * tFactor;
         const double duration = RFLength * dt;
         // Skip blocks entirely outside range
         if (tStart >= visibleEnd || (tStart + duration) <= visibleStart) continue;
-        // Allocate pixels proportional to duration
-        int pxForBlock = std::max(1, int(std::round(duration / window * pixelWidth)));
-
-        const RFAmpEntry& entryA = ensureRfAmpCached(rfList, RFLength, rf.magShape, rf.timeShape);
-        // Build amplitude block data (prefer LTTB over min-max)
-        QVector<double> tAmpBlk, vAmpBlk;
-        double ppp = (pxForBlock > 0) ? double(RFLength) / double(pxForBlock) : double(RFLength);
-        if (!allowDecimateRF || RFLength <= 64 || ppp <= 1.2) {
-            tAmpBlk.reserve(RFLength); vAmpBlk.reserve(RFLength);
-            for (int ii=0;ii<RFLength;++ii){ tAmpBlk.append(tStart + ii*dt); vAmpBlk.append(double(entryA.ampNorm[ii]) * double(rf.amplitude)); }
-        } else {
-            int target = std::min(RFLength, std::min(10000, int(std::round(pxForBlock*2.0))));
-            if (target <= 3 || pxForBlock <= 2) {
-                // Ultra-narrow pulse in pixels: sample around peak to preserve Gaussian shape
-                int iPeak = (entryA.peakIndex >= 0 && entryA.peakIndex < RFLength) ? entryA.peakIndex : RFLength/2;
-                auto clampIndex = [&](int idx){ return std::max(0, std::min(RFLength-1, idx)); };
-                QSet<int> idxs;
-                idxs.insert(0);
-                idxs.insert(clampIndex((int)std::floor(0.25 * (RFLength-1))));
-                idxs.insert(clampIndex(iPeak-1));
-                idxs.insert(clampIndex(iPeak));
-                idxs.insert(clampIndex(iPeak+1));
-                idxs.insert(clampIndex((int)std::floor(0.75 * (RFLength-1))));
-                idxs.insert(RFLength-1);
-                QList<int> sorted = QList<int>(idxs.constBegin(), idxs.constEnd());
-                std::sort(sorted.begin(), sorted.end());
-                tAmpBlk.reserve(sorted.size()); vAmpBlk.reserve(sorted.size());
-                for (int ii : sorted){ tAmpBlk.append(tStart + ii*dt); vAmpBlk.append(double(entryA.ampNorm[ii]) * double(rf.amplitude)); }
+        auto cached = segments.constFind(i);
+        if (cached == segments.constEnd()) {
+            // Shape samples live in the decoded block; only a segment not built yet needs them
+            const std::shared_ptr<SeqBlock> blk = m_decodedBlocks.block(i);
+            if (!blk) continue;
+            const float* rfList = blk->GetRFAmplitudePtr();
+            const float* phaseList = blk->GetRFPhasePtr();
+            RfViewportSegment segment;
+            // Allocate pixels proportional to duration
+            int pxForBlock = std::max(1, int(std::round(duration / window * pixelWidth)));
+
+            const RFAmpEntry& entryA = ensureRfAmpCached(rfList, RFLength, rfRows.magShape[r], rfRows.timeShape[r]);
+            // Build amplitude block data (prefer LTTB over min-max)
+            QVector<double>& tAmpBlk = segment.tAmp;
+            QVector<double>& vAmpBlk = segment.vAmp;
+            double ppp = (pxForBlock > 0) ? double(RFLength) / double(pxForBlock) : double(RFLength);
+            if (!allowDecimateRF || RFLength <= 64 || ppp <= 1.2) {
+                tAmpBlk.reserve(RFLength); vAmpBlk.reserve(RFLength);
+                for (int ii=0;ii<RFLength;++ii){ tAmpBlk.append(tStart + ii*dt); vAmpBlk.append(double(entryA.ampNorm[ii]) * amplitude); }
+            } else {
+                int target = std::min(RFLength, std::min(10000, int(std::round(pxForBlock*2.0))));
+                if (target <= 3 || pxForBlock <= 2) {
+                    // Ultra-narrow pulse in pixels: sample around peak to preserve Gaussian shape
+                    int iPeak = (entryA.peakIndex >= 0 && entryA.peakIndex < RFLength) ? entryA.peakIndex : RFLength/2;
+                    auto clampIndex = [&](int idx){ return std::max(0, std::min(RFLength-1, idx)); };
+                    QSet<int> idxs;
+                    idxs.insert(0);
+                    idxs.insert(clampIndex((int)std::floor(0.25 * (RFLength-1))));
+                    idxs.insert(clampIndex(iPeak-1));
+                    idxs.insert(clampIndex(iPeak));
+                    idxs.insert(clampIndex(iPeak+1));
+                    idxs.insert(clampIndex((int)std::floor(0.75 * (RFLength-1))));
+                    idxs.insert(RFLength-1);
+                    QList<int> sorted = QList<int>(idxs.constBegin(), idxs.constEnd());
+                    std::sort(sorted.begin(), sorted.end());
+                    tAmpBlk.reserve(sorted.size()); vAmpBlk.reserve(sorted.size());
+                    for (int ii : sorted){ tAmpBlk.append(tStart + ii*dt); vAmpBlk.append(double(entryA.ampNorm[ii]) * amplitude); }
+                } else {
+                    QVector<double> dT, dV; lttbDownsampleUniform(entryA.ampNorm, tStart, dt, target, dT, dV);
+                    tAmpBlk = dT; vAmpBlk.reserve(dV.size()); for (double val : dV){ vAmpBlk.append(val * amplitude); }
+                }
+            }
+            // Produce phase series similarly
+            // Phase block data + continuity
+            QVector<double>& tPhBlk = segment.tPh;
+            QVector<double>& vPhBlk = segment.vPh;
+            const RFPhEntry& entryP = ensureRfPhCached(phaseList, RFLength, rfRows.phaseShape[r], rfRows.timeShape[r]);
+            double pppPh = (pxForBlock > 0) ? double(RFLength) / double(pxForBlock) : double(RFLength);
+            if (!allowDecimateRF || RFLength <= 64 || pppPh <= 1.2) {
+                tPhBlk.reserve(RFLength); vPhBlk.reserve(RFLength);
+                for (int ii=0;ii<RFLength;++ii){ tPhBlk.append(tStart + ii*dt); vPhBlk.append(double(entryP.phNorm[ii])); }
             } else {
-                QVector<double> dT, dV; lttbDownsampleUniform(entryA.ampNorm, tStart, dt, target, dT, dV);
-                tAmpBlk = dT; vAmpBlk.reserve(dV.size()); for (double val : dV){ vAmpBlk.append(val * double(rf.amplitude)); }
+                int target = std::min(RFLength, std::min(10000, int(std::round(pxForBlock*2.0))));
+                QVector<double> dT, dV; lttbDownsampleUniform(entryP.phNorm, tStart, dt, target, dT, dV);
+                tPhBlk = dT; vPhBlk = dV;
+            }
+
+            // Apply full phase offsets (MATLAB-matching)
+            {
+                double fullFreqOff = rfRows.freqOffset[r] + rfRows.freqPPM[r] * 1e-6 * gamma * m_b0Tesla;
+                double fullPhaseOff = rfRows.phaseOffset[r] + rfRows.phasePPM[r] * 1e-6 * gamma * m_b0Tesla;
+            
+                // Check if logic shape is "Real" (only 0 or pi phases, ignoring small numerical noise)
+                // MATLAB uses angle(s * sign(real(s))) which maps pi -> 0 for real pulses (negative lobes).
+                bool isRealLike = entryP.isRealLike;
+
+                // tStart is in display units. We need time in seconds from the start of the pulse for freq offset.
+                // ii * dt -> gives time in display units from start of pulse.
+                // Divide by tFactor to get internal units (us), then * 1e-6 to get seconds.
+            
+                double minPh = 1e9, maxPh = -1e9;
+                for (int k = 0; k < vPhBlk.size(); ++k) {
+                    double t_display = tPhBlk[k];
+                    // Convert display duration to seconds: (t_display - tStart) / tFactor -> us -> * 1e-6 -> seconds
+                    double t_local_sec = ((t_display - tStart) / tFactor) * 1e-6;
+                
+                    // If real-like, ignore the shape phase (treat pi as 0, i.e. negative amplitude)
+                    // This matches MATLAB's sign(real(s)) correction.
+                    double phaseVal = isRealLike ? 0.0 : vPhBlk[k];
+                
+                    // Add linear phase evolution: 2*pi * t * freq
+                    double totalPhase = phaseVal + fullPhaseOff + 2.0 * M_PI * t_local_sec * fullFreqOff;
+                
+                    // Wrap to [-pi, pi]
+                    double wrapped = std::atan2(std::sin(totalPhase), std::cos(totalPhase));
+                    vPhBlk[k] = wrapped;
+                
+                    if (wrapped < minPh) minPh = wrapped;
+                    if (wrapped > maxPh) maxPh = wrapped;
+                }
+                // Debug print once per block (throttle maybe?)
+                // Debug print once per block (throttle maybe?)
+                // static int dbgCount = 0; if (dbgCount++ < 20) 
+                // qDebug() << "RF Block" << i << "isRealLike:" << isRealLike << "Offset:" << fullPhaseOff 
+                //          << "Freq:" << fullFreqOff << "MinPh:" << minPh << "MaxPh:" << maxPh << "B0:" << m_b0Tesla;
+
             }
+            cached = segments.insert(i, segment);
         }
         // Continuity handling for amplitude
         auto appendWithBreakAmp = [&](const QVector<double>& tB, const QVector<double>& vB){
@@ -2149,7 +2967,7 @@ void PulseqLoader::getRfViewportDecimated(double visibleStart, double visibleEnd
                 lastTAmp = tB.last(); lastVAmp = std::numeric_limits<double>::quiet_NaN(); haveLastAmp = true;
             }
         };
-        appendWithBreakAmp(tAmpBlk, vAmpBlk);
+        appendWithBreakAmp(cached->tAmp, cached->vAmp);
         // Keep block separation with NaN break; duplicate last x to preserve sorted order
         if (!tAmp.isEmpty()) {
             double tEnd = tStart + std::max(0, RFLength-1) * dt;
@@ -2158,61 +2976,6 @@ void PulseqLoader::getRfViewportDecimated(double visibleStart, double visibleEnd
             vAmp.append(std::numeric_limits<double>::quiet_NaN());
         }
 
-        // Produce phase series similarly
-        // Phase block data + continuity
-        QVector<double> tPhBlk, vPhBlk;
-        const RFPhEntry& entryP = ensureRfPhCached(phaseList, RFLength, rf.phaseShape, rf.timeShape);
-        double pppPh = (pxForBlock > 0) ? double(RFLength) / double(pxForBlock) : double(RFLength);
-        if (!allowDecimateRF || RFLength <= 64 || pppPh <= 1.2) {
-            tPhBlk.reserve(RFLength); vPhBlk.reserve(RFLength);
-            for (int ii=0;ii<RFLength;++ii){ tPhBlk.append(tStart + ii*dt); vPhBlk.append(double(entryP.phNorm[ii])); }
-        } else {
-            int target = std::min(RFLength, std::min(10000, int(std::round(pxForBlock*2.0))));
-            QVector<double> dT, dV; lttbDownsampleUniform(entryP.phNorm, tStart, dt, target, dT, dV);
-            tPhBlk = dT; vPhBlk = dV;
-        }
-
-        // Apply full phase offsets (MATLAB-matching)
-        {
-            double gamma = Settings::getInstance().getGamma();
-            double fullFreqOff = rf.freqOffset + rf.freqPPM * 1e-6 * gamma * m_b0Tesla;
-            double fullPhaseOff = rf.phaseOffset + rf.phasePPM * 1e-6 * gamma * m_b0Tesla;
-            
-            // Check if logic shape is "Real" (only 0 or pi phases, ignoring small numerical noise)
-            // MATLAB uses angle(s * sign(real(s))) which maps pi -> 0 for real pulses (negative lobes).
-            bool isRealLike = entryP.isRealLike;
-
-            // tStart is in display units. We need time in seconds from the start of the pulse for freq offset.
-            // ii * dt -> gives time in display units from start of pulse.
-            // Divide by tFactor to get internal units (us), then * 1e-6 to get seconds.
-            
-            double minPh = 1e9, maxPh = -1e9;
-            for (int k = 0; k < vPhBlk.size(); ++k) {
-                double t_display = tPhBlk[k];
-                // Convert display duration to seconds: (t_display - tStart) / tFactor -> us -> * 1e-6 -> seconds
-                double t_local_sec = ((t_display - tStart) / tFactor) * 1e-6;
-                
-                // If real-like, ignore the shape phase (treat pi as 0, i.e. negative amplitude)
-                // This matches MATLAB's sign(real(s)) correction.
-                double phaseVal = isRealLike ? 0.0 : vPhBlk[k];
-                
-                // Add linear phase evolution: 2*pi * t * freq
-                double totalPhase = phaseVal + fullPhaseOff + 2.0 * M_PI * t_local_sec * fullFreqOff;
-                
-                // Wrap to [-pi, pi]
-                double wrapped = std::atan2(std::sin(totalPhase), std::cos(totalPhase));
-                vPhBlk[k] = wrapped;
-                
-                if (wrapped < minPh) minPh = wrapped;
-                if (wrapped > maxPh) maxPh = wrapped;
-            }
-            // Debug print once per block (throttle maybe?)
-            // Debug print once per block (throttle maybe?)
-            // static int dbgCount = 0; if (dbgCount++ < 20) 
-            // qDebug() << "RF Block" << i << "isRealLike:" << isRealLike << "Offset:" << fullPhaseOff 
-            //          << "Freq:" << fullFreqOff << "MinPh:" << minPh << "MaxPh:" << maxPh << "B0:" << m_b0Tesla;
-
-        }
         auto appendWithBreakPh = [&](const QVector<double>& tB, const QVector<double>& vB){
             if (tB.isEmpty()) return;
             if (haveLastPh) {
@@ -2225,7 +2988,7 @@ void PulseqLoader::getRfViewportDecimated(double visibleStart, double visibleEnd
             for (int idx = vB.size()-1; idx >= 0; --idx){ if (!std::isnan(vB[idx])) { lastTPh = tB[idx]; lastVPh = vB[idx]; haveLastPh = true; break; } }
             if (!haveLastPh) { lastTPh = tB.last(); lastVPh = std::numeric_limits<double>::quiet_NaN(); haveLastPh = true; }
         };
-        appendWithBreakPh(tPhBlk, vPhBlk);
+        appendWithBreakPh(cached->tPh, cached->vPh);
     }
 }
 
@@ -2251,20 +3014,8 @@ QPair<double,double> PulseqLoader::getRfGlobalRangeAmp()
 
 QPair<double,double> PulseqLoader::getRfGlobalRangePh()
 {
-    double mn = std::numeric_limits<double>::infinity();
-    double mx = -std::numeric_limits<double>::infinity();
-    QSet<QString> seen;
-    for (SeqBlock* blk : m_vecDecodeSeqBlocks) {
-        if (!blk || !blk->isRF()) continue;
-        RFEvent& rf = blk->GetRFEvent();
-        int RFLength = blk->GetRFLength(); if (RFLength <= 0) continue;
-        float* rfList = blk->GetRFAmplitudePtr();
-        float* phaseList = blk->GetRFPhasePtr();
-        QString key = rfPhKey(rf.phaseShape, rf.timeShape, RFLength);
-        if (seen.contains(key)) continue; seen.insert(key);
-        const RFPhEntry& eP = ensureRfPhCached(phaseList, RFLength, rf.phaseShape, rf.timeShape);
-        if (eP.phMin < mn) mn = eP.phMin; if (eP.phMax > mx) mx = eP.phMax;
-    }
+    // Aggregated over all phase shapes by the load pass; no block access needed
+    double mn = m_rfPhaseMin, mx = m_rfPhaseMax;
     if (!std::isfinite(mn) || !std::isfinite(mx)) { mn = -1.0; mx = 1.0; }
     return qMakePair(mn, mx);
 }
@@ -2272,19 +3023,22 @@ QPair<double,double> PulseqLoader::getRfGlobalRangePh()
 // (removed getRfViewportRangeAmp; y-axis ranges are computed once at load time)
 
 // ADC Phase viewport rendering (MATLAB-matching formula: angle(exp(i*phase)*exp(i*2*pi*t*freq)))
-// Three optimization strategies to keep rendering fast:
+// Four optimization strategies to keep rendering fast:
 //   1. Pixel-aware decimation: stride through samples when points-per-pixel > 2
 //   2. Viewport caching: if visibleStart/visibleEnd/pixelWidth unchanged, return cached result
 //   3. NaN breaks between ADC blocks: enables lsLine rendering (10x faster than scatter dots)
 //      while preventing lines from connecting unrelated ADC events
+//   4. Min/max pyramid: viewports spanning more blocks than pixels are answered per pixel
 void PulseqLoader::getAdcPhaseViewport(double visibleStart, double visibleEnd, int pixelWidth,
-                                       QVector<double>& tOut, QVector<double>& vOut)
+                                       QVector<double>& tOut, QVector<double>& vOut, double gamma)
 {
+    QMutexLocker viewportLock(&m_viewportMutex);
     // Viewport cache: return cached data if viewport/pixelWidth unchanged
     if (m_adcPhaseCache.valid &&
         m_adcPhaseCache.visibleStart == visibleStart &&
         m_adcPhaseCache.visibleEnd == visibleEnd &&
-        m_adcPhaseCache.pixelWidth == pixelWidth)
+        m_adcPhaseCache.pixelWidth == pixelWidth &&
+        m_adcPhaseCache.gamma == gamma)
     {
         tOut = m_adcPhaseCache.tData;
         vOut = m_adcPhaseCache.vData;
@@ -2292,22 +3046,24 @@ void PulseqLoader::getAdcPhaseViewport(double visibleStart, double visibleEnd, i
     }
 
     tOut.clear(); vOut.clear();
-    if (m_vecDecodeSeqBlocks.empty() || vecBlockEdges.isEmpty() || pixelWidth <= 0) return;
+    if (m_decodedBlocks.empty() || vecBlockEdges.isEmpty() || pixelWidth <= 0) return;
 
     // Find visible block range via binary search
-    auto itStart = std::lower_bound(vecBlockEdges.begin(), vecBlockEdges.end(), visibleStart);
-    int startBlock = std::max(0, int(std::distance(vecBlockEdges.begin(), itStart)) - 1);
-    
-    double gamma = Settings::getInstance().getGamma();
+    int startBlock = 0, endBlock = -1;
+    if (!findBlockRange(visibleStart, visibleEnd, startBlock, endBlock)) return;
 
-    // Count total visible ADC samples for global decimation gating (like RF approach)
-    long long totalAdcSamples = 0;
-    for (int i = startBlock; i < vecBlockEdges.size() - 1; ++i) {
-        if (vecBlockEdges[i] > visibleEnd) break;
-        SeqBlock* blk = m_vecDecodeSeqBlocks[i];
-        if (!blk || !blk->isADC()) continue;
-        totalAdcSamples += blk->GetADCEvent().numSamples;
+    // More blocks than pixels in view: per-pixel envelope from the min/max pyramid
+    if (const MinMaxPyramid* pyramid = waveformPyramid(PyramidAdcPhase, visibleStart, visibleEnd, pixelWidth, endBlock - startBlock + 1, gamma))
+    {
+        pyramid->query(visibleStart, visibleEnd, pixelWidth, tOut, vOut);
+        return;
     }
+
+    // Count total visible ADC samples for global decimation gating (like RF approach)
+    const SequenceTable::AdcColumns& adcRows = m_sequenceTable.adc;
+    int firstRow = 0, endRow = 0;
+    SequenceTable::rowRange(adcRows, startBlock, endBlock, firstRow, endRow);
+    const long long totalAdcSamples = SequenceTable::samplesIn(adcRows, firstRow, endRow);
     if (totalAdcSamples == 0) return;
 
     // Determine stride based on points-per-pixel (ppp), mirroring RF decimation logic
@@ -2321,20 +3077,16 @@ void PulseqLoader::getAdcPhaseViewport(double visibleStart, double visibleEnd, i
 
     // Emit points with computed stride, NaN-break between ADC blocks for line plot
     bool emittedAny = false;
-    for (int i = startBlock; i < vecBlockEdges.size() - 1; ++i) {
-        double blockStart = vecBlockEdges[i];
-        if (blockStart > visibleEnd) break;
-        
-        SeqBlock* blk = m_vecDecodeSeqBlocks[i];
-        if (!blk || !blk->isADC()) continue;
-
-        ADCEvent& adc = blk->GetADCEvent();
-        int nSamples = adc.numSamples;
-        double dwell = adc.dwellTime * 1e-9; // ns to seconds
-        double delay = adc.delay * 1e-6;     // us to seconds
+    for (int r = firstRow; r < endRow; ++r) {
+        const int i = adcRows.block[r];
+        const int adcDelay = adcRows.delay[r];
+        const int adcDwell = adcRows.dwell[r];
+        int nSamples = adcRows.numSamples[r];
+        double dwell = adcDwell * 1e-9; // ns to seconds
+        double delay = adcDelay * 1e-6; // us to seconds
         
-        double fullFreqOff = adc.freqOffset + adc.freqPPM * 1e-6 * gamma * m_b0Tesla;
-        double fullPhaseOff = adc.phaseOffset + adc.phasePPM * 1e-6 * gamma * m_b0Tesla;
+        double fullFreqOff = adcRows.freqOffset[r] + adcRows.freqPPM[r] * 1e-6 * gamma * m_b0Tesla;
+        double fullPhaseOff = adcRows.phaseOffset[r] + adcRows.phasePPM[r] * 1e-6 * gamma * m_b0Tesla;
 
         // Insert NaN break before this block to separate from previous block's line
         if (emittedAny) {
@@ -2345,7 +3097,7 @@ void PulseqLoader::getAdcPhaseViewport(double visibleStart, double visibleEnd, i
         bool emittedInBlock = false;
         for (int k = 0; k < nSamples; k += stride) {
             double t_local = delay + (k + 0.5) * dwell; // Center of dwell
-            double t_offset_us = adc.delay + (k + 0.5) * (adc.dwellTime * 1e-3);
+            double t_offset_us = adcDelay + (k + 0.5) * (adcDwell * 1e-3);
             double t_plot = vecBlockEdges[i] + t_offset_us * tFactor;
             
             if (t_plot < visibleStart) continue;
@@ -2365,89 +3117,214 @@ void PulseqLoader::getAdcPhaseViewport(double visibleStart, double visibleEnd, i
     m_adcPhaseCache.visibleStart = visibleStart;
     m_adcPhaseCache.visibleEnd = visibleEnd;
     m_adcPhaseCache.pixelWidth = pixelWidth;
+    m_adcPhaseCache.gamma = gamma;
     m_adcPhaseCache.tData = tOut;
     m_adcPhaseCache.vData = vOut;
     m_adcPhaseCache.valid = true;
 }
 
-void PulseqLoader::buildShapeScaleAggregates()
-{
-    // Reset
-    m_rfAgg.clear();
-    for (int c = 0; c < 3; ++c) {
-        m_gradAgg[c].clear();
-        m_gradTrapMaxPosScale[c] = 0.0;
-        m_gradTrapMinNegScale[c] = 0.0;
-        m_gradExtTrapGlobalMin[c] = std::numeric_limits<double>::infinity();
-        m_gradExtTrapGlobalMax[c] = -std::numeric_limits<double>::infinity();
-    }
-    // Single pass over blocks
-    for (SeqBlock* blk : m_vecDecodeSeqBlocks) {
-        if (!blk) continue;
-        // RF
-        if (blk->isRF()) {
-            RFEvent& rf = blk->GetRFEvent();
-            int RFLength = blk->GetRFLength();
-            if (RFLength > 0) {
-                float* rfList = blk->GetRFAmplitudePtr();
-                const RFAmpEntry& eA = ensureRfAmpCached(rfList, RFLength, rf.magShape, rf.timeShape);
-                QString key = rfAmpKey(rf.magShape, rf.timeShape, RFLength);
-                ScaleAgg& ag = m_rfAgg[key];
-                if (!ag.hasShape) ag.updateShape(eA.ampMin, eA.ampMax);
-                ag.updateScale(double(rf.amplitude));
+// ===== Whole-sequence min/max pyramids =====
+// Long sequences viewed zoomed out cover far more blocks than pixels; walking and decimating every
+// visible block per repaint is what makes panning laggy there. One pass over the blocks records the
+// min/max of each channel into a MinMaxPyramid, which then answers such viewports per pixel.
+
+void PulseqLoader::clearWaveformPyramids()
+{
+    ++m_viewportRevision; // called wherever the viewport data changes
+    for (MinMaxPyramid& pyramid : m_waveformPyramids)
+        pyramid.clear();
+}
+
+const MinMaxPyramid* PulseqLoader::waveformPyramid(int channel, double visibleStart, double visibleEnd,
+                                                    int pixelWidth, int visibleBlocks, double gamma)
+{
+    if (visibleBlocks <= pixelWidth || m_decodedBlocks.empty() || vecBlockEdges.size() < 2) return nullptr;
+
+    // Phases depend on gamma (PPM offsets); rebuild those if it changed in the settings
+    const bool phaseChannel = channel == PyramidRfPhase || channel == PyramidAdcPhase;
+    if (phaseChannel && gamma != m_waveformPyramidGamma)
+    {
+        m_waveformPyramids[PyramidRfPhase].clear();
+        m_waveformPyramids[PyramidAdcPhase].clear();
+        m_waveformPyramidGamma = gamma;
+    }
+
+    MinMaxPyramid& pyramid = m_waveformPyramids[channel];
+    if (!pyramid.isReady()) buildWaveformPyramid(channel, pyramid, gamma);
+    return pyramid.resolves(visibleStart, visibleEnd, pixelWidth) ? &pyramid : nullptr;
+}
+
+void PulseqLoader::buildWaveformPyramid(int channel, MinMaxPyramid& pyramid, double gamma)
+{
+    const int blockCount = int(m_decodedBlocks.size());
+    const int bins = int(std::min<long long>(kMaxPyramidBins, (long long)blockCount * kPyramidBinsPerBlock));
+    pyramid.reset(vecBlockEdges.first(), vecBlockEdges.last(), bins);
+    const double binWidth = pyramid.baseBinWidth();
+
+    double gradRaster_us = 0.0;
+    if (channel >= PyramidGx && channel <= PyramidGz && m_spPulseqSeq)
+    {
+        std::vector<double> def = m_spPulseqSeq->GetDefinition("GradientRasterTime");
+        if (!def.empty() && std::isfinite(def[0]) && def[0] > 0.0) gradRaster_us = def[0] * 1e6;
+    }
+
+    if (channel >= PyramidGx && channel <= PyramidGz)
+    {
+        // Gradients from the event table, drawn as in getGradViewportDecimated
+        const int gradChannel = channel - PyramidGx;
+        const SequenceTable::GradColumns& events = m_sequenceTable.grad[gradChannel];
+        for (int e = 0; e < events.size(); ++e)
+        {
+            const int i = events.block[e];
+            const double tStart = vecBlockEdges[i] + events.delay[e] * tFactor;
+            if (events.kind[e] == SequenceTable::GradTrap)
+            {
+                const double amp = events.amplitude[e];
+                const double t1 = tStart + events.rampUp[e] * tFactor;
+                const double t2 = t1 + events.flat[e] * tFactor;
+                const double t3 = t2 + events.rampDown[e] * tFactor;
+                pyramid.addLine(tStart, 0.0, t1, amp);
+                pyramid.addLine(t1, amp, t2, amp);
+                pyramid.addLine(t2, amp, t3, 0.0);
+            }
+            else if (events.kind[e] == SequenceTable::GradExtTrap)
+            {
+                const int first = events.extFirst[e], n = events.extCount[e];
+                auto timeAt = [&](int k) { return tStart + events.extTime[first + k] * tFactor; };
+                pyramid.addRange(timeAt(0), timeAt(0), events.extValue[first], events.extValue[first]);
+                for (int k = 1; k < n; ++k)
+                    pyramid.addLine(timeAt(k - 1), events.extValue[first + k - 1], timeAt(k), events.extValue[first + k]);
+            }
+            else
+            {
+                const std::shared_ptr<SeqBlock> blk = m_decodedBlocks.block(i);
+                if (!blk || gradRaster_us <= 0.0) continue;
+                const GradEvent& grad = blk->GetGradEvent(gradChannel);
+                const int numSamples = blk->GetArbGradNumSamples(gradChannel);
+                const float* shapePtr = blk->GetArbGradShapePtr(gradChannel);
+                if (numSamples <= 0 || !shapePtr) continue;
+                const GradShapeEntry& entry = ensureGradCached(shapePtr, numSamples, grad.waveShape, grad.timeShape);
+                const double amp = grad.amplitude;
+                const double dt = gradRaster_us * tFactor;
+                const double tLast = tStart + (numSamples - 1) * dt;
+                if (tLast - tStart < binWidth)
+                {
+                    pyramid.addRange(tStart, tLast, std::min(entry.vMin * amp, entry.vMax * amp), std::max(entry.vMin * amp, entry.vMax * amp));
+                    continue;
+                }
+                for (int k = 1; k < numSamples; ++k)
+                    pyramid.addLine(tStart + (k - 1) * dt, entry.norm[k - 1] * amp, tStart + k * dt, entry.norm[k] * amp);
             }
         }
-        // Gradients per channel
-        for (int ch = 0; ch < 3; ++ch) {
-            bool hasG = blk->isTrapGradient(ch) || blk->isArbitraryGradient(ch) || blk->isExtTrapGradient(ch);
-            if (!hasG) continue;
-            const GradEvent& grad = blk->GetGradEvent(ch);
-            if (blk->isTrapGradient(ch)) {
-                double s = double(grad.amplitude);
-                if (s >= 0) m_gradTrapMaxPosScale[ch] = std::max(m_gradTrapMaxPosScale[ch], s);
-                else        m_gradTrapMinNegScale[ch] = std::min(m_gradTrapMinNegScale[ch], s);
+        pyramid.finalize();
+        return;
+    }
+
+    if (channel == PyramidRfAmp || channel == PyramidRfPhase)
+    {
+        const SequenceTable::RfColumns& rfRows = m_sequenceTable.rf;
+        for (int r = 0; r < rfRows.size(); ++r)
+        {
+            const int i = rfRows.block[r];
+            const int RFLength = rfRows.length[r];
+            const std::shared_ptr<SeqBlock> blk = m_decodedBlocks.block(i);
+            if (RFLength <= 0 || !blk) continue;
+            // Sample times as in getRfViewportDecimated
+            const double tStart = vecBlockEdges[i] + rfRows.delay[r] * tFactor;
+            const double dt = rfRows.dwell[r] * tFactor;
+            const double tLast = tStart + (RFLength - 1) * dt;
+            const bool oneBin = (tLast - tStart) < binWidth;
+            if (channel == PyramidRfAmp)
+            {
+                const RFAmpEntry& entryA = ensureRfAmpCached(blk->GetRFAmplitudePtr(), RFLength, rfRows.magShape[r], rfRows.timeShape[r]);
+                const double amp = rfRows.amplitude[r];
+                if (oneBin)
+                {
+                    pyramid.addRange(tStart, tLast, std::min(entryA.ampMin * amp, entryA.ampMax * amp),
+                                     std::max(entryA.ampMin * amp, entryA.ampMax * amp));
+                    continue;
+                }
+                for (int k = 1; k < RFLength; ++k)
+                    pyramid.addLine(tStart + (k - 1) * dt, entryA.ampNorm[k - 1] * amp, tStart + k * dt, entryA.ampNorm[k] * amp);
                 continue;
             }
-            if (blk->isArbitraryGradient(ch)) {
-                int numSamples = blk->GetArbGradNumSamples(ch);
-                const float* shapePtr = blk->GetArbGradShapePtr(ch);
-                if (numSamples > 0 && shapePtr) {
-                    const GradShapeEntry& e = ensureGradCached(shapePtr, numSamples, grad.waveShape, grad.timeShape);
-                    QString key = gradKey(grad.waveShape, grad.timeShape, numSamples);
-                    ScaleAgg& ag = m_gradAgg[ch][key];
-                    if (!ag.hasShape) ag.updateShape(e.vMin, e.vMax);
-                    ag.updateScale(double(grad.amplitude));
-                }
+            const RFPhEntry& entryP = ensureRfPhCached(blk->GetRFPhasePtr(), RFLength, rfRows.phaseShape[r], rfRows.timeShape[r]);
+            const double fullFreqOff = rfRows.freqOffset[r] + rfRows.freqPPM[r] * 1e-6 * gamma * m_b0Tesla;
+            const double fullPhaseOff = rfRows.phaseOffset[r] + rfRows.phasePPM[r] * 1e-6 * gamma * m_b0Tesla;
+            const double dwellSec = rfRows.dwell[r] * 1e-6;
+            if (oneBin)
+            {
+                // Shape phase range plus the linear frequency-offset term, then wrapped
+                const double ramp = 2.0 * M_PI * (RFLength - 1) * dwellSec * fullFreqOff;
+                const double shapeMin = entryP.isRealLike ? 0.0 : entryP.phMin;
+                const double shapeMax = entryP.isRealLike ? 0.0 : entryP.phMax;
+                double lo = 0.0, hi = 0.0;
+                wrappedPhaseBounds(shapeMin + fullPhaseOff + std::min(0.0, ramp), shapeMax + fullPhaseOff + std::max(0.0, ramp), lo, hi);
+                pyramid.addRange(tStart, tLast, lo, hi);
                 continue;
             }
-            if (blk->isExtTrapGradient(ch)) {
-                const std::vector<float>& shape = blk->GetExtTrapGradShape(ch);
-                if (!shape.empty()) {
-                    double smin = std::numeric_limits<double>::infinity();
-                    double smax = -std::numeric_limits<double>::infinity();
-                    for (float v : shape) {
-                        if (!std::isnan(v)) { if (v < smin) smin = v; if (v > smax) smax = v; }
-                    }
-                    if (!std::isfinite(smin) || !std::isfinite(smax)) { smin = 0.0; smax = 0.0; }
-                    double scale = double(grad.amplitude);
-                    double cands[2] = { smin * scale, smax * scale };
-                    for (double v : cands) {
-                        if (!std::isfinite(v)) continue;
-                        if (v < m_gradExtTrapGlobalMin[ch]) m_gradExtTrapGlobalMin[ch] = v;
-                        if (v > m_gradExtTrapGlobalMax[ch]) m_gradExtTrapGlobalMax[ch] = v;
-                    }
+            // Same formula as getRfViewportDecimated
+            auto phaseAt = [&](int k) {
+                const double totalPhase = (entryP.isRealLike ? 0.0 : double(entryP.phNorm[k])) + fullPhaseOff
+                                          + 2.0 * M_PI * (k * dwellSec) * fullFreqOff;
+                return std::atan2(std::sin(totalPhase), std::cos(totalPhase));
+            };
+            double prev = phaseAt(0);
+            for (int k = 1; k < RFLength; ++k)
+            {
+                const double cur = phaseAt(k);
+                pyramid.addLine(tStart + (k - 1) * dt, prev, tStart + k * dt, cur);
+                prev = cur;
+            }
+        }
+    }
+
+    if (channel == PyramidAdcPhase)
+    {
+        const SequenceTable::AdcColumns& adcRows = m_sequenceTable.adc;
+        for (int r = 0; r < adcRows.size(); ++r)
+        {
+            const int i = adcRows.block[r];
+            const int nSamples = adcRows.numSamples[r];
+            if (nSamples <= 0) continue;
+            // Sample times and phases as in getAdcPhaseViewport; the phase is linear in time, so each
+            // bin only needs the phases of its first and last sample
+            const int adcDelay = adcRows.delay[r];
+            const int adcDwell = adcRows.dwell[r];
+            const double dwell_us = adcDwell * 1e-3;
+            const double fullFreqOff = adcRows.freqOffset[r] + adcRows.freqPPM[r] * 1e-6 * gamma * m_b0Tesla;
+            const double fullPhaseOff = adcRows.phaseOffset[r] + adcRows.phasePPM[r] * 1e-6 * gamma * m_b0Tesla;
+            auto timeAt = [&](int k) { return vecBlockEdges[i] + (adcDelay + (k + 0.5) * dwell_us) * tFactor; };
+            auto unwrappedPhaseAt = [&](int k) {
+                return fullPhaseOff + 2.0 * M_PI * (adcDelay * 1e-6 + (k + 0.5) * adcDwell * 1e-9) * fullFreqOff;
+            };
+            const double dtPlot = dwell_us * tFactor;
+            int k0 = 0;
+            while (k0 < nSamples)
+            {
+                const int bin = pyramid.binAt(timeAt(k0));
+                int k1 = nSamples - 1;
+                if (dtPlot > 0.0)
+                {
+                    // last sample before the next bin starts
+                    const double kNext = std::ceil((pyramid.binStart(bin + 1) - timeAt(0)) / dtPlot);
+                    if (kNext - 1 < k1) k1 = std::max(k0, int(kNext) - 1);
                 }
-                continue;
+                double lo = 0.0, hi = 0.0;
+                const double p0 = unwrappedPhaseAt(k0), p1 = unwrappedPhaseAt(k1);
+                wrappedPhaseBounds(std::min(p0, p1), std::max(p0, p1), lo, hi);
+                pyramid.addRange(timeAt(k0), timeAt(k1), lo, hi);
+                k0 = k1 + 1;
             }
         }
     }
+    pyramid.finalize();
 }
 
 QList<QPair<QString, int>> PulseqLoader::getActiveLabels(int blockIdx) const
 {
     QList<QPair<QString, int>> result;
-    const LabelSnapshot* snap = labelSnapshotAfterBlock(blockIdx);
-    if (!snap) return result;
+    if (blockIdx < 0 || blockIdx >= m_labels.blockCount()) return result;
 
     struct Spec { QString name; bool isFlag; int id; };
     static const QVector<Spec> specs = {
@@ -2472,15 +3349,16 @@ QList<QPair<QString, int>> PulseqLoader::getActiveLabels(int blockIdx) const
 
         if (s.isFlag)
         {
-            if (s.id < 0 || s.id >= snap->flags.size()) continue;
-            if (snap->flags[s.id]) {
+            bool v = false;
+            if (!m_labels.flagAfterBlock(blockIdx, s.id, v)) continue;
+            if (v) {
                 result.append({s.name, 1});
             }
         }
         else
         {
-            if (s.id < 0 || s.id >= snap->counters.size()) continue;
-            int v = snap->counters[s.id];
+            int v = 0;
+            if (!m_labels.counterAfterBlock(blockIdx, s.id, v)) continue;
             // Show all counters, even if 0, to match user expectation of "current state"
             result.append({s.name, v});
         }
@@ -11,12 +11,22 @@
 #include <QHash>
 #include <limits>
 #include <QSet>
+#include <QPointer>
+#include <QList>
+#include <QRecursiveMutex>
+#include <functional>
 
 #include "ExternalSequence.h" // For ExternalSequence factory and SeqBlock
+#include "BlockLookup.h"
+#include "MinMaxPyramid.h"
+#include "SequenceTable.h"
+#include "DecodedBlockCache.h"
+#include "LabelStore.h"
 
 // Forward declarations
 class MainWindow;
 class EventBlockInfoDialog;
+class QThread;
 
 class PulseqLoader : public QObject
 {
@@ -28,10 +38,14 @@ public:
 
     // Public API for other classes
     bool LoadPulseqFile(const QString& sPulseqFilePath);
+    // Parse and decode on a background thread; progress is reported through the signals below
+    void LoadPulseqFileAsync(const QString& sPulseqFilePath);
+    bool isLoading() const { return m_loadJob != nullptr; }
     void setBlockInfoContent(EventBlockInfoDialog* dialog, int currentBlock);
     void setRawBlockInfoContent(EventBlockInfoDialog* dialog, int currentBlock);
 
-    // Extension label snapshots (current values after a block).
+    // Extension label values after a block (change-point store, see LabelStore.h).
+    const LabelStore& getLabelStore() const { return m_labels; }
     bool getCounterValueAfterBlock(int blockIdx, int counterId, int& outVal) const;
     bool getFlagValueAfterBlock(int blockIdx, int flagId, bool& outVal) const;
     QSet<QString> getUsedExtensions() const { return m_usedExtensions; }
@@ -40,9 +54,20 @@ public:
 
     // Getters for data needed by other handlers
     const QVector<double>& getBlockEdges() const { return vecBlockEdges; }
+    // Binary-search lookups on the block edges, see BlockLookup.h
+    int findBlockAt(double t) const { return BlockLookup::blockAt(vecBlockEdges, t); }
+    bool findBlockRange(double tStart, double tEnd, int& first, int& last) const
+    {
+        return BlockLookup::blockRange(vecBlockEdges, tStart, tEnd, first, last);
+    }
     const QString& getTimeUnits() const { return TimeUnits; }
     double getTotalDuration_us() const { return m_dTotalDuration_us; }
-    const std::vector<SeqBlock*>& getDecodedSeqBlocks() const { return m_vecDecodeSeqBlocks; }
+    // Decoded blocks: resident after an eager load, decoded on demand after a lazy one (see DecodedBlockCache.h)
+    const DecodedBlockCache& getDecodedBlocks() const { return m_decodedBlocks; }
+    std::shared_ptr<SeqBlock> getDecodedBlock(int blockIdx) const { return m_decodedBlocks.block(blockIdx); }
+    int getBlockCount() const { return m_decodedBlocks.size(); }
+    // Per-channel event columns of the decoded sequence for scans over many blocks
+    const SequenceTable& getSequenceTable() const { return m_sequenceTable; }
     int getBlockRangeStart() const { return nBlockRangeStart; }
     int getBlockRangeEnd() const { return nBlockRangeEnd; }
     void setBlockRange(int start, int end) { nBlockRangeStart = start; nBlockRangeEnd = end; }
@@ -83,9 +108,11 @@ public:
 
     // RF on-demand rendering API (Phase 1)
     // Build viewport RF amplitude/phase series using per-shape cache and per-block scaling.
+    // gamma (Hz/T) converts the PPM offsets; the caller passes it so that a render thread does not
+    // read the settings.
     void getRfViewportDecimated(double visibleStart, double visibleEnd, int pixelWidth,
                                 QVector<double>& tAmp, QVector<double>& vAmp,
-                                QVector<double>& tPh, QVector<double>& vPh);
+                                QVector<double>& tPh, QVector<double>& vPh, double gamma);
 
     // Global RF ranges without materializing merged arrays
     QPair<double,double> getRfGlobalRangeAmp();
@@ -93,13 +120,14 @@ public:
 
     // ADC phase on-demand rendering (MATLAB-matching formula)
     void getAdcPhaseViewport(double visibleStart, double visibleEnd, int pixelWidth,
-                             QVector<double>& tOut, QVector<double>& vOut);
+                             QVector<double>& tOut, QVector<double>& vOut, double gamma);
 
     // ADC phase viewport cache (invalidated on sequence reload)
     struct AdcPhaseCache {
         double visibleStart {0.0};
         double visibleEnd {0.0};
         int pixelWidth {0};
+        double gamma {0.0};
         QVector<double> tData;
         QVector<double> vData;
         bool valid {false};
@@ -109,6 +137,12 @@ public:
     // B0 accessor (from sequence [DEFINITIONS])
     double getB0Tesla() const { return m_b0Tesla; }
 
+    // Guards what the viewport builders read (blocks, edges, shape caches, pyramids) against the render
+    // worker of WaveformDrawer: held by the worker per viewport, taken by the GUI thread before changing it
+    QRecursiveMutex& viewportMutex() const { return m_viewportMutex; }
+    // Changes whenever the data behind the viewport series does (load, reload, time unit rescale)
+    quint64 viewportRevision() const { return m_viewportRevision; }
+
     // Phase 2: Gradient on-demand rendering API
     void getGradViewportDecimated(int channel, double visibleStart, double visibleEnd, int pixelWidth,
                                   QVector<double>& tOut, QVector<double>& vOut);
@@ -131,7 +165,12 @@ public:
     const QVector<double>& getRefocusingCenters() const { return m_refocusingCentersAxis; }
     QVector<double> getKxKyZeroTimes() const; // Returns times when kx=ky=0 (in axis units)
 
+    // The trajectory is integrated on a background thread once the blocks are loaded and grows in time
+    // order as it is published (trajectoryProgress); the getters return the part available so far.
+    // ensureTrajectoryPrepared starts it unless it is complete or under way; waitForTrajectory blocks
+    // until it is complete (exports, snapshots).
     void ensureTrajectoryPrepared();
+    void waitForTrajectory();
     const QVector<double>& getTrajectoryKx() const { return m_kTrajectoryX; }
     const QVector<double>& getTrajectoryKy() const { return m_kTrajectoryY; }
     const QVector<double>& getTrajectoryKz() const { return m_kTrajectoryZ; }
@@ -140,7 +179,10 @@ public:
     const QVector<double>& getTrajectoryKyAdc() const { return m_kTrajectoryYAdc; }
     const QVector<double>& getTrajectoryKzAdc() const { return m_kTrajectoryZAdc; }
     const QVector<double>& getTrajectoryTimeAdcSec() const { return m_kTimeAdcSec; }
-    bool hasTrajectoryData() const { return m_kTrajectoryReady; }
+    bool hasTrajectoryData() const { return !m_kTimeSec.isEmpty(); }
+    bool isTrajectoryComplete() const { return m_kTrajectoryReady; }
+    // Points up to this time (seconds) are available
+    double trajectoryAvailableUntilSec() const;
     bool needsRfUseGuessWarning() const { return m_rfUseGuessed && !m_warnedRfUseGuess; }
     void markRfUseGuessWarningShown() { m_warnedRfUseGuess = true; }
     QString getRfUseGuessWarning() const { return m_rfGuessWarning; }
@@ -155,25 +197,69 @@ public slots:
     // Slots for UI connections
     void OpenPulseqFile();
     void ReOpenPulseqFile();
+    void ReOpenPulseqFileAsync();
     bool ClosePulseqFile();
+    void CancelPulseqFileLoad();
     // Lightweight time-unit rescaling (avoids full file reload)
     void rescaleTimeUnit();
 
-private:
-    struct LabelSnapshot
-    {
-        QVector<int>  counters; // size NUM_LABELS (known counters only)
-        QVector<bool> flags;    // size NUM_FLAGS (known flags only)
-    };
-
-    void buildLabelSnapshotCache();
-    const LabelSnapshot* labelSnapshotAfterBlock(int blockIdx) const;
+signals:
+    // Stages of LoadPulseqFileAsync, in this order
+    void librariesParsed();                  // sequence libraries and definitions are available
+    void firstBlocksDecoded(int blockCount); // the first TR (or first blocks) is decoded and drawn
+    void blocksDecoded();                    // all blocks are decoded
+    void aggregatesReady();                  // label cache, shape aggregates and Y-axis ranges are built
+    void loadFinished(bool ok);              // also emitted on failure; not emitted when canceled
+    // Background trajectory: more of it is available (percent of the blocks integrated), then complete.
+    // Not emitted for a trajectory stopped by a reload or close.
+    void trajectoryProgress(int percent);
+    void trajectoryFinished();
 
-    void buildShapeScaleAggregates();
+private:
+    // Consumers of the load pass over the decoded blocks (see runLoadPass)
+    class LabelStoreBuilder;      // label/flag change points and the used extensions
+    class ShapeAggregateBuilder;  // per-shape scale aggregates; reads the sequence table rows of the block
+    struct LoadTables;
     void ClearPulseqCache();
+
+    // Load stages shared by LoadPulseqFile and LoadPulseqFileAsync
+    std::shared_ptr<ExternalSequence> createSequenceForFile(const QString& sPulseqFilePath);
+    void reportLoadFailure(const QString& sPulseqFilePath);
+    bool acceptLoadedSequence();
+    // Load pass over blocks [0, blockCount) of seq into tables; touches no loader state, so it runs on the
+    // load thread of a background load. resident holds the decoded blocks, or is null to decode them in
+    // windows on a thread pool and delete them after the pass. onProgress(blocksDone) may return false to
+    // cancel. False on a decode error (tables.failedBlockIndex) or when canceled.
+    static bool runLoadPass(ExternalSequence* seq, const std::vector<SeqBlock*>* resident, int64_t blockCount,
+                            double tFactor, double gammaHzPerT, LoadTables& tables,
+                            const std::function<bool(int64_t)>& onProgress);
+    static double b0TeslaFor(ExternalSequence* seq);
+    // GUI thread: takes over the tables built with time factor passTFactor, then sets up the view
+    bool applyDecodedBlocks(const QString& sPulseqFilePath, bool complete, LoadTables& tables, double passTFactor);
+    void installLoadTables(LoadTables& tables, double passTFactor);
+    void reportDecodeFailure(int64_t blockIndex);
+
+    // Background loading: runLoadJob runs on the load thread, the onLoadJob* handlers on the GUI thread
+    struct LoadJob;
+    void runLoadJob(std::shared_ptr<LoadJob> job);
+    void onLoadJobLibrariesParsed(const std::shared_ptr<LoadJob>& job);
+    void onLoadJobProgress(const std::shared_ptr<LoadJob>& job, int progress);
+    void onLoadJobPreviewDecoded(const std::shared_ptr<LoadJob>& job);
+    void onLoadJobDecoded(const std::shared_ptr<LoadJob>& job);
+    void onLoadJobFailed(const std::shared_ptr<LoadJob>& job);
+    void stopLoadJob();
     bool IsBlockRf(const float* fAmp, const float* fPhase, const int& iSamples);
     void updateEchoAndExcitationMetadata(int versionMajor, int versionMinor);
-    void computeKSpaceTrajectory();
+    void buildTrBlockIndices();
+    void readTrajectoryDefinitions(double& gradRasterUs, double& rfRasterUs);
+
+    // Background trajectory: runTrajectoryJob runs on its own thread and reads the decoded blocks, so the
+    // job is stopped before they change; onTrajectoryJobProgress appends the published part on the GUI thread
+    struct TrajectoryJob;
+    void startTrajectoryJob();
+    void runTrajectoryJob(std::shared_ptr<TrajectoryJob> job);
+    void onTrajectoryJobProgress(const std::shared_ptr<TrajectoryJob>& job);
+    void stopTrajectoryJob();
     void updateTimeUnitFromSettings();
 
     // Settings management
@@ -189,7 +275,18 @@ private:
     QString m_sLastOpenDirectory;  // Remember last opened directory
     QStringList m_listRecentPulseqFilePaths;
     std::shared_ptr<ExternalSequence> m_spPulseqSeq;
-    std::vector<SeqBlock*> m_vecDecodeSeqBlocks;
+    std::vector<SeqBlock*> m_vecDecodeSeqBlocks; // eager load only; empty after a lazy load
+    DecodedBlockCache m_decodedBlocks;           // all block access goes through here
+    // Background load in progress (null otherwise) and the threads of all loads which may still be running
+    std::shared_ptr<LoadJob> m_loadJob;
+    QList<QPointer<QThread>> m_loadThreads;
+    std::shared_ptr<TrajectoryJob> m_trajectoryJob; // null when complete or not started
+    // During a background load m_vecDecodeSeqBlocks only views the first blocks, which the load job still owns
+    bool m_bBlocksBorrowedFromLoadJob {false};
+    // Viewport set for the preview of a background load; kept on completion if the user changed it meanwhile
+    bool m_bPreviewViewSet {false};
+    double m_dPreviewViewLower {0.0};
+    double m_dPreviewViewUpper {0.0};
     std::vector<int> m_vecTrBlockIndices;
     double m_dTotalDuration_us;
 
@@ -224,19 +321,20 @@ private:
     // Cached pulseq version like "v1.4.1"
     QString m_pulseqVersionString;
 
-    // Cached extension label values after each block (for Information window)
-    QVector<LabelSnapshot> m_labelSnapshots;
+    // Extension label values after each block (for Information window)
+    LabelStore m_labels;
     QSet<QString> m_usedExtensions;
-    // Precomputed maximum accumulated counter value across all blocks.
-    // Computed once in buildLabelSnapshotCache; avoids per-frame scanning loops.
-    int m_maxAccumulatedCounter {0};
 public:
-    int getMaxAccumulatedCounter() const { return m_maxAccumulatedCounter; }
+    // Maximum accumulated counter value across all blocks, kept by the label store
+    int getMaxAccumulatedCounter() const { return m_labels.maxAbsCounter(); }
 private:
 
     // Test/CLI behavior
     bool m_silentMode {false};
 
+    mutable QRecursiveMutex m_viewportMutex;
+    quint64 m_viewportRevision {0};
+
     // B0 field strength from [DEFINITIONS] (Tesla); needed for PPM phase terms
     double m_b0Tesla {0.0};
 
@@ -251,7 +349,7 @@ private:
     bool m_warnedRfUseGuess {false};
     QString m_rfGuessWarning;
 
-    bool m_kTrajectoryReady {false};
+    bool m_kTrajectoryReady {false}; // complete
     QVector<double> m_kTrajectoryX;
     QVector<double> m_kTrajectoryY;
     QVector<double> m_kTrajectoryZ;
@@ -277,12 +375,24 @@ private:
         double phMax {0.0};
         bool isRealLike {false};
     };
-    QHash<QString, RFAmpEntry> m_rfAmpCache; // rfA:<magShapeId>:<timeShapeId>#<len>
-    QHash<QString, RFPhEntry>  m_rfPhCache;  // rfP:<phaseShapeId>:<timeShapeId>#<len>
-    QString rfAmpKey(int magShapeId, int timeShapeId, int len) const;
-    QString rfPhKey(int phaseShapeId, int timeShapeId, int len) const;
-    const RFAmpEntry& ensureRfAmpCached(const float* amp, int len, int magShapeId, int timeShapeId);
-    const RFPhEntry&  ensureRfPhCached(const float* phase, int len, int phaseShapeId, int timeShapeId);
+    // Shape caches are keyed by the library IDs of the value and time shapes packed into one integer, so a
+    // lookup costs no allocation. The pair fixes the decompressed sample count; the entry keeps it as a check.
+    static quint64 shapeKey(int shapeId, int timeShapeId)
+    {
+        return (quint64(quint32(shapeId)) << 32) | quint32(timeShapeId);
+    }
+    QHash<quint64, RFAmpEntry> m_rfAmpCache; // shapeKey(magShapeId, timeShapeId)
+    QHash<quint64, RFPhEntry>  m_rfPhCache;  // shapeKey(phaseShapeId, timeShapeId)
+    static const RFAmpEntry& ensureRfAmpCached(QHash<quint64, RFAmpEntry>& cache, const float* amp, int len, int magShapeId, int timeShapeId);
+    static const RFPhEntry&  ensureRfPhCached(QHash<quint64, RFPhEntry>& cache, const float* phase, int len, int phaseShapeId, int timeShapeId);
+    const RFAmpEntry& ensureRfAmpCached(const float* amp, int len, int magShapeId, int timeShapeId)
+    {
+        return ensureRfAmpCached(m_rfAmpCache, amp, len, magShapeId, timeShapeId);
+    }
+    const RFPhEntry& ensureRfPhCached(const float* phase, int len, int phaseShapeId, int timeShapeId)
+    {
+        return ensureRfPhCached(m_rfPhCache, phase, len, phaseShapeId, timeShapeId);
+    }
     void downsampleMinMax(const QVector<float>& src, int buckets, QVector<int>& outIdxMin, QVector<int>& outIdxMax) const;
     void lttbDownsampleUniform(const QVector<float>& src, double tStart, double dt, int targetPoints,
                                QVector<double>& tOut, QVector<double>& vOut) const;
@@ -294,10 +404,13 @@ private:
         double vMin {0.0};
         double vMax {0.0};
     };
-    QHash<QString, GradShapeEntry> m_gradShapeCache; // key: grad:<waveShapeId>:<timeShapeId>#<len>
-    QString gradKey(int waveShapeId, int timeShapeId, int len) const;
-    const GradShapeEntry& ensureGradCached(const float* shape, int len,
-                                          int waveShapeId, int timeShapeId);
+    QHash<quint64, GradShapeEntry> m_gradShapeCache; // shapeKey(waveShapeId, timeShapeId)
+    static const GradShapeEntry& ensureGradCached(QHash<quint64, GradShapeEntry>& cache, const float* shape, int len,
+                                                  int waveShapeId, int timeShapeId);
+    const GradShapeEntry& ensureGradCached(const float* shape, int len, int waveShapeId, int timeShapeId)
+    {
+        return ensureGradCached(m_gradShapeCache, shape, len, waveShapeId, timeShapeId);
+    }
 
     // ===== Aggregated per-shape scale tracking (for global Y-range, computed once at load) =====
     struct ScaleAgg {
@@ -314,16 +427,88 @@ private:
             else        minNegScale = std::min(minNegScale, s);
         }
     };
-    // RF amplitude aggregations (keyed by rfAmpKey)
-    QHash<QString, ScaleAgg> m_rfAgg;
-    // Gradient aggregations per channel (keyed by gradKey for arbitrary shapes)
-    QHash<QString, ScaleAgg> m_gradAgg[3];
+    // RF amplitude aggregations (keyed by shapeKey of the magnitude shape)
+    QHash<quint64, ScaleAgg> m_rfAgg;
+    // Gradient aggregations per channel (keyed by shapeKey for arbitrary shapes)
+    QHash<quint64, ScaleAgg> m_gradAgg[3];
     // Trapezoid gradient per-channel scale extremes (no shape key)
     double m_gradTrapMaxPosScale[3] {0.0, 0.0, 0.0};
     double m_gradTrapMinNegScale[3] {0.0, 0.0, 0.0};
     // External trapezoid global min/max per channel (aggregated during load)
     double m_gradExtTrapGlobalMin[3] { std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() };
     double m_gradExtTrapGlobalMax[3] { -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() };
+    // RF phase range over all phase shapes (aggregated during load)
+    double m_rfPhaseMin { std::numeric_limits<double>::infinity() };
+    double m_rfPhaseMax { -std::numeric_limits<double>::infinity() };
+
+    // ===== Products of the load pass (runLoadPass) =====
+    // Built without touching the loader, on the load thread of a background load, and swapped into the
+    // members above on the GUI thread by installLoadTables.
+    struct LoadTables {
+        QVector<double> blockEdges;
+        SequenceTable sequenceTable;
+        QVector<double> adcTime, adcValues;
+        LabelStore labels;
+        QSet<QString> usedExtensions;
+        QHash<quint64, RFAmpEntry> rfAmpCache;
+        QHash<quint64, RFPhEntry> rfPhCache;
+        QHash<quint64, GradShapeEntry> gradShapeCache;
+        QHash<quint64, ScaleAgg> rfAgg;
+        QHash<quint64, ScaleAgg> gradAgg[3];
+        double gradTrapMaxPosScale[3] {0.0, 0.0, 0.0};
+        double gradTrapMinNegScale[3] {0.0, 0.0, 0.0};
+        double gradExtTrapGlobalMin[3] { std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() };
+        double gradExtTrapGlobalMax[3] { -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() };
+        double rfPhaseMin { std::numeric_limits<double>::infinity() };
+        double rfPhaseMax { -std::numeric_limits<double>::infinity() };
+        // RF use of each block and the excitation/refocusing centers (internal time units)
+        QVector<double> excitationCenters, refocusingCenters;
+        QVector<char> rfUsePerBlock;
+        bool rfUseGuessed {false};
+        QString rfGuessWarning;
+        int64_t failedBlockIndex {-1};
+    };
+
+    // ===== Whole-sequence min/max pyramids (built on the first zoomed-out viewport, cleared on reload) =====
+    enum PyramidChannel { PyramidRfAmp, PyramidRfPhase, PyramidGx, PyramidGy, PyramidGz, PyramidAdcPhase, PyramidChannelCount };
+    MinMaxPyramid m_waveformPyramids[PyramidChannelCount];
+    double m_waveformPyramidGamma {0.0}; // gamma the phase pyramids were built with
+    // Pyramid answering the viewport, or null when it spans no more blocks than pixels (per-block path).
+    // gamma is only used by the phase channels.
+    const MinMaxPyramid* waveformPyramid(int channel, double visibleStart, double visibleEnd, int pixelWidth, int visibleBlocks,
+                                         double gamma);
+    void buildWaveformPyramid(int channel, MinMaxPyramid& pyramid, double gamma);
+    void clearWaveformPyramids();
+
+    // ===== Columnar event table (built once at load, see SequenceTable.h) =====
+    SequenceTable m_sequenceTable;
+
+    // ===== Per-block viewport segments (incremental pan) =====
+    // The decimated series each block contributed to recent RF/gradient viewports, keyed by block index.
+    // Panning keeps the window and pixel widths, so blocks still in view are spliced from here and only
+    // blocks entering the window are decimated. A segment depends on its set's parameters; sets for other
+    // window widths (e.g. the prefetched zoom levels) are kept apart so they do not evict the panning set.
+    struct ViewportSegmentParams {
+        double window {0.0};   // visible span, sets the pixels per block
+        int pixelWidth {0};
+        bool decimate {false}; // global decimation gate of the viewport
+        double gamma {0.0};    // RF phase offsets
+        bool matches(const ViewportSegmentParams& other) const;
+    };
+    struct RfViewportSegment { QVector<double> tAmp, vAmp, tPh, vPh; };
+    struct GradViewportSegment { QVector<double> t, v; };
+    template <typename Segment>
+    struct ViewportSegmentSet {
+        ViewportSegmentParams params;
+        QHash<int, Segment> blocks;
+    };
+    QList<ViewportSegmentSet<RfViewportSegment>> m_rfSegmentSets;
+    QList<ViewportSegmentSet<GradViewportSegment>> m_gradSegmentSets[3];
+    template <typename Segment>
+    static QHash<int, Segment>& viewportSegments(QList<ViewportSegmentSet<Segment>>& sets, const ViewportSegmentParams& params);
+    template <typename Segment>
+    static void pruneViewportSegments(QHash<int, Segment>& blocks, int startBlock, int endBlock);
+    void clearViewportSegments();
 };
 
 #endif // PULSEQLOADER_H
@@ -0,0 +1,131 @@
+#include "SequenceTable.h"
+#include "ExternalSequence.h"
+#include <cmath>
+#include <limits>
+
+void SequenceTable::Builder::begin(int blockCount)
+{
+    m_table.clear();
+    m_table.duration.resize(blockCount);
+    m_table.rfRow.fill(-1, blockCount);
+    m_table.adcRow.fill(-1, blockCount);
+    for (QVector<int>& rows : m_table.gradRow) rows.fill(-1, blockCount);
+    m_rfSamples = m_adcSamples = 0;
+    for (qint64& samples : m_gradSamples) samples = 0;
+}
+
+void SequenceTable::Builder::consume(int i, SeqBlock& block, double)
+{
+    SeqBlock* blk = &block;
+    m_table.duration[i] = blk->GetDuration();
+
+    if (blk->isRF())
+    {
+        const RFEvent& e = blk->GetRFEvent();
+        m_table.rfRow[i] = m_table.rf.size();
+        m_table.rf.block.append(i);
+        m_table.rf.delay.append(e.delay);
+        m_table.rf.length.append(blk->GetRFLength());
+        m_table.rf.dwell.append(blk->GetRFDwellTime());
+        m_table.rf.amplitude.append(e.amplitude);
+        m_table.rf.magShape.append(e.magShape);
+        m_table.rf.phaseShape.append(e.phaseShape);
+        m_table.rf.timeShape.append(e.timeShape);
+        m_table.rf.freqOffset.append(e.freqOffset);
+        m_table.rf.phaseOffset.append(e.phaseOffset);
+        m_table.rf.freqPPM.append(e.freqPPM);
+        m_table.rf.phasePPM.append(e.phasePPM);
+        m_table.rf.samplesBefore.append(m_rfSamples);
+        m_rfSamples += std::max(0, blk->GetRFLength());
+    }
+
+    if (blk->isADC())
+    {
+        const ADCEvent& e = blk->GetADCEvent();
+        m_table.adcRow[i] = m_table.adc.size();
+        m_table.adc.block.append(i);
+        m_table.adc.delay.append(e.delay);
+        m_table.adc.numSamples.append(e.numSamples);
+        m_table.adc.dwell.append(e.dwellTime);
+        m_table.adc.freqOffset.append(e.freqOffset);
+        m_table.adc.phaseOffset.append(e.phaseOffset);
+        m_table.adc.freqPPM.append(e.freqPPM);
+        m_table.adc.phasePPM.append(e.phasePPM);
+        m_table.adc.samplesBefore.append(m_adcSamples);
+        m_adcSamples += std::max(0, e.numSamples);
+    }
+
+    for (int ch = 0; ch < 3; ++ch)
+    {
+        GradColumns& g = m_table.grad[ch];
+        const GradEvent& e = blk->GetGradEvent(ch);
+        const double amp = double(e.amplitude);
+        double eventDuration = 0.0, vMin = 0.0, vMax = 0.0;
+        int extFirst = -1, extCount = 0, numSamples = 0, drawn = 0;
+        GradKind kind;
+        if (blk->isTrapGradient(ch)) {
+            kind = GradTrap;
+            eventDuration = double(e.rampUpTime) + double(e.flatTime) + double(e.rampDownTime);
+            vMin = std::min(0.0, amp); vMax = std::max(0.0, amp);
+            drawn = 4;
+        } else if (blk->isExtTrapGradient(ch)) {
+            const std::vector<long>& times = blk->GetExtTrapGradTimes(ch);
+            const std::vector<float>& shape = blk->GetExtTrapGradShape(ch);
+            if (times.empty() || times.size() != shape.size()) continue;
+            kind = GradExtTrap;
+            extFirst = int(g.extTime.size());
+            extCount = int(times.size());
+            vMin = std::numeric_limits<double>::infinity(); vMax = -vMin;
+            for (size_t k = 0; k < times.size(); ++k) {
+                const double v = double(shape[k]) * amp;
+                g.extTime.append(double(times[k]));
+                g.extValue.append(v);
+                if (v < vMin) vMin = v;
+                if (v > vMax) vMax = v;
+            }
+            eventDuration = double(times.back());
+            drawn = extCount;
+        } else if (blk->isArbitraryGradient(ch)) {
+            numSamples = blk->GetArbGradNumSamples(ch);
+            if (numSamples <= 0 || !blk->GetArbGradShapePtr(ch)) continue;
+            kind = GradArbitrary;
+            eventDuration = numSamples * m_gradRaster_us;
+            drawn = numSamples;
+        } else {
+            continue;
+        }
+        m_table.gradRow[ch][i] = g.size();
+        g.block.append(i);
+        g.kind.append(kind);
+        g.delay.append(double(e.delay));
+        g.rampUp.append(kind == GradTrap ? double(e.rampUpTime) : 0.0);
+        g.flat.append(kind == GradTrap ? double(e.flatTime) : 0.0);
+        g.rampDown.append(kind == GradTrap ? double(e.rampDownTime) : 0.0);
+        g.amplitude.append(amp);
+        g.duration.append(eventDuration);
+        g.vMin.append(vMin);
+        g.vMax.append(vMax);
+        g.waveShape.append(kind == GradArbitrary ? e.waveShape : 0);
+        g.timeShape.append(kind == GradArbitrary ? e.timeShape : 0);
+        g.numSamples.append(numSamples);
+        g.extFirst.append(extFirst);
+        g.extCount.append(extCount);
+        g.samplesBefore.append(m_gradSamples[ch]);
+        m_gradSamples[ch] += drawn;
+    }
+
+    if (blk->isLabel())
+    {
+        for (const LabelEvent& e : blk->GetLabelSetEvents())
+            m_table.maxAbsLabelValue = std::max(m_table.maxAbsLabelValue, std::abs(double(e.numVal.second)));
+        for (const LabelEvent& e : blk->GetLabelIncEvents())
+            m_table.maxAbsLabelValue = std::max(m_table.maxAbsLabelValue, std::abs(double(e.numVal.second)));
+    }
+}
+
+void SequenceTable::Builder::finish()
+{
+    m_table.rf.samplesBefore.append(m_rfSamples);
+    m_table.adc.samplesBefore.append(m_adcSamples);
+    for (int ch = 0; ch < 3; ++ch) m_table.grad[ch].samplesBefore.append(m_gradSamples[ch]);
+}
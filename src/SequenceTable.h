@@ -0,0 +1,110 @@
+#ifndef SEQUENCETABLE_H
+#define SEQUENCETABLE_H
+
+#include <QVector>
+#include <QtGlobal>
+#include <algorithm>
+#include <vector>
+#include "LoadPipeline.h"
+
+// Structure-of-arrays copy of the decoded sequence for the hot loops (viewport builders, pyramids,
+// scale aggregates, ADC sample times). Per-block columns hold the duration and the row of each of the
+// block's events (-1 without one); per-event columns hold the event parameters in block order, with
+// shapes referenced by their library IDs. Scans stream through a few flat arrays instead of following
+// a SeqBlock pointer per block, and sample counts over a block range come from prefix sums.
+// Times are in microseconds (ADC dwell in ns, as in the file), so a time-unit change keeps the table.
+class SequenceTable
+{
+public:
+    enum GradKind : quint8 { GradTrap, GradExtTrap, GradArbitrary };
+
+    struct RfColumns {
+        QVector<int> block;          // ascending
+        QVector<int> delay;          // us from the block start
+        QVector<int> length;         // samples
+        QVector<float> dwell;        // us
+        QVector<float> amplitude;    // Hz
+        QVector<int> magShape, phaseShape, timeShape;
+        QVector<float> freqOffset, phaseOffset, freqPPM, phasePPM;
+        QVector<qint64> samplesBefore; // samples of the rows before each one, plus the total
+        int size() const { return int(block.size()); }
+    };
+
+    struct AdcColumns {
+        QVector<int> block;
+        QVector<int> delay;          // us from the block start
+        QVector<int> numSamples;
+        QVector<int> dwell;          // ns
+        QVector<float> freqOffset, phaseOffset, freqPPM, phasePPM;
+        QVector<qint64> samplesBefore;
+        int size() const { return int(block.size()); }
+    };
+
+    // Every gradient event of a channel. Trapezoids and extended trapezoids carry their geometry,
+    // so they are drawn without going back to the decoded blocks; arbitrary gradients are drawn
+    // from their shape (waveShape/timeShape IDs).
+    struct GradColumns {
+        QVector<int> block;
+        QVector<quint8> kind;        // GradKind
+        QVector<double> delay;       // event start (us from the block start)
+        QVector<double> rampUp;      // trapezoid ramp/flat durations (us)
+        QVector<double> flat;
+        QVector<double> rampDown;
+        QVector<double> amplitude;   // Hz/m
+        QVector<double> duration;    // event start to last point (us)
+        QVector<double> vMin;        // value range drawn by the event (Hz/m)
+        QVector<double> vMax;
+        QVector<int> waveShape, timeShape, numSamples; // arbitrary gradients
+        QVector<int> extFirst;       // extended trapezoid: first corner in extTime/extValue, -1 otherwise
+        QVector<int> extCount;
+        QVector<double> extTime;     // corner times (us from the event start)
+        QVector<double> extValue;    // corner values (Hz/m)
+        QVector<qint64> samplesBefore;
+        int size() const { return int(block.size()); }
+    };
+
+    // Fills a table from the blocks of the load pass; gradRaster_us sizes arbitrary gradients
+    class Builder : public BlockConsumer
+    {
+    public:
+        Builder(SequenceTable& table, double gradRaster_us) : m_table(table), m_gradRaster_us(gradRaster_us) {}
+        void begin(int blockCount) override;
+        void consume(int index, SeqBlock& block, double blockStart) override;
+        void finish() override;
+
+    private:
+        SequenceTable& m_table;
+        double m_gradRaster_us;
+        qint64 m_rfSamples {0}, m_adcSamples {0}, m_gradSamples[3] {0, 0, 0};
+    };
+
+    void clear() { *this = SequenceTable(); }
+    int blockCount() const { return int(duration.size()); }
+
+    // Rows [first, end) of the events in blocks startBlock..endBlock
+    template <typename Columns>
+    static void rowRange(const Columns& columns, int startBlock, int endBlock, int& first, int& end)
+    {
+        first = int(std::lower_bound(columns.block.begin(), columns.block.end(), startBlock) - columns.block.begin());
+        end = int(std::upper_bound(columns.block.begin(), columns.block.end(), endBlock) - columns.block.begin());
+    }
+    // Samples in rows [first, end)
+    template <typename Columns>
+    static qint64 samplesIn(const Columns& columns, int first, int end)
+    {
+        return columns.samplesBefore.isEmpty() ? 0 : columns.samplesBefore[end] - columns.samplesBefore[first];
+    }
+
+    // Per block
+    QVector<double> duration;        // us
+    QVector<int> rfRow;
+    QVector<int> adcRow;
+    QVector<int> gradRow[3];
+
+    RfColumns rf;
+    AdcColumns adc;
+    GradColumns grad[3];
+    double maxAbsLabelValue {0.0};   // largest |value| set or added by a label event
+};
+
+#endif // SEQUENCETABLE_H
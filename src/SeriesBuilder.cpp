@@ -6,7 +6,7 @@
 namespace SeriesBuilder {
 
 void buildRFSeries(
-    const std::vector<SeqBlock*>& blocks,
+    const DecodedBlockCache& blocks,
     const QVector<double>& edges,
     double tFactor,
     QVector<double>& rfTimeAmp,
@@ -33,7 +33,8 @@ void buildRFSeries(
     const double epsV = 1e-12;   // value equality tolerance
 
     for (int i = 0; i < numBlocks; ++i) {
-        SeqBlock* blk = blocks[i];
+        const std::shared_ptr<SeqBlock> blockRef = blocks.block(i);
+        SeqBlock* blk = blockRef.get();
         if (!blk || !blk->isRF()) continue;
 
         RFEvent& rf = blk->GetRFEvent();
@@ -41,8 +42,8 @@ void buildRFSeries(
         if (RFLength <= 0) continue;
 
         float dwell = blk->GetRFDwellTime();
-        float* rfList = blk->GetRFAmplitudePtr();
-        float* phaseList = blk->GetRFPhasePtr();
+        const float* rfList = blk->GetRFAmplitudePtr();
+        const float* phaseList = blk->GetRFPhasePtr();
         const double tStart = edges[i] + rf.delay * tFactor;
 
         // Decide whether to insert a break based on exact endpoint equality rule
@@ -100,7 +101,7 @@ void buildRFSeries(
 }
 
 void buildGradientSeries(
-    const std::vector<SeqBlock*>& blocks,
+    const DecodedBlockCache& blocks,
     const QVector<double>& edges,
     double tFactor,
     int channel, // 0=GX, 1=GY, 2=GZ
@@ -108,193 +109,221 @@ void buildGradientSeries(
     QVector<double>& gradValues,
     double gradientRasterUs)
 {
-    gradTime.clear(); gradValues.clear();
-    
+    GradientSeriesBuilder builder(tFactor, channel, gradTime, gradValues, gradientRasterUs);
     const int numBlocks = static_cast<int>(blocks.size());
+    builder.begin(numBlocks);
     if (numBlocks == 0 || edges.isEmpty()) return;
     
-    bool hasAnyPoint = false;
-    double lastTime = 0.0;
-    double lastVal = 0.0;
+    for (int i = 0; i < numBlocks; ++i) {
+        const std::shared_ptr<SeqBlock> blockRef = blocks.block(i);
+        if (!blockRef) continue;
+        builder.consume(i, *blockRef, edges[i]);
+    }
+}
+
+GradientSeriesBuilder::GradientSeriesBuilder(double tFactor, int channel, QVector<double>& gradTime,
+                                             QVector<double>& gradValues, double gradientRasterUs)
+    : m_tFactor(tFactor), m_channel(channel), m_time(gradTime), m_values(gradValues),
+      m_gradientRasterUs(gradientRasterUs)
+{
+}
+
+void GradientSeriesBuilder::begin(int)
+{
+    m_time.clear(); m_values.clear();
+    m_hasAnyPoint = false;
+    m_lastTime = 0.0;
+    m_lastVal = 0.0;
+}
+
+void GradientSeriesBuilder::consume(int, SeqBlock& block, double blockStart)
+{
+    SeqBlock* blk = &block;
     
     // Tolerances for endpoint equality
     const double epsT = 1e-12;
     const double epsV = 1e-12;
     
-    for (int i = 0; i < numBlocks; ++i) {
-        SeqBlock* blk = const_cast<SeqBlock*>(blocks[i]);
-        if (!blk) continue;
-        
-        // Check if this block has gradient data for the specified channel
-        bool hasGradient = false;
-        if (blk->isTrapGradient(channel) || blk->isArbitraryGradient(channel) || blk->isExtTrapGradient(channel)) {
-            hasGradient = true;
-        }
-        
-        if (!hasGradient) continue;
-        
-        const GradEvent& grad = blk->GetGradEvent(channel);
-        const double tStart = edges[i] + grad.delay * tFactor;
+    // Check if this block has gradient data for the specified channel
+    bool hasGradient = false;
+    if (blk->isTrapGradient(m_channel) || blk->isArbitraryGradient(m_channel) || blk->isExtTrapGradient(m_channel)) {
+        hasGradient = true;
+    }
+    
+    if (!hasGradient) return;
+    
+    const GradEvent& grad = blk->GetGradEvent(m_channel);
+    const double tStart = blockStart + grad.delay * m_tFactor;
+    
+    // Process different gradient types
+    QVector<double> blockTime, blockValues;
+    
+    if (blk->isTrapGradient(m_channel)) {
+        // Trapezoid gradient: build time/amplitude arrays
+        double rampUpTime = grad.rampUpTime * m_tFactor;
+        double flatTime = grad.flatTime * m_tFactor;
+        double rampDownTime = grad.rampDownTime * m_tFactor;
         
-        // Process different gradient types
-        QVector<double> blockTime, blockValues;
+        // Build trapezoid points
+        QVector<double> times = {0, rampUpTime, rampUpTime + flatTime, rampUpTime + flatTime + rampDownTime};
+        QVector<double> amps = {0, grad.amplitude, grad.amplitude, 0};
         
-        if (blk->isTrapGradient(channel)) {
-            // Trapezoid gradient: build time/amplitude arrays
-            double rampUpTime = grad.rampUpTime * tFactor;
-            double flatTime = grad.flatTime * tFactor;
-            double rampDownTime = grad.rampDownTime * tFactor;
-            
-            // Build trapezoid points
-            QVector<double> times = {0, rampUpTime, rampUpTime + flatTime, rampUpTime + flatTime + rampDownTime};
-            QVector<double> amps = {0, grad.amplitude, grad.amplitude, 0};
-            
-            for (int j = 0; j < times.size(); ++j) {
-                blockTime.append(tStart + times[j]);
-                blockValues.append(amps[j]);
-            }
+        for (int j = 0; j < times.size(); ++j) {
+            blockTime.append(tStart + times[j]);
+            blockValues.append(amps[j]);
         }
-        else if (blk->isArbitraryGradient(channel)) {
-            // Arbitrary gradient: use shape data
-            int numSamples = blk->GetArbGradNumSamples(channel);
-            const float* shapePtr = blk->GetArbGradShapePtr(channel);
+    }
+    else if (blk->isArbitraryGradient(m_channel)) {
+        // Arbitrary gradient: use shape data
+        int numSamples = blk->GetArbGradNumSamples(m_channel);
+        const float* shapePtr = blk->GetArbGradShapePtr(m_channel);
+        
+        if (numSamples > 0 && shapePtr) {
+            // Use provided gradient raster time in microseconds if valid, otherwise fallback
+            double gradRaster_us = (m_gradientRasterUs > 0.0 ? m_gradientRasterUs : 10.0);
             
-            if (numSamples > 0 && shapePtr) {
-                // Use provided gradient raster time in microseconds if valid, otherwise fallback
-                double gradRaster_us = (gradientRasterUs > 0.0 ? gradientRasterUs : 10.0);
-                
-                for (int j = 0; j < numSamples; ++j) {
-                    double t = tStart + j * gradRaster_us * tFactor;
-                    double amp = static_cast<double>(shapePtr[j]) * static_cast<double>(grad.amplitude);
-                    blockTime.append(t);
-                    blockValues.append(amp);
-                }
+            for (int j = 0; j < numSamples; ++j) {
+                double t = tStart + j * gradRaster_us * m_tFactor;
+                double amp = static_cast<double>(shapePtr[j]) * static_cast<double>(grad.amplitude);
+                blockTime.append(t);
+                blockValues.append(amp);
             }
         }
-        else if (blk->isExtTrapGradient(channel)) {
-            // Extended trapezoid gradient: use time/amplitude arrays
-            const std::vector<long>& times = blk->GetExtTrapGradTimes(channel);
-            const std::vector<float>& shape = blk->GetExtTrapGradShape(channel);
-            
-            if (!times.empty() && !shape.empty() && times.size() == shape.size()) {
-                for (size_t j = 0; j < times.size(); ++j) {
-                    double t = tStart + times[j] * tFactor;
-                    double amp = static_cast<double>(shape[j]) * static_cast<double>(grad.amplitude);
-                    blockTime.append(t);
-                    blockValues.append(amp);
-                }
+    }
+    else if (blk->isExtTrapGradient(m_channel)) {
+        // Extended trapezoid gradient: use time/amplitude arrays
+        const std::vector<long>& times = blk->GetExtTrapGradTimes(m_channel);
+        const std::vector<float>& shape = blk->GetExtTrapGradShape(m_channel);
+        
+        if (!times.empty() && !shape.empty() && times.size() == shape.size()) {
+            for (size_t j = 0; j < times.size(); ++j) {
+                double t = tStart + times[j] * m_tFactor;
+                double amp = static_cast<double>(shape[j]) * static_cast<double>(grad.amplitude);
+                blockTime.append(t);
+                blockValues.append(amp);
             }
         }
-        
-        // Deduplicate identical timestamps within this block (keep last occurrence)
-        if (!blockTime.isEmpty()) {
-            int n = blockTime.size();
-            int w = 0;
-            double prevT = std::numeric_limits<double>::quiet_NaN();
-            for (int j = 0; j < n; ++j) {
-                double tj = blockTime[j];
-                double vj = blockValues[j];
-                if (w > 0 && std::abs(tj - prevT) <= epsT) {
-                    // Overwrite previous value at the same timestamp
-                    blockTime[w - 1] = tj;
-                    blockValues[w - 1] = vj;
-                    continue;
-                }
-                blockTime[w] = tj;
-                blockValues[w] = vj;
-                prevT = tj;
-                ++w;
+    }
+    
+    // Deduplicate identical timestamps within this block (keep last occurrence)
+    if (!blockTime.isEmpty()) {
+        int n = blockTime.size();
+        int w = 0;
+        double prevT = std::numeric_limits<double>::quiet_NaN();
+        for (int j = 0; j < n; ++j) {
+            double tj = blockTime[j];
+            double vj = blockValues[j];
+            if (w > 0 && std::abs(tj - prevT) <= epsT) {
+                // Overwrite previous value at the same timestamp
+                blockTime[w - 1] = tj;
+                blockValues[w - 1] = vj;
+                continue;
             }
-            blockTime.resize(w);
-            blockValues.resize(w);
+            blockTime[w] = tj;
+            blockValues[w] = vj;
+            prevT = tj;
+            ++w;
         }
+        blockTime.resize(w);
+        blockValues.resize(w);
+    }
 
-        if (blockTime.isEmpty()) continue;
+    if (blockTime.isEmpty()) return;
 
-        // Avoid boundary duplicate timestamp with previous block (drop first if equal-in-time)
-        if (hasAnyPoint && std::abs(blockTime.first() - lastTime) <= epsT) {
-            if (blockTime.size() > 1) {
-                blockTime.remove(0);
-                blockValues.remove(0);
-            } else {
-                // Single-point block coinciding with boundary; nothing meaningful to add
-                continue;
-            }
+    // Avoid boundary duplicate timestamp with previous block (drop first if equal-in-time)
+    if (m_hasAnyPoint && std::abs(blockTime.first() - m_lastTime) <= epsT) {
+        if (blockTime.size() > 1) {
+            blockTime.remove(0);
+            blockValues.remove(0);
+        } else {
+            // Single-point block coinciding with boundary; nothing meaningful to add
+            return;
         }
+    }
+    
+    // Check for continuity with previous block
+    if (m_hasAnyPoint && !blockTime.isEmpty()) {
+        const double firstTime = blockTime.first();
+        const double firstVal = blockValues.first();
         
-        // Check for continuity with previous block
-        if (hasAnyPoint && !blockTime.isEmpty()) {
-            const double firstTime = blockTime.first();
-            const double firstVal = blockValues.first();
-            
-            const bool samePoint = (std::abs(lastTime - firstTime) <= epsT) &&
-                                  (std::abs(lastVal - firstVal) <= epsV);
-            if (!samePoint) {
-                // Insert NaN to break the line
-                gradTime.append(lastTime);
-                gradValues.append(std::numeric_limits<double>::quiet_NaN());
-            }
+        const bool samePoint = (std::abs(m_lastTime - firstTime) <= epsT) &&
+                              (std::abs(m_lastVal - firstVal) <= epsV);
+        if (!samePoint) {
+            // Insert NaN to break the line
+            m_time.append(m_lastTime);
+            m_values.append(std::numeric_limits<double>::quiet_NaN());
         }
+    }
+    
+    // Append this block's data
+    m_time.reserve(m_time.size() + blockTime.size());
+    m_values.reserve(m_values.size() + blockValues.size());
+    
+    for (int j = 0; j < blockTime.size(); ++j) {
+        m_time.append(blockTime[j]);
+        m_values.append(blockValues[j]);
         
-        // Append this block's data
-        gradTime.reserve(gradTime.size() + blockTime.size());
-        gradValues.reserve(gradValues.size() + blockValues.size());
-        
-        for (int j = 0; j < blockTime.size(); ++j) {
-            gradTime.append(blockTime[j]);
-            gradValues.append(blockValues[j]);
-            
-            lastTime = blockTime[j];
-            lastVal = blockValues[j];
-            hasAnyPoint = true;
-        }
+        m_lastTime = blockTime[j];
+        m_lastVal = blockValues[j];
+        m_hasAnyPoint = true;
     }
 }
 
 void buildADCSeries(
-    const std::vector<SeqBlock*>& blocks,
+    const DecodedBlockCache& blocks,
     const QVector<double>& edges,
     double tFactor,
     QVector<double>& adcTime,
     QVector<double>& adcValues)
 {
-    adcTime.clear(); adcValues.clear();
-    
+    ADCSeriesBuilder builder(tFactor, adcTime, adcValues);
     const int numBlocks = static_cast<int>(blocks.size());
+    builder.begin(numBlocks);
     if (numBlocks == 0 || edges.isEmpty()) return;
     
     for (int i = 0; i < numBlocks; ++i) {
-        SeqBlock* blk = const_cast<SeqBlock*>(blocks[i]);
-        if (!blk || !blk->isADC()) continue;
-        
-        const ADCEvent& adc = blk->GetADCEvent();
-        if (adc.numSamples == 0) continue;
-        
-        const double tStart = edges[i] + adc.delay * tFactor;
-        const double tEnd = tStart + (adc.numSamples * adc.dwellTime / 1000.0) * tFactor;
-        
-        // ADC events are represented as rectangular pulses
-        // Create simple rectangle: bottom -> top -> top -> bottom
-        // This creates a clean rectangle without connecting lines
-        
-        // Start with NaN to ensure separation from previous ADC event
-        if (!adcTime.isEmpty()) {
-            adcTime.append(tStart);
-            adcValues.append(std::numeric_limits<double>::quiet_NaN());
-        }
-        
-        // Create rectangle: bottom -> top -> top -> bottom
-        adcTime.append(tStart); adcValues.append(0.0);  // Bottom left
-        adcTime.append(tStart); adcValues.append(1.0);  // Top left  
-        adcTime.append(tEnd);   adcValues.append(1.0);  // Top right
-        adcTime.append(tEnd);   adcValues.append(0.0);  // Bottom right
-        
-        // Add NaN to close the rectangle
-        adcTime.append(tEnd);
-        adcValues.append(std::numeric_limits<double>::quiet_NaN());
+        const std::shared_ptr<SeqBlock> blockRef = blocks.block(i);
+        if (!blockRef) continue;
+        builder.consume(i, *blockRef, edges[i]);
     }
 }
 
+void ADCSeriesBuilder::begin(int)
+{
+    m_time.clear(); m_values.clear();
+}
+
+void ADCSeriesBuilder::consume(int, SeqBlock& block, double blockStart)
+{
+    if (!block.isADC()) return;
+    
+    const ADCEvent& adc = block.GetADCEvent();
+    if (adc.numSamples == 0) return;
+    
+    const double tStart = blockStart + adc.delay * m_tFactor;
+    const double tEnd = tStart + (adc.numSamples * adc.dwellTime / 1000.0) * m_tFactor;
+    
+    // ADC events are represented as rectangular pulses
+    // Create simple rectangle: bottom -> top -> top -> bottom
+    // This creates a clean rectangle without connecting lines
+    
+    // Start with NaN to ensure separation from previous ADC event
+    if (!m_time.isEmpty()) {
+        m_time.append(tStart);
+        m_values.append(std::numeric_limits<double>::quiet_NaN());
+    }
+    
+    // Create rectangle: bottom -> top -> top -> bottom
+    m_time.append(tStart); m_values.append(0.0);  // Bottom left
+    m_time.append(tStart); m_values.append(1.0);  // Top left  
+    m_time.append(tEnd);   m_values.append(1.0);  // Top right
+    m_time.append(tEnd);   m_values.append(0.0);  // Bottom right
+    
+    // Add NaN to close the rectangle
+    m_time.append(tEnd);
+    m_values.append(std::numeric_limits<double>::quiet_NaN());
+}
+
 } // namespace SeriesBuilder
 
 
@@ -4,6 +4,8 @@
 #include <QVector>
 #include <vector>
 #include "external/pulseq/ExternalSequence.h"
+#include "DecodedBlockCache.h"
+#include "LoadPipeline.h"
 
 // Build merged time/value series per axis from decoded Pulseq blocks.
 // Rules:
@@ -16,7 +18,7 @@ namespace SeriesBuilder {
 
 // RF: build two independent series for amplitude and phase.
 void buildRFSeries(
-    const std::vector<SeqBlock*>& blocks,
+    const DecodedBlockCache& blocks,
     const QVector<double>& edges,
     double tFactor,
     QVector<double>& rfTimeAmp,
@@ -27,7 +29,7 @@ void buildRFSeries(
 
 // Gradients: build merged series for GX, GY, GZ channels.
 void buildGradientSeries(
-    const std::vector<SeqBlock*>& blocks,
+    const DecodedBlockCache& blocks,
     const QVector<double>& edges,
     double tFactor,
     int channel, // 0=GX, 1=GY, 2=GZ
@@ -38,13 +40,48 @@ void buildGradientSeries(
 
 // ADC: build merged series for ADC events.
 void buildADCSeries(
-    const std::vector<SeqBlock*>& blocks,
+    const DecodedBlockCache& blocks,
     const QVector<double>& edges,
     double tFactor,
     QVector<double>& adcTime,
     QVector<double>& adcValues
 );
 
+// Per-block forms of buildGradientSeries and buildADCSeries, so the series can be built in the load pass.
+// The output vectors are cleared in begin() and must outlive the builder.
+class GradientSeriesBuilder : public BlockConsumer
+{
+public:
+    GradientSeriesBuilder(double tFactor, int channel, QVector<double>& gradTime, QVector<double>& gradValues,
+                          double gradientRasterUs = -1.0);
+    void begin(int blockCount) override;
+    void consume(int index, SeqBlock& block, double blockStart) override;
+
+private:
+    double m_tFactor;
+    int m_channel;
+    QVector<double>& m_time;
+    QVector<double>& m_values;
+    double m_gradientRasterUs;
+    bool m_hasAnyPoint {false};
+    double m_lastTime {0.0};
+    double m_lastVal {0.0};
+};
+
+class ADCSeriesBuilder : public BlockConsumer
+{
+public:
+    ADCSeriesBuilder(double tFactor, QVector<double>& adcTime, QVector<double>& adcValues)
+        : m_tFactor(tFactor), m_time(adcTime), m_values(adcValues) {}
+    void begin(int blockCount) override;
+    void consume(int index, SeqBlock& block, double blockStart) override;
+
+private:
+    double m_tFactor;
+    QVector<double>& m_time;
+    QVector<double>& m_values;
+};
+
 }
 
 #endif // SERIESBUILDER_H
@@ -27,6 +27,7 @@ Settings::Settings(QObject* parent)
     , m_gamma(42.576e6) // Hz/T for hydrogen
     , m_logLevel(LogLevel::Warning) // Default to Warning level
     , m_showExtensionTooltip(false)
+    , m_lazyBlockDecoding(false)
     // Old time-based LOD settings removed - replaced with complexity-based LOD system
 {
     // Place settings in per-user home directory: ~/.seqeyes/settings.json
@@ -421,6 +422,7 @@ void Settings::saveSettings()
     obj["showTeApproximateDialog"] = m_showTeApproximateDialog;
     obj["showTrajectoryApproximateDialog"] = m_showTrajectoryApproximateDialog;
     obj["showExtensionTooltip"] = m_showExtensionTooltip;
+    obj["lazyBlockDecoding"] = m_lazyBlockDecoding;
     // Input behavior
     obj["zoomInputMode"] = getZoomInputModeString();
     obj["panWheelEnabled"] = m_panWheelEnabled;
@@ -545,6 +547,7 @@ void Settings::loadSettings()
     m_showTeApproximateDialog = obj.value("showTeApproximateDialog").toBool(true);
     m_showTrajectoryApproximateDialog = obj.value("showTrajectoryApproximateDialog").toBool(true);
     m_showExtensionTooltip = obj.value("showExtensionTooltip").toBool(false);
+    m_lazyBlockDecoding = obj.value("lazyBlockDecoding").toBool(false);
 
     // Load extension labels (merge onto defaults)
     if (obj.contains("extensionLabels") && obj.value("extensionLabels").isObject())
@@ -585,6 +588,7 @@ void Settings::resetToDefaults()
     m_showTeApproximateDialog = true;
     m_showTrajectoryApproximateDialog = true;
     m_showExtensionTooltip = false;
+    m_lazyBlockDecoding = false;
     m_panLeftKey = QStringLiteral("A");
     m_panRightKey = QStringLiteral("D");
     // Old time-based LOD settings removed - replaced with complexity-based LOD system
@@ -723,3 +727,17 @@ bool Settings::getShowExtensionTooltip() const
 {
     return m_showExtensionTooltip;
 }
+
+void Settings::setLazyBlockDecoding(bool lazy)
+{
+    if (m_lazyBlockDecoding != lazy) {
+        m_lazyBlockDecoding = lazy;
+        saveSettings();
+        emit settingsChanged();
+    }
+}
+
+bool Settings::getLazyBlockDecoding() const
+{
+    return m_lazyBlockDecoding;
+}
@@ -155,6 +155,10 @@ public:
     void setShowExtensionTooltip(bool show);
     bool getShowExtensionTooltip() const;
 
+    // Decode blocks on demand through a bounded cache instead of all at load (large sequences)
+    void setLazyBlockDecoding(bool lazy);
+    bool getLazyBlockDecoding() const;
+
 signals:
     void settingsChanged();
     void timeUnitChanged();
@@ -186,6 +190,7 @@ private:
     bool m_showTeApproximateDialog { true }; // Show TE approximate warning for legacy sequences
     bool m_showTrajectoryApproximateDialog { true }; // Show trajectory warning for legacy sequences
     bool m_showExtensionTooltip { false }; // Show extension tooltip on hover
+    bool m_lazyBlockDecoding { false }; // Decode blocks on demand instead of at load
     // Old time-based LOD settings removed - replaced with complexity-based LOD system
     
     // Conversion helper functions
@@ -673,7 +673,7 @@ void TRManager::onTrSliderChanged(int value)
     else
     {
         int currentTrIndex = loader->getTrBlockIndices()[value];
-        int nextTrIndex = (value + 1 < loader->getTrBlockIndices().size()) ? loader->getTrBlockIndices()[value + 1] : loader->getDecodedSeqBlocks().size();
+        int nextTrIndex = (value + 1 < loader->getTrBlockIndices().size()) ? loader->getTrBlockIndices()[value + 1] : loader->getBlockCount();
         startTime = loader->getBlockEdges()[currentTrIndex];
         endTime = loader->getBlockEdges()[nextTrIndex];
     }
@@ -1177,31 +1177,25 @@ void TRManager::updateTrRangeDisplay()
             // Update time slider range for new TR, but postpone actual axis replot
             updateTimeSliderFromTrRange(startTr, endTr);
             
-            // Redraw with correct viewport using persistent graphs (no clearGraphs)
-            WaveformDrawer* drawer = m_mainWindow->getWaveformDrawer();
-            drawer->DrawRFWaveform(0, -1);
-            drawer->DrawADCWaveform(0, -1);
-            drawer->DrawGWaveform(0, -1);
-            if (drawer->getShowBlockEdges())
+            // Update axis range to the new TR window (preserve current relative window).
+            // The viewport sync redraws it, from the prefetched viewport cache when the step was predicted.
             {
-                drawer->DrawBlockEdges();
-            }
-            // Update axis range to the new TR window (preserve current relative window)
-            {
-                double relStart_ms = m_pTimeStartInput->text().toDouble();
-                double relEnd_ms   = m_pTimeEndInput->text().toDouble();
-                double trStart_ms  = (startTr - 1) * loader->getRepetitionTime_us() / 1000.0;
-                double absStart_ms = trStart_ms + relStart_ms;
-                double absEnd_ms   = trStart_ms + relEnd_ms;
-                double tFactor     = loader->getTFactor();
-                QCPRange newRange(absStart_ms * tFactor * 1000.0,
-                                  absEnd_ms   * tFactor * 1000.0);
+                QCPRange newRange = trWindowAxisRange(startTr);
                 if (auto ih = m_mainWindow->getInteractionHandler()) {
                     ih->synchronizeXAxes(newRange);
                 } else {
                     // Fallback: set each rect directly if InteractionHandler unavailable
-                    for (auto& rect : m_mainWindow->getWaveformDrawer()->getRects())
+                    WaveformDrawer* drawer = m_mainWindow->getWaveformDrawer();
+                    for (auto& rect : drawer->getRects())
                         rect->axis(QCPAxis::atBottom)->setRange(newRange);
+                    // Redraw with correct viewport using persistent graphs (no clearGraphs)
+                    drawer->DrawRFWaveform(0, -1);
+                    drawer->DrawADCWaveform(0, -1);
+                    drawer->DrawGWaveform(0, -1);
+                    if (drawer->getShowBlockEdges())
+                    {
+                        drawer->DrawBlockEdges();
+                    }
                 }
             }
 
@@ -1218,6 +1212,26 @@ void TRManager::updateTrRangeDisplay()
     m_mainWindow->ui->customPlot->replot();
 }
 
+int TRManager::trStepSize() const
+{
+    bool okInc = false;
+    int incVal = m_pTrIncInput->text().toInt(&okInc);
+    int step = okInc ? std::abs(incVal) : 1;
+    return step > 0 ? step : 1;
+}
+
+QCPRange TRManager::trWindowAxisRange(int startTr) const
+{
+    PulseqLoader* loader = m_mainWindow->getPulseqLoader();
+    double relStart_ms = m_pTimeStartInput->text().toDouble();
+    double relEnd_ms   = m_pTimeEndInput->text().toDouble();
+    double trStart_ms  = (startTr - 1) * loader->getRepetitionTime_us() / 1000.0;
+    double absStart_ms = trStart_ms + relStart_ms;
+    double absEnd_ms   = trStart_ms + relEnd_ms;
+    double tFactor     = loader->getTFactor();
+    return QCPRange(absStart_ms * tFactor * 1000.0, absEnd_ms * tFactor * 1000.0);
+}
+
 // Unified function to update time range - all time modifications should call this
 void TRManager::setTimeRange(double startMs, double endMs)
 {
@@ -1636,7 +1650,7 @@ void TRManager::updateBlockRangeFromTrRange(int startTr, int endTr)
 void TRManager::calculateBlockRangeFromTrRange(int startTr, int endTr, int& startBlock, int& endBlock)
 {
     PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-    if (!loader->hasRepetitionTime() || loader->getDecodedSeqBlocks().empty())
+    if (!loader->hasRepetitionTime() || loader->getBlockCount() == 0)
     {
         startBlock = 0;
         endBlock = 0;
@@ -1651,29 +1665,14 @@ void TRManager::calculateBlockRangeFromTrRange(int startTr, int endTr, int& star
         endTime = loader->getTotalDuration_us() * tFactor;
     }
 
-    const auto& blockEdges = loader->getBlockEdges();
-    startBlock = 0;
-    endBlock = loader->getDecodedSeqBlocks().size() - 1;
-
-    for (int i = 0; i < blockEdges.size() - 1; ++i)
-    {
-        if (startTime >= blockEdges[i] && startTime < blockEdges[i + 1])
-        {
-            startBlock = i;
-            break;
-        }
-    }
-    for (int i = 0; i < blockEdges.size() - 1; ++i)
-    {
-        if (endTime >= blockEdges[i] && endTime < blockEdges[i + 1])
-        {
-            endBlock = i;
-            break;
-        }
-    }
+    // Blocks containing the start and end times; the whole sequence if outside
+    startBlock = loader->findBlockAt(startTime);
+    endBlock = loader->findBlockAt(endTime);
+    if (startBlock < 0) startBlock = 0;
+    if (endBlock < 0) endBlock = loader->getBlockCount() - 1;
 
     if (startBlock < 0) startBlock = 0;
-    if (endBlock >= loader->getDecodedSeqBlocks().size()) endBlock = loader->getDecodedSeqBlocks().size() - 1;
+    if (endBlock >= loader->getBlockCount()) endBlock = loader->getBlockCount() - 1;
     if (startBlock > endBlock) startBlock = endBlock;
 }
 
@@ -1691,7 +1690,7 @@ void TRManager::onShowBlockEdgesToggled(bool checked)
         
         // Only update the ticker, don't redraw all waveforms
         PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-        if (loader && !loader->getDecodedSeqBlocks().empty())
+        if (loader && loader->getBlockCount() > 0)
         {
             // Just update the block edges display (which handles both cases)
             drawer->DrawBlockEdges();
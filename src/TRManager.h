@@ -66,6 +66,11 @@ public:
     DoubleRangeSlider* getTrRangeSlider() const { return m_pTrRangeSlider; }
     DoubleRangeSlider* getTimeRangeSlider() const { return m_pTimeRangeSlider; }
 
+    // TR stepping (TR-Segmented mode): step size of the shortcuts (|Inc|, at least 1), and the axis
+    // range shown for a TR range starting at startTr, keeping the relative time window
+    int trStepSize() const;
+    QCPRange trWindowAxisRange(int startTr) const;
+
 public slots:
     // Slots for UI connections
     void onTrRangeSliderChanged(int start, int end);
@@ -8,6 +8,7 @@
 #include "TRManager.h"
 #include "PulseqLabelAnalyzer.h"
 #include "ExtensionPlotter.h"
+#include "DecimationKernels.h"
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -16,6 +17,7 @@
 #include <QHash>
 #include <QTimer>
 #include <QPen>
+#include <QThread>
 #include <QtGlobal>
 #include <chrono>
 
@@ -101,6 +103,7 @@ WaveformDrawer::WaveformDrawer(MainWindow* mainWindow)
 WaveformDrawer::~WaveformDrawer()
 {
     // All QCustomPlot items are owned by the plot itself.
+    stopViewportRenderer();
 }
 
 void WaveformDrawer::InitSequenceFigure()
@@ -841,14 +844,67 @@ void WaveformDrawer::ResetView()
     customPlot->replot();
 }
 
+// Viewport the channel series are built for: optionally kept inside the sequence (RF), and
+// intersected with the selected TRs (moved by trOffset TRs) in TR-Segmented mode.
+void WaveformDrawer::clampRenderViewport(bool clampToSequence, double& visibleStart, double& visibleEnd, int trOffset) const
+{
+    PulseqLoader* loader = m_mainWindow->getPulseqLoader();
+    if (clampToSequence)
+    {
+        // Ensure visible range is also valid
+        if (visibleStart < 0) visibleStart = 0;
+        if (visibleEnd <= visibleStart) visibleEnd = visibleStart + 1.0;
+
+        // Ensure visible range doesn't exceed sequence bounds
+        double totalDuration = loader->getTotalDuration_us() * loader->getTFactor();
+        if (totalDuration > 0)
+        {
+            if (visibleEnd > totalDuration) visibleEnd = totalDuration;
+            if (visibleStart > totalDuration) visibleStart = totalDuration;
+        }
+    }
+
+    // Clamp viewport to TR bounds if TR-Segmented mode is active
+    TRManager* trm = m_mainWindow->getTRManager();
+    if (trm && loader->hasRepetitionTime() && trm->isTrBasedMode())
+    {
+        int startTr = trm->getTrStartInput()->text().toInt() + trOffset;
+        int endTr = trm->getTrEndInput()->text().toInt() + trOffset;
+        double trStart = (startTr - 1) * loader->getRepetitionTime_us() * loader->getTFactor();
+        double trEnd = endTr * loader->getRepetitionTime_us() * loader->getTFactor();
+        // In TR range mode, intersect with TR bounds instead of expanding to full TR.
+        // This preserves deep zoom behavior for accurate rendering/detail.
+        visibleStart = std::max(visibleStart, trStart);
+        visibleEnd = std::min(visibleEnd, trEnd);
+        if (visibleEnd <= visibleStart) {
+            // Fallback to a minimal positive window within TR to avoid empty draw
+            visibleStart = trStart;
+            visibleEnd = std::max(trStart + 1e-6, trEnd);
+        }
+    }
+}
+
+// Device pixel width of an axis rect (fallback if it does not exist). In FULL_DETAIL mode an
+// effectively huge width is returned to disable decimation in the loader.
+int WaveformDrawer::viewportPixelWidth(int rectIndex, int fallback) const
+{
+    int px = fallback;
+    if (m_vecRects.size() > rectIndex && m_vecRects[rectIndex])
+        px = qMax(1, static_cast<int>(qRound(m_vecRects[rectIndex]->width() * m_mainWindow->devicePixelRatioF())));
+    if (getCurrentLODLevel() != LODLevel::DOWNSAMPLED)
+        px = qMax(px, 100000);
+    return px;
+}
+
 void WaveformDrawer::DrawRFWaveform(const double& dStartTime, double dEndTime)
 {
     static int callCount = 0;
     callCount++;
     // Debug logging removed
     
+    discardViewportRender(); // drawn synchronously; a render in flight is stale
     PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-    if (loader->getDecodedSeqBlocks().empty()) return;
+    if (loader->getBlockCount() == 0) return;
 
     // Validate input parameters - ensure non-negative time coordinates
     double safeStartTime = dStartTime;
@@ -866,39 +922,7 @@ void WaveformDrawer::DrawRFWaveform(const double& dStartTime, double dEndTime)
     QCPRange viewport = m_vecRects[0]->axis(QCPAxis::atBottom)->range();
     double visibleStart = viewport.lower;
     double visibleEnd = viewport.upper;
-    
-    // Debug logging removed
-
-    // Ensure visible range is also valid
-    if (visibleStart < 0) visibleStart = 0;
-    if (visibleEnd <= visibleStart) visibleEnd = visibleStart + 1.0;
-
-    // Ensure visible range doesn't exceed sequence bounds
-    double totalDuration = loader->getTotalDuration_us() * loader->getTFactor();
-    if (totalDuration > 0)
-    {
-        if (visibleEnd > totalDuration) visibleEnd = totalDuration;
-        if (visibleStart > totalDuration) visibleStart = totalDuration;
-    }
-
-    // Clamp viewport to TR bounds if TR-Segmented mode is active
-    TRManager* trm = m_mainWindow->getTRManager();
-    if (trm && m_mainWindow->getPulseqLoader()->hasRepetitionTime() && trm->isTrBasedMode())
-    {
-        int startTr = trm->getTrStartInput()->text().toInt();
-        int endTr = trm->getTrEndInput()->text().toInt();
-        double trStart = (startTr - 1) * loader->getRepetitionTime_us() * loader->getTFactor();
-        double trEnd = endTr * loader->getRepetitionTime_us() * loader->getTFactor();
-        // In TR range mode, intersect with TR bounds instead of expanding to full TR.
-        // This preserves deep zoom behavior for accurate rendering/detail.
-        visibleStart = std::max(visibleStart, trStart);
-        visibleEnd = std::min(visibleEnd, trEnd);
-        if (visibleEnd <= visibleStart) {
-            // Fallback to a minimal positive window within TR to avoid empty draw
-            visibleStart = trStart;
-            visibleEnd = std::max(trStart + 1e-6, trEnd);
-        }
-    }
+    clampRenderViewport(true, visibleStart, visibleEnd);
     updateTeGuides(visibleStart, visibleEnd);
     updateKxKyZeroGuides(visibleStart, visibleEnd);
 
@@ -907,78 +931,25 @@ void WaveformDrawer::DrawRFWaveform(const double& dStartTime, double dEndTime)
 
     // Fast path: RF on-demand viewport rendering via shape cache
     {
-        int pxRF = 0;
-        if (m_vecRects.size() > 1 && m_vecRects[1])
-            pxRF = qMax(1, static_cast<int>(qRound(m_vecRects[1]->width() * m_mainWindow->devicePixelRatioF())));
-        // If LOD is FULL_DETAIL, force an effectively huge pixel width to disable decimation in loader
-        int pxRFEffective = (currentLODLevel == LODLevel::DOWNSAMPLED ? pxRF : qMax(pxRF, 100000));
-
+        // If LOD is FULL_DETAIL, the pixel widths are forced huge to disable decimation in loader
+        const int pxRFEffective = viewportPixelWidth(1, 0);
+        const double gamma = Settings::getInstance().getGamma();
         QVector<double> tAmp, vAmp, tPh, vPh;
-        loader->getRfViewportDecimated(visibleStart, visibleEnd, pxRFEffective, tAmp, vAmp, tPh, vPh);
-        if (m_graphRFMag) { m_graphRFMag->setData(tAmp, vAmp); m_graphRFMag->setVisible(m_curveVisibility.value(1, true)); }
-        if (m_graphRFPh)  { m_graphRFPh->setData(tPh, vPh);   m_graphRFPh->setVisible(m_curveVisibility.value(2, true)); }
+        loader->getRfViewportDecimated(visibleStart, visibleEnd, pxRFEffective, tAmp, vAmp, tPh, vPh, gamma);
 
         // Added: ADC Phase (pixel-aware decimation like RF)
         QVector<double> tAdcPh, vAdcPh;
-        int pxADCPh = pxRFEffective; // reuse RF effective pixel width for phase rect
-        if (m_vecRects.size() > 2 && m_vecRects[2])
-            pxADCPh = qMax(1, static_cast<int>(qRound(m_vecRects[2]->width() * m_mainWindow->devicePixelRatioF())));
-        if (currentLODLevel != LODLevel::DOWNSAMPLED)
-            pxADCPh = qMax(pxADCPh, 100000); // full detail mode
-        loader->getAdcPhaseViewport(visibleStart, visibleEnd, pxADCPh, tAdcPh, vAdcPh);
-        if (m_graphADCPh) {
-             m_graphADCPh->setData(tAdcPh, vAdcPh);
-             m_graphADCPh->setVisible(m_curveVisibility.value(2, true)); // controlled by RF Phase visibility checkbox
-        }
-
-        if (!m_lockYAxisRanges)
-        {
-            auto upd = [](const QVector<double>& arr, double& mn, double& mx){ for (double v: arr){ if (std::isnan(v)) continue; if (v<mn) mn=v; if (v>mx) mx=v; } };
-            double minMag = std::numeric_limits<double>::max();
-            double maxMag = -std::numeric_limits<double>::infinity();
-            double minPh  = std::numeric_limits<double>::max();
-            double maxPh  = -std::numeric_limits<double>::infinity();
-            upd(vAmp, minMag, maxMag); upd(vPh, minPh, maxPh);
-            upd(vAdcPh, minPh, maxPh); // Include ADC phase in range computation
-
-            if (maxMag >= minMag && m_vecRects.size() > 1 && m_vecRects[1]){
-                double pad = (maxMag - minMag) * 0.05; if (pad == 0) pad = 1.0;
-                m_vecRects[1]->axis(QCPAxis::atLeft)->setRange(minMag - pad, maxMag + pad);
-            }
-            if (maxPh >= minPh && m_vecRects.size() > 2 && m_vecRects[2]){
-                // Force full [-pi, pi] range coverage to ensure negative values are visible
-                double forceMin = -3.2; // slightly more than -pi
-                double forceMax = 3.2;  // slightly more than pi
-                if (minPh > forceMin) minPh = forceMin;
-                if (maxPh < forceMax) maxPh = forceMax;
-                
-                double pad = (maxPh - minPh) * 0.05; if (pad == 0) pad = 1.0;
-                m_vecRects[2]->axis(QCPAxis::atLeft)->setRange(minPh - pad, maxPh + pad);
-            }
-        } else {
-            if (m_vecRects.size() > 1 && m_vecRects[1]) m_vecRects[1]->axis(QCPAxis::atLeft)->setRange(m_fixedYRanges[1].first, m_fixedYRanges[1].second);
-            if (m_vecRects.size() > 2 && m_vecRects[2]) m_vecRects[2]->axis(QCPAxis::atLeft)->setRange(m_fixedYRanges[2].first, m_fixedYRanges[2].second);
-        }
-        
-        // DEBUG: Unconditionally force phase Y-axis range to [-3.5, 3.5] to reveal negative values
-        if (m_vecRects.size() > 2 && m_vecRects[2]) {
-             m_vecRects[2]->axis(QCPAxis::atLeft)->setRange(-3.5, 3.5);
-        }
+        loader->getAdcPhaseViewport(visibleStart, visibleEnd, viewportPixelWidth(2, pxRFEffective), tAdcPh, vAdcPh, gamma);
+        applyRfViewportSeries(tAmp, vAmp, tPh, vPh, tAdcPh, vAdcPh);
         return;
     }
 
     // Visible block range
     const auto& edges = loader->getBlockEdges();
-    int startBlock = loader->getBlockRangeStart();
-    int endBlock = loader->getBlockRangeEnd();
-    for (int i = startBlock; i <= endBlock; ++i)
-    {
-        if (i + 1 < edges.size() && edges[i + 1] > visibleStart) { startBlock = i; break; }
-    }
-    for (int i = endBlock; i >= startBlock; --i)
-    {
-        if (edges[i] < visibleEnd) { endBlock = i; break; }
-    }
+    int startBlock = 0, endBlock = -1;
+    if (!loader->findBlockRange(visibleStart, visibleEnd, startBlock, endBlock)) return;
+    startBlock = std::max(startBlock, loader->getBlockRangeStart());
+    endBlock = std::min(endBlock, loader->getBlockRangeEnd());
     if (startBlock > endBlock) return;
 
     if (startBlock >= edges.size() || startBlock < 0) {
@@ -1275,10 +1246,56 @@ void WaveformDrawer::DrawRFWaveform(const double& dStartTime, double dEndTime)
     }
 }
 
+void WaveformDrawer::applyRfViewportSeries(const QVector<double>& tAmp, const QVector<double>& vAmp,
+                                           const QVector<double>& tPh, const QVector<double>& vPh,
+                                           const QVector<double>& tAdcPh, const QVector<double>& vAdcPh)
+{
+    if (m_graphRFMag) { m_graphRFMag->setData(tAmp, vAmp); m_graphRFMag->setVisible(m_curveVisibility.value(1, true)); }
+    if (m_graphRFPh)  { m_graphRFPh->setData(tPh, vPh);   m_graphRFPh->setVisible(m_curveVisibility.value(2, true)); }
+    if (m_graphADCPh) {
+         m_graphADCPh->setData(tAdcPh, vAdcPh);
+         m_graphADCPh->setVisible(m_curveVisibility.value(2, true)); // controlled by RF Phase visibility checkbox
+    }
+
+    if (!m_lockYAxisRanges)
+    {
+        auto upd = [](const QVector<double>& arr, double& mn, double& mx){ for (double v: arr){ if (std::isnan(v)) continue; if (v<mn) mn=v; if (v>mx) mx=v; } };
+        double minMag = std::numeric_limits<double>::max();
+        double maxMag = -std::numeric_limits<double>::infinity();
+        double minPh  = std::numeric_limits<double>::max();
+        double maxPh  = -std::numeric_limits<double>::infinity();
+        upd(vAmp, minMag, maxMag); upd(vPh, minPh, maxPh);
+        upd(vAdcPh, minPh, maxPh); // Include ADC phase in range computation
+
+        if (maxMag >= minMag && m_vecRects.size() > 1 && m_vecRects[1]){
+            double pad = (maxMag - minMag) * 0.05; if (pad == 0) pad = 1.0;
+            m_vecRects[1]->axis(QCPAxis::atLeft)->setRange(minMag - pad, maxMag + pad);
+        }
+        if (maxPh >= minPh && m_vecRects.size() > 2 && m_vecRects[2]){
+            // Force full [-pi, pi] range coverage to ensure negative values are visible
+            double forceMin = -3.2; // slightly more than -pi
+            double forceMax = 3.2;  // slightly more than pi
+            if (minPh > forceMin) minPh = forceMin;
+            if (maxPh < forceMax) maxPh = forceMax;
+            
+            double pad = (maxPh - minPh) * 0.05; if (pad == 0) pad = 1.0;
+            m_vecRects[2]->axis(QCPAxis::atLeft)->setRange(minPh - pad, maxPh + pad);
+        }
+    } else {
+        if (m_vecRects.size() > 1 && m_vecRects[1]) m_vecRects[1]->axis(QCPAxis::atLeft)->setRange(m_fixedYRanges[1].first, m_fixedYRanges[1].second);
+        if (m_vecRects.size() > 2 && m_vecRects[2]) m_vecRects[2]->axis(QCPAxis::atLeft)->setRange(m_fixedYRanges[2].first, m_fixedYRanges[2].second);
+    }
+    
+    // DEBUG: Unconditionally force phase Y-axis range to [-3.5, 3.5] to reveal negative values
+    if (m_vecRects.size() > 2 && m_vecRects[2]) {
+         m_vecRects[2]->axis(QCPAxis::atLeft)->setRange(-3.5, 3.5);
+    }
+}
+
 void WaveformDrawer::DrawADCWaveform(const double& dStartTime, double dEndTime)
 {
     PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-    if (loader->getDecodedSeqBlocks().empty()) return;
+    if (loader->getBlockCount() == 0) return;
     
     // ʹ��PulseqLabelAnalyzer����ȷ������ǩ״̬
     static PulseqLabelAnalyzer* labelAnalyzer = nullptr;
@@ -1324,19 +1341,8 @@ void WaveformDrawer::DrawADCWaveform(const double& dStartTime, double dEndTime)
     // Compute unified ADC rectangle height based on label range across the sequence
     double adcHeight = 1.0; // default when no label exists
     {
-        double maxAbsLabel = 0.0;
-        const auto& blocks = loader->getDecodedSeqBlocks();
-        for (auto* blk : blocks)
-        {
-            if (!blk) continue;
-            if (blk->isLabel())
-            {
-                const auto& sets = blk->GetLabelSetEvents();
-                const auto& incs = blk->GetLabelIncEvents();
-                for (const auto& e : sets) { maxAbsLabel = std::max(maxAbsLabel, std::abs((double)e.numVal.second)); }
-                for (const auto& e : incs) { maxAbsLabel = std::max(maxAbsLabel, std::abs((double)e.numVal.second)); }
-            }
-        }
+        // Largest label set/inc value, collected once at load in the sequence table
+        double maxAbsLabel = loader->getSequenceTable().maxAbsLabelValue;
         // Include precomputed max accumulated counter (e.g. LIN=63 from INC events)
         maxAbsLabel = std::max(maxAbsLabel, (double)loader->getMaxAccumulatedCounter());
         if (maxAbsLabel <= 0.0) maxAbsLabel = 1.0;
@@ -1456,7 +1462,7 @@ void WaveformDrawer::DrawADCWaveform(const double& dStartTime, double dEndTime)
                 auto itL = std::upper_bound(edges.begin(), edges.end(), visibleStart);
                 int b0 = std::max(0, int(std::distance(edges.begin(), itL)) - 1);
                 auto itU = std::upper_bound(edges.begin(), edges.end(), visibleEnd);
-                int b1 = std::min(int(loader->getDecodedSeqBlocks().size()) - 1,
+                int b1 = std::min(loader->getBlockCount() - 1,
                                   std::max(b0, int(std::distance(edges.begin(), itU)) - 1));
                 for (int b = b0; b <= b1; ++b)
                 {
@@ -1509,7 +1515,7 @@ void WaveformDrawer::DrawTriggerOverlay()
         return;
 
     PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-    if (!loader || loader->getDecodedSeqBlocks().empty())
+    if (!loader || loader->getBlockCount() == 0)
         return;
 
     if (m_vecRects.isEmpty() || !m_vecRects[0])
@@ -1549,12 +1555,12 @@ void WaveformDrawer::DrawTriggerOverlay()
         auto itL = std::upper_bound(edges.begin(), edges.end(), visibleStart);
         int b0   = std::max(0, int(std::distance(edges.begin(), itL)) - 1);
         auto itU = std::upper_bound(edges.begin(), edges.end(), visibleEnd);
-        int b1   = std::min(int(loader->getDecodedSeqBlocks().size()) - 1,
+        int b1   = std::min(loader->getBlockCount() - 1,
                             std::max(b0, int(std::distance(edges.begin(), itU)) - 1));
 
         for (int b = b0; b <= b1; ++b)
         {
-            SeqBlock* blk = loader->getDecodedSeqBlocks()[b];
+            const std::shared_ptr<SeqBlock> blk = loader->getDecodedBlock(b);
             if (!blk || !blk->isTrigger())
                 continue;
             const TriggerEvent& trg = blk->GetTriggerEvent();
@@ -1597,8 +1603,9 @@ void WaveformDrawer::DrawTriggerOverlay()
 
 void WaveformDrawer::DrawGWaveform(const double& dStartTime, double dEndTime)
 {
+    discardViewportRender(); // drawn synchronously; a render in flight is stale
     PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-    if (loader->getDecodedSeqBlocks().empty()) return;
+    if (loader->getBlockCount() == 0) return;
 
     // Determine visible viewport in internal time units
     if (m_vecRects.isEmpty() || !m_vecRects[0]) {
@@ -1608,36 +1615,15 @@ void WaveformDrawer::DrawGWaveform(const double& dStartTime, double dEndTime)
     QCPRange viewport = m_vecRects[0]->axis(QCPAxis::atBottom)->range();
     double visibleStart = viewport.lower;
     double visibleEnd = viewport.upper;
+    clampRenderViewport(false, visibleStart, visibleEnd);
 
-    // Clamp viewport to TR bounds if TR-Segmented mode is active
-    TRManager* trm2 = m_mainWindow->getTRManager();
-    if (trm2 && m_mainWindow->getPulseqLoader()->hasRepetitionTime() && trm2->isTrBasedMode())
-    {
-        int startTr = trm2->getTrStartInput()->text().toInt();
-        int endTr = trm2->getTrEndInput()->text().toInt();
-        double trStart = (startTr - 1) * loader->getRepetitionTime_us() * loader->getTFactor();
-        double trEnd = endTr * loader->getRepetitionTime_us() * loader->getTFactor();
-        // Intersect with TR bounds to keep zoom fidelity
-        visibleStart = std::max(visibleStart, trStart);
-        visibleEnd = std::min(visibleEnd, trEnd);
-        if (visibleEnd <= visibleStart) {
-            visibleStart = trStart;
-            visibleEnd = std::max(trStart + 1e-6, trEnd);
-        }
-    }
-
-    // Use simple LOD system
-    LODLevel currentLODLevel = getCurrentLODLevel();
     double tFactor = loader->getTFactor();
 
     // Phase 2: On-demand gradients per channel using loader cache
     for (int channel = 0; channel < 3; ++channel) {
         int curveIndex = channel + 3;
-        int px = 0;
-        if (m_vecRects.size() > curveIndex && m_vecRects[curveIndex])
-            px = qMax(1, static_cast<int>(qRound(m_vecRects[curveIndex]->width() * m_mainWindow->devicePixelRatioF())));
         // Respect LOD: in FULL_DETAIL mode, disable decimation by faking a huge pixel width
-        int pxEffective = (currentLODLevel == LODLevel::DOWNSAMPLED ? px : qMax(px, 100000));
+        int pxEffective = viewportPixelWidth(curveIndex, 0);
 
         QVector<double> tG, vG;
         loader->getGradViewportDecimated(channel, visibleStart, visibleEnd, pxEffective, tG, vG);
@@ -1654,23 +1640,29 @@ void WaveformDrawer::DrawGWaveform(const double& dStartTime, double dEndTime)
             }
         }
 
-        QCPGraph* target = (channel == 0 ? m_graphGx : (channel == 1 ? m_graphGy : m_graphGz));
-        if (target) {
-            target->setData(tG, vG);
-            target->setVisible(m_curveVisibility.value(curveIndex, true) && !tG.isEmpty());
-
-            if (!m_lockYAxisRanges) {
-                double mn = std::numeric_limits<double>::max();
-                double mx = -std::numeric_limits<double>::infinity();
-                for (double v : vG) { if (!std::isnan(v)) { if (v < mn) mn = v; if (v > mx) mx = v; } }
-                if (mx >= mn) {
-                    double pad = (mx - mn) * 0.05; if (pad == 0) pad = 0.1;
-                    m_vecRects[curveIndex]->axis(QCPAxis::atLeft)->setRange(mn - pad, mx + pad);
-                }
-            } else {
-                if (m_vecRects.size() > curveIndex && m_vecRects[curveIndex])
-                    m_vecRects[curveIndex]->axis(QCPAxis::atLeft)->setRange(m_fixedYRanges[curveIndex].first, m_fixedYRanges[curveIndex].second);
+        applyGradViewportSeries(channel, tG, vG);
+    }
+}
+
+void WaveformDrawer::applyGradViewportSeries(int channel, const QVector<double>& tG, const QVector<double>& vG)
+{
+    int curveIndex = channel + 3;
+    QCPGraph* target = (channel == 0 ? m_graphGx : (channel == 1 ? m_graphGy : m_graphGz));
+    if (target) {
+        target->setData(tG, vG);
+        target->setVisible(m_curveVisibility.value(curveIndex, true) && !tG.isEmpty());
+
+        if (!m_lockYAxisRanges) {
+            double mn = std::numeric_limits<double>::max();
+            double mx = -std::numeric_limits<double>::infinity();
+            for (double v : vG) { if (!std::isnan(v)) { if (v < mn) mn = v; if (v > mx) mx = v; } }
+            if (mx >= mn) {
+                double pad = (mx - mn) * 0.05; if (pad == 0) pad = 0.1;
+                m_vecRects[curveIndex]->axis(QCPAxis::atLeft)->setRange(mn - pad, mx + pad);
             }
+        } else {
+            if (m_vecRects.size() > curveIndex && m_vecRects[curveIndex])
+                m_vecRects[curveIndex]->axis(QCPAxis::atLeft)->setRange(m_fixedYRanges[curveIndex].first, m_fixedYRanges[curveIndex].second);
         }
     }
 }
@@ -1691,14 +1683,7 @@ void WaveformDrawer::computeAndLockYAxisRanges()
     };
 
     // 0: ADC/labels -> use computed adcHeight similar to DrawADCWaveform
-    double maxAbsLabel = 0.0;
-    for (auto* blk : loader->getDecodedSeqBlocks()) {
-        if (!blk) continue; if (blk->isLabel()) {
-            const auto& sets = blk->GetLabelSetEvents(); const auto& incs = blk->GetLabelIncEvents();
-            for (const auto& e : sets) maxAbsLabel = std::max(maxAbsLabel, std::abs((double)e.numVal.second));
-            for (const auto& e : incs) maxAbsLabel = std::max(maxAbsLabel, std::abs((double)e.numVal.second));
-        }
-    }
+    double maxAbsLabel = loader->getSequenceTable().maxAbsLabelValue;
     // Include precomputed max accumulated counter (e.g. LIN=63 from INC events)
     maxAbsLabel = std::max(maxAbsLabel, (double)loader->getMaxAccumulatedCounter());
     if (maxAbsLabel <= 0.0) maxAbsLabel = 1.0;
@@ -1744,7 +1729,7 @@ void WaveformDrawer::computeAndLockYAxisRanges()
 void WaveformDrawer::DrawBlockEdges()
 {
     PulseqLoader* loader = m_mainWindow->getPulseqLoader();
-    if (loader->getDecodedSeqBlocks().empty()) return;
+    if (loader->getBlockCount() == 0) return;
 
     const auto& edges = loader->getBlockEdges();
     if (edges.isEmpty()) return;
@@ -1755,22 +1740,25 @@ void WaveformDrawer::DrawBlockEdges()
     double visibleStart = viewport.lower;
     double visibleEnd = viewport.upper;
 
+    // Edges inside the viewport
+    int firstEdge = 0, endEdge = 0;
+    BlockLookup::edgeRange(edges, visibleStart, visibleEnd, firstEdge, endEdge);
+
     // Build per-rect vertical line segments with NaN breaks
     for (int r = 0; r < m_vecRects.size(); ++r)
     {
         if (!m_blockEdgeGraphs.value(r)) continue;
-        QVector<double> xs; xs.reserve(edges.size()*3);
-        QVector<double> ys; ys.reserve(edges.size()*3);
+        QVector<double> xs; xs.reserve((endEdge - firstEdge)*3);
+        QVector<double> ys; ys.reserve((endEdge - firstEdge)*3);
 
         // Use current y-range of the rect to span full height
         QCPRange yr = m_vecRects[r]->axis(QCPAxis::atLeft)->range();
         double yMin = yr.lower;
         double yMax = yr.upper;
 
-        for (int i = 0; i < edges.size(); ++i)
+        for (int i = firstEdge; i < endEdge; ++i)
         {
             double t = edges[i];
-            if (t < visibleStart || t > visibleEnd) continue;
             xs.append(t); ys.append(yMin);
             xs.append(t); ys.append(yMax);
             xs.append(t); ys.append(std::numeric_limits<double>::quiet_NaN()); // break
@@ -1960,10 +1948,10 @@ void WaveformDrawer::ensureRenderedForCurrentViewport()
             }
             return;
         }
-        // Redraw visible content for all channels based on the current viewport
-        DrawRFWaveform();
+        // Redraw visible content for all channels based on the current viewport; the RF, ADC phase
+        // and gradient series follow from the render worker
+        requestViewportRender();
         DrawADCWaveform();
-        DrawGWaveform();
         DrawTriggerOverlay();
         if (getShowBlockEdges()) DrawBlockEdges();
         m_mainWindow->ui->customPlot->replot();
@@ -1978,6 +1966,298 @@ void WaveformDrawer::ensureRenderedForCurrentViewport()
     }
 }
 
+// ===== Render worker =====
+// Interactive viewport changes build the six channel series on a worker thread, so a slow decimation
+// never blocks wheel and mouse handling. The worker takes the loader's viewport mutex for one channel
+// at a time and re-checks the data revision and whether the request was superseded before each, so
+// hover sampling and synchronous draws wait for one channel at most; the GUI thread only swaps
+// finished series into the graphs.
+// Built series are kept in a cache bounded by viewport_cache_budget_mb (zoom_config.json). Once the
+// current viewport is done, the worker prefetches its likely successors (previous/next TR range, one
+// pan step either way, one zoom step in and out) until the next request arrives, so stepping through
+// them is served from the cache without a build.
+
+bool WaveformDrawer::ViewportKey::matches(const ViewportKey& other) const
+{
+    // Predicted windows come from the same arithmetic as the real ones; allow for rounding only
+    auto same = [](double a, double b, double span) { return std::abs(a - b) <= 1e-9 * (span + std::abs(a)); };
+    const double rfSpan = std::abs(rfEnd - rfStart);
+    const double gradSpan = std::abs(gradEnd - gradStart);
+    return revision == other.revision && gamma == other.gamma && gradScale == other.gradScale
+        && pxRf == other.pxRf && pxAdcPh == other.pxAdcPh
+        && pxGrad[0] == other.pxGrad[0] && pxGrad[1] == other.pxGrad[1] && pxGrad[2] == other.pxGrad[2]
+        && same(rfStart, other.rfStart, rfSpan) && same(rfEnd, other.rfEnd, rfSpan)
+        && same(gradStart, other.gradStart, gradSpan) && same(gradEnd, other.gradEnd, gradSpan);
+}
+
+qint64 WaveformDrawer::ViewportSeries::bytes() const
+{
+    qint64 values = tAmp.size() + vAmp.size() + tPh.size() + vPh.size() + tAdcPh.size() + vAdcPh.size();
+    for (int channel = 0; channel < 3; ++channel)
+        values += tG[channel].size() + vG[channel].size();
+    return values * qint64(sizeof(double)) + qint64(sizeof(ViewportSeries));
+}
+
+WaveformDrawer::ViewportKey WaveformDrawer::viewportKeyFor(double axisStart, double axisEnd, int trOffset) const
+{
+    ViewportKey key;
+    key.rfStart = axisStart;
+    key.rfEnd = axisEnd;
+    clampRenderViewport(true, key.rfStart, key.rfEnd, trOffset);
+    key.gradStart = axisStart;
+    key.gradEnd = axisEnd;
+    clampRenderViewport(false, key.gradStart, key.gradEnd, trOffset);
+
+    key.pxRf = viewportPixelWidth(1, 0);
+    key.pxAdcPh = viewportPixelWidth(2, key.pxRf);
+    for (int channel = 0; channel < 3; ++channel)
+        key.pxGrad[channel] = viewportPixelWidth(channel + 3, 0);
+    // Gradient unit conversions are linear in the value
+    Settings& s = Settings::getInstance();
+    const QString toUnit = s.getGradientUnitString();
+    if (toUnit != "Hz/m") key.gradScale = s.convertGradient(1.0, "Hz/m", toUnit);
+    key.gamma = s.getGamma();
+    key.revision = m_mainWindow->getPulseqLoader()->viewportRevision();
+    return key;
+}
+
+QVector<WaveformDrawer::ViewportKey> WaveformDrawer::prefetchKeysFor(const QCPRange& axisRange) const
+{
+    QVector<ViewportKey> keys;
+    InteractionHandler* ih = m_mainWindow->getInteractionHandler();
+    PulseqLoader* loader = m_mainWindow->getPulseqLoader();
+    if (!ih || !loader) return keys;
+
+    // Axis range [lower, upper] as InteractionHandler::synchronizeXAxes would clamp it to the extent
+    auto addWindow = [&](double lower, double upper, const QCPRange& extent, int trOffset) {
+        const double width = upper - lower;
+        if (width <= 0) return;
+        if (width >= extent.size()) { lower = extent.lower; upper = extent.upper; }
+        else if (lower < extent.lower) { upper += extent.lower - lower; lower = extent.lower; }
+        else if (upper > extent.upper) { lower -= upper - extent.upper; upper = extent.upper; }
+        keys.append(viewportKeyFor(lower, upper, trOffset));
+    };
+
+    // TR stepping in TR-Segmented mode (Alt+Q/W): the selected TR range moves by the TR increment
+    TRManager* trm = m_mainWindow->getTRManager();
+    if (trm && loader->hasRepetitionTime() && trm->isTrBasedMode())
+    {
+        const int startTr = trm->getTrStartInput()->text().toInt();
+        const int endTr = trm->getTrEndInput()->text().toInt();
+        const double tFactor = loader->getTFactor();
+        for (int offset : {trm->trStepSize(), -trm->trStepSize()})
+        {
+            if (startTr + offset < 1 || endTr + offset > loader->getTrCount()) continue;
+            const QCPRange next = trm->trWindowAxisRange(startTr + offset);
+            const QCPRange nextExtent((startTr + offset - 1) * loader->getRepetitionTime_us() / 1000.0 * tFactor * 1000.0,
+                                      (endTr + offset) * loader->getRepetitionTime_us() / 1000.0 * tFactor * 1000.0);
+            addWindow(next.lower, next.upper, nextExtent, offset);
+        }
+    }
+
+    // Pan buttons and wheel: 10% of the range; zoom buttons: factor 1.2 about the centre
+    const QCPRange extent = ih->getCurrentTimeRange();
+    const double step = axisRange.size() * 0.1;
+    addWindow(axisRange.lower + step, axisRange.upper + step, extent, 0);
+    addWindow(axisRange.lower - step, axisRange.upper - step, extent, 0);
+    const double center = (axisRange.lower + axisRange.upper) * 0.5;
+    for (double newRange : {axisRange.size() / 1.2, axisRange.size() * 1.2})
+        addWindow(center - newRange * 0.5, center + newRange * 0.5, extent, 0);
+    return keys;
+}
+
+std::shared_ptr<const WaveformDrawer::ViewportSeries> WaveformDrawer::findCachedViewport(const ViewportKey& key)
+{
+    for (int i = 0; i < m_viewportCache.size(); ++i)
+    {
+        if (!m_viewportCache[i].key.matches(key)) continue;
+        if (i > 0) m_viewportCache.move(i, 0);
+        return m_viewportCache.first().series;
+    }
+    return nullptr;
+}
+
+void WaveformDrawer::insertCachedViewport(const ViewportKey& key, const std::shared_ptr<const ViewportSeries>& series, qint64 budget)
+{
+    // Replace the same viewport and drop everything built from older sequence data
+    for (int i = m_viewportCache.size() - 1; i >= 0; --i)
+    {
+        if (m_viewportCache[i].key.revision == key.revision && !m_viewportCache[i].key.matches(key)) continue;
+        m_viewportCacheBytes -= m_viewportCache[i].series->bytes();
+        m_viewportCache.removeAt(i);
+    }
+    const qint64 bytes = series->bytes();
+    if (bytes > budget) return;
+    m_viewportCache.prepend(CachedViewport{key, series});
+    m_viewportCacheBytes += bytes;
+    while (m_viewportCacheBytes > budget)
+    {
+        m_viewportCacheBytes -= m_viewportCache.last().series->bytes();
+        m_viewportCache.removeLast();
+    }
+}
+
+std::shared_ptr<WaveformDrawer::ViewportSeries> WaveformDrawer::buildViewportSeries(PulseqLoader* loader, const ViewportKey& key,
+                                                                                     const std::function<bool()>& abandon)
+{
+    // Hover sampling and synchronous draws on the GUI thread take the same mutex; between channels
+    // they get it back, and the series is dropped if they changed the data meanwhile
+    auto current = [&]() {
+        return !abandon() && loader->viewportRevision() == key.revision && loader->getBlockCount() > 0;
+    };
+    auto series = std::make_shared<ViewportSeries>();
+    {
+        QMutexLocker dataLock(&loader->viewportMutex());
+        if (!current()) return nullptr;
+        loader->getRfViewportDecimated(key.rfStart, key.rfEnd, key.pxRf, series->tAmp, series->vAmp, series->tPh, series->vPh,
+                                       key.gamma);
+    }
+    {
+        QMutexLocker dataLock(&loader->viewportMutex());
+        if (!current()) return nullptr;
+        loader->getAdcPhaseViewport(key.rfStart, key.rfEnd, key.pxAdcPh, series->tAdcPh, series->vAdcPh, key.gamma);
+    }
+    for (int channel = 0; channel < 3; ++channel)
+    {
+        {
+            QMutexLocker dataLock(&loader->viewportMutex());
+            if (!current()) return nullptr;
+            loader->getGradViewportDecimated(channel, key.gradStart, key.gradEnd, key.pxGrad[channel],
+                                             series->tG[channel], series->vG[channel]);
+        }
+        if (key.gradScale != 1.0)
+            for (double& v : series->vG[channel]) v *= key.gradScale;
+    }
+    return series;
+}
+
+void WaveformDrawer::requestViewportRender()
+{
+    PulseqLoader* loader = m_mainWindow->getPulseqLoader();
+    if (!loader || loader->getBlockCount() == 0 || m_vecRects.isEmpty() || !m_vecRects[0]) return;
+
+    const QCPRange viewport = m_vecRects[0]->axis(QCPAxis::atBottom)->range();
+    ViewportRenderRequest request;
+    request.loader = loader;
+    request.key = viewportKeyFor(viewport.lower, viewport.upper);
+    updateTeGuides(request.key.rfStart, request.key.rfEnd);
+    updateKxKyZeroGuides(request.key.rfStart, request.key.rfEnd);
+    request.cacheBudget = qint64(m_zoomManager ? m_zoomManager->getViewportCacheBudgetMb() : 0) * 1024 * 1024;
+    if (request.cacheBudget > 0) request.prefetch = prefetchKeysFor(viewport);
+    request.generation = ++m_renderGeneration;
+
+    std::shared_ptr<const ViewportSeries> cached;
+    {
+        QMutexLocker lock(&m_renderMutex);
+        cached = findCachedViewport(request.key);
+    }
+    if (cached)
+    {
+        // Prefetched: shown by the caller's replot, the worker only prefetches further
+        applyViewportSeries(*cached);
+        request.build = false;
+    }
+
+    if (!m_renderThread)
+    {
+        m_renderThread = QThread::create([this]() { runViewportRenderer(); });
+        m_renderThread->start();
+    }
+    QMutexLocker lock(&m_renderMutex);
+    m_pendingRender = request; // replaces a request the worker has not picked up yet
+    m_hasPendingRender = true;
+    m_renderWake.wakeOne();
+}
+
+void WaveformDrawer::runViewportRenderer()
+{
+    for (;;)
+    {
+        ViewportRenderRequest request;
+        {
+            QMutexLocker lock(&m_renderMutex);
+            while (!m_hasPendingRender && !m_stopRenderer)
+                m_renderWake.wait(&m_renderMutex);
+            if (m_stopRenderer) return;
+            request = m_pendingRender;
+            m_hasPendingRender = false;
+        }
+        PulseqLoader* loader = request.loader;
+
+        if (request.build)
+        {
+            std::shared_ptr<const ViewportSeries> series;
+            {
+                QMutexLocker lock(&m_renderMutex);
+                series = findCachedViewport(request.key); // prefetched after the request was posted
+            }
+            if (!series)
+            {
+                // Superseded while building (newer viewport, synchronous draw or reload)
+                const quint64 generation = request.generation;
+                series = buildViewportSeries(loader, request.key,
+                                             [this, generation]() { return generation != m_renderGeneration.load(); });
+                if (!series) continue;
+            }
+            if (request.cacheBudget > 0)
+            {
+                QMutexLocker lock(&m_renderMutex);
+                insertCachedViewport(request.key, series, request.cacheBudget);
+            }
+            const quint64 generation = request.generation;
+            QMetaObject::invokeMethod(this, [this, generation, series]() { applyViewportRender(generation, *series); },
+                                      Qt::QueuedConnection);
+        }
+
+        // Speculative prefetch, abandoned as soon as a new request comes in
+        for (const ViewportKey& key : request.prefetch)
+        {
+            {
+                QMutexLocker lock(&m_renderMutex);
+                if (m_hasPendingRender || m_stopRenderer) break;
+                if (findCachedViewport(key)) continue;
+            }
+            const std::shared_ptr<const ViewportSeries> series = buildViewportSeries(loader, key, [this]() {
+                QMutexLocker lock(&m_renderMutex);
+                return m_hasPendingRender || m_stopRenderer;
+            });
+            if (!series) break;
+            QMutexLocker lock(&m_renderMutex);
+            insertCachedViewport(key, series, request.cacheBudget);
+        }
+    }
+}
+
+void WaveformDrawer::applyViewportRender(quint64 generation, const ViewportSeries& series)
+{
+    if (generation != m_renderGeneration.load()) return; // stale
+    applyViewportSeries(series);
+    m_mainWindow->ui->customPlot->replot(QCustomPlot::rpQueuedReplot);
+}
+
+void WaveformDrawer::applyViewportSeries(const ViewportSeries& series)
+{
+    applyRfViewportSeries(series.tAmp, series.vAmp, series.tPh, series.vPh, series.tAdcPh, series.vAdcPh);
+    for (int channel = 0; channel < 3; ++channel)
+        applyGradViewportSeries(channel, series.tG[channel], series.vG[channel]);
+}
+
+void WaveformDrawer::stopViewportRenderer()
+{
+    if (!m_renderThread) return;
+    {
+        QMutexLocker lock(&m_renderMutex);
+        m_stopRenderer = true;
+        m_renderWake.wakeOne();
+    }
+    m_renderThread->wait();
+    delete m_renderThread;
+    m_renderThread = nullptr;
+    ++m_renderGeneration; // results still queued to the GUI thread are stale
+    m_viewportCache.clear();
+    m_viewportCacheBytes = 0;
+}
+
 void WaveformDrawer::updateAxisLabels()
 {
     // Update Y-axis labels using each rect's fixed identity (matching InitSequenceFigure).
@@ -2076,120 +2356,15 @@ void WaveformDrawer::applyLTTBDownsampling(const QVector<double>& time, const QV
                                           int targetPoints,
                                           QVector<double>& sampledTime, QVector<double>& sampledValues)
 {
-    if (time.isEmpty() || values.isEmpty() || time.size() != values.size()) {
-        sampledTime.clear();
-        sampledValues.clear();
-        return;
-    }
-
-    // Guard targetPoints
-    if (targetPoints <= 0) targetPoints = 2;
-    if (targetPoints > time.size()) targetPoints = time.size();
-    
-    if (time.size() <= targetPoints) {
-        // No downsampling needed
-        sampledTime = time;
-        sampledValues = values;
-        return;
-    }
-    
-    // LTTB algorithm implementation
-    sampledTime.clear();
-    sampledValues.clear();
-    sampledTime.reserve(targetPoints);
-    sampledValues.reserve(targetPoints);
-
-    // Always include first point
-    sampledTime.append(time.first());
-    sampledValues.append(values.first());
-
-    if (targetPoints <= 2) {
-        // If only 2 points, include last point
-        if (targetPoints == 2) {
-            sampledTime.append(time.last());
-            sampledValues.append(values.last());
-        }
-        return;
-    }
-
-    // Calculate bucket size
-    int bucketSize = (time.size() - 2) / (targetPoints - 2);
-    
-    for (int i = 1; i < targetPoints - 1; ++i) {
-        int bucketStart = (i - 1) * bucketSize + 1;
-        int bucketEnd = qMin(bucketStart + bucketSize, static_cast<int>(time.size()) - 1);
-        
-        // Find the point with the largest triangle area
-        double maxArea = -1.0;
-        int maxIndex = bucketStart;
-        
-        for (int j = bucketStart; j < bucketEnd; ++j) {
-            double area = calculateTriangleArea(
-                time[i-1], values[i-1],           // Previous point
-                time[j], values[j],               // Current point
-                time[bucketEnd], values[bucketEnd] // Next bucket start
-            );
-            
-            if (area > maxArea) {
-                maxArea = area;
-                maxIndex = j;
-            }
-        }
-        
-        sampledTime.append(time[maxIndex]);
-        sampledValues.append(values[maxIndex]);
-    }
-
-    // Always include last point
-    sampledTime.append(time.last());
-    sampledValues.append(values.last());
-}
-
-double WaveformDrawer::calculateTriangleArea(double x1, double y1, double x2, double y2, double x3, double y3)
-{
-    // Using the formula: |(x2-x1)(y3-y1) - (x3-x1)(y2-y1)| / 2
-    return qAbs((x2 - x1) * (y3 - y1) - (x3 - x1) * (y2 - y1)) / 2.0;
+    DecimationKernels::lttb(time, values, targetPoints, sampledTime, sampledValues);
 }
 
- 
-
 // Min-max per pixel buckets: O(n) and preserves envelope; outputs up to 2*pixelBuckets points
 void WaveformDrawer::applyMinMaxDownsampling(const QVector<double>& time, const QVector<double>& values,
                                             int pixelBuckets,
                                             QVector<double>& outTime, QVector<double>& outValues)
 {
-    outTime.clear(); outValues.clear();
-    if (time.isEmpty() || values.isEmpty() || time.size() != values.size() || pixelBuckets <= 0) return;
-    int n = time.size();
-    if (n <= 2*pixelBuckets) { outTime = time; outValues = values; return; }
-    outTime.reserve(2*pixelBuckets);
-    outValues.reserve(2*pixelBuckets);
-    double tMin = time.first();
-    double tMax = time.last();
-    if (tMax <= tMin) { outTime = time; outValues = values; return; }
-    double bucketW = (tMax - tMin) / pixelBuckets;
-    int idx = 0;
-    for (int b = 0; b < pixelBuckets; ++b) {
-        double bx0 = tMin + b*bucketW;
-        double bx1 = (b == pixelBuckets-1) ? tMax : (bx0 + bucketW);
-        double ymin = std::numeric_limits<double>::infinity();
-        double ymax = -std::numeric_limits<double>::infinity();
-        double txMin = bx0, txMax = bx0;
-        // advance idx to first point >= bx0
-        while (idx < n && time[idx] < bx0) ++idx;
-        int j = idx;
-        for (; j < n && time[j] <= bx1; ++j) {
-            double v = values[j];
-            if (std::isnan(v)) continue; // skip breaks
-            if (v < ymin) { ymin = v; txMin = time[j]; }
-            if (v > ymax) { ymax = v; txMax = time[j]; }
-        }
-        if (ymin != std::numeric_limits<double>::infinity()) {
-            outTime.append(txMin); outValues.append(ymin);
-            if (ymax != ymin) { outTime.append(txMax); outValues.append(ymax); }
-        }
-        idx = j;
-    }
+    DecimationKernels::minMaxByTime(time, values, pixelBuckets, outTime, outValues);
 }
 
 // Simple LOD system - no complex precomputation needed
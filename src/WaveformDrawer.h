@@ -8,6 +8,10 @@
 #include <QDateTime>
 #include <QString>
 #include <QTimer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
 #include <memory>
 
 class ExtensionPlotter;
@@ -22,6 +26,9 @@ class QCPMarginGroup;
 class QCPItemText;
 class Settings;
 class ZoomManager;
+class PulseqLoader;
+class QThread;
+class QCPRange;
 namespace QCP { class Range; }
 
 class WaveformDrawer : public QObject
@@ -57,6 +64,15 @@ public:
     
     // Ensure current viewport has been rendered at the correct detail
     void ensureRenderedForCurrentViewport();
+
+    // Render worker: builds the RF/ADC phase/gradient series of the current viewport off the GUI thread.
+    // Only the newest request is built; its result replaces the graph data in one step. Viewports
+    // already in the series cache are applied at once; the worker then prefetches the likely next ones.
+    void requestViewportRender();
+    // Drop renders in flight, e.g. because the data they read is going away or was drawn synchronously
+    void discardViewportRender() { ++m_renderGeneration; }
+    // Stop the worker thread; must run before the PulseqLoader it reads from is destroyed
+    void stopViewportRenderer();
     
     // Simple viewport change processing
     void processViewportChangeSimple(double visibleStart, double visibleEnd);
@@ -124,6 +140,58 @@ public slots:
 private:
     // Old time-based LOD functions removed - replaced with complexity-based LOD system
 
+    // Viewport and pixel widths the channel series are built for, shared by the synchronous draws
+    // and the render worker requests
+    void clampRenderViewport(bool clampToSequence, double& visibleStart, double& visibleEnd, int trOffset = 0) const;
+    int viewportPixelWidth(int rectIndex, int fallback) const;
+    // Put built series into the persistent graphs and update their Y ranges
+    void applyRfViewportSeries(const QVector<double>& tAmp, const QVector<double>& vAmp,
+                               const QVector<double>& tPh, const QVector<double>& vPh,
+                               const QVector<double>& tAdcPh, const QVector<double>& vAdcPh);
+    void applyGradViewportSeries(int channel, const QVector<double>& tG, const QVector<double>& vG);
+
+    // Everything the viewport series depend on
+    struct ViewportKey {
+        double rfStart {0.0}, rfEnd {0.0};     // RF and ADC phase viewport
+        double gradStart {0.0}, gradEnd {0.0}; // gradient viewport
+        int pxRf {0};
+        int pxAdcPh {0};
+        int pxGrad[3] {0, 0, 0};
+        double gradScale {1.0};                // Hz/m -> selected gradient unit
+        double gamma {0.0};                    // RF/ADC phase offsets
+        quint64 revision {0};                  // PulseqLoader::viewportRevision()
+        bool matches(const ViewportKey& other) const;
+    };
+    struct ViewportSeries {
+        QVector<double> tAmp, vAmp, tPh, vPh, tAdcPh, vAdcPh;
+        QVector<double> tG[3], vG[3];
+        qint64 bytes() const;
+    };
+    struct ViewportRenderRequest {
+        quint64 generation {0};
+        PulseqLoader* loader {nullptr};
+        ViewportKey key;
+        bool build {true};               // false if the GUI thread already applied it from the cache
+        QVector<ViewportKey> prefetch;   // likely next viewports, most likely first
+        qint64 cacheBudget {0};          // bytes
+    };
+    struct CachedViewport {
+        ViewportKey key;
+        std::shared_ptr<const ViewportSeries> series;
+    };
+    ViewportKey viewportKeyFor(double axisStart, double axisEnd, int trOffset = 0) const;
+    QVector<ViewportKey> prefetchKeysFor(const QCPRange& axisRange) const;
+    // Viewport series cache (LRU, front = most recent); callers hold m_renderMutex
+    std::shared_ptr<const ViewportSeries> findCachedViewport(const ViewportKey& key);
+    void insertCachedViewport(const ViewportKey& key, const std::shared_ptr<const ViewportSeries>& series, qint64 budget);
+    // Build all series of a viewport, taking the loader's viewport mutex for one channel at a time.
+    // Null if the loader's data changed or abandon() returned true before a channel.
+    static std::shared_ptr<ViewportSeries> buildViewportSeries(PulseqLoader* loader, const ViewportKey& key,
+                                                               const std::function<bool()>& abandon);
+    void runViewportRenderer();
+    void applyViewportRender(quint64 generation, const ViewportSeries& series);
+    void applyViewportSeries(const ViewportSeries& series);
+
 private:
     MainWindow* m_mainWindow;
 
@@ -208,7 +276,6 @@ private:
     void applyLTTBDownsampling(const QVector<double>& time, const QVector<double>& values,
                                int targetPoints,
                                QVector<double>& downsampledTime, QVector<double>& downsampledValues);
-    double calculateTriangleArea(double x1, double y1, double x2, double y2, double x3, double y3);
     // Very fast min-max per pixel downsampling for huge spans
     void applyMinMaxDownsampling(const QVector<double>& time, const QVector<double>& values,
                                  int pixelBuckets,
@@ -233,6 +300,18 @@ private:
     // Zoom management
     ZoomManager* m_zoomManager {nullptr};
 
+    // Render worker state; the request slot holds only the newest request
+    QThread* m_renderThread {nullptr};
+    QMutex m_renderMutex;
+    QWaitCondition m_renderWake;
+    ViewportRenderRequest m_pendingRender;
+    bool m_hasPendingRender {false};
+    bool m_stopRenderer {false};
+    // Bumped by every request and synchronous draw; results of older generations are dropped
+    std::atomic<quint64> m_renderGeneration {0};
+    QVector<CachedViewport> m_viewportCache;
+    qint64 m_viewportCacheBytes {0};
+
     // Extension labels overlay (SLC/REP/AVG...)
     std::unique_ptr<ExtensionPlotter> m_extensionPlotter;
 
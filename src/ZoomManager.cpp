@@ -25,7 +25,8 @@ ZoomManager::ZoomManager(QObject* parent)
       
       // Cache configuration
       m_maxCacheEntries(1000),
-      m_cacheCleanupThreshold(1000)
+      m_cacheCleanupThreshold(1000),
+      m_viewportCacheBudgetMb(64)
 {
 }
 
@@ -64,6 +65,8 @@ bool ZoomManager::loadConfig(const QString& configPath)
         m_maxCacheEntries = obj.value("max_cache_entries").toInt(m_maxCacheEntries);
     if (obj.contains("cache_cleanup_threshold")) 
         m_cacheCleanupThreshold = obj.value("cache_cleanup_threshold").toInt(m_cacheCleanupThreshold);
+    if (obj.contains("viewport_cache_budget_mb"))
+        m_viewportCacheBudgetMb = qMax(0, obj.value("viewport_cache_budget_mb").toInt(m_viewportCacheBudgetMb));
 
     return true;
 }
@@ -34,6 +34,8 @@ public:
     // Cache configuration
     int getMaxCacheEntries() const { return m_maxCacheEntries; }
     int getCacheCleanupThreshold() const { return m_cacheCleanupThreshold; }
+    // Memory budget of the viewport series cache and its prefetcher (MB, 0 disables both)
+    int getViewportCacheBudgetMb() const { return m_viewportCacheBudgetMb; }
 
 private:
     // Complexity-based LOD thresholds
@@ -49,6 +51,7 @@ private:
     // Cache configuration
     int m_maxCacheEntries;        // Maximum number of cached entries
     int m_cacheCleanupThreshold;   // Cache cleanup threshold
+    int m_viewportCacheBudgetMb;   // Viewport series cache budget (MB)
 };
 
 #endif // ZOOMMANAGER_H
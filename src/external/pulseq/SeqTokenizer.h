@@ -0,0 +1,201 @@
+/** @file SeqTokenizer.h - Locale-independent field tokenizer shared by the Pulseq loaders */
+
+#ifndef _SEQ_TOKENIZER_H_
+#define _SEQ_TOKENIZER_H_
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#if !(defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L)
+#include <locale.h>
+#include <stdlib.h>
+#if defined(__APPLE__) || defined(__FreeBSD__)
+#include <xlocale.h>
+#endif
+#endif
+
+// optionally use SEQ_NAMESPACE
+#ifdef SEQ_NAMESPACE
+namespace SEQ_NAMESPACE {
+#endif
+
+/**
+ * @brief Sequential reader of whitespace separated fields in one line of a .seq file
+ *
+ * Replacement for the sscanf() calls of the loaders: numbers are converted with
+ * std::from_chars, which neither allocates nor depends on the current C locale
+ * (a comma decimal separator set by the host application cannot break the parser).
+ * Like sscanf, leading whitespace of each field is skipped, conversion stops at the
+ * first character that does not belong to the number, and once a field fails all
+ * following reads are ignored. count() then returns the number of converted fields,
+ * i.e. the value sscanf would have returned.
+ *
+ * @code
+ *   SeqTokenizer tok(line, line+length);
+ *   tok >> id >> event.amplitude >> event.delay;
+ *   if (!tok) ...   // or tok.count()<3
+ * @endcode
+ */
+class SeqTokenizer
+{
+  public:
+	SeqTokenizer(const char* begin, const char* end) : m_pos(begin), m_end(end), m_count(0), m_bFailed(false) {}
+	explicit SeqTokenizer(const char* str) : m_pos(str), m_end(str+strlen(str)), m_count(0), m_bFailed(false) {}
+
+	SeqTokenizer& operator>>(int& value)    { return readInteger(value); }
+	SeqTokenizer& operator>>(long& value)   { return readInteger(value); }
+	SeqTokenizer& operator>>(float& value)  { return readFloat(value); }
+	SeqTokenizer& operator>>(double& value) { return readFloat(value); }
+
+	/**
+	 * @brief Read the next non-whitespace character (sscanf " %c")
+	 */
+	SeqTokenizer& operator>>(char& value)
+	{
+		if (!begin()) return *this;
+		value = *m_pos++;
+		return converted();
+	}
+
+	/**
+	 * @brief Read the next word (sscanf "%s"), truncated to size-1 characters; buffer may be NULL to skip the word
+	 */
+	SeqTokenizer& word(char* buffer, int size)
+	{
+		if (!begin()) return *this;
+		const char* start = m_pos;
+		while (m_pos<m_end && !isSpace(*m_pos))
+			++m_pos;
+		if (buffer && size>0) {
+			size_t n = m_pos-start;
+			if (n > (size_t)(size-1)) n = size-1;
+			memcpy(buffer, start, n);
+			buffer[n] = '\0';
+		}
+		return converted();
+	}
+
+	/**
+	 * @brief Match a literal keyword (e.g. "extension"), does not count as a converted field
+	 */
+	SeqTokenizer& expect(const char* literal)
+	{
+		if (!begin()) return *this;
+		size_t n = strlen(literal);
+		if ((size_t)(m_end-m_pos)<n || 0!=strncmp(m_pos, literal, n))
+			m_bFailed = true;
+		else
+			m_pos += n;
+		return *this;
+	}
+
+	int count() const { return m_count; }               /**< @brief Number of successfully converted fields */
+	bool good() const { return !m_bFailed; }            /**< @brief No conversion failed so far */
+	operator bool() const { return !m_bFailed; }
+	const char* position() const { return m_pos; }      /**< @brief Current read position (sscanf "%n") */
+	const char* end() const { return m_end; }
+
+	static bool isSpace(char c) { return c==' ' || c=='\t' || c=='\r' || c=='\n' || c=='\v' || c=='\f'; }
+
+  private:
+	/** @brief Skip whitespace in front of the next field, false if there is nothing left to read */
+	bool begin()
+	{
+		if (m_bFailed) return false;
+		while (m_pos<m_end && isSpace(*m_pos))
+			++m_pos;
+		if (m_pos>=m_end) {
+			m_bFailed = true;
+			return false;
+		}
+		return true;
+	}
+
+	SeqTokenizer& converted() { ++m_count; return *this; }
+
+	/** @brief Start of the number without an explicit '+' sign, which from_chars does not accept */
+	const char* numberStart() const
+	{
+		if (*m_pos=='+' && m_pos+1<m_end && *(m_pos+1)!='-' && *(m_pos+1)!='+')
+			return m_pos+1;
+		return m_pos;
+	}
+
+	template <typename T>
+	SeqTokenizer& readInteger(T& value)
+	{
+		if (!begin()) return *this;
+		std::from_chars_result res = std::from_chars(numberStart(), m_end, value);
+		if (res.ec != std::errc()) {
+			m_bFailed = true;
+			return *this;
+		}
+		m_pos = res.ptr;
+		return converted();
+	}
+
+	template <typename T>
+	SeqTokenizer& readFloat(T& value)
+	{
+		if (!begin()) return *this;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+		const char* start = numberStart();
+		std::from_chars_result res = std::from_chars(start, m_end, value);
+		if (res.ec == std::errc::result_out_of_range) {
+			// like strtod: underflow gives zero, overflow gives infinity
+			bool bNegative = (*start=='-');
+			bool bUnderflow = false;
+			for (const char* p=start; p+1<res.ptr; ++p)
+				if ((*p=='e' || *p=='E') && *(p+1)=='-')
+					bUnderflow = true;
+			value = bUnderflow ? T(0) : std::numeric_limits<T>::infinity();
+			if (bNegative) value = -value;
+			m_pos = res.ptr;
+			return converted();
+		}
+		if (res.ec != std::errc()) {
+			m_bFailed = true;
+			return *this;
+		}
+		m_pos = res.ptr;
+#else
+		// standard libraries without floating-point from_chars: strtod in the "C" locale on a
+		// bounded copy of the field, the global locale may use a comma decimal separator
+		char field[64];
+		size_t n = 0;
+		const char* p = m_pos;
+		while (p<m_end && !isSpace(*p) && n<sizeof(field)-1)
+			field[n++] = *p++;
+		field[n] = '\0';
+		char* fieldEnd = NULL;
+#ifdef _WIN32
+		static const _locale_t cLocale = _create_locale(LC_NUMERIC, "C");
+		double v = _strtod_l(field, &fieldEnd, cLocale);
+#else
+		static const locale_t cLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+		double v = strtod_l(field, &fieldEnd, cLocale);
+#endif
+		if (fieldEnd==field) {
+			m_bFailed = true;
+			return *this;
+		}
+		value = static_cast<T>(v);
+		m_pos += fieldEnd-field;
+#endif
+		return converted();
+	}
+
+	const char* m_pos;
+	const char* m_end;
+	int m_count;
+	bool m_bFailed;
+};
+
+// optionally close SEQ_NAMESPACE
+#ifdef SEQ_NAMESPACE
+}; // namespace SEQ_NAMESPACE
+#endif
+
+#endif // _SEQ_TOKENIZER_H_
@@ -1,6 +1,6 @@
 #include "ExternalSequence.h"
+#include "../SeqTokenizer.h"
 
-#include <stdio.h>		// sscanf
 #include <cstring>		// strlen etc
 #include <iomanip>		// std::setw etc
 
@@ -186,7 +186,6 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 	}
 
 	char buffer[MAX_LINE_SIZE];
-	char tmpStr[MAX_LINE_SIZE];
 
 	print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Building index" );
 
@@ -204,20 +203,20 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 		{
 			//print_msg(DEBUG_MEDIUM_LEVEL, std::ostringstream().flush() << "buffer: \n" << buffer << std::endl );
 			if (0==strncmp(buffer,"major",5)) {
-				    if (1!=sscanf(buffer+5, "%d", &version_major)) {
+				    if (1!=(SeqTokenizer(buffer+5) >> version_major).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode version_major");
 					return false;
 				}
 			    print_msg(DEBUG_MEDIUM_LEVEL, std::ostringstream().flush() << "major=" << version_major);		
 			} else if (0==strncmp(buffer,"minor",5)) {
-				if (1!=sscanf(buffer+5, "%d", &version_minor)) {
+				if (1!=(SeqTokenizer(buffer+5) >> version_minor).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode version_minor");
 					return false;
 				}
 				print_msg(DEBUG_MEDIUM_LEVEL, std::ostringstream().flush() << "minor=" << version_minor);
 			}
 			else if (0==strncmp(buffer,"revision",8)) {
-				if (1!=sscanf(buffer+8, "%d", &version_revision)) {
+				if (1!=(SeqTokenizer(buffer+8) >> version_revision).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode version_revision \n" << buffer << std::endl );
 					return false;
 				}
@@ -269,12 +268,12 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 
 			while (data_stream.good() && buffer[0]=='s')
 			{
-				if (2!=sscanf(buffer, "%s%d", tmpStr, &shapeId)) {
+				if (2!=(SeqTokenizer(buffer).word(NULL,0) >> shapeId).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'shapeId'\n" << buffer << std::endl );
 					return false;
 				}
 				getline(data_stream, buffer, MAX_LINE_SIZE);
-				if (2!=sscanf(buffer, "%s%d", tmpStr, &numSamples)) {
+				if (2!=(SeqTokenizer(buffer).word(NULL,0) >> numSamples).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'numSamples'\n" << buffer << std::endl );
 					return false;
 				}
@@ -287,7 +286,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 					if (buffer[0]=='s' || strlen(buffer)==0) {
 						break;
 					}
-					if (1!=sscanf(buffer, "%f", &sample)) {
+					if (1!=(SeqTokenizer(buffer) >> sample).count()) {
 						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'sample'\n" << buffer << std::endl );
 						return false;
 					}
@@ -337,10 +336,10 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				RFEvent event;
 				if (version_combined<1004000L)
 				{
-					if (7!=sscanf(buffer, "%d%f%d%d%d%f%f", &rfId, &(event.amplitude),
-								&(event.magShape),&(event.phaseShape), &(event.delay),
-								&(event.freqOffset), &(event.phaseOffset)
-								)) {
+					if (7!=(SeqTokenizer(buffer) >> rfId >> event.amplitude
+								>> event.magShape >> event.phaseShape >> event.delay
+								>> event.freqOffset >> event.phaseOffset
+								).count()) {
 						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
 						return false;
 					}
@@ -348,10 +347,10 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				}
 				else
 				{
-					if (8!=sscanf(buffer, "%d%f%d%d%d%d%f%f", &rfId, &(event.amplitude),
-								&(event.magShape),&(event.phaseShape),&(event.timeShape),&(event.delay),
-								&(event.freqOffset), &(event.phaseOffset)
-								)) {
+					if (8!=(SeqTokenizer(buffer) >> rfId >> event.amplitude
+								>> event.magShape >> event.phaseShape >> event.timeShape
+								>> event.delay >> event.freqOffset >> event.phaseOffset
+								).count()) {
 						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
 						return false;
 					}
@@ -374,7 +373,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				GradEvent event;
 				if ( version_combined>=1004000L )
 				{
-					if (5!=sscanf(buffer, "%d%f%d%d%d", &gradId, &(event.amplitude), &(event.waveShape), &(event.timeShape), &(event.delay))) {
+					if (5!=(SeqTokenizer(buffer) >> gradId >> event.amplitude >> event.waveShape >> event.timeShape >> event.delay).count()) {
 						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.4.x gradient event\n" << buffer << std::endl );
 						return false;
 					}
@@ -382,7 +381,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				else
 				{
 					event.timeShape=0;
-					if (4!=sscanf(buffer, "%d%f%d%d", &gradId, &(event.amplitude), &(event.waveShape), &(event.delay))) {
+					if (4!=(SeqTokenizer(buffer) >> gradId >> event.amplitude >> event.waveShape >> event.delay).count()) {
 						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.2.x gradient event\n" << buffer << std::endl );
 						return false;
 					}
@@ -402,8 +401,8 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				}
 				int gradId;
 				GradEvent event;
-				if (6!=sscanf(buffer, "%d%f%ld%ld%ld%d", &gradId, &(event.amplitude),
-					&(event.rampUpTime),&(event.flatTime),&(event.rampDownTime),&(event.delay))) {
+				if (6!=(SeqTokenizer(buffer) >> gradId >> event.amplitude
+					>> event.rampUpTime >> event.flatTime >> event.rampDownTime >> event.delay).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode trapezoid gradient entry" << buffer << std::endl );
 					return false;
 				}					
@@ -429,8 +428,9 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 					break;
 				}
 				ADCEvent event;
-				if (6!=sscanf(buffer, "%d%d%d%d%f%f", &adcId, &(event.numSamples),
-							&(event.dwellTime),&(event.delay),&(event.freqOffset),&(event.phaseOffset))) {
+				if (6!=(SeqTokenizer(buffer) >> adcId >> event.numSamples
+							>> event.dwellTime >> event.delay >> event.freqOffset >> event.phaseOffset
+							).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode ADC event\n" << buffer << std::endl );
 					return false;
 				}
@@ -451,7 +451,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				if (buffer[0]=='[' || strlen(buffer)==0) {
 					break;
 				}
-				if (2!=sscanf(buffer, "%d%ld", &delayId, &delay)) {
+				if (2!=(SeqTokenizer(buffer) >> delayId >> delay).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode delay event\n" << buffer << std::endl );
 					return false;
 				}
@@ -492,7 +492,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 					char szStrID[MAX_LINE_SIZE];
 					int nInternalID=0;
 					int nKnownID=EXT_UNKNOWN;
-					if (2!=sscanf(buffer, "extension %s %d", szStrID, &nInternalID)) {
+					if (2!=(SeqTokenizer(buffer).expect("extension").word(szStrID, MAX_LINE_SIZE) >> nInternalID).count()) {
 						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode extension header entry\n" << buffer << std::endl );
 						return false;
 					}
@@ -523,7 +523,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 					LabelEvent	label;			   // write label event
 					switch (nExtensionID) {
 						case EXT_LIST: 
-							if (4!=sscanf(buffer, "%d%d%d%ld", &nID, &(extEntry.type), &(extEntry.ref), &(extEntry.next))) {
+							if (4!=(SeqTokenizer(buffer) >> nID >> extEntry.type >> extEntry.ref >> extEntry.next).count()) {
 								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode extension list entry\n" << buffer << std::endl );
 								return false;
 							}
@@ -532,17 +532,15 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 							print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "nID:" << nID << " type:" << extEntry.type << " ref" << extEntry.ref << " next:" << extEntry.next);
 							break;
 						case EXT_TRIGGER: 
-							if (5!=sscanf(buffer, "%d%d%d%ld%ld", &nID, &(trigger.triggerType), &(trigger.triggerChannel), &(trigger.delay), &(trigger.duration))) {
+							if (5!=(SeqTokenizer(buffer) >> nID >> trigger.triggerType >> trigger.triggerChannel >> trigger.delay >> trigger.duration).count()) {
 								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode trigger event\n" << buffer << std::endl );
 								return false;
 							}
 							m_triggerLibrary[nID] = trigger;
 							break;
 						case EXT_ROTATION: 
-							if (10!=sscanf(buffer, "%d%lf%lf%lf%lf%lf%lf%lf%lf%lf", &nID, 
-										&rotation.rotMatrix[0], &rotation.rotMatrix[1], &rotation.rotMatrix[2],
-										&rotation.rotMatrix[3], &rotation.rotMatrix[4], &rotation.rotMatrix[5],
-										&rotation.rotMatrix[6], &rotation.rotMatrix[7], &rotation.rotMatrix[8])) {
+							if (10!=(SeqTokenizer(buffer) >> nID
+								>> rotation.rotMatrix[0] >> rotation.rotMatrix[1] >> rotation.rotMatrix[2] >> rotation.rotMatrix[3] >> rotation.rotMatrix[4] >> rotation.rotMatrix[5] >> rotation.rotMatrix[6] >> rotation.rotMatrix[7] >> rotation.rotMatrix[8]).count()) {
 								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode rotation event\n" << buffer << std::endl );
 								return false;
 							}
@@ -550,7 +548,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 							m_rotationLibrary[nID] = rotation; 
 							break;
 						case EXT_LABELSET: 
-							if (3!=sscanf(buffer, "%d%d%s", &nID, &nVal, szLabelID)) {
+							if (3!=(SeqTokenizer(buffer) >> nID >> nVal).word(szLabelID, MAX_LINE_SIZE).count()) {
 								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to load labelset event\n" << buffer << std::endl );
 								return false;
 							}
@@ -564,7 +562,7 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 							m_labelsetLibrary[nID] = label;
 							break;
 						case EXT_LABELINC: 
-							if (3!=sscanf(buffer, "%d%d%s", &nID, &nVal, szLabelID)) {
+							if (3!=(SeqTokenizer(buffer) >> nID >> nVal).word(szLabelID, MAX_LINE_SIZE).count()) {
 								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode labelinc event\n" << buffer << std::endl );
 								return false;
 							}
@@ -597,10 +595,8 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				}
 				ControlEvent event;
 				event.type = ControlEvent::ROTATION;
-				if (10!=sscanf(buffer, "%d%lf%lf%lf%lf%lf%lf%lf%lf%lf", &controlId, 
-							&event.rotMatrix[0], &event.rotMatrix[1], &event.rotMatrix[2],
-							&event.rotMatrix[3], &event.rotMatrix[4], &event.rotMatrix[5],
-							&event.rotMatrix[6], &event.rotMatrix[7], &event.rotMatrix[8])) {
+				if (10!=(SeqTokenizer(buffer) >> controlId
+						>> event.rotMatrix[0] >> event.rotMatrix[1] >> event.rotMatrix[2] >> event.rotMatrix[3] >> event.rotMatrix[4] >> event.rotMatrix[5] >> event.rotMatrix[6] >> event.rotMatrix[7] >> event.rotMatrix[8]).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode rotation event\n" << buffer << std::endl );
 					return false;
 				}
@@ -753,13 +749,13 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 			memset(events.id, 0, NUM_EVENTS*sizeof(int));
 			long dur_ru =0;
 
-			int ret=sscanf(buffer, "%d%d%d%d%d%d%d%d", &blockIdx,
-					&dur_ru,                                        // block duration
-					&events.id[RF],                                 // RF
-					&events.id[GX],&events.id[GY],&events.id[GZ],   // Gradients
-					&events.id[ADC],                                // ADCs
-					&events.id[EXT]                                 // Extensions
-					);
+			int ret=(SeqTokenizer(buffer) >> blockIdx
+					>> dur_ru                                       // block duration
+					>> events.id[RF]                                // RF
+					>> events.id[GX] >> events.id[GY] >> events.id[GZ] // Gradients
+					>> events.id[ADC]                               // ADCs
+					>> events.id[EXT]                               // Extensions
+					).count();
 			if (7>ret
 					) {
 						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode event table entry:\n" << buffer << std::endl );
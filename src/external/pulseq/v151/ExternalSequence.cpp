@@ -1,31 +1,339 @@
 #include "ExternalSequence.h"
+#include "../SeqTokenizer.h"
 #include "../../compat_bind.hpp"  // Compatibility for std::bind1st in C++17
 extern "C" {
     #include "md5.h"
 }
 
-#include <stdio.h>		// sscanf
+#include <stdio.h>		// sprintf
 #include <cstring>		// strlen etc
 #include <iomanip>		// std::setw etc
 
 #include <algorithm>	// for std::max_element
 #include <functional>	// for std::bind...
+#include <future>		// std::async
+#include <mutex>		// std::mutex
+#include <thread>		// std::thread::hardware_concurrency
+#include <type_traits>	// std::is_trivially_copyable
 
 #include <math.h>		// fabs etc
+#include <sys/stat.h>	// stat (cache key)
 
 #include <assert.h>		// assert (TODO: remove in the released version)
 
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>	// CreateFileMapping, MapViewOfFile
+#define SEQ_HAVE_FILE_MAPPING
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>		// open
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#include <unistd.h>		// close
+#define SEQ_HAVE_FILE_MAPPING
+#endif
+
 // optionally use SEQ_NAMESPACE
 #ifdef SEQ_NAMESPACE
 using namespace SEQ_NAMESPACE;
 #endif
 
+namespace {
+
+/**
+ * @brief Read-only memory mapping of a complete file
+ *
+ * open() fails for empty files and on platforms without file mapping support,
+ * the caller then falls back to reading the file through a stream.
+ */
+class MappedSeqFile
+{
+  public:
+	MappedSeqFile() : m_data(NULL), m_size(0)
+#if defined(_WIN32)
+		, m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+#endif
+	{}
+	~MappedSeqFile() { close(); }
+
+	bool open(const std::string& path);
+	void close();
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+  private:
+	MappedSeqFile(const MappedSeqFile&);
+	MappedSeqFile& operator=(const MappedSeqFile&);
+
+	const char* m_data;
+	size_t m_size;
+#if defined(_WIN32)
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+#endif
+};
+
+bool MappedSeqFile::open(const std::string& path)
+{
+	close();
+#if defined(_WIN32)
+	m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+						  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart <= 0) {
+		close();
+		return false;
+	}
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping == NULL) {
+		close();
+		return false;
+	}
+	m_data = static_cast<const char*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == NULL) {
+		close();
+		return false;
+	}
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+#elif defined(SEQ_HAVE_FILE_MAPPING)
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		::close(fd);
+		return false;
+	}
+	void* addr = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping stays valid after the descriptor is closed
+	if (addr == MAP_FAILED)
+		return false;
+#ifdef MADV_SEQUENTIAL
+	madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+#endif
+	m_data = static_cast<const char*>(addr);
+	m_size = static_cast<size_t>(st.st_size);
+	return true;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+void MappedSeqFile::close()
+{
+#if defined(_WIN32)
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_hMapping) CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle(m_hFile);
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+#elif defined(SEQ_HAVE_FILE_MAPPING)
+	if (m_data) munmap(const_cast<char*>(m_data), m_size);
+#endif
+	m_data = NULL;
+	m_size = 0;
+}
+
+/**
+ * @brief Size and modification time of a file, false if it does not exist
+ */
+bool getFileStat(const std::string& path, unsigned long long& size, long long& modificationTime)
+{
+#if defined(_WIN32)
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+#endif
+	size = static_cast<unsigned long long>(st.st_size);
+	modificationTime = static_cast<long long>(st.st_mtime);
+	return true;
+}
+
+/**
+ * @brief Appends the fields of the cache file to a memory buffer
+ *
+ * Trivially copyable values and vectors of them are stored as raw bytes in the memory
+ * layout of this build, the cache header records the sizes to detect a mismatch.
+ */
+class CacheWriter
+{
+  public:
+	template <typename T>
+	void pod(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "cached values must be trivially copyable");
+		m_buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	void podVector(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "cached values must be trivially copyable");
+		pod<unsigned long long>(values.size());
+		if (!values.empty())
+			m_buffer.append(reinterpret_cast<const char*>(&values[0]), values.size()*sizeof(T));
+	}
+
+	void str(const std::string& value)
+	{
+		pod<unsigned long long>(value.size());
+		m_buffer.append(value);
+	}
+
+	/** @brief Library of trivially copyable events: count, then ID and event of each entry */
+	template <typename T>
+	void podMap(const std::map<int,T>& library)
+	{
+		pod<unsigned long long>(library.size());
+		for (typename std::map<int,T>::const_iterator it=library.begin(); it!=library.end(); ++it) {
+			pod(it->first);
+			pod(it->second);
+		}
+	}
+
+	const std::string& buffer() const { return m_buffer; }
+	size_t size() const { return m_buffer.size(); }
+
+  private:
+	std::string m_buffer;
+};
+
+/**
+ * @brief Checksum of the cache payload (FNV-1a over 64-bit words, then the remaining bytes)
+ */
+unsigned long long cacheChecksum(const char* data, size_t size)
+{
+	const unsigned long long prime = 0x100000001b3ULL;
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	size_t i = 0;
+	for (; i+sizeof(unsigned long long)<=size; i+=sizeof(unsigned long long)) {
+		unsigned long long word;
+		memcpy(&word, data+i, sizeof(word));
+		hash = (hash ^ word) * prime;
+	}
+	for (; i<size; i++)
+		hash = (hash ^ (unsigned char)data[i]) * prime;
+	return hash;
+}
+
+/**
+ * @brief Reads the fields written by CacheWriter from the mapped cache file
+ *
+ * Every read is bounds checked; after the first failure all reads fail.
+ */
+class CacheReader
+{
+  public:
+	CacheReader(const char* data, size_t size) : m_pos(data), m_end(data+size), m_bFailed(false) {}
+
+	template <typename T>
+	bool pod(T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "cached values must be trivially copyable");
+		if (!take(sizeof(T))) return false;
+		memcpy(&value, m_pos-sizeof(T), sizeof(T));
+		return true;
+	}
+
+	template <typename T>
+	bool podVector(std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "cached values must be trivially copyable");
+		unsigned long long n = 0;
+		if (!count(n, sizeof(T))) return false;
+		values.resize(n);
+		if (n>0)
+			memcpy(&values[0], m_pos-n*sizeof(T), n*sizeof(T));
+		return true;
+	}
+
+	bool str(std::string& value)
+	{
+		unsigned long long n = 0;
+		if (!count(n, 1)) return false;
+		value.assign(m_pos-n, n);
+		return true;
+	}
+
+	template <typename T>
+	bool podMap(std::map<int,T>& library)
+	{
+		unsigned long long n = 0;
+		if (!pod(n) || n > (unsigned long long)(m_end-m_pos)) return fail();
+		library.clear();
+		for (unsigned long long i=0; i<n; ++i) {
+			int id;
+			T value;
+			if (!pod(id) || !pod(value)) return false;
+			library.insert(library.end(), std::make_pair(id, value));
+		}
+		return true;
+	}
+
+	/** @brief Read a count of elements of the given size and skip their bytes, which then end at the read position */
+	bool count(unsigned long long& n, size_t elementSize)
+	{
+		if (!pod(n)) return false;
+		if (n > (unsigned long long)(m_end-m_pos)/elementSize) return fail();
+		m_pos += n*elementSize;
+		return true;
+	}
+
+	bool good() const { return !m_bFailed; }
+	bool atEnd() const { return m_pos==m_end; }
+
+	/** @brief Take the checksum off the end of the data and compare it with the checksum of the unread rest */
+	bool verifyTrailingChecksum()
+	{
+		unsigned long long checksum = 0;
+		if (m_bFailed || (size_t)(m_end-m_pos) < sizeof(checksum)) return fail();
+		m_end -= sizeof(checksum);
+		memcpy(&checksum, m_end, sizeof(checksum));
+		if (checksum != cacheChecksum(m_pos, m_end-m_pos)) return fail();
+		return true;
+	}
+
+  private:
+	bool take(size_t n)
+	{
+		if (m_bFailed || n > (size_t)(m_end-m_pos)) return fail();
+		m_pos += n;
+		return true;
+	}
+	bool fail() { m_bFailed = true; return false; }
+
+	const char* m_pos;
+	const char* m_end;
+	bool m_bFailed;
+};
+
+} // namespace
+
 ExternalSequence::PrintFunPtr ExternalSequence::print_fun = &ExternalSequence::defaultPrint;
 const int ExternalSequence::MAX_LINE_SIZE = 256;
+const size_t ExternalSequence::PARALLEL_LOAD_MIN_SIZE = 1<<20;
+const size_t ExternalSequence::BLOCK_CHUNK_MIN_SIZE = 1<<18;
 const char ExternalSequence::COMMENT_CHAR = '#';
+const unsigned int ExternalSequence::CACHE_FORMAT_VERSION = 2;
 std::string& str_trim(std::string& str);
 std::string str_tolower(std::string str);
 double SeqBlock::s_blockDurationRaster = 10.0;
+const std::vector<float> SeqBlock::s_emptyShape;
+const std::vector<long>  SeqBlock::s_emptyTimeShape;
 
 /***********************************************************/
 ExternalSequence::ExternalSequence()
@@ -52,6 +360,9 @@ void ExternalSequence::print_msg(MessageType level, std::ostream& ss) {
 		std::ostringstream oss;
 		oss.width(2*(level-1)); oss << "";
 		oss << static_cast<std::ostringstream&>(ss).str();
+		// sections may be decoded on several threads, see load_from_memory()
+		static std::mutex print_mutex;
+		std::lock_guard<std::mutex> lock(print_mutex);
 		print_fun(oss.str().c_str());
 #endif
 	}
@@ -66,6 +377,7 @@ void ExternalSequence::reset()
 	m_adcLibrary.clear();
 	m_blockDurations_ru.clear();
 	m_blocks.clear();
+	m_blockIds.clear();
 	m_bSignatureDefined=false;
 	// not on vb17 // m_strSignature.clear();
 	m_strSignature="";
@@ -84,6 +396,9 @@ void ExternalSequence::reset()
 	m_rfLibrary.clear();
 	m_rotationLibrary.clear();
 	m_shapeLibrary.clear();
+	for (int k=0; k<PS_NUM_KINDS; k++)
+		m_shapePool[k].clear();
+	m_timeShapePool.clear();
 	m_signatureMap.clear();
 	m_strSignature="";
 	m_strSignatureType="";
@@ -110,6 +425,15 @@ bool ExternalSequence::load(std::string path)
 		filepath = path + PATH_SEPARATOR + "external.seq";
 	}
 	print_msg(NORMAL_MSG, std::ostringstream().flush() << "Opening " << filepath);			
+
+	// Preferably map the whole file into memory and decode the sections directly
+	// from the mapped bytes, the stream-based code below is the fallback
+	MappedSeqFile mapped_file;
+	if (mapped_file.open(filepath)) {
+		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "Parsing memory-mapped file (" << mapped_file.size() << " bytes)");
+		return load_from_memory(mapped_file.data(), mapped_file.size());
+	}
+
 	// Open in binary mode to ensure all end-of-line characters are processed
 	data_file.open(filepath.c_str(), std::ios::in | std::ios::binary);
 	data_file.seekg(0, std::ios::beg);
@@ -182,57 +506,380 @@ bool ExternalSequence::load_from_buffer(char * buffer)
 	print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "Loading sequence from a text buffer");
 
 	// Try single file mode (everything in a single .seq file)
-	std::istringstream string_stream(buffer);
-	string_stream.seekg(0, std::ios::beg);
-	return load(string_stream);
+	return load_from_memory(buffer, strlen(buffer));
 }
 
-bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_singlefile*/)
+/***********************************************************/
+bool ExternalSequence::loadWithCache(std::string path, std::string cachePath)
 {
-	if (loadMode == lm_singlefile)
+	// only single .seq files are cached, the other layouts go through the regular loader
+	FileStamp stamp;
+	if (path.size()<4 || path.substr(path.size()-4)!=".seq" || cachePath.empty() || !getFileStat(path, stamp.size, stamp.modificationTime))
+		return load(path);
+
+	MappedSeqFile mapped_file;
+	if (!mapped_file.open(path))
+		return load(path);
+
+	MappedSeqFile cache_file;
+	if (cache_file.open(cachePath)) {
+		reset();
+		if (readCache(cache_file.data(), cache_file.size(), stamp, SeqText(mapped_file.data(), mapped_file.size()))) {
+			print_msg(NORMAL_MSG, std::ostringstream().flush() << "Loaded the parsed sequence from " << cachePath);
+			return true;
+		}
+		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "Ignoring outdated or incompatible cache " << cachePath);
+	}
+
+	print_msg(NORMAL_MSG, std::ostringstream().flush() << "Opening " << path);
+	if (!load_from_memory(mapped_file.data(), mapped_file.size()))
+		return false;
+	if (!writeCache(cachePath, stamp))
+		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "Could not write cache " << cachePath);
+	return true;
+}
+
+/***********************************************************/
+// Layout of the cache file: "SEQCACHE", format version, memory layout (byte order and sizes of
+// the raw-copied structures), stamp and MD5 hash of the .seq file, then the parsed sequence and
+// the checksum of it (catches truncated or altered caches before the raw structures are used).
+static const char CACHE_MAGIC[8] = {'S','E','Q','C','A','C','H','E'};
+
+static std::vector<unsigned int> cacheLayout()
+{
+	std::vector<unsigned int> layout;
+	layout.push_back(0x01020304); // byte order
+	layout.push_back(sizeof(long));
+	layout.push_back(sizeof(EventIDs));
+	layout.push_back(sizeof(RFEvent));
+	layout.push_back(sizeof(GradEvent));
+	layout.push_back(sizeof(ADCEvent));
+	layout.push_back(sizeof(ExtensionListEntry));
+	layout.push_back(sizeof(TriggerEvent));
+	layout.push_back(sizeof(RotationEvent));
+	layout.push_back(sizeof(SoftDelayEvent));
+	return layout;
+}
+
+bool ExternalSequence::writeCache(const std::string& cachePath, const FileStamp& stamp)
+{
+	CacheWriter out;
+	out.pod(CACHE_MAGIC);
+	out.pod(CACHE_FORMAT_VERSION);
+	out.podVector(cacheLayout());
+	out.pod(stamp.size);
+	out.pod(stamp.modificationTime);
+	out.str(m_strCalculatedMD5Signature);
+	const size_t payloadStart = out.size();
+
+	out.pod(version_major);
+	out.pod(version_minor);
+	out.pod(version_revision);
+	out.pod(version_combined);
+	out.pod(m_dAdcRasterTime_us);
+	out.pod(m_dGradientRasterTime_us);
+	out.pod(m_dRadiofrequencyRasterTime_us);
+	out.pod(m_dBlockDurationRaster_us);
+
+	out.pod<unsigned long long>(m_definitions_str.size());
+	for (std::map<std::string,std::string>::const_iterator it=m_definitions_str.begin(); it!=m_definitions_str.end(); ++it) {
+		out.str(it->first);
+		out.str(it->second);
+	}
+	out.pod<unsigned long long>(m_definitions.size());
+	for (std::map<std::string,std::vector<double> >::const_iterator it=m_definitions.begin(); it!=m_definitions.end(); ++it) {
+		out.str(it->first);
+		out.podVector(it->second);
+	}
+
+	out.pod<unsigned long long>(m_signatureMap.size());
+	for (std::map<std::string,std::string>::const_iterator it=m_signatureMap.begin(); it!=m_signatureMap.end(); ++it) {
+		out.str(it->first);
+		out.str(it->second);
+	}
+	out.pod(m_bSignatureDefined);
+	out.str(m_strSignature);
+	out.str(m_strSignatureType);
+	out.pod(m_bSignatureCheckSucceeded);
+
+	out.podVector(m_blocks);
+	out.podVector(m_blockDurations_ru);
+
+	out.podMap(m_rfLibrary);
+	out.podMap(m_gradLibrary);
+	out.podMap(m_adcLibrary);
+	out.podMap(m_extensionLibrary);
+	out.podMap(m_triggerLibrary);
+	out.podMap(m_rotationLibrary);
+	out.podMap(m_softDelayLibrary);
+	const std::map<int,LabelEvent>* labelLibraries[2] = {&m_labelsetLibrary, &m_labelincLibrary};
+	for (int l=0; l<2; l++) {
+		out.pod<unsigned long long>(labelLibraries[l]->size());
+		for (std::map<int,LabelEvent>::const_iterator it=labelLibraries[l]->begin(); it!=labelLibraries[l]->end(); ++it) {
+			out.pod(it->first);
+			out.pod(it->second.numVal.first);
+			out.pod(it->second.numVal.second);
+			out.pod(it->second.flagVal.first);
+			out.pod(it->second.flagVal.second);
+		}
+	}
+	out.pod<unsigned long long>(m_extensionNameIDs.size());
+	for (std::map<int,std::pair<std::string,int> >::const_iterator it=m_extensionNameIDs.begin(); it!=m_extensionNameIDs.end(); ++it) {
+		out.pod(it->first);
+		out.str(it->second.first);
+		out.pod(it->second.second);
+	}
+	out.pod<unsigned long long>(m_rfShimLibrary.size());
+	for (std::map<int,RfShimmingEvent>::const_iterator it=m_rfShimLibrary.begin(); it!=m_rfShimLibrary.end(); ++it) {
+		out.pod(it->first);
+		out.pod(it->second.id);
+		out.pod(it->second.nchan);
+		out.podVector(it->second.amplitudes);
+		out.podVector(it->second.phases);
+	}
+
+	out.pod<unsigned long long>(m_labelMap.mapStrToLabel.size());
+	for (LabelMap::tM::const_iterator it=m_labelMap.mapStrToLabel.begin(); it!=m_labelMap.mapStrToLabel.end(); ++it) {
+		out.str(it->first);
+		out.pod<int>(it->second.first);
+		out.pod<int>(it->second.second);
+	}
+	const std::map<int,std::string>* labelNames[2] = {&m_labelMap.mapLabelIdToStr, &m_labelMap.mapFlagIdToStr};
+	for (int l=0; l<2; l++) {
+		out.pod<unsigned long long>(labelNames[l]->size());
+		for (std::map<int,std::string>::const_iterator it=labelNames[l]->begin(); it!=labelNames[l]->end(); ++it) {
+			out.pod(it->first);
+			out.str(it->second);
+		}
+	}
+
+	out.pod<unsigned long long>(m_shapeLibrary.size());
+	for (std::map<int,CompressedShape>::const_iterator it=m_shapeLibrary.begin(); it!=m_shapeLibrary.end(); ++it) {
+		out.pod(it->first);
+		out.pod(it->second.numUncompressedSamples);
+		out.pod(it->second.isCompressed);
+		out.podVector(it->second.samples);
+	}
+	out.pod(cacheChecksum(out.buffer().data()+payloadStart, out.size()-payloadStart));
+
+	// write to a temporary file first so that a concurrent reader never sees a partial cache;
+	// the name is unique per process and thread, so concurrent writers do not share it
+#if defined(_WIN32)
+	const unsigned long processId = GetCurrentProcessId();
+#elif defined(SEQ_HAVE_FILE_MAPPING)
+	const unsigned long processId = (unsigned long)getpid();
+#else
+	const unsigned long processId = 0;
+#endif
+	std::ostringstream tmpName;
+	tmpName << cachePath << '.' << processId << '.' << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+	const std::string tmpPath = tmpName.str();
 	{
+		std::ofstream file(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+		file.write(out.buffer().data(), out.buffer().size());
+		if (!file.good()) {
+			file.close();
+			remove(tmpPath.c_str());
+			return false;
+		}
+	}
+	remove(cachePath.c_str()); // rename() does not replace existing files on all platforms
+	if (0!=rename(tmpPath.c_str(), cachePath.c_str())) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool ExternalSequence::readCache(const char* data, size_t size, const FileStamp& stamp, SeqText seqText)
+{
+	CacheReader in(data, size);
+	char magic[sizeof(CACHE_MAGIC)];
+	unsigned int formatVersion = 0;
+	std::vector<unsigned int> layout;
+	FileStamp cachedStamp;
+	if (!in.pod(magic) || 0!=memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+		!in.pod(formatVersion) || formatVersion!=CACHE_FORMAT_VERSION ||
+		!in.podVector(layout) || layout!=cacheLayout() ||
+		!in.pod(cachedStamp.size) || !in.pod(cachedStamp.modificationTime) ||
+		cachedStamp.size!=stamp.size || cachedStamp.modificationTime!=stamp.modificationTime)
+		return false;
+
+	// the stamp matches, confirm the content by the MD5 hash (this also builds the file index)
+	std::string md5;
+	buildFileIndex(seqText);
+	if (!in.str(md5) || md5!=m_strCalculatedMD5Signature) {
+		reset();
+		return false;
+	}
+	if (!in.verifyTrailingChecksum()) {
+		print_msg(WARNING_MSG, std::ostringstream().flush() << "WARNING: the sequence cache is corrupt and is ignored");
+		reset();
+		return false;
+	}
+
+	bool ok = in.pod(version_major) && in.pod(version_minor) && in.pod(version_revision) && in.pod(version_combined)
+		&& in.pod(m_dAdcRasterTime_us) && in.pod(m_dGradientRasterTime_us)
+		&& in.pod(m_dRadiofrequencyRasterTime_us) && in.pod(m_dBlockDurationRaster_us);
+
+	unsigned long long n = 0;
+	std::string key, value;
+	ok = ok && in.pod(n);
+	for (unsigned long long i=0; ok && i<n; i++) {
+		ok = in.str(key) && in.str(value);
+		m_definitions_str[key] = value;
+	}
+	ok = ok && in.pod(n);
+	for (unsigned long long i=0; ok && i<n; i++) {
+		std::vector<double> values;
+		ok = in.str(key) && in.podVector(values);
+		m_definitions[key].swap(values);
+	}
+
+	ok = ok && in.pod(n);
+	for (unsigned long long i=0; ok && i<n; i++) {
+		ok = in.str(key) && in.str(value);
+		m_signatureMap[key] = value;
+	}
+	ok = ok && in.pod(m_bSignatureDefined) && in.str(m_strSignature) && in.str(m_strSignatureType) && in.pod(m_bSignatureCheckSucceeded);
+
+	ok = ok && in.podVector(m_blocks) && in.podVector(m_blockDurations_ru) && m_blocks.size()==m_blockDurations_ru.size();
+
+	ok = ok && in.podMap(m_rfLibrary) && in.podMap(m_gradLibrary) && in.podMap(m_adcLibrary)
+		&& in.podMap(m_extensionLibrary) && in.podMap(m_triggerLibrary) && in.podMap(m_rotationLibrary)
+		&& in.podMap(m_softDelayLibrary);
+	std::map<int,LabelEvent>* labelLibraries[2] = {&m_labelsetLibrary, &m_labelincLibrary};
+	for (int l=0; ok && l<2; l++) {
+		labelLibraries[l]->clear();
+		ok = in.pod(n);
+		for (unsigned long long i=0; ok && i<n; i++) {
+			int id = 0;
+			LabelEvent label = LabelEvent();
+			ok = in.pod(id) && in.pod(label.numVal.first) && in.pod(label.numVal.second)
+				&& in.pod(label.flagVal.first) && in.pod(label.flagVal.second);
+			labelLibraries[l]->insert(labelLibraries[l]->end(), std::make_pair(id, label));
+		}
+	}
+	ok = ok && in.pod(n);
+	for (unsigned long long i=0; ok && i<n; i++) {
+		int id = 0, knownID = 0;
+		ok = in.pod(id) && in.str(value) && in.pod(knownID);
+		m_extensionNameIDs[id] = std::make_pair(value, knownID);
+	}
+	m_rfShimLibrary.clear();
+	ok = ok && in.pod(n);
+	for (unsigned long long i=0; ok && i<n; i++) {
+		int id = 0;
+		RfShimmingEvent shim = RfShimmingEvent();
+		ok = in.pod(id) && in.pod(shim.id) && in.pod(shim.nchan) && in.podVector(shim.amplitudes) && in.podVector(shim.phases);
+		m_rfShimLibrary[id] = shim;
+	}
+
+	m_labelMap = LabelMap();
+	ok = ok && in.pod(n);
+	for (unsigned long long i=0; ok && i<n; i++) {
+		int label = 0, flag = 0;
+		ok = in.str(key) && in.pod(label) && in.pod(flag);
+		m_labelMap.mapStrToLabel[key] = std::make_pair(Labels(label), Flags(flag));
+	}
+	std::map<int,std::string>* labelNames[2] = {&m_labelMap.mapLabelIdToStr, &m_labelMap.mapFlagIdToStr};
+	for (int l=0; ok && l<2; l++) {
+		ok = in.pod(n);
+		for (unsigned long long i=0; ok && i<n; i++) {
+			int id = 0;
+			ok = in.pod(id) && in.str(value);
+			(*labelNames[l])[id] = value;
+		}
+	}
+
+	ok = ok && in.pod(n);
+	for (unsigned long long i=0; ok && i<n; i++) {
+		int id = 0;
+		CompressedShape shape = CompressedShape();
+		ok = in.pod(id) && in.pod(shape.numUncompressedSamples) && in.pod(shape.isCompressed) && in.podVector(shape.samples);
+		m_shapeLibrary[id].samples.swap(shape.samples);
+		m_shapeLibrary[id].numUncompressedSamples = shape.numUncompressedSamples;
+		m_shapeLibrary[id].isCompressed = shape.isCompressed;
+	}
+
+	// the same check as after parsing: the block events must exist in the libraries
+	for (size_t b=0; ok && b<m_blocks.size(); ++b)
+		ok = checkBlockReferences(m_blocks[b]);
+
+	if (!ok || !in.atEnd()) {
+		print_msg(WARNING_MSG, std::ostringstream().flush() << "WARNING: the sequence cache is corrupt and is ignored");
 		reset();
+		return false;
 	}
+	SeqBlock::s_blockDurationRaster=m_dBlockDurationRaster_us;
+	return true;
+}
 
+bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_singlefile*/)
+{
 	if (!data_stream.good())
 	{
+		if (loadMode == lm_singlefile)
+			reset();
 		print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: Function load() failed to read from the stream provided");
 		return false;
 	}
 
+	// read the remaining stream in one go, the sections are decoded from memory
+	std::ostringstream text_stream;
+	text_stream << data_stream.rdbuf();
+	const std::string text = text_stream.str();
+	return load_from_memory(text.data(), text.size(), loadMode);
+}
+
+bool ExternalSequence::load_from_memory(const char* data, size_t size, load_mode loadMode /*=lm_singlefile*/)
+{
+	if (loadMode == lm_singlefile)
+	{
+		reset();
+	}
+
+	if (data==NULL)
+	{
+		print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: Function load() failed to read from the memory provided");
+		return false;
+	}
+
+	SeqText data_text(data, size);
 	char buffer[MAX_LINE_SIZE];
-	char tmpStr[MAX_LINE_SIZE];
 
 	print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Building index" );
 
 	// Save locations of section tags
-	buildFileIndex(data_stream);
+	buildFileIndex(data_text);
 
 	// Read version section
 	if (m_fileIndex.find("[VERSION]") != m_fileIndex.end()) {
 		print_msg(DEBUG_MEDIUM_LEVEL, std::ostringstream().flush() << "decoding VERSION section");
 		// Version is a recommended but not a compulsory section
 		// very basic reading code, repeated keywords will overwrite previous values, no serious error checking
-		data_stream.seekg(m_fileIndex["[VERSION]"], std::ios::beg);
-		skipComments(data_stream,buffer);			// load up some data and ignore comments & empty lines
-		while (data_stream.good() && buffer[0]!='[')
+		data_text.seek(m_fileIndex.find("[VERSION]")->second);
+		skipComments(data_text,buffer);			// load up some data and ignore comments & empty lines
+		while (data_text.good() && buffer[0]!='[')
 		{
 			//print_msg(DEBUG_MEDIUM_LEVEL, std::ostringstream().flush() << "buffer: \n" << buffer << std::endl );
 			if (0==strncmp(buffer,"major",5)) {
-				    if (1!=sscanf(buffer+5, "%d", &version_major)) {
+				    if (1!=(SeqTokenizer(buffer+5) >> version_major).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode version_major");
 					return false;
 				}
 			    print_msg(DEBUG_MEDIUM_LEVEL, std::ostringstream().flush() << "major=" << version_major);		
 			} else if (0==strncmp(buffer,"minor",5)) {
-				if (1!=sscanf(buffer+5, "%d", &version_minor)) {
+				if (1!=(SeqTokenizer(buffer+5) >> version_minor).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode version_minor");
 					return false;
 				}
 				print_msg(DEBUG_MEDIUM_LEVEL, std::ostringstream().flush() << "minor=" << version_minor);
 			}
 			else if (0==strncmp(buffer,"revision",8)) {
-				if (1!=sscanf(buffer+8, "%d", &version_revision)) {
+				if (1!=(SeqTokenizer(buffer+8) >> version_revision).count()) {
 					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode version_revision \n" << buffer << std::endl );
 					return false;
 				}
@@ -243,8 +890,8 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 				print_msg(WARNING_MSG, std::ostringstream().flush() << "*** WARNING: unknown field in the [VERSION] block");
 				return false;
 			}
-			//getline(data_stream, buffer, MAX_LINE_SIZE);
-			skipComments(data_stream,buffer);			// load up some data and ignore comments & empty lines
+			//getline(data_text, buffer, MAX_LINE_SIZE);
+			skipComments(data_text,buffer);			// load up some data and ignore comments & empty lines
 		}
 		version_combined=version_major*1000000L+version_minor*1000L+version_revision;
 	}
@@ -261,498 +908,58 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 	}
 	
 	// **********************************************************************************************************************
-	// ************************ READ SHAPES ***********************************
+	// ************************ READ SHAPES AND EVENTS ***********************************
 
+	// The shape and event libraries do not depend on each other or on the blocks, for larger
+	// single files they are decoded on their own threads while the blocks are read below.
+	// All futures are joined (explicitly or by their destructors) before returning.
+	const bool bParallel = (loadMode == lm_singlefile && size >= PARALLEL_LOAD_MIN_SIZE);
+	std::future<bool> shapesRead, eventsRead;
 	if (loadMode == lm_singlefile || loadMode == lm_shapes) 
 	{
-		// Read shapes section
-		// ------------------------
-		m_shapeLibrary.clear();
-		if (m_fileIndex.find("[SHAPES]") != m_fileIndex.end()) {
-			data_stream.seekg(m_fileIndex["[SHAPES]"], std::ios::beg);
-			skipComments(data_stream,buffer);			// Ignore comments & empty lines
-
-			int shapeId, numSamples;
-			float sample;
-
-			while (data_stream.good() && buffer[0]=='s')
-			{
-				if (2!=sscanf(buffer, "%s%d", tmpStr, &shapeId)) {
-					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'shapeId'\n" << buffer << std::endl );
-					return false;
-				}
-				getline(data_stream, buffer, MAX_LINE_SIZE);
-				if (2!=sscanf(buffer, "%s%d", tmpStr, &numSamples)) {
-					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'numSamples'\n" << buffer << std::endl );
-					return false;
-				}
-
-				//print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Reading shape " << shapeId );
-
-				CompressedShape shape;
-				shape.samples.clear();
-				while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
-					if (buffer[0]=='s' || strlen(buffer)==0) {
-						break;
-					}
-					if (1!=sscanf(buffer, "%f", &sample)) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'sample'\n" << buffer << std::endl );
-						return false;
-					}
-					shape.samples.push_back(sample);
-				}
-				// number of samples equal to the data length is used as a non-compressed flag
-				// but only for v1.4.0 or above
-				if (version_combined >= 1004000 && numSamples==shape.samples.size())
-					shape.isCompressed=false;
-				else 
-					shape.isCompressed=true;
-				shape.numUncompressedSamples=numSamples;
-
-				print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Shape index " << shapeId << " has " << shape.samples.size()
-					<< " compressed and " << shape.numUncompressedSamples << " uncompressed samples" );
-
-				m_shapeLibrary[shapeId] = shape;
-
-				skipComments(data_stream,buffer);			// Ignore comments & empty lines
-			}
-			data_stream.clear();	// In case EOF reached
-
-			print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "-- SHAPES READ numShapes: " << m_shapeLibrary.size() );
-		}
-		else
-		{
-			print_msg(NORMAL_MSG, std::ostringstream().flush() << "-- No SHAPES section found, which is permisible but unusual" );
-		}
+		if (bParallel)
+			shapesRead = std::async(std::launch::async, &ExternalSequence::readShapes, this, data_text);
+		else if (!readShapes(data_text))
+			return false;
+	}
+	if (loadMode == lm_singlefile || loadMode == lm_events) 
+	{
+		if (bParallel)
+			eventsRead = std::async(std::launch::async, &ExternalSequence::readEvents, this, data_text);
+		else if (!readEvents(data_text))
+			return false;
 	}
 
 	// **********************************************************************************************************************
-	// ************************ READ EVENTS ********************
-	
-	if (loadMode == lm_singlefile || loadMode == lm_events) 
+	// ************************ READ BLOCKS ********************
+	if (loadMode == lm_singlefile || loadMode == lm_blocks) 
 	{
-		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading RF section");
-		// Read RF section
+		unsigned int numBlocks = 0;
+		
+		// Read definition section
 		// ------------------------
-		if (m_fileIndex.find("[RF]") != m_fileIndex.end()) {
-			data_stream.seekg(m_fileIndex["[RF]"], std::ios::beg);
+		if (m_fileIndex.find("[DEFINITIONS]") != m_fileIndex.end()) {
+			data_text.seek(m_fileIndex.find("[DEFINITIONS]")->second);
 
-			int rfId;
-			m_rfLibrary.clear();
-			while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
+			// Read each definition line
+			m_definitions.clear();
+			m_definitions_str.clear();
+			int retgl=0;
+			while (retgl=getline(data_text, buffer, MAX_LINE_SIZE)) {
 				if (buffer[0]=='[' || strlen(buffer)==0) {
 					break;
 				}
-				RFEvent event;
-				if (version_combined<1004000L)
-				{
-					// pre v1.4.0
-					if (7!=sscanf(buffer, "%d%f%d%d%d%f%f", &rfId, &(event.amplitude),
-								&(event.magShape),&(event.phaseShape), &(event.delay),
-								&(event.freqOffset), &(event.phaseOffset)
-								)) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
-						return false;
-					}
-                    event.freqPPM=0.0;
-                    event.phasePPM = 0.0;
-                    event.timeShape = 0;
-					event.use='u'; // undefined use
-					event.center=-1.0; // mark as invalid
-				}
-				else if (version_combined < 1005000) 
-				{
-					// 1.4.0
-					if (8!=sscanf(buffer, "%d%f%d%d%d%d%f%f", &rfId, &(event.amplitude),
-								&(event.magShape), &(event.phaseShape), &(event.timeShape),
-								&(event.delay), &(event.freqOffset), &(event.phaseOffset)
-								)) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
-						return false;
-					}
-                    event.freqPPM = 0.0;
-                    event.phasePPM = 0.0;
-                    event.use       = 'u';  // undefined use
-					event.center=-1.0; // mark as invalid
-				}
-				else 
-				{
-					// 1.5.0
-					if (12!=sscanf(buffer, "%d%f%d%d%d%f%d%f%f%f%f %c", &rfId, &(event.amplitude),
-								&(event.magShape),&(event.phaseShape), &(event.timeShape), &(event.center),
-								&(event.delay), &(event.freqPPM), &(event.phasePPM), &(event.freqOffset), &(event.phaseOffset), &(event.use)
-								)) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
-						return false;
-					}
-				}
-				m_rfLibrary[rfId] = event;
-                ExternalSequence::print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "m_rfLibrary["<<rfId<<"].use="<<event.use);
-			}
-		}
-		
-		// Read *arbitrary* gradient section
-		// -------------------------------
-		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading arbitrary gradient section");
-		m_gradLibrary.clear();
-		if (m_fileIndex.find("[GRADIENTS]") != m_fileIndex.end()) {
-			data_stream.seekg(m_fileIndex["[GRADIENTS]"], std::ios::beg);
-
-			while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
-				if (buffer[0]=='[' || strlen(buffer)==0) {
-					break;
-				}
-				print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "got line: " << buffer);
-				int gradId;
-				GradEvent event;
-				if ( version_combined>=1005000L )
-				{
-					// v1.5.0
-					if (7!=sscanf(buffer, "%d%f%f%f%d%d%d", &gradId, &(event.amplitude), &(event.first), &(event.last), &(event.waveShape), &(event.timeShape), &(event.delay))) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.4.x gradient event\n" << buffer << std::endl );
-						return false;
-					}
-				}
-				else if ( version_combined>=1004000L )
-				{
-					// v1.4.0
-					if (5!=sscanf(buffer, "%d%f%d%d%d", &gradId, &(event.amplitude), &(event.waveShape), &(event.timeShape), &(event.delay))) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.4.x gradient event\n" << buffer << std::endl );
-						return false;
-					}
-					event.first=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
-					event.last=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
-				}
-				else
-				{
-					// pre v1.4.0
-					event.timeShape=0;
-					if (4!=sscanf(buffer, "%d%f%d%d", &gradId, &(event.amplitude), &(event.waveShape), &(event.delay))) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.2.x gradient event\n" << buffer << std::endl );
-						return false;
-					}
-					event.first=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
-					event.last=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
-				}
-				print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "assigning the event to the library under the ID " << gradId);
-				m_gradLibrary[gradId] = event;
-				print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "done");
-			}
-		}
-
-		// Read *trapezoid* gradient section
-		// -------------------------------
-		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading trapezoids section");
-		if (m_fileIndex.find("[TRAP]") != m_fileIndex.end()) {
-			data_stream.seekg(m_fileIndex["[TRAP]"], std::ios::beg);
-
-			while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
-				if (buffer[0]=='[' || strlen(buffer)==0) {
-					break;
-				}
-				int gradId;
-				GradEvent event;
-				if (6!=sscanf(buffer, "%d%f%ld%ld%ld%d", &gradId, &(event.amplitude),
-					&(event.rampUpTime),&(event.flatTime),&(event.rampDownTime),&(event.delay))) {
-					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode trapezoid gradient entry" << buffer << std::endl );
-					return false;
-				}					
-				event.waveShape=0;
-				event.timeShape=0;
-				m_gradLibrary[gradId] = event;
-			}
-		}
-
-		// Sort gradients based on index
-		// -----------------------------
-		//std::sort(m_gradLibrary.begin(),m_gradLibrary.end(),compareGradEvents);
-
-		// Read ADC section
-		// -------------------------------
-		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading ADC section");
-		if (m_fileIndex.find("[ADC]") != m_fileIndex.end()) {
-			data_stream.seekg(m_fileIndex["[ADC]"], std::ios::beg);
-
-			int adcId;
-			m_adcLibrary.clear();
-			while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
-				if (buffer[0]=='[' || strlen(buffer)==0) {
-					break;
-				}
-				ADCEvent event;
-				if ( version_combined>=1005000L )
-				{
-					// v1.5.0
-					if (9!=sscanf(buffer, "%d%d%d%d%f%f%f%f%d", &adcId, &(event.numSamples),
-								&(event.dwellTime),&(event.delay),&(event.freqPPM),&(event.phasePPM),&(event.freqOffset),&(event.phaseOffset),&(event.phaseModulationShape))) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode ADC event\n" << buffer << std::endl );
-						return false;
-					}
-				}
-				else
-				{
-					// v1.4.0 and older
-					if (6!=sscanf(buffer, "%d%d%d%d%f%f", &adcId, &(event.numSamples),
-								&(event.dwellTime),&(event.delay),&(event.freqOffset),&(event.phaseOffset))) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode ADC event\n" << buffer << std::endl );
-						return false;
-					}
-                    event.freqPPM=0.0; // no ppmOffset in older formats
-                    event.phasePPM= 0.0; 
-					event.phaseModulationShape=0; // no phase modulation shape provided 
-				}
-				
-				m_adcLibrary[adcId] = event;
-			}
-		}
-
-		// Read delays section (comatibility with Pulseq version prior to 1.4.0)
-		// ---------------------------------------------------------------------
-		//std::map<int,long> tmpDelayLibrary;
-		m_tmpDelayLibrary.clear();
-		if (m_fileIndex.find("[DELAYS]") != m_fileIndex.end()) {
-			print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading DELAYS section (compatibility)");
-			data_stream.seekg(m_fileIndex["[DELAYS]"], std::ios::beg);
-
-			int delayId;
-			long delay;
-			while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
-				if (buffer[0]=='[' || strlen(buffer)==0) {
-					break;
-				}
-				if (2!=sscanf(buffer, "%d%ld", &delayId, &delay)) {
-					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode delay event\n" << buffer << std::endl );
-					return false;
-				}
-				m_tmpDelayLibrary[delayId] = delay;
-			}
-		}
-
-		// Read extensions section
-		// -------------------------------
-		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading and processing extensions");
-		m_extensionLibrary.clear();
-		m_extensionNameIDs.clear();
-		m_triggerLibrary.clear(); // clear also all known extension libraries
-		m_labelsetLibrary.clear();
-		m_labelincLibrary.clear();
-		std::map<std::string,int>::iterator itFI = m_fileIndex.find("[EXTENSIONS]");
-		if ( itFI != m_fileIndex.end()) {
-			data_stream.seekg(itFI->second, std::ios::beg);
-			std::set<int>::iterator itSFI = m_fileSections.find(itFI->second);
-			if ( itSFI==m_fileSections.end() ||
-				 (++itSFI)==m_fileSections.end() )
-			{
-				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed find the end of the section while reading EXTENSIONS");
-				return false;
-			}
-			int sectionEnd = *itSFI;
-			// we first read in the extension list
-			int nID;
-			int nExtensionID=EXT_LIST; // EXT_LIST means we are reading the extension list
-			while ( data_stream.tellg()<sectionEnd &&
-					getline(data_stream, buffer, MAX_LINE_SIZE)) 
-			{
-				if (buffer[0]=='#' || buffer[0]=='[' || strlen(buffer)==0) {
-					continue;
-				}
-				print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "input line: " << buffer);
-				if (0==strncmp(buffer,"extension",9)) {
-					// read new extension ID from the header
-					char szStrID[MAX_LINE_SIZE];
-					int nInternalID=0;
-					int nKnownID=EXT_UNKNOWN;
-					if (2!=sscanf(buffer, "extension %s %d", szStrID, &nInternalID)) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode extension header entry\n" << buffer << std::endl );
-						return false;
-					}
-					// here is the list of extensions we currently recognize
-					if (0==strcmp("TRIGGERS",szStrID))
-						nKnownID=EXT_TRIGGER;
-					else if (0==strcmp("ROTATIONS",szStrID))
-						nKnownID=EXT_ROTATION;
-					else if (0==strcmp("LABELSET",szStrID))
-						nKnownID=EXT_LABELSET;
-					else if (0==strcmp("LABELINC",szStrID))
-						nKnownID=EXT_LABELINC;
-					else if (0==strcmp("DELAYS",szStrID))
-						nKnownID=EXT_DELAY;
-					else if (0==strcmp("RF_SHIMS",szStrID))
-						nKnownID=EXT_RF_SHIM;
-					if (nKnownID!=EXT_UNKNOWN)
-						m_extensionNameIDs[nInternalID]=std::make_pair(std::string(szStrID),nKnownID);
-					else {
-						print_msg(WARNING_MSG, std::ostringstream().flush() << "*** WARNING: unknown extension ignored\n" << buffer << std::endl );
-					}
-					nExtensionID=nKnownID;
-				}
-				else
-				{
-					ExtensionListEntry extEntry;
-					TriggerEvent trigger;
-					RotationEvent rotation;
-					SoftDelayEvent delay;
-                    RfShimmingEvent rfShim;
-					int  nVal;					   // read label set/inc values from label set/inc extension
-					int  nRet;                     // conversion result / return value
-					char szLabelID[MAX_LINE_SIZE]; // read labels strings from label set/inc extension
-					LabelEvent	label;			   // write label event
-					switch (nExtensionID) {
-						case EXT_LIST: 
-							if (4!=sscanf(buffer, "%d%d%d%ld", &nID, &(extEntry.type), &(extEntry.ref), &(extEntry.next))) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode extension list entry\n" << buffer << std::endl );
-								return false;
-							}
-							print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoding extension list entry " << buffer);
-							m_extensionLibrary[nID] = extEntry;
-							print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "nID:" << nID << " type:" << extEntry.type << " ref" << extEntry.ref << " next:" << extEntry.next);
-							break;
-						case EXT_TRIGGER: 
-							if (5!=sscanf(buffer, "%d%d%d%ld%ld", &nID, &(trigger.triggerType), &(trigger.triggerChannel), &(trigger.delay), &(trigger.duration))) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode trigger event\n" << buffer << std::endl );
-								return false;
-							}
-							m_triggerLibrary[nID] = trigger;
-							break;
-						case EXT_ROTATION: 
-							if (5!=sscanf(buffer, "%d%lf%lf%lf%lf", &nID, &rotation.rotQuaternion[0], &rotation.rotQuaternion[1], &rotation.rotQuaternion[2], &rotation.rotQuaternion[3])) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode rotation event\n" << buffer << std::endl );
-                                return false;
-							}
-                            {
-								double dNorm=sqrt(rotation.rotQuaternion[0]*rotation.rotQuaternion[0]+rotation.rotQuaternion[1]*rotation.rotQuaternion[1]+rotation.rotQuaternion[2]*rotation.rotQuaternion[2]+rotation.rotQuaternion[3]*rotation.rotQuaternion[3]);
-                                if (fabs(dNorm-1.0)>1e-3) {
-									print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: rotation extension loaded a non-normalized quaternion " << buffer << std::endl );
-									return false;
-								}
-								for (int i = 0; i < 4; ++i)
-                                    rotation.rotQuaternion[i] /= dNorm; 
-                            }
-							rotation.defined=true;
-							m_rotationLibrary[nID] = rotation; 
-							break;
-						case EXT_LABELSET: 
-							if (3!=sscanf(buffer, "%d%d%s", &nID, &nVal, szLabelID)) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to load labelset event\n" << buffer << std::endl );
-								return false;
-							}
-							nRet = decodeLabel(EXT_LABELSET,nVal,szLabelID,label);
-							if (nRet<0) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode labelset event\n" << buffer << std::endl );
-								return false;
-							}else if(nRet>0) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** decoding labelset event returned 0\n" << buffer << std::endl );
-							} 
-							m_labelsetLibrary[nID] = label;
-							break;
-						case EXT_LABELINC: 
-							if (3!=sscanf(buffer, "%d%d%s", &nID, &nVal, szLabelID)) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode labelinc event\n" << buffer << std::endl );
-								return false;
-							}
-							nRet = decodeLabel(EXT_LABELINC,nVal,szLabelID,label);
-							if (nRet<0) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode labelinc event\n" << buffer << std::endl );
-								return false;
-							}else if(nRet>0) {
-								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: decoding labelinc event returnd 0\n" << buffer << std::endl );
-							}
-
-							m_labelincLibrary[nID] = label;
-							break;
-						case EXT_DELAY: 
-							{
-								int n=0;
-								if (4!=sscanf(buffer, "%d%d%d%d%n", &nID, &(delay.numID), &(delay.offset), &(delay.factor), &n)) {
-									print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode soft delay event\n" << buffer << std::endl );
-									return false;
-								}
-								strncpy(delay.hint,stripWhiteSpace(buffer+n),SOFT_DELAY_HINT_LENGTH);
-								delay.hint[SOFT_DELAY_HINT_LENGTH-1]=0;
-								print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoded soft delay " << delay.numID << " with the hint:" << delay.hint);
-								m_softDelayLibrary[nID] = delay;
-							}
-							break;
-                        case EXT_RF_SHIM:
-                            {
-								int nPos=0; 
-								if (2!= sscanf(buffer, "%d%d%n", &rfShim.id, &(rfShim.nchan), &(nPos)))
-                                {
-                                    print_msg(
-                                        ERROR_MSG,
-                                        std::ostringstream().flush() << "*** ERROR: failed to decode RF shim event\n"
-                                                                     << buffer << std::endl);
-                                    return false;
-                                }
-								print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoded initial part of the RF shim event, id:" << rfShim.id << " nChan:" << rfShim.nchan << " curren position:" << nPos);
-								rfShim.amplitudes.reserve(rfShim.nchan);
-								rfShim.phases.reserve(rfShim.nchan);
-								int n=nPos;
-								for (int i=0;i<rfShim.nchan; ++i) 
-								{
-									float fa,fp;
-									if (2!= sscanf(buffer+n, "%f%f%n", &(fa), &(fp), &(nPos)))
-									{
-										print_msg(
-											ERROR_MSG,
-											std::ostringstream().flush() << "*** ERROR: failed to decode RF shim event for channel " << i << " in\n"
-																		 << buffer << std::endl);
-										return false;
-									}
-									print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoded a further part of the RF shim event, fa:" << fa << " fp:" << fp << " curren position:" << n+nPos);
-									rfShim.amplitudes.push_back(fa);
-									rfShim.phases.push_back(fp);								
-									n+=nPos;
-								}
-								print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "finished decoding RF shim event");
-                                m_rfShimLibrary[rfShim.id] = rfShim;
-                            }
-                            break;
-						case EXT_UNKNOWN:
-							print_msg(WARNING_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode unknown extension event\n" << buffer << std::endl );
-							break; // just ignore unknown extensions
-					}
-				}
-			}
-		}		
-		
-		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "-- EVENTS READ: "
-			<<" RF: " << m_rfLibrary.size()
-			<<" GRAD: " << m_gradLibrary.size()
-			<<" ADC: " << m_adcLibrary.size()
-			<<" EXTENSIONS: " << m_extensionLibrary.size() + m_triggerLibrary.size() + m_rotationLibrary.size() + m_labelsetLibrary.size() + m_labelincLibrary.size());
-	}
-
-	// **********************************************************************************************************************
-	// ************************ READ BLOCKS ********************
-	if (loadMode == lm_singlefile || loadMode == lm_blocks) 
-	{
-		unsigned int numBlocks = 0;
-		
-		// Read definition section
-		// ------------------------
-		if (m_fileIndex.find("[DEFINITIONS]") != m_fileIndex.end()) {
-			data_stream.seekg(m_fileIndex["[DEFINITIONS]"], std::ios::beg);
-
-			// Read each definition line
-			m_definitions.clear();
-			m_definitions_str.clear();
-			int retgl=0;
-			while (retgl=getline(data_stream, buffer, MAX_LINE_SIZE)) {
-				if (buffer[0]=='[' || strlen(buffer)==0) {
-					break;
-				}
-				// this was not compatible with Numaris4 VB line (MSVC6)
-				/*std::istringstream ss(buffer);
-				while(retgl==gl_truncated) { // if the line was truncated read in the rest of it into the stream/buffer
-					retgl=getline(data_stream, buffer, MAX_LINE_SIZE);
-					ss.str(ss.str()+buffer); 
-				}*/
-				// stupid compatible code
-				std::string stmp(buffer);
-				while(retgl==gl_truncated) { // if the line was truncated read in the rest of it into the temporary string
-					retgl=getline(data_stream, buffer, MAX_LINE_SIZE);
-					stmp+=buffer;
+				// this was not compatible with Numaris4 VB line (MSVC6)
+				/*std::istringstream ss(buffer);
+				while(retgl==gl_truncated) { // if the line was truncated read in the rest of it into the stream/buffer
+					retgl=getline(data_text, buffer, MAX_LINE_SIZE);
+					ss.str(ss.str()+buffer); 
+				}*/
+				// stupid compatible code
+				std::string stmp(buffer);
+				while(retgl==gl_truncated) { // if the line was truncated read in the rest of it into the temporary string
+					retgl=getline(data_text, buffer, MAX_LINE_SIZE);
+					stmp+=buffer;
 				}
 				char* tmp_buff1= new char[stmp.length()+1]; // old compilers like MSVC6 require such stupid conversions
 				strcpy(tmp_buff1,stmp.c_str());
@@ -883,45 +1090,22 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 			print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: Required: [BLOCKS] section");
 			return false;
 		}
-		data_stream.seekg(m_fileIndex["[BLOCKS]"], std::ios::beg);
-
-		int blockIdx;
-		EventIDs events;
-
-		// Read blocks
-		m_blocks.clear();
-		while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
-			if (buffer[0]=='[' || strlen(buffer)==0) {
-				break;
-			}
-
-			memset(events.id, 0, NUM_EVENTS*sizeof(int));
-			long dur_ru =0;
-
-			int ret=sscanf(buffer, "%d%d%d%d%d%d%d%d", &blockIdx,
-					&dur_ru,                                        // block duration
-					&events.id[RF],                                 // RF
-					&events.id[GX],&events.id[GY],&events.id[GZ],   // Gradients
-					&events.id[ADC],                                // ADCs
-					&events.id[EXT]                                 // Extensions
-					);
-			if (7>ret
-					) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode event table entry:\n" << buffer << std::endl );
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "***        number of fields read: " << ret << std::endl );
-				return false;
-			}
+		if (!readBlocks(data_text, bParallel))
+			return false;
 
+		// the library references can only be checked once all events are known
+		if ((shapesRead.valid() && !shapesRead.get()) || (eventsRead.valid() && !eventsRead.get()))
+			return false;
+		for (size_t b=0; b<m_blocks.size(); ++b) {
+			EventIDs& events = m_blocks[b];
 			if (!checkBlockReferences(events)) {
-				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: Block " << blockIdx
+				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: Block " << m_blockIds[b]
 					<< " contains references to undefined events" );
 				print_msg(ERROR_MSG, std::ostringstream().flush() << "***        RF:" << events.id[RF] << " GX:" << events.id[GX] << " GY:" << events.id[GY] << " GZ:" << events.id[GZ] << " ADC:" << events.id[ADC] << " EXT:" << events.id[EXT]);
 				return false;
 			}
-			// Add event IDs to list of blocks
-			m_blocks.push_back(events);
-			m_blockDurations_ru.push_back(dur_ru); // ATTENTION, for versions prior to 1.4.0 this will contain delayIDs, we fix it below
 		}
+		std::vector<int>().swap(m_blockIds);
 
 		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "-- BLOCKS READ: " << m_blocks.size());
 		// Num_Blocks definition (if defined) is used to check the correct number of blocks are read
@@ -935,11 +1119,11 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 		// Read signature section
 		// ------------------------
 		if (m_fileIndex.find("[SIGNATURE]") != m_fileIndex.end()) {
-			data_stream.seekg(m_fileIndex["[SIGNATURE]"], std::ios::beg);
+			data_text.seek(m_fileIndex.find("[SIGNATURE]")->second);
 
 			// Read each signature line
 			m_signatureMap.clear();
-			while (getline(data_stream, buffer, MAX_LINE_SIZE)) {
+			while (getline(data_text, buffer, MAX_LINE_SIZE)) {
 				if (buffer[0]=='[' || strlen(buffer)==0) {
 					break;
 				}
@@ -989,78 +1173,671 @@ bool ExternalSequence::load(std::istream& data_stream, load_mode loadMode /*=lm_
 			}
 		}
 
-		if (version_combined<1004000L) 
+		if (version_combined<1004000L) 
+		{
+			print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "-- converting blocks from version " << version_combined);
+			// we need to calculate dutation of every block and save it in m_blockDurations_ru
+
+			for (int b=0; b<m_blocks.size(); ++b) 
+			{
+				SeqBlock* block=GetBlock(b);
+				// Calculate duration of block
+				long duration = 0;
+				// special processing of the delay objects (which are now eliminated)
+				if (m_blockDurations_ru[b]) // non-zero means old delay library reference
+				{
+					if (m_tmpDelayLibrary.end()==m_tmpDelayLibrary.find(m_blockDurations_ru[b])) {
+						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: invalid delay library reference " << m_blockDurations_ru[b] << " in block " << b << " detected while convering the Pulseq file from older version");
+						return false;
+					}
+					duration=m_tmpDelayLibrary[m_blockDurations_ru[b]]; // we know delay is still 0, see above
+				}
+				// fairly standard code, copied from the old version of GetBlock()
+				if (block->isRF()) {
+					RFEvent &rf = block->GetRFEvent();
+					duration = MAX(duration, rf.delay+(long)m_shapeLibrary[rf.magShape].numUncompressedSamples); // in versions prior to v 1.4.0 RF raster was 1us and there was no RF time shape
+				}
+				for (int iC=0; iC<NUM_GRADS; iC++)
+				{
+					GradEvent &grad = block->GetGradEvent(iC);
+					if (block->isArbitraryGradient(iC))
+						duration = MAX(duration, (long)(m_dGradientRasterTime_us*m_shapeLibrary[grad.waveShape].numUncompressedSamples) + grad.delay); // in versions prior to v 1.4.0 there was no time shape
+					else if (block->isTrapGradient(iC))
+						duration = MAX(duration, grad.rampUpTime + grad.flatTime + grad.rampDownTime + grad.delay); 
+					else if (block->isExtTrapGradient(iC)) {
+						// in versions prior to 1.4.0 there were no extended trapezoids (no time shape IDs) so this should never happen
+						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: unexpected error while converting arbitrary gradients");
+						return false;
+					}
+				}
+				if (block->isADC()) {
+					ADCEvent &adc = block->GetADCEvent();
+					duration = MAX(duration, adc.delay + (adc.numSamples*adc.dwellTime)/1000);
+				}
+				if (block->isTrigger()) {
+					TriggerEvent &trigger = block->GetTriggerEvent();
+					duration = MAX(duration, trigger.delay+trigger.duration );
+				}
+				// clean up memory
+				delete block;
+				// convert duration to raster units and store it
+				m_blockDurations_ru[b]=ceil(duration/SeqBlock::s_blockDurationRaster - 1e-12);
+				// sanity check
+				if (fabs(m_blockDurations_ru[b]*SeqBlock::s_blockDurationRaster-duration)>1e-9) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** WARNING: rounding up block duration for block" << b);
+				}
+			}
+			m_tmpDelayLibrary.clear();
+		}
+	}
+
+	if ((shapesRead.valid() && !shapesRead.get()) || (eventsRead.valid() && !eventsRead.get()))
+		return false;
+
+	//std::vector<double> def = GetDefinition("Scan_ID");
+	//int scanID = def.empty() ? 0: (int)def[0];
+	//print_msg(NORMAL_MSG, std::ostringstream().flush() << "==========================================" );
+	//print_msg(NORMAL_MSG, std::ostringstream().flush() << "===== EXTERNAL SEQUENCE #" << std::setw(5) << scanID << " ===========" );
+	//print_msg(NORMAL_MSG, std::ostringstream().flush() << "==========================================" );
+
+	return true;
+};
+
+
+/***********************************************************/
+bool ExternalSequence::readShapes(SeqText data_text)
+{
+	char buffer[MAX_LINE_SIZE];
+	const char* line;
+	int length;
+
+	// Read shapes section
+	// ------------------------
+	m_shapeLibrary.clear();
+	if (m_fileIndex.find("[SHAPES]") != m_fileIndex.end()) {
+		data_text.seek(m_fileIndex.find("[SHAPES]")->second);
+		skipComments(data_text,buffer);			// Ignore comments & empty lines
+
+		int shapeId, numSamples;
+		float sample;
+
+		while (data_text.good() && buffer[0]=='s')
+		{
+			if (2!=(SeqTokenizer(buffer).word(NULL,0) >> shapeId).count()) {
+				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'shapeId'\n" << buffer << std::endl );
+				return false;
+			}
+			getline(data_text, buffer, MAX_LINE_SIZE);
+			if (2!=(SeqTokenizer(buffer).word(NULL,0) >> numSamples).count()) {
+				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'numSamples'\n" << buffer << std::endl );
+				return false;
+			}
+
+			//print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Reading shape " << shapeId );
+
+			CompressedShape shape;
+			shape.samples.clear();
+			// the samples are decoded straight from the text without copying the lines
+			while (scanLine(data_text, line, length, MAX_LINE_SIZE)) {
+				if (length==0 || line[0]=='s') {
+					break;
+				}
+				if (1!=(SeqTokenizer(line, line+length) >> sample).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode 'sample'\n" << std::string(line, length) << std::endl );
+					return false;
+				}
+				shape.samples.push_back(sample);
+			}
+			// number of samples equal to the data length is used as a non-compressed flag
+			// but only for v1.4.0 or above
+			if (version_combined >= 1004000 && numSamples==shape.samples.size())
+				shape.isCompressed=false;
+			else 
+				shape.isCompressed=true;
+			shape.numUncompressedSamples=numSamples;
+
+			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Shape index " << shapeId << " has " << shape.samples.size()
+				<< " compressed and " << shape.numUncompressedSamples << " uncompressed samples" );
+
+			m_shapeLibrary[shapeId] = shape;
+
+			skipComments(data_text,buffer);			// Ignore comments & empty lines
+		}
+		data_text.clear();	// In case EOF reached
+
+		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "-- SHAPES READ numShapes: " << m_shapeLibrary.size() );
+	}
+	else
+	{
+		print_msg(NORMAL_MSG, std::ostringstream().flush() << "-- No SHAPES section found, which is permisible but unusual" );
+	}
+	return true;
+}
+
+
+/***********************************************************/
+bool ExternalSequence::readEvents(SeqText data_text)
+{
+	char buffer[MAX_LINE_SIZE];
+
+	print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading RF section");
+	// Read RF section
+	// ------------------------
+	if (m_fileIndex.find("[RF]") != m_fileIndex.end()) {
+		data_text.seek(m_fileIndex.find("[RF]")->second);
+
+		int rfId;
+		m_rfLibrary.clear();
+		while (getline(data_text, buffer, MAX_LINE_SIZE)) {
+			if (buffer[0]=='[' || strlen(buffer)==0) {
+				break;
+			}
+			RFEvent event;
+			if (version_combined<1004000L)
+			{
+				// pre v1.4.0
+				if (7!=(SeqTokenizer(buffer) >> rfId >> event.amplitude
+							>> event.magShape >> event.phaseShape >> event.delay
+							>> event.freqOffset >> event.phaseOffset
+							).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
+					return false;
+				}
+                    event.freqPPM=0.0;
+                    event.phasePPM = 0.0;
+                    event.timeShape = 0;
+				event.use='u'; // undefined use
+				event.center=-1.0; // mark as invalid
+			}
+			else if (version_combined < 1005000) 
+			{
+				// 1.4.0
+				if (8!=(SeqTokenizer(buffer) >> rfId >> event.amplitude
+							>> event.magShape >> event.phaseShape >> event.timeShape
+							>> event.delay >> event.freqOffset >> event.phaseOffset
+							).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
+					return false;
+				}
+                    event.freqPPM = 0.0;
+                    event.phasePPM = 0.0;
+                    event.use       = 'u';  // undefined use
+				event.center=-1.0; // mark as invalid
+			}
+			else 
+			{
+				// 1.5.0
+				if (12!=(SeqTokenizer(buffer) >> rfId >> event.amplitude
+							>> event.magShape >> event.phaseShape >> event.timeShape >> event.center
+							>> event.delay >> event.freqPPM >> event.phasePPM >> event.freqOffset >> event.phaseOffset >> event.use
+							).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode RF event\n" << buffer << std::endl );
+					return false;
+				}
+			}
+			m_rfLibrary[rfId] = event;
+                ExternalSequence::print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "m_rfLibrary["<<rfId<<"].use="<<event.use);
+		}
+	}
+	
+	// Read *arbitrary* gradient section
+	// -------------------------------
+	print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading arbitrary gradient section");
+	m_gradLibrary.clear();
+	if (m_fileIndex.find("[GRADIENTS]") != m_fileIndex.end()) {
+		data_text.seek(m_fileIndex.find("[GRADIENTS]")->second);
+
+		while (getline(data_text, buffer, MAX_LINE_SIZE)) {
+			if (buffer[0]=='[' || strlen(buffer)==0) {
+				break;
+			}
+			print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "got line: " << buffer);
+			int gradId;
+			GradEvent event;
+			if ( version_combined>=1005000L )
+			{
+				// v1.5.0
+				if (7!=(SeqTokenizer(buffer) >> gradId >> event.amplitude >> event.first >> event.last >> event.waveShape >> event.timeShape >> event.delay).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.4.x gradient event\n" << buffer << std::endl );
+					return false;
+				}
+			}
+			else if ( version_combined>=1004000L )
+			{
+				// v1.4.0
+				if (5!=(SeqTokenizer(buffer) >> gradId >> event.amplitude >> event.waveShape >> event.timeShape >> event.delay).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.4.x gradient event\n" << buffer << std::endl );
+					return false;
+				}
+				event.first=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
+				event.last=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
+			}
+			else
+			{
+				// pre v1.4.0
+				event.timeShape=0;
+				if (4!=(SeqTokenizer(buffer) >> gradId >> event.amplitude >> event.waveShape >> event.delay).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode v1.2.x gradient event\n" << buffer << std::endl );
+					return false;
+				}
+				event.first=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
+				event.last=FLOAT_UNDEFINED; // std::numeric_limits<float>::quiet_NaN(); <- did not work with older MSVC
+			}
+			print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "assigning the event to the library under the ID " << gradId);
+			m_gradLibrary[gradId] = event;
+			print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "done");
+		}
+	}
+
+	// Read *trapezoid* gradient section
+	// -------------------------------
+	print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading trapezoids section");
+	if (m_fileIndex.find("[TRAP]") != m_fileIndex.end()) {
+		data_text.seek(m_fileIndex.find("[TRAP]")->second);
+
+		while (getline(data_text, buffer, MAX_LINE_SIZE)) {
+			if (buffer[0]=='[' || strlen(buffer)==0) {
+				break;
+			}
+			int gradId;
+			GradEvent event;
+			if (6!=(SeqTokenizer(buffer) >> gradId >> event.amplitude
+				>> event.rampUpTime >> event.flatTime >> event.rampDownTime >> event.delay).count()) {
+				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode trapezoid gradient entry" << buffer << std::endl );
+				return false;
+			}					
+			event.waveShape=0;
+			event.timeShape=0;
+			m_gradLibrary[gradId] = event;
+		}
+	}
+
+	// Sort gradients based on index
+	// -----------------------------
+	//std::sort(m_gradLibrary.begin(),m_gradLibrary.end(),compareGradEvents);
+
+	// Read ADC section
+	// -------------------------------
+	print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading ADC section");
+	if (m_fileIndex.find("[ADC]") != m_fileIndex.end()) {
+		data_text.seek(m_fileIndex.find("[ADC]")->second);
+
+		int adcId;
+		m_adcLibrary.clear();
+		while (getline(data_text, buffer, MAX_LINE_SIZE)) {
+			if (buffer[0]=='[' || strlen(buffer)==0) {
+				break;
+			}
+			ADCEvent event;
+			if ( version_combined>=1005000L )
+			{
+				// v1.5.0
+				if (9!=(SeqTokenizer(buffer) >> adcId >> event.numSamples
+							>> event.dwellTime >> event.delay >> event.freqPPM >> event.phasePPM >> event.freqOffset >> event.phaseOffset >> event.phaseModulationShape
+							).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode ADC event\n" << buffer << std::endl );
+					return false;
+				}
+			}
+			else
+			{
+				// v1.4.0 and older
+				if (6!=(SeqTokenizer(buffer) >> adcId >> event.numSamples
+							>> event.dwellTime >> event.delay >> event.freqOffset >> event.phaseOffset
+							).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode ADC event\n" << buffer << std::endl );
+					return false;
+				}
+                    event.freqPPM=0.0; // no ppmOffset in older formats
+                    event.phasePPM= 0.0; 
+				event.phaseModulationShape=0; // no phase modulation shape provided 
+			}
+			
+			m_adcLibrary[adcId] = event;
+		}
+	}
+
+	// Read delays section (comatibility with Pulseq version prior to 1.4.0)
+	// ---------------------------------------------------------------------
+	//std::map<int,long> tmpDelayLibrary;
+	m_tmpDelayLibrary.clear();
+	if (m_fileIndex.find("[DELAYS]") != m_fileIndex.end()) {
+		print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading DELAYS section (compatibility)");
+		data_text.seek(m_fileIndex.find("[DELAYS]")->second);
+
+		int delayId;
+		long delay;
+		while (getline(data_text, buffer, MAX_LINE_SIZE)) {
+			if (buffer[0]=='[' || strlen(buffer)==0) {
+				break;
+			}
+			if (2!=(SeqTokenizer(buffer) >> delayId >> delay).count()) {
+				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode delay event\n" << buffer << std::endl );
+				return false;
+			}
+			m_tmpDelayLibrary[delayId] = delay;
+		}
+	}
+
+	// Read extensions section
+	// -------------------------------
+	print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "reading and processing extensions");
+	m_extensionLibrary.clear();
+	m_extensionNameIDs.clear();
+	m_triggerLibrary.clear(); // clear also all known extension libraries
+	m_labelsetLibrary.clear();
+	m_labelincLibrary.clear();
+	std::map<std::string,int>::iterator itFI = m_fileIndex.find("[EXTENSIONS]");
+	if ( itFI != m_fileIndex.end()) {
+		data_text.seek(itFI->second);
+		std::set<int>::iterator itSFI = m_fileSections.find(itFI->second);
+		if ( itSFI==m_fileSections.end() ||
+			 (++itSFI)==m_fileSections.end() )
 		{
-			print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "-- converting blocks from version " << version_combined);
-			// we need to calculate dutation of every block and save it in m_blockDurations_ru
-
-			for (int b=0; b<m_blocks.size(); ++b) 
-			{
-				SeqBlock* block=GetBlock(b);
-				// Calculate duration of block
-				long duration = 0;
-				// special processing of the delay objects (which are now eliminated)
-				if (m_blockDurations_ru[b]) // non-zero means old delay library reference
-				{
-					if (m_tmpDelayLibrary.end()==m_tmpDelayLibrary.find(m_blockDurations_ru[b])) {
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: invalid delay library reference " << m_blockDurations_ru[b] << " in block " << b << " detected while convering the Pulseq file from older version");
-						return false;
-					}
-					duration=m_tmpDelayLibrary[m_blockDurations_ru[b]]; // we know delay is still 0, see above
-				}
-				// fairly standard code, copied from the old version of GetBlock()
-				if (block->isRF()) {
-					RFEvent &rf = block->GetRFEvent();
-					duration = MAX(duration, rf.delay+(long)m_shapeLibrary[rf.magShape].numUncompressedSamples); // in versions prior to v 1.4.0 RF raster was 1us and there was no RF time shape
-				}
-				for (int iC=0; iC<NUM_GRADS; iC++)
-				{
-					GradEvent &grad = block->GetGradEvent(iC);
-					if (block->isArbitraryGradient(iC))
-						duration = MAX(duration, (long)(m_dGradientRasterTime_us*m_shapeLibrary[grad.waveShape].numUncompressedSamples) + grad.delay); // in versions prior to v 1.4.0 there was no time shape
-					else if (block->isTrapGradient(iC))
-						duration = MAX(duration, grad.rampUpTime + grad.flatTime + grad.rampDownTime + grad.delay); 
-					else if (block->isExtTrapGradient(iC)) {
-						// in versions prior to 1.4.0 there were no extended trapezoids (no time shape IDs) so this should never happen
-						print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: unexpected error while converting arbitrary gradients");
-						return false;
-					}
-				}
-				if (block->isADC()) {
-					ADCEvent &adc = block->GetADCEvent();
-					duration = MAX(duration, adc.delay + (adc.numSamples*adc.dwellTime)/1000);
+			print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed find the end of the section while reading EXTENSIONS");
+			return false;
+		}
+		int sectionEnd = *itSFI;
+		// we first read in the extension list
+		int nID;
+		int nExtensionID=EXT_LIST; // EXT_LIST means we are reading the extension list
+		while ( data_text.tell()<sectionEnd &&
+				getline(data_text, buffer, MAX_LINE_SIZE)) 
+		{
+			if (buffer[0]=='#' || buffer[0]=='[' || strlen(buffer)==0) {
+				continue;
+			}
+			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "input line: " << buffer);
+			if (0==strncmp(buffer,"extension",9)) {
+				// read new extension ID from the header
+				char szStrID[MAX_LINE_SIZE];
+				int nInternalID=0;
+				int nKnownID=EXT_UNKNOWN;
+				if (2!=(SeqTokenizer(buffer).expect("extension").word(szStrID, MAX_LINE_SIZE) >> nInternalID).count()) {
+					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode extension header entry\n" << buffer << std::endl );
+					return false;
 				}
-				if (block->isTrigger()) {
-					TriggerEvent &trigger = block->GetTriggerEvent();
-					duration = MAX(duration, trigger.delay+trigger.duration );
+				// here is the list of extensions we currently recognize
+				if (0==strcmp("TRIGGERS",szStrID))
+					nKnownID=EXT_TRIGGER;
+				else if (0==strcmp("ROTATIONS",szStrID))
+					nKnownID=EXT_ROTATION;
+				else if (0==strcmp("LABELSET",szStrID))
+					nKnownID=EXT_LABELSET;
+				else if (0==strcmp("LABELINC",szStrID))
+					nKnownID=EXT_LABELINC;
+				else if (0==strcmp("DELAYS",szStrID))
+					nKnownID=EXT_DELAY;
+				else if (0==strcmp("RF_SHIMS",szStrID))
+					nKnownID=EXT_RF_SHIM;
+				if (nKnownID!=EXT_UNKNOWN)
+					m_extensionNameIDs[nInternalID]=std::make_pair(std::string(szStrID),nKnownID);
+				else {
+					print_msg(WARNING_MSG, std::ostringstream().flush() << "*** WARNING: unknown extension ignored\n" << buffer << std::endl );
 				}
-				// clean up memory
-				delete block;
-				// convert duration to raster units and store it
-				m_blockDurations_ru[b]=ceil(duration/SeqBlock::s_blockDurationRaster - 1e-12);
-				// sanity check
-				if (fabs(m_blockDurations_ru[b]*SeqBlock::s_blockDurationRaster-duration)>1e-9) {
-					print_msg(ERROR_MSG, std::ostringstream().flush() << "*** WARNING: rounding up block duration for block" << b);
+				nExtensionID=nKnownID;
+			}
+			else
+			{
+				ExtensionListEntry extEntry;
+				TriggerEvent trigger;
+				RotationEvent rotation;
+				SoftDelayEvent delay;
+                    RfShimmingEvent rfShim;
+				int  nVal;					   // read label set/inc values from label set/inc extension
+				int  nRet;                     // conversion result / return value
+				char szLabelID[MAX_LINE_SIZE]; // read labels strings from label set/inc extension
+				LabelEvent	label;			   // write label event
+				switch (nExtensionID) {
+					case EXT_LIST: 
+						if (4!=(SeqTokenizer(buffer) >> nID >> extEntry.type >> extEntry.ref >> extEntry.next).count()) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode extension list entry\n" << buffer << std::endl );
+							return false;
+						}
+						print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoding extension list entry " << buffer);
+						m_extensionLibrary[nID] = extEntry;
+						print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "nID:" << nID << " type:" << extEntry.type << " ref" << extEntry.ref << " next:" << extEntry.next);
+						break;
+					case EXT_TRIGGER: 
+						if (5!=(SeqTokenizer(buffer) >> nID >> trigger.triggerType >> trigger.triggerChannel >> trigger.delay >> trigger.duration).count()) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode trigger event\n" << buffer << std::endl );
+							return false;
+						}
+						m_triggerLibrary[nID] = trigger;
+						break;
+					case EXT_ROTATION: 
+						if (5!=(SeqTokenizer(buffer) >> nID >> rotation.rotQuaternion[0] >> rotation.rotQuaternion[1] >> rotation.rotQuaternion[2] >> rotation.rotQuaternion[3]).count()) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode rotation event\n" << buffer << std::endl );
+                                return false;
+						}
+                            {
+							double dNorm=sqrt(rotation.rotQuaternion[0]*rotation.rotQuaternion[0]+rotation.rotQuaternion[1]*rotation.rotQuaternion[1]+rotation.rotQuaternion[2]*rotation.rotQuaternion[2]+rotation.rotQuaternion[3]*rotation.rotQuaternion[3]);
+                                if (fabs(dNorm-1.0)>1e-3) {
+								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: rotation extension loaded a non-normalized quaternion " << buffer << std::endl );
+								return false;
+							}
+							for (int i = 0; i < 4; ++i)
+                                    rotation.rotQuaternion[i] /= dNorm; 
+                            }
+						rotation.defined=true;
+						m_rotationLibrary[nID] = rotation; 
+						break;
+					case EXT_LABELSET: 
+						if (3!=(SeqTokenizer(buffer) >> nID >> nVal).word(szLabelID, MAX_LINE_SIZE).count()) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to load labelset event\n" << buffer << std::endl );
+							return false;
+						}
+						nRet = decodeLabel(EXT_LABELSET,nVal,szLabelID,label);
+						if (nRet<0) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode labelset event\n" << buffer << std::endl );
+							return false;
+						}else if(nRet>0) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** decoding labelset event returned 0\n" << buffer << std::endl );
+						} 
+						m_labelsetLibrary[nID] = label;
+						break;
+					case EXT_LABELINC: 
+						if (3!=(SeqTokenizer(buffer) >> nID >> nVal).word(szLabelID, MAX_LINE_SIZE).count()) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode labelinc event\n" << buffer << std::endl );
+							return false;
+						}
+						nRet = decodeLabel(EXT_LABELINC,nVal,szLabelID,label);
+						if (nRet<0) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode labelinc event\n" << buffer << std::endl );
+							return false;
+						}else if(nRet>0) {
+							print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: decoding labelinc event returnd 0\n" << buffer << std::endl );
+						}
+
+						m_labelincLibrary[nID] = label;
+						break;
+					case EXT_DELAY: 
+						{
+							SeqTokenizer tok(buffer);
+							if (4!=(tok >> nID >> delay.numID >> delay.offset >> delay.factor).count()) {
+								print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode soft delay event\n" << buffer << std::endl );
+								return false;
+							}
+							strncpy(delay.hint,stripWhiteSpace(buffer+(tok.position()-buffer)),SOFT_DELAY_HINT_LENGTH); // the rest of the line
+							delay.hint[SOFT_DELAY_HINT_LENGTH-1]=0;
+							print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoded soft delay " << delay.numID << " with the hint:" << delay.hint);
+							m_softDelayLibrary[nID] = delay;
+						}
+						break;
+                        case EXT_RF_SHIM:
+                            {
+							SeqTokenizer tok(buffer);
+							if (2!= (tok >> rfShim.id >> rfShim.nchan).count())
+                                {
+                                    print_msg(
+                                        ERROR_MSG,
+                                        std::ostringstream().flush() << "*** ERROR: failed to decode RF shim event\n"
+                                                                     << buffer << std::endl);
+                                    return false;
+                                }
+							print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoded initial part of the RF shim event, id:" << rfShim.id << " nChan:" << rfShim.nchan << " curren position:" << tok.position()-buffer);
+							rfShim.amplitudes.reserve(rfShim.nchan);
+							rfShim.phases.reserve(rfShim.nchan);
+							for (int i=0;i<rfShim.nchan; ++i) 
+							{
+								float fa,fp;
+								if (!(tok >> fa >> fp))
+								{
+									print_msg(
+										ERROR_MSG,
+										std::ostringstream().flush() << "*** ERROR: failed to decode RF shim event for channel " << i << " in\n"
+																	 << buffer << std::endl);
+									return false;
+								}
+								print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "decoded a further part of the RF shim event, fa:" << fa << " fp:" << fp << " curren position:" << tok.position()-buffer);
+								rfShim.amplitudes.push_back(fa);
+								rfShim.phases.push_back(fp);								
+							}
+							print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "finished decoding RF shim event");
+                                m_rfShimLibrary[rfShim.id] = rfShim;
+                            }
+                            break;
+					case EXT_UNKNOWN:
+						print_msg(WARNING_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode unknown extension event\n" << buffer << std::endl );
+						break; // just ignore unknown extensions
 				}
 			}
-			m_tmpDelayLibrary.clear();
 		}
-	}
+	}		
+	
+	print_msg(DEBUG_HIGH_LEVEL, std::ostringstream().flush() << "-- EVENTS READ: "
+		<<" RF: " << m_rfLibrary.size()
+		<<" GRAD: " << m_gradLibrary.size()
+		<<" ADC: " << m_adcLibrary.size()
+		<<" EXTENSIONS: " << m_extensionLibrary.size() + m_triggerLibrary.size() + m_rotationLibrary.size() + m_labelsetLibrary.size() + m_labelincLibrary.size());
+	return true;
+}
 
-	//std::vector<double> def = GetDefinition("Scan_ID");
-	//int scanID = def.empty() ? 0: (int)def[0];
-	//print_msg(NORMAL_MSG, std::ostringstream().flush() << "==========================================" );
-	//print_msg(NORMAL_MSG, std::ostringstream().flush() << "===== EXTERNAL SEQUENCE #" << std::setw(5) << scanID << " ===========" );
-	//print_msg(NORMAL_MSG, std::ostringstream().flush() << "==========================================" );
 
+/***********************************************************/
+bool ExternalSequence::readBlocks(SeqText& data_text, bool bParallel)
+{
+	std::map<std::string,int>::const_iterator itFI = m_fileIndex.find("[BLOCKS]");
+	if (itFI == m_fileIndex.end())
+		return false;
+
+	// The section ends with the first empty line or section header, at the latest where the next
+	// section starts. That range is split into line-aligned chunks which are decoded concurrently.
+	const char* sectionBegin = data_text.begin + itFI->second;
+	const char* sectionEnd = data_text.end;
+	std::set<int>::const_iterator itSFI = m_fileSections.upper_bound(itFI->second);
+	if (itSFI != m_fileSections.end() && *itSFI <= data_text.end - data_text.begin)
+		sectionEnd = data_text.begin + *itSFI;
+	const size_t sectionSize = sectionEnd - sectionBegin;
+
+	size_t numChunks = 1;
+	if (bParallel) {
+		numChunks = MIN((size_t)MAX(std::thread::hardware_concurrency(), 1u), sectionSize / BLOCK_CHUNK_MIN_SIZE);
+		numChunks = MAX(numChunks, (size_t)1);
+	}
+	std::vector<BlockChunk> chunks(numChunks);
+	const char* p = sectionBegin;
+	for (size_t c=0; c<numChunks; ++c) {
+		BlockChunk& chunk = chunks[c];
+		chunk.begin = p;
+		if (c+1 == numChunks)
+			p = sectionEnd;
+		else {
+			// move the split point to the beginning of the next line
+			p = MAX(p, sectionBegin + sectionSize*(c+1)/numChunks);
+			while (p < sectionEnd && *p != '\n' && *p != '\r')
+				++p;
+			if (p < sectionEnd && *p == '\r' && p+1 < sectionEnd && p[1] == '\n')
+				++p;
+			if (p < sectionEnd)
+				++p;
+		}
+		chunk.end = p;
+	}
+
+	std::vector< std::future<void> > workers;
+	for (size_t c=1; c<numChunks; ++c)
+		workers.push_back(std::async(std::launch::async, &ExternalSequence::readBlockChunk, std::ref(chunks[c])));
+	readBlockChunk(chunks[0]);
+	for (size_t w=0; w<workers.size(); ++w)
+		workers[w].get();
+
+	// Collect the chunks in file order up to the end of the section, anything after it is ignored
+	size_t numBlocks = 0;
+	for (size_t c=0; c<numChunks; ++c) {
+		numBlocks += chunks[c].events.size();
+		if (chunks[c].errorFields>=0 || chunks[c].terminated)
+			break;
+	}
+	m_blocks.clear();
+	m_blockDurations_ru.clear();
+	m_blockIds.clear();
+	m_blocks.reserve(numBlocks);
+	m_blockDurations_ru.reserve(numBlocks);
+	m_blockIds.reserve(numBlocks);
+	for (size_t c=0; c<numChunks; ++c) {
+		const BlockChunk& chunk = chunks[c];
+		m_blocks.insert(m_blocks.end(), chunk.events.begin(), chunk.events.end());
+		m_blockDurations_ru.insert(m_blockDurations_ru.end(), chunk.durations_ru.begin(), chunk.durations_ru.end()); // ATTENTION, for versions prior to 1.4.0 this will contain delayIDs, we fix it in load()
+		m_blockIds.insert(m_blockIds.end(), chunk.blockIds.begin(), chunk.blockIds.end());
+		if (chunk.errorFields>=0) {
+			print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: failed to decode event table entry:\n" << chunk.errorLine << std::endl );
+			print_msg(ERROR_MSG, std::ostringstream().flush() << "***        number of fields read: " << chunk.errorFields << std::endl );
+			return false;
+		}
+		if (chunk.terminated)
+			break;
+	}
 	return true;
-};
+}
+
+
+/***********************************************************/
+void ExternalSequence::readBlockChunk(BlockChunk& chunk)
+{
+	SeqText data_text(chunk.begin, chunk.end - chunk.begin);
+	const char* line;
+	int length;
+
+	int blockIdx;
+	EventIDs events;
+
+	chunk.events.reserve((chunk.end - chunk.begin)/24 + 1); // rough estimate of the line count
+	chunk.durations_ru.reserve(chunk.events.capacity());
+	chunk.blockIds.reserve(chunk.events.capacity());
+	// the block lines are decoded straight from the text without copying them
+	while (scanLine(data_text, line, length, MAX_LINE_SIZE)) {
+		if (length==0 || line[0]=='[') {
+			chunk.terminated = true;
+			return;
+		}
+
+		memset(events.id, 0, NUM_EVENTS*sizeof(int));
+		long dur_ru =0;
+
+		int ret=(SeqTokenizer(line, line+length) >> blockIdx
+				>> dur_ru                                       // block duration
+				>> events.id[RF]                                // RF
+				>> events.id[GX] >> events.id[GY] >> events.id[GZ] // Gradients
+				>> events.id[ADC]                               // ADCs
+				>> events.id[EXT]                               // Extensions
+				).count();
+		if (7>ret) {
+			chunk.errorFields = ret;
+			chunk.errorLine.assign(line, length);
+			return;
+		}
+		chunk.events.push_back(events);
+		chunk.durations_ru.push_back(dur_ru);
+		chunk.blockIds.push_back(blockIdx);
+	}
+}
 
 
 /***********************************************************/
-void ExternalSequence::skipComments(std::istream &fileStream, char *buffer)
+void ExternalSequence::skipComments(SeqText &text, char *buffer)
 {
-	while (getline(fileStream, buffer, MAX_LINE_SIZE)) {
+	while (getline(text, buffer, MAX_LINE_SIZE)) {
 		if (buffer[0]!=COMMENT_CHAR && strlen(buffer)>0) {
 			break;
 		}
@@ -1083,51 +1860,52 @@ char* ExternalSequence::stripWhiteSpace(char *buffer)
 
 
 /***********************************************************/
-void ExternalSequence::buildFileIndex(std::istream &fileStream)
+void ExternalSequence::buildFileIndex(SeqText &text)
 {
-	char buffer[MAX_LINE_SIZE];
-    char* pBr;
+	const char* line;
+	int length;
     struct MD5Context mdc;
     unsigned char dg[16];
     MD5Init(&mdc);
     bool bSignatureSectionFound = false;
-    std::string strippedLine;
-    		
-	while (getline(fileStream, buffer, MAX_LINE_SIZE, true)) {		
-		//ExternalSequence::print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "buildFileIndex(): read line: [" << line << "]");
-		if (buffer[0]=='[' ) {
-            //print_msg(NORMAL_MSG, std::ostringstream().flush() << "opening bracket found in " << buffer);
-            pBr=strchr(buffer+1,']');
+	// a pending line break is only hashed if more content follows before [SIGNATURE]
+	const char* strippedLine = NULL;
+	int strippedLength = 0;
+
+	// lines are hashed directly from the text, no copy is made
+	text.seek(0);
+	while (scanLine(text, line, length, MAX_LINE_SIZE, true)) {
+		if (line[0]=='[' ) {
+            const char* pBr = static_cast<const char*>(memchr(line+1, ']', length-1));
 			if (pBr) {
-                std::string line  = std::string(buffer, pBr - buffer + 1);
-                //print_msg(NORMAL_MSG, std::ostringstream().flush() << "closing bracket found, line " << line);
-                m_fileIndex[line] = fileStream.tellg();
-                m_fileSections.insert(fileStream.tellg());
-                if (line == "[SIGNATURE]") {
+                std::string header(line, pBr - line + 1);
+                m_fileIndex[header] = text.tell();
+                m_fileSections.insert(text.tell());
+                if (header == "[SIGNATURE]") {
                     bSignatureSectionFound = true;
-                    // not on vb17 // strippedLine.clear();
-					strippedLine="";
-					//print_msg(NORMAL_MSG, std::ostringstream().flush() << "signature block found");
+					strippedLine = NULL;
+					strippedLength = 0;
 				}
 			}
 		}
         if (!bSignatureSectionFound) {
-            if (!strippedLine.empty())
-                MD5Update(&mdc, (unsigned char*)strippedLine.c_str(), strippedLine.length());
-            if (0==strcmp(buffer, "\n") || 0==strcmp(buffer, "\r\n"))
-                strippedLine = buffer;
+            if (strippedLine)
+                MD5Update(&mdc, (unsigned char*)strippedLine, strippedLength);
+            if ((length==1 && line[0]=='\n') || (length==2 && line[0]=='\r' && line[1]=='\n')) {
+                strippedLine = line;
+				strippedLength = length;
+			}
 			else {
-                MD5Update(&mdc, (unsigned char*)buffer, strlen(buffer));
-                // not on vb17 // strippedLine.clear();
-				strippedLine="";
+                MD5Update(&mdc, (unsigned char*)line, length);
+				strippedLine = NULL;
+				strippedLength = 0;
 			}
 		}			
 	}
-	m_fileSections.insert(fileStream.tellg()); // add the end-of-file (+1?)
-	fileStream.clear();		// reset EOF flag
-	fileStream.seekg(0, std::ios::beg);
-    if (!strippedLine.empty())
-        MD5Update(&mdc, (unsigned char*)strippedLine.c_str(), strippedLine.length());
+	m_fileSections.insert(text.tell()); // add the end-of-file
+	text.seek(0);
+    if (strippedLine)
+        MD5Update(&mdc, (unsigned char*)strippedLine, strippedLength);
     // finalize the MD5 hash calculation
 	MD5Final(dg, &mdc);
     char hash[33];
@@ -1151,6 +1929,16 @@ std::vector<std::string> ExternalSequence::GetAllDefinitions()
     return keys;
 }
 
+/***********************************************************/
+// Copy an event out of a library without inserting missing IDs like operator[] would:
+// GetBlock() may be called from several threads at once once the sequence is loaded
+template <typename T>
+static T findEvent(const std::map<int,T>& library, int id)
+{
+	typename std::map<int,T>::const_iterator it = library.find(id);
+	return (it!=library.end()) ? it->second : T();
+}
+
 /***********************************************************/
 SeqBlock*	ExternalSequence::GetBlock(int index) {
 	SeqBlock *block = new SeqBlock();
@@ -1175,10 +1963,10 @@ SeqBlock*	ExternalSequence::GetBlock(int index) {
 	block->rfShim.nchan=-1;
 	block->rfShim.id=0;
 	// Set event structures (if applicable) so e.g. gradient type can be determined
-	if (events.id[RF]>0)     block->rf      = m_rfLibrary[events.id[RF]];
-	if (events.id[ADC]>0)    block->adc     = m_adcLibrary[events.id[ADC]];
+	if (events.id[RF]>0)     block->rf      = findEvent(m_rfLibrary,events.id[RF]);
+	if (events.id[ADC]>0)    block->adc     = findEvent(m_adcLibrary,events.id[ADC]);
 	for (unsigned int i=0; i<NUM_GRADS; i++)
-		if (events.id[GX+i]>0) block->grad[i] = m_gradLibrary[events.id[GX+i]];
+		if (events.id[GX+i]>0) block->grad[i] = findEvent(m_gradLibrary,events.id[GX+i]);
 	// unpack (known) extension objects
 	if (events.id[EXT]>0) {
 		// oh yeah, the current data stuctures seem to be really ugly and slow...
@@ -1201,7 +1989,7 @@ SeqBlock*	ExternalSequence::GetBlock(int index) {
 						}
 						else {
 							// ok, lets find the trigger in the library
-							block->trigger=m_triggerLibrary[itEL->second.ref]; // do we have to check whether it can be found?
+							block->trigger=findEvent(m_triggerLibrary,itEL->second.ref); // do we have to check whether it can be found?
 						}
 						break;
 					case EXT_ROTATION:
@@ -1210,18 +1998,18 @@ SeqBlock*	ExternalSequence::GetBlock(int index) {
 						}
 						else {
 							// ok, lets find the rotation in the library
-							block->rotation=m_rotationLibrary[itEL->second.ref]; // do we have to check whether it can be found?
+							block->rotation=findEvent(m_rotationLibrary,itEL->second.ref); // do we have to check whether it can be found?
 						}
 						break;
 					case EXT_LABELSET:
 						//do we have to check anything ? //MZ: TODO: check that we find the evet in the library TODO: check for conflicts between set and inc
 							// ok, lets find the labelset in the library
-							block->labelset.push_back(m_labelsetLibrary[itEL->second.ref]); // do we have to check whether it can be found?
+							block->labelset.push_back(findEvent(m_labelsetLibrary,itEL->second.ref)); // do we have to check whether it can be found?
 						break;
 					case EXT_LABELINC:
 						//do we have to check anything ? //MZ: TODO: check that we find the evet in the library TODO: check for conflicts between set and inc
 							// ok, lets find the labelinc in the library
-							block->labelinc.push_back(m_labelincLibrary[itEL->second.ref]); // do we have to check whether it can be found?
+							block->labelinc.push_back(findEvent(m_labelincLibrary,itEL->second.ref)); // do we have to check whether it can be found?
 						break;
 					case EXT_DELAY:
 						if (block->softDelay.numID>=0) {
@@ -1229,7 +2017,7 @@ SeqBlock*	ExternalSequence::GetBlock(int index) {
 						}
 						else {
 							// ok, lets find the soft delay in the library
-							block->softDelay=m_softDelayLibrary[itEL->second.ref]; // do we have to check whether it can be found?
+							block->softDelay=findEvent(m_softDelayLibrary,itEL->second.ref); // do we have to check whether it can be found?
 						}
 						break;
 					case EXT_RF_SHIM:
@@ -1238,7 +2026,7 @@ SeqBlock*	ExternalSequence::GetBlock(int index) {
 						}
 						else {
 							// ok, lets find the RF shim event in the library
-							block->rfShim=m_rfShimLibrary[itEL->second.ref]; // do we have to check whether it can be found?
+							block->rfShim=findEvent(m_rfShimLibrary,itEL->second.ref); // do we have to check whether it can be found?
 						}
 						break;
 					default:
@@ -1311,37 +2099,21 @@ bool ExternalSequence::decodeBlock(SeqBlock *block)
 		<< events[0]+1 << " " << events[1]+1 << " " << events[2]+1 << " "
 		<< events[3]+1 << " " << events[4]+1 );
 	
-	std::vector<float> waveform;	
 	// Decode RF
 	if (block->isRF())
 	{
-		// Decompress the shape for this channel
-		CompressedShape& shape = m_shapeLibrary[block->rf.magShape];
-		waveform.resize(shape.numUncompressedSamples);
-		if (!decompressShape(shape,&waveform[0]))
-			return false;
-
-		//MZ: original Kelvin's code follows
-		CompressedShape& shapePhase = m_shapeLibrary[block->rf.phaseShape];
-		std::vector<float> waveform_p;
-		waveform_p.resize(shapePhase.numUncompressedSamples);
-		if (!decompressShape(shapePhase,&waveform_p[0]))
-			return false;
-		// Scale phase by 2pi
-		std::transform(
-			waveform_p.begin(),
-			waveform_p.end(),
-			waveform_p.begin(),
-			[](float x) { return x * static_cast<float>(TWO_PI); }
-		);
-
 		float fDwellTime_us=0;
 		// feature of v1.4.x
 		// handle time shape 
 		if (block->rf.timeShape) 
 		{
 			// new file format (v1.4.x)
-			CompressedShape& shapeTime = m_shapeLibrary[block->rf.timeShape];
+			std::map<int,CompressedShape>::const_iterator itTime = m_shapeLibrary.find(block->rf.timeShape);
+			if (itTime==m_shapeLibrary.end()) {
+				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: RF time shape " << block->rf.timeShape << " not found in block " << block->index );
+				return false;
+			}
+			const CompressedShape& shapeTime = itTime->second;
 			// detect regular sampling 
 			if (shapeTime.samples.size()!=shapeTime.numUncompressedSamples &&
 				(shapeTime.samples.size()==3 || shapeTime.samples.size()==4)) 
@@ -1352,32 +2124,8 @@ bool ExternalSequence::decodeBlock(SeqBlock *block)
 			}
 			else
 			{
-				std::vector<float> waveform_t;
-				waveform_t.resize(shapeTime.numUncompressedSamples);
-				if (!decompressShape(shapeTime,&waveform_t[0]))
-					return false;
-				// we resample the input on the fly 
-				// for now we just use the RF raster time
+				// the shapes are resampled on the RF raster time when entering the pool
 				fDwellTime_us=m_dRadiofrequencyRasterTime_us;
-				int nSamples=int(0.5+waveform_t.back());
-				// for now we use nearest neighbour/right repetition interpolation
-				// FIXME/TODO: convert to complex, use linear interpolation and convert back to magnitude&phase
-				std::vector<float> wv_a(nSamples);
-				std::vector<float> wv_p(nSamples);
-				int tc=0;
-				for(int c=0;c<nSamples;++c)
-				{
-					if(waveform_t[tc]<(c+1)) 
-					{
-						if (tc<waveform_t.size())
-							++tc;
-					}
-					wv_a[c]=waveform[tc];
-					wv_p[c]=waveform_p[tc];
-				}
-				// replace the waveforms
-				waveform.swap(wv_a);
-				waveform_p.swap(wv_p);
 			}
 		}
 		else
@@ -1390,8 +2138,10 @@ bool ExternalSequence::decodeBlock(SeqBlock *block)
 				fDwellTime_us=1.0; // old Pulseq's predefined RF raster time
 		}
 		//
-		block->rfAmplitude = std::vector<float>(waveform);
-		block->rfPhase = std::vector<float>(waveform_p);
+		block->rfAmplitude = getPooledShape(PS_RF_AMPLITUDE, block->rf.magShape, block->rf.timeShape);
+		block->rfPhase = getPooledShape(PS_RF_PHASE, block->rf.phaseShape, block->rf.timeShape);
+		if (!block->rfAmplitude || !block->rfPhase)
+			return false;
 		block->rfDwellTime_us = fDwellTime_us;
 	}
 
@@ -1400,19 +2150,6 @@ bool ExternalSequence::decodeBlock(SeqBlock *block)
 	{
 		if (block->isArbitraryGradient(iC-GX))	// is arbitrary gradient?
 		{
-			// Decompress the arbitrary shape for this channel
-			CompressedShape& shape = m_shapeLibrary[block->grad[iC-GX].waveShape];
-
-			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Loaded shape with "
-				<< shape.samples.size() << " compressed samples" );
-
-			waveform.resize(shape.numUncompressedSamples);
-			if (!decompressShape(shape,&waveform[0]))
-				return false;
-
-			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Shape uncompressed to "
-				<< shape.numUncompressedSamples << " samples" );
-
 			if (fabs(m_dGradientRasterTime_us-10)>1e-3)
 			{
 				print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Shape is on a raster that is different from the system raster, exitting... (will try resampling in the future versions...)" );
@@ -1421,20 +2158,10 @@ bool ExternalSequence::decodeBlock(SeqBlock *block)
 				return false;
 			}
 
-			if (block->isArbGradWithOversampling(iC-GX))	// oversampling?
-			{
-				block->gradWaveforms[iC-GX] = std::vector<float>((waveform.size()+1)/2);
-				std::vector<float>::iterator it_os=waveform.begin();
-				for (std::vector<float>::iterator it=block->gradWaveforms[iC-GX].begin(); it !=block->gradWaveforms[iC-GX].end(); ++it){
-					*it=*it_os;
-					// std::advance(it_os,2); // this doen't work because of the odd number of elements 
-					++it_os;
-					if (it_os!=waveform.end())
-						++it_os;
-				}
-			}
-			else
-				block->gradWaveforms[iC-GX] = std::vector<float>(waveform);
+			// the time shape ID distinguishes the oversampled (-1) from the regular arbitrary shape (0)
+			block->gradWaveforms[iC-GX] = getPooledShape(PS_ARB_GRADIENT, block->grad[iC-GX].waveShape, MIN(block->grad[iC-GX].timeShape,0));
+			if (!block->gradWaveforms[iC-GX])
+				return false;
 		}
 	}
 
@@ -1453,9 +2180,6 @@ bool ExternalSequence::decodeBlock(SeqBlock *block)
 		block->delay = m_delayLibrary[events[DELAY]];
 	}*/
 
-	checkGradient(*block);
-	checkRF(*block);
-
 	return true;
 }
 
@@ -1466,36 +2190,21 @@ bool ExternalSequence::decodeExtTrapGradInBlock(SeqBlock *block)
 		<< events[0]+1 << " " << events[1]+1 << " " << events[2]+1 << " "
 		<< events[3]+1 << " " << events[4]+1 );
 
-	std::vector<float> waveform;
-	block->gradExtTrapForms.clear();
-	block->gradExtTrapForms.resize(NUM_GRADS);
 	// Decode gradients
 	for (int iC=GX; iC<ADC; iC++)
 	{
+		block->gradExtTrapTimes[iC-GX].reset();
+		block->gradExtTrapShapes[iC-GX].reset();
 		if (block->isExtTrapGradient(iC-GX))	// is arbitrary gradient?
 		{
-			// Decompress the ExtTrap shapes for this channel
+			// Get the ExtTrap shapes for this channel from the pool
 			// time shape first
-			CompressedShape& tshape = m_shapeLibrary[block->grad[iC-GX].timeShape];
-			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Loaded time shape " << block->grad[iC-GX].timeShape << " with " << tshape.samples.size() << " compressed samples" );
-			//for (int a=0; a<tshape.samples.size(); ++a) {
-			//	print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << tshape.samples[a] );
-			//}
-			waveform.resize(tshape.numUncompressedSamples);
-			if (!decompressShape(tshape,&waveform[0])) return false;
-			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Time shape uncompressed to " << tshape.numUncompressedSamples << " samples" );
-			//block->gradExtTrapForms[iC-GX].first = std::vector<float>(waveform); 
-			block->gradExtTrapForms[iC-GX].first.resize(waveform.size());
-			for (int i=0;i<waveform.size();++i)
-				block->gradExtTrapForms[iC-GX].first[i]=long(0.5+m_dGradientRasterTime_us*waveform[i]); // convert to long usec from grad rasters 
+			block->gradExtTrapTimes[iC-GX] = getPooledTimeShape(block->grad[iC-GX].timeShape);
+			if (!block->gradExtTrapTimes[iC-GX]) return false;
 			// now wave amplitude shape
-			CompressedShape& wshape = m_shapeLibrary[block->grad[iC-GX].waveShape];
-			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Loaded wave shape " << block->grad[iC-GX].waveShape << " with " << wshape.samples.size() << " compressed samples" );
-			waveform.resize(wshape.numUncompressedSamples);
-			if (!decompressShape(wshape,&waveform[0])) return false;
-			print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Wave shape uncompressed to " << wshape.numUncompressedSamples << " samples" );
-			block->gradExtTrapForms[iC-GX].second = std::vector<float>(waveform);
-			if (block->gradExtTrapForms[iC-GX].first.size() != block->gradExtTrapForms[iC-GX].second.size()) {
+			block->gradExtTrapShapes[iC-GX] = getPooledShape(PS_EXTTRAP_GRADIENT, block->grad[iC-GX].waveShape, block->grad[iC-GX].timeShape);
+			if (!block->gradExtTrapShapes[iC-GX]) return false;
+			if (block->gradExtTrapTimes[iC-GX]->size() != block->gradExtTrapShapes[iC-GX]->size()) {
 				print_msg(ERROR_MSG, std::ostringstream().flush() << "ERROR: uncompressed extended trapezoid time and wave shape lengths do not match" );
 				return false;
 			}
@@ -1504,6 +2213,139 @@ bool ExternalSequence::decodeExtTrapGradInBlock(SeqBlock *block)
 	return true;
 }
 
+/***********************************************************/
+bool ExternalSequence::decompressShapeByID(int shapeID, std::vector<float>& waveform)
+{
+	std::map<int,CompressedShape>::iterator it = m_shapeLibrary.find(shapeID);
+	if (it==m_shapeLibrary.end() || it->second.numUncompressedSamples==0 || it->second.samples.empty()) {
+		print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: shape " << shapeID << " not found or empty" );
+		return false;
+	}
+	CompressedShape& shape = it->second;
+	print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Loaded shape " << shapeID << " with "
+		<< shape.samples.size() << " compressed samples" );
+	waveform.resize(shape.numUncompressedSamples);
+	if (!decompressShape(shape,&waveform[0]))
+		return false;
+	print_msg(DEBUG_LOW_LEVEL, std::ostringstream().flush() << "Shape uncompressed to "
+		<< shape.numUncompressedSamples << " samples" );
+	return true;
+}
+
+/***********************************************************/
+SharedShape ExternalSequence::getPooledShape(PooledShapeKind kind, int shapeID, int timeID)
+{
+	// decompression happens at most once per shape, so holding the lock while decoding is cheap
+	std::lock_guard<std::mutex> lock(m_shapePoolMutex);
+	SharedShape& pooled = m_shapePool[kind][std::make_pair(shapeID,timeID)];
+	if (pooled)
+		return pooled;
+
+	std::shared_ptr<std::vector<float> > waveform = std::make_shared<std::vector<float> >();
+	if (!decompressShapeByID(shapeID, *waveform)) {
+		m_shapePool[kind].erase(std::make_pair(shapeID,timeID));
+		return SharedShape();
+	}
+
+	switch (kind)
+	{
+	case PS_RF_AMPLITUDE:
+	case PS_RF_PHASE:
+		if (kind==PS_RF_PHASE) {
+			// Scale phase by 2pi
+			std::transform(
+				waveform->begin(),
+				waveform->end(),
+				waveform->begin(),
+				[](float x) { return x * static_cast<float>(TWO_PI); }
+			);
+		}
+		if (timeID) {
+			std::map<int,CompressedShape>::const_iterator itTime = m_shapeLibrary.find(timeID);
+			if (itTime==m_shapeLibrary.end()) {
+				print_msg(ERROR_MSG, std::ostringstream().flush() << "*** ERROR: RF time shape " << timeID << " not found" );
+				m_shapePool[kind].erase(std::make_pair(shapeID,timeID));
+				return SharedShape();
+			}
+			const CompressedShape& shapeTime = itTime->second;
+			// regularly sampled shapes (size=3: 1 1 N-2; size=4: t0 d d N-3) are used as they are
+			if (!(shapeTime.samples.size()!=shapeTime.numUncompressedSamples &&
+				(shapeTime.samples.size()==3 || shapeTime.samples.size()==4))) 
+			{
+				std::vector<float> waveform_t;
+				if (!decompressShapeByID(timeID, waveform_t)) {
+					m_shapePool[kind].erase(std::make_pair(shapeID,timeID));
+					return SharedShape();
+				}
+				// we resample the input on the fly 
+				// for now we just use the RF raster time
+				int nSamples=int(0.5+waveform_t.back());
+				// for now we use nearest neighbour/right repetition interpolation
+				// FIXME/TODO: convert to complex, use linear interpolation and convert back to magnitude&phase
+				std::vector<float> wv(nSamples);
+				int tc=0;
+				for(int c=0;c<nSamples;++c)
+				{
+					if(waveform_t[tc]<(c+1)) 
+					{
+						if (tc<waveform_t.size())
+							++tc;
+					}
+					wv[c]=(*waveform)[tc];
+				}
+				// replace the waveform
+				waveform->swap(wv);
+			}
+		}
+		checkRF(*waveform, kind==PS_RF_PHASE);
+		break;
+
+	case PS_ARB_GRADIENT:
+		if (timeID==-1)	// oversampling?
+		{
+			std::vector<float> wv((waveform->size()+1)/2);
+			std::vector<float>::iterator it_os=waveform->begin();
+			for (std::vector<float>::iterator it=wv.begin(); it !=wv.end(); ++it){
+				*it=*it_os;
+				// std::advance(it_os,2); // this doen't work because of the odd number of elements 
+				++it_os;
+				if (it_os!=waveform->end())
+					++it_os;
+			}
+			waveform->swap(wv);
+		}
+		checkGradient(*waveform);
+		break;
+
+	default: // PS_EXTTRAP_GRADIENT: used unchanged
+		break;
+	}
+
+	pooled = waveform;
+	return pooled;
+}
+
+/***********************************************************/
+SharedTimeShape ExternalSequence::getPooledTimeShape(int timeID)
+{
+	std::lock_guard<std::mutex> lock(m_shapePoolMutex);
+	SharedTimeShape& pooled = m_timeShapePool[timeID];
+	if (pooled)
+		return pooled;
+
+	std::vector<float> waveform;
+	if (!decompressShapeByID(timeID, waveform)) {
+		m_timeShapePool.erase(timeID);
+		return SharedTimeShape();
+	}
+	std::shared_ptr<std::vector<long> > times = std::make_shared<std::vector<long> >(waveform.size());
+	for (int i=0;i<waveform.size();++i)
+		(*times)[i]=long(0.5+m_dGradientRasterTime_us*waveform[i]); // convert to long usec from grad rasters 
+
+	pooled = times;
+	return pooled;
+}
+
 /***********************************************************/
 bool ExternalSequence::decompressShape(CompressedShape& encoded, float *shape)
 {
@@ -1570,83 +2412,86 @@ bool ExternalSequence::checkBlockReferences(EventIDs& events)
 }
 
 /***********************************************************/
-void ExternalSequence::checkGradient(SeqBlock& block)
+void ExternalSequence::checkGradient(std::vector<float>& waveform)
 {
-	for (unsigned int i=0; i<NUM_GRADS; i++)
+	for (unsigned j=0; j<waveform.size(); j++)
 	{
-		std::vector<float> &waveform = block.gradWaveforms[i];
-		for (unsigned j=0; j<waveform.size(); j++)
-		{
-			if (waveform[j]>1.0)  waveform[j]= 1.0;
-			if (waveform[j]<-1.0) waveform[j]=-1.0;
-		}
-		// Ensure last point is zero // MZ: no, its wrong! trapezoid gradients have a non-zero at the end!
-		// if (waveform.size()>0) waveform[waveform.size()-1]=0.0;
+		if (waveform[j]>1.0)  waveform[j]= 1.0;
+		if (waveform[j]<-1.0) waveform[j]=-1.0;
 	}
+	// Ensure last point is zero // MZ: no, its wrong! trapezoid gradients have a non-zero at the end!
+	// if (waveform.size()>0) waveform[waveform.size()-1]=0.0;
 }
 
 
 /***********************************************************/
-void ExternalSequence::checkRF(SeqBlock& block)
+void ExternalSequence::checkRF(std::vector<float>& waveform, bool bPhase)
 {
-	for (unsigned int i=0; i<block.rfAmplitude.size(); i++)
+	for (unsigned int i=0; i<waveform.size(); i++)
 	{
-		if (block.rfAmplitude[i]>1.0) block.rfAmplitude[i]=1.0;
-		if (block.rfAmplitude[i]<0.0) block.rfAmplitude[i]=0.0;
-		if (block.rfPhase[i]>TWO_PI-1.e-4) block.rfPhase[i]=(float)(TWO_PI-1.e-4);
-		if (block.rfPhase[i]<0) block.rfPhase[i]=0.0;
+		if (bPhase) {
+			if (waveform[i]>TWO_PI-1.e-4) waveform[i]=(float)(TWO_PI-1.e-4);
+			if (waveform[i]<0) waveform[i]=0.0;
+		}
+		else {
+			if (waveform[i]>1.0) waveform[i]=1.0;
+			if (waveform[i]<0.0) waveform[i]=0.0;
+		}
 	}
 }
 
 
 /***********************************************************/
-int ExternalSequence::getline(std::istream& is, char *buffer, int MAX_SIZE, bool bRaw)
+int ExternalSequence::scanLine(SeqText& text, const char*& line, int& length, int MAX_SIZE, bool bRaw)
 {
-	//std::cout << "ExternalSequence::getline()" << std::endl;
-
-	int i=0;	// Current position in buffer
-	for(;;) {
-		char c = (char)is.get();
-
-		if (!bRaw) {
-            switch (c) {
-                case '\n':
-                    buffer[i] = '\0';
-                    // std::cout << "ExternalSequence::getline() EOL i:" << i << std::endl;
-                    // std::cout << "buffer: " << buffer << std::endl;
-                    return gl_true;
-                case '\r':
-                    if (is.peek() == '\n')
-                    {
-                        is.get(); // Discard character
-                    }
-                    buffer[i] = '\0';
-                    // std::cout << "ExternalSequence::getline() CR i:" << i << std::endl;
-                    // std::cout << "buffer: " << buffer << std::endl;
-                    return gl_true;
-            }
+	line = text.pos;
+	length = 0;
+	if (text.pos >= text.end) {
+		text.eof = true;
+		return gl_false;
+	}
+
+	// at most MAX_SIZE-1 characters fit into a caller's line buffer (plus the \0 symbol)
+	const char* limit = text.pos + MIN((long)(text.end - text.pos), (long)(MAX_SIZE - 1));
+	const char* p = text.pos;
+	if (bRaw) {
+		p = static_cast<const char*>(memchr(p, '\n', limit - p));
+		if (p) {
+			length = (int)(p + 1 - line); // in the *raw* mode the line ending is kept
+			text.pos = p + 1;
+			return gl_true;
 		}
-        switch (c) {
-			case EOF:
-				if(i==0)
-					is.seekg(-1);   // Create error on stream
-				buffer[i]='\0';     // In case last line has no line ending
-				//std::cout << "ExternalSequence::getline() EOF i:" << i << std::endl;
-				return (i!=0)?gl_true:gl_false;
-			default:
-				buffer[i++] = c;
-				if (i>=MAX_SIZE-1 || // -1 because we have to reserve one place for the \0 symbol
-					c=='\n' )        // we are in the *raw* mode
-				{
-					buffer[i]='\0';
-                    if (c == '\n')
-                        return gl_true;
-                    else
-						return gl_truncated;
-				}
-				
+	}
+	else {
+		while (p < limit && *p != '\n' && *p != '\r')
+			++p;
+		if (p < limit) {
+			length = (int)(p - line);
+			if (*p == '\r' && p + 1 < text.end && p[1] == '\n')
+				++p; // Windows line ending
+			text.pos = p + 1;
+			return gl_true;
 		}
 	}
+
+	length = (int)(limit - line);
+	text.pos = limit;
+	if (limit == text.end) {
+		text.eof = true; // last line has no line ending
+		return gl_true;
+	}
+	return gl_truncated;
+}
+
+/***********************************************************/
+int ExternalSequence::getline(SeqText& text, char *buffer, int MAX_SIZE, bool bRaw)
+{
+	const char* line;
+	int length;
+	int ret = scanLine(text, line, length, MAX_SIZE, bRaw);
+	memcpy(buffer, line, length);
+	buffer[length] = '\0';
+	return ret;
 }
 
 #define LABELMAP_COUNTER(LBL) \
@@ -1797,9 +2642,9 @@ bool ExternalSequence::isGradientInBlockStartAtNonZero(SeqBlock *block, int chan
 		return fabs(block->grad[channel].first)>0;
 	}
 	// older formats
-	if (!block->gradWaveforms[channel].empty()) { 
-		//ExternalSequence::print_msg(NORMAL_MSG, std::ostringstream().flush() << "isGradientInBlockStartAtNonZero() uses decompressed shape and returns " << (fabs(block->gradWaveforms[channel].front())>0));
-		return fabs(block->gradWaveforms[channel].front())>0;
+	if (block->gradWaveforms[channel] && !block->gradWaveforms[channel]->empty()) { 
+		//ExternalSequence::print_msg(NORMAL_MSG, std::ostringstream().flush() << "isGradientInBlockStartAtNonZero() uses decompressed shape and returns " << (fabs(block->gradWaveforms[channel]->front())>0));
+		return fabs(block->gradWaveforms[channel]->front())>0;
 	}
 	// we could decode the block's shapes at this point, but we can also just look up the first sample of the compressed shape
 	//ExternalSequence::print_msg(NORMAL_MSG, std::ostringstream().flush() << "isGradientInBlockStartAtNonZero() uses compressed shape and returns " << (fabs(m_shapeLibrary[block->grad[channel].waveShape].samples.front())>0));
@@ -7,6 +7,8 @@
 #include <fstream>
 #include <set>
 #include <map>
+#include <memory>
+#include <mutex>
 //#include <limits>	    // for std::numeric_limits<...>::quiet_NaN()
 
 #ifndef _EXTERNAL_SEQUENCE_H_
@@ -79,6 +81,16 @@ enum Event {
 const int NUM_EVENTS=LAST_UNUSED;
 const int NUM_GRADS=ADC-GX;
 
+/**
+ * @brief Decompressed shape shared between all blocks referencing it (immutable)
+ */
+typedef std::shared_ptr<const std::vector<float> > SharedShape;
+
+/**
+ * @brief Decompressed time shape of extended trapezoids in us, shared between all blocks referencing it (immutable)
+ */
+typedef std::shared_ptr<const std::vector<long> > SharedTimeShape;
+
 /**
  * @brief RF event data
  *
@@ -427,10 +439,7 @@ public:
 	/**
 	 * @brief Constructor
 	 */
-	SeqBlock() { 
-		gradWaveforms.resize(NUM_GRADS);
-		gradExtTrapForms.resize(NUM_GRADS);
-	}
+	SeqBlock() : rfDwellTime_us(0) {}
 
 	/**
 	 * @brief Return `true` if block has RF event
@@ -527,8 +536,10 @@ public:
 
 	/**
 	 * @brief Directly get a pointer to the samples of the arbitrary gradient
+	 *
+	 * The samples are shared by all blocks using the same shape and must not be modified
 	 */
-	float* GetArbGradShapePtr(int channel);
+	const float* GetArbGradShapePtr(int channel);
 
 	/**
 	 * @brief Return the timening and the shape of the ExtTrp grdient on the given gradient channel.
@@ -559,13 +570,17 @@ public:
 
 	/**
 	 * @brief Directly get a pointer to the samples of the RF amplitude shape
+	 *
+	 * The samples are shared by all blocks using the same shape and must not be modified
 	 */
-	float* GetRFAmplitudePtr();
+	const float* GetRFAmplitudePtr();
 
 	/**
 	 * @brief Directly get a pointer to the samples of the RF phase shape
+	 *
+	 * The samples are shared by all blocks using the same shape and must not be modified
 	 */
-	float* GetRFPhasePtr();
+	const float* GetRFPhasePtr();
 
 	/**
 	 * @brief Get dwell time for the RF amplitude and phase shapes (in us)
@@ -656,18 +671,24 @@ protected:
     RfShimmingEvent rfShim;     /**< @brief optional array of RF shimming events */
 	std::vector<LabelEvent> labelinc;    /**< @brief labelinc event, can be more than one */ // MZ: TODO: check if we should switch to storing only IDs in the library
 	std::vector<LabelEvent> labelset;    /**< @brief labelset event, can be more than one */ // MZ: TODO: check if we should switch to storing only IDs in the library
-	// Below is only valid once decompressed:
+	// Below is only valid once decompressed.
+	// The uncompressed shapes are owned by the shape pool of the parent ExternalSequence and shared between all blocks referencing them
 
 	// RF
-	std::vector<float> rfAmplitude;    /**< @brief RF amplitude shape (uncompressed) */
-	std::vector<float> rfPhase;        /**< @brief RF phase shape (uncompressed) */
+	SharedShape        rfAmplitude;    /**< @brief RF amplitude shape (uncompressed) */
+	SharedShape        rfPhase;        /**< @brief RF phase shape (uncompressed) */
 	float              rfDwellTime_us; /**< @brief dwell time of the RF shapes (in us) */
 
 	// Gradient waveforms
-	std::vector< std::vector<float> > gradWaveforms;    /**< @brief Arbitrary gradient shapes for each channel (uncompressed) */
+	SharedShape gradWaveforms[NUM_GRADS];    /**< @brief Arbitrary gradient shapes for each channel (uncompressed) */
 
 	// ExtTrap waveforms
-	std::vector< std::pair< std::vector< long >, std::vector< float > > > gradExtTrapForms;    /**< @brief ExtTrap gradient shapes for each channel (uncompressed) */
+	SharedTimeShape gradExtTrapTimes[NUM_GRADS];   /**< @brief ExtTrap gradient time points for each channel (in us) */
+	SharedShape     gradExtTrapShapes[NUM_GRADS];  /**< @brief ExtTrap gradient shapes for each channel (uncompressed) */
+
+	// returned for events which are not present or not decoded
+	static const std::vector<float> s_emptyShape;
+	static const std::vector<long>  s_emptyTimeShape;
 
 	// static for the duraton raster
 	static double s_blockDurationRaster;
@@ -729,24 +750,27 @@ inline std::string SeqBlock::GetTypeString() {
 	return type;
 }
 
-inline float*    SeqBlock::GetArbGradShapePtr(int channel) { return (gradWaveforms[channel].size()>0) ? &gradWaveforms[channel][0] : NULL; }
-inline int       SeqBlock::GetArbGradNumSamples(int channel) {	return gradWaveforms[channel].size(); }
+inline const float* SeqBlock::GetArbGradShapePtr(int channel) { return (gradWaveforms[channel] && !gradWaveforms[channel]->empty()) ? &(*gradWaveforms[channel])[0] : NULL; }
+inline int       SeqBlock::GetArbGradNumSamples(int channel) { return gradWaveforms[channel] ? gradWaveforms[channel]->size() : 0; }
 
-inline const std::vector<long>&  SeqBlock::GetExtTrapGradTimes(int channel) { return gradExtTrapForms[channel].first; }
-inline const std::vector<float>& SeqBlock::GetExtTrapGradShape(int channel) { return gradExtTrapForms[channel].second; }
+inline const std::vector<long>&  SeqBlock::GetExtTrapGradTimes(int channel) { return gradExtTrapTimes[channel] ? *gradExtTrapTimes[channel] : s_emptyTimeShape; }
+inline const std::vector<float>& SeqBlock::GetExtTrapGradShape(int channel) { return gradExtTrapShapes[channel] ? *gradExtTrapShapes[channel] : s_emptyShape; }
 
-inline float*    SeqBlock::GetRFAmplitudePtr() { return &rfAmplitude[0]; }
-inline float*    SeqBlock::GetRFPhasePtr() { return &rfPhase[0]; }
-inline int       SeqBlock::GetRFLength() { return rfAmplitude.size(); }
+inline const float* SeqBlock::GetRFAmplitudePtr() { return (rfAmplitude && !rfAmplitude->empty()) ? &(*rfAmplitude)[0] : NULL; }
+inline const float* SeqBlock::GetRFPhasePtr() { return (rfPhase && !rfPhase->empty()) ? &(*rfPhase)[0] : NULL; }
+inline int       SeqBlock::GetRFLength() { return rfAmplitude ? rfAmplitude->size() : 0; }
 inline float     SeqBlock::GetRFDwellTime() { return rfDwellTime_us; }
 inline double SeqBlock::getBlockDurationRaster() {return SeqBlock::s_blockDurationRaster; }
 
 inline void      SeqBlock::free() {
-	// Force the memory to be freed
-	std::vector<float>().swap(rfAmplitude);
-	std::vector<float>().swap(rfPhase);
-	std::vector<std::vector<float> >().swap(gradWaveforms);
-	std::vector<std::pair<std::vector<long>,std::vector<float> > >().swap(gradExtTrapForms);
+	// Release the references to the shared shapes (the memory is freed with the last reference)
+	rfAmplitude.reset();
+	rfPhase.reset();
+	for (int i=0; i<NUM_GRADS; i++) {
+		gradWaveforms[i].reset();
+		gradExtTrapTimes[i].reset();
+		gradExtTrapShapes[i].reset();
+	}
  }
 
 
@@ -765,6 +789,29 @@ struct CompressedShape
 };
 
 
+/**
+ * @brief Read position within the complete text of a sequence file held in memory
+ *
+ * The loader parses all sections directly from this memory (usually a read-only
+ * mapping of the .seq file). Offsets are byte offsets from the start of the text,
+ * i.e. the values stored in the file index.
+ */
+struct SeqText
+{
+	const char* begin;    /**< @brief First character of the text */
+	const char* end;      /**< @brief One past the last character of the text */
+	const char* pos;      /**< @brief Current read position */
+	bool eof;             /**< @brief Set once a read reached the end of the text */
+
+	SeqText(const char* data, size_t size) : begin(data), end(data+size), pos(data), eof(false) {}
+
+	void seek(long offset) { pos = begin + MIN(MAX(offset,0L),(long)(end-begin)); eof=false; }
+	long tell() const { return (long)(pos-begin); }
+	bool good() const { return !eof; }
+	void clear() { eof=false; }
+};
+
+
 /**
  * @brief Data representing the entire MR sequence
  *
@@ -842,6 +889,32 @@ class ExternalSequence
 	enum load_mode {lm_singlefile=0, lm_shapes, lm_events, lm_blocks};
 	bool load(std::istream &data_stream, load_mode loadMose = lm_singlefile);
 
+	/**
+	 * @brief Load the sequence from the complete file text held in memory
+	 *
+	 * All sections are decoded directly from the given bytes, no copy of the text
+	 * is made. The memory only has to stay valid for the duration of the call.
+	 * This is the path used by load(std::string) for memory-mapped files.
+	 *
+	 * @param  data pointer to the first character of the text
+	 * @param  size number of bytes in the text (no terminating zero required)
+	 */
+	bool load_from_memory(const char* data, size_t size, load_mode loadMode = lm_singlefile);
+
+	/**
+	 * @brief Load the sequence from a single .seq file, reusing a binary cache of the parsed sequence
+	 *
+	 * The cache file holds the parsed definitions, event and shape libraries and the block table
+	 * of the .seq file it was written for. It is only used if its format version and memory layout
+	 * match this build and the .seq file still has the same size, modification time and MD5 hash
+	 * (of the signed part, as calculated by buildFileIndex()). Otherwise the file is parsed as in
+	 * load() and the cache is rewritten. Failing to read or write the cache is not an error.
+	 *
+	 * @param  path       location of the .seq file
+	 * @param  cachePath  location of the cache file, e.g. next to the .seq file
+	 */
+	bool loadWithCache(std::string path, std::string cachePath);
+
 	/**
 	 * @brief Report the version of the loaded sequence
 	 *
@@ -924,6 +997,11 @@ class ExternalSequence
 	 */
 	int  GetNumberOfBlocks(void);
 
+	/**
+	 * @brief Return the duration of a block (us) from the block table, without constructing the block
+	 */
+	double GetBlockDuration(int blockIndex);
+
 	/**
 	 * @brief Construct a sequence block from the library events
 	 *
@@ -978,43 +1056,127 @@ class ExternalSequence
   private:
 
 	static const int MAX_LINE_SIZE;	/**< @brief Maximum length of line */
+	static const size_t PARALLEL_LOAD_MIN_SIZE;	/**< @brief Smallest file (bytes) for which sections are decoded concurrently */
+	static const size_t BLOCK_CHUNK_MIN_SIZE;	/**< @brief Smallest part of the [BLOCKS] section (bytes) decoded by one thread */
 	static const char COMMENT_CHAR;	/**< @brief Character defining the start of a comment line */
+	static const unsigned int CACHE_FORMAT_VERSION;	/**< @brief Version of the cache file layout, increment on every change */
 
 	// *** Private helper functions ***
 
 	/**
-	 * @brief Read a line from the input stream *independent of line ending*.
+	 * @brief Locate the next line in the text *independent of line ending*.
 	 *
-	 * Unlike istream::getline(), this function safely handles three
-	 * different line endings:
+	 * Handles three different line endings:
 	 *  - Unix/OSX (\\n)
 	 *  - Windows (\\r\\n)
 	 *  - Old Mac (\\r)
 	 *
-	 * @param stream the input file stream to read from
+	 * The line is returned as a pointer into the text (no copy). Lines longer
+	 * than MAX_SIZE-1 characters are returned in pieces (gl_truncated). In the
+	 * *raw* mode only \\n ends a line and it is included in the result.
+	 *
+	 * @param text the text to read from, the read position is advanced
+	 * @param line returns the start of the line
+	 * @param length returns the number of characters in the line
+	 * @param MAX_SIZE maximum size of the line buffer the caller works with
+	 */
+	enum gl_ret {gl_false=0, gl_true, gl_truncated};
+	static int scanLine(SeqText& text, const char*& line, int& length, const int MAX_SIZE, bool bRaw=false);
+
+	/**
+	 * @brief Read a line from the text into a buffer, see scanLine()
+	 *
+	 * @param text the text to read from
 	 * @param buffer the output line buffer (null terminated)
 	 * @param MAX_SIZE maximum size of the buffer
 	 */
-	// MZ: VC2008 / VD13 do not seem to properly handle the errors streams
-	//static std::istream& 
-	enum gl_ret {gl_false=0, gl_true, gl_truncated};
-    static int getline(std::istream& stream, char* buffer, const int MAX_SIZE, bool bRaw=false);
+	static int getline(SeqText& text, char* buffer, const int MAX_SIZE, bool bRaw=false);
+
+	/**
+	 * @brief Search the text for section headers e.g. [RF], [GRAD] etc
+	 *
+	 * Searches forward in the text for sections enclosed in square brackets
+	 * and writes to index, the MD5 hash of the signed part is calculated on the way
+	 */
+	void buildFileIndex(SeqText &text);
+
+	/**
+	 * @brief Decode the [SHAPES] section into the shape library
+	 *
+	 * Uses its own read position so that it can run concurrently with readEvents() and readBlocks().
+	 */
+	bool readShapes(SeqText text);
+
+	/**
+	 * @brief Decode the event sections ([RF], [GRADIENTS], [TRAP], [ADC], [DELAYS], [EXTENSIONS])
+	 *
+	 * Uses its own read position so that it can run concurrently with readShapes() and readBlocks().
+	 * The block references to the events are checked later in load_from_memory().
+	 */
+	bool readEvents(SeqText text);
+
+	/**
+	 * @brief Line-aligned part of the [BLOCKS] section, decoded independently of the other parts
+	 */
+	struct BlockChunk
+	{
+		const char* begin;               /**< @brief First character of the chunk (start of a line) */
+		const char* end;                 /**< @brief One past the last character of the chunk */
+		std::vector<EventIDs> events;    /**< @brief Event IDs of the decoded blocks */
+		std::vector<long> durations_ru;  /**< @brief Durations of the decoded blocks (block raster units) */
+		std::vector<int> blockIds;       /**< @brief Block IDs of the decoded blocks as written in the file */
+		bool terminated;                 /**< @brief The end of the section was found in this chunk */
+		int errorFields;                 /**< @brief Number of fields in the line that failed to decode, -1 if none */
+		std::string errorLine;           /**< @brief The line that failed to decode */
+
+		BlockChunk() : begin(NULL), end(NULL), terminated(false), errorFields(-1) {}
+	};
 
 	/**
-	 * @brief Search the file stream for section headers e.g. [RF], [GRAD] etc
+	 * @brief Decode the [BLOCKS] section into m_blocks, m_blockDurations_ru and m_blockIds
 	 *
-	 * Searches forward in the stream for sections enclosed in square brackets
-	 * and writes to index
+	 * The section is split into line-aligned chunks which are decoded on separate threads
+	 * if bParallel is set. Event references are not checked here.
+	 */
+	bool readBlocks(SeqText& text, bool bParallel);
+
+	/**
+	 * @brief Decode the block lines of one chunk, stops at the end of the section or at the first error
 	 */
-	void buildFileIndex(std::istream &stream);
+	static void readBlockChunk(BlockChunk& chunk);
 
 	/**
-	 * @brief Skip the comments and empty lines in the given input stream.
+	 * @brief Size and modification time of a sequence file, the part of the cache key known without reading it
+	 */
+	struct FileStamp
+	{
+		unsigned long long size;
+		long long modificationTime;
+	};
+
+	/**
+	 * @brief Restore the parsed sequence from the cache file data
 	 *
-	 * @param stream the input file stream to process
+	 * @param  data      mapped cache file
+	 * @param  size      size of the cache file
+	 * @param  stamp     stamp of the .seq file, the cache is rejected if it was written for a different one
+	 * @param  seqText   complete text of the .seq file, only hashed if the stamp matches
+	 * @return false if the cache does not belong to the file or is corrupt (the sequence is reset then)
+	 */
+	bool readCache(const char* data, size_t size, const FileStamp& stamp, SeqText seqText);
+
+	/**
+	 * @brief Write the parsed sequence to the cache file (through a temporary file which is renamed)
+	 */
+	bool writeCache(const std::string& cachePath, const FileStamp& stamp);
+
+	/**
+	 * @brief Skip the comments and empty lines in the given text.
+	 *
+	 * @param text the text to process
 	 * @param buffer return output buffer of next non-comment line
 	 */
-	void skipComments(std::istream &stream, char* buffer);
+	void skipComments(SeqText &text, char* buffer);
 
 	/**
 	 * @brief Strip any empty characters at th beginning or at the end of the string.
@@ -1043,24 +1205,61 @@ class ExternalSequence
 	bool checkBlockReferences(EventIDs& events);
 
 	/**
-	 * @brief Check the shapes defining the arbitrary gradient events (if present)
+	 * @brief Check the shape defining an arbitrary gradient event
 	 *
-	 * Check the *decompressed* amplitude of the given block is
-	 * between [0 1].
-	 * @param  block The sequence block to check
+	 * Clip the *decompressed* amplitude to [-1 1].
+	 * @param  waveform The decompressed gradient shape
 	 * @see checkRF()
 	 */
-	void checkGradient(SeqBlock& block);
+	void checkGradient(std::vector<float>& waveform);
 
 	/**
-	 * @brief Check the shapes defining the RF event (if present)
+	 * @brief Check a shape defining an RF event
 	 *
-	 * Check the *decompressed* RF amplitude of the given block is
-	 * between [0 1] and the phase between [0 2pi].
-	 * @param  block The sequence block to check
+	 * Clip the *decompressed* RF amplitude to [0 1] or the phase to [0 2pi].
+	 * @param  waveform The decompressed amplitude or phase shape
+	 * @param  bPhase   true if the shape is the (already scaled) phase
 	 * @see checkGradient()
 	 */
-	void checkRF(SeqBlock& block);
+	void checkRF(std::vector<float>& waveform, bool bPhase);
+
+	/**
+	 * @brief Kinds of decompressed shapes held in the shape pool
+	 *
+	 * The same compressed shape yields different samples depending on its use
+	 * (scaling, clipping, resampling on the time shape), so each use has its own pool.
+	 */
+	enum PooledShapeKind {
+		PS_RF_AMPLITUDE,
+		PS_RF_PHASE,
+		PS_ARB_GRADIENT,
+		PS_EXTTRAP_GRADIENT,
+		PS_NUM_KINDS // this entry should be last in the list
+	};
+
+	/**
+	 * @brief Return the decompressed samples of a shape from the shape pool
+	 *
+	 * The shape is decompressed (and checked) the first time it is requested;
+	 * all later requests share the same immutable samples. Thread-safe.
+	 *
+	 * @param kind     Use of the shape
+	 * @param shapeID  ID of the amplitude or phase shape
+	 * @param timeID   ID of the time shape (0 if none, -1 for oversampled gradients)
+	 * @return shared samples, or an empty pointer on error
+	 */
+	SharedShape getPooledShape(PooledShapeKind kind, int shapeID, int timeID);
+
+	/**
+	 * @brief Return the time points (in us) of an extended trapezoid time shape from the shape pool
+	 * @see getPooledShape()
+	 */
+	SharedTimeShape getPooledTimeShape(int timeID);
+
+	/**
+	 * @brief Decompress a shape of the library into a new vector, false if it does not exist or is corrupt
+	 */
+	bool decompressShapeByID(int shapeID, std::vector<float>& waveform);
 
 	/**
 	 * @brief Check the IDs contains references to valid labels in the library
@@ -1097,6 +1296,7 @@ class ExternalSequence
 	std::vector<EventIDs> m_blocks;            /**< @brief List of sequence blocks */
 
 	std::vector<long> m_blockDurations_ru;     /**< @brief List of block durations expressed in duration raster units */
+	std::vector<int> m_blockIds;               /**< @brief Block IDs from the file, only kept until the event references are checked */
 
 	// extension list storage
 	//std::vector<ExtensionListEntry> m_extensions; /**< @brief the storage area of the extension list referenced by the enent table */
@@ -1133,6 +1333,11 @@ class ExternalSequence
     
     // List of basic shapes (referenced by events)
 	std::map<int,CompressedShape> m_shapeLibrary;    /**< @brief Library of compressed shapes */
+
+	// Pool of decompressed shapes (referenced by decoded blocks), keyed by shape ID and time shape ID
+	std::map<std::pair<int,int>,SharedShape> m_shapePool[PS_NUM_KINDS]; /**< @brief Decompressed shapes per kind of use */
+	std::map<int,SharedTimeShape> m_timeShapePool;   /**< @brief Decompressed ExtTrap time shapes */
+	std::mutex m_shapePoolMutex;                      /**< @brief Guards the shape pools, blocks may be decoded concurrently */
 	// raster times
 	double m_dAdcRasterTime_us; // Siemens default: 1e-07s 
 	double m_dGradientRasterTime_us; // Siemens default: 1e-05s 
@@ -1145,6 +1350,7 @@ class ExternalSequence
 // * ------------------------------------------------------------------ *
 
 inline int ExternalSequence::GetNumberOfBlocks(void){return m_blocks.size();}
+inline double ExternalSequence::GetBlockDuration(int blockIndex){return m_blockDurations_ru[blockIndex]*SeqBlock::s_blockDurationRaster;}
 
 inline std::vector<double>	ExternalSequence::GetDefinition(std::string key){
 	if (m_definitions.count(key)>0)
@@ -36,6 +36,9 @@
 #include <cmath>
 #include <limits>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include <QPainter>
 
 // Lightweight overlay widget for drawing trajectory crosshair without forcing full plot replots
@@ -119,6 +122,7 @@ MainWindow::MainWindow(QWidget* parent)
       m_waveformDrawer(nullptr),
       m_pVersionLabel(nullptr),
       m_pProgressBar(nullptr),
+      m_pCancelLoadButton(nullptr),
       m_pCoordLabel(nullptr),
       m_settingsDialog(nullptr)
 {
@@ -291,11 +295,14 @@ MainWindow::~MainWindow()
 {
     // Ensure cleanup order: delete PulseqLoader before UI widgets it references
     // to avoid accessing destroyed UI elements during loader's ClearPulseqCache.
+    // The render worker reads the loader, so it is stopped first.
+    if (m_waveformDrawer) m_waveformDrawer->stopViewportRenderer();
     SAFE_DELETE(m_pulseqLoader);
 
     // Handlers are QObjects parented to MainWindow and will be deleted automatically.
     SAFE_DELETE(m_pVersionLabel);
     SAFE_DELETE(m_pProgressBar);
+    SAFE_DELETE(m_pCancelLoadButton);
     SAFE_DELETE(m_pCoordLabel);
     SAFE_DELETE(m_settingsDialog);
     delete ui;
@@ -311,7 +318,7 @@ void MainWindow::InitSlots()
 {
     // File Menu
     connect(ui->actionOpen, &QAction::triggered, m_pulseqLoader, &PulseqLoader::OpenPulseqFile);
-    connect(ui->actionReopen, &QAction::triggered, m_pulseqLoader, &PulseqLoader::ReOpenPulseqFile);
+    connect(ui->actionReopen, &QAction::triggered, m_pulseqLoader, &PulseqLoader::ReOpenPulseqFileAsync);
     connect(ui->actionCloseFile, &QAction::triggered, m_pulseqLoader, &PulseqLoader::ClosePulseqFile);
 
     // View Menu
@@ -373,6 +380,15 @@ void MainWindow::InitStatusBar()
     m_pProgressBar->setRange(0, 100);
     m_pProgressBar->setValue(0);
     ui->statusbar->addWidget(m_pProgressBar);
+
+    m_pCancelLoadButton = new QPushButton(tr("Cancel"), this);
+    m_pCancelLoadButton->setToolTip(tr("Stop loading the sequence"));
+    m_pCancelLoadButton->hide();
+    ui->statusbar->addWidget(m_pCancelLoadButton);
+    connect(m_pCancelLoadButton, &QPushButton::clicked, m_pulseqLoader, &PulseqLoader::CancelPulseqFileLoad);
+    // The trajectory is computed in the background after a load and shown as it grows
+    connect(m_pulseqLoader, &PulseqLoader::trajectoryProgress, this, &MainWindow::onTrajectoryProgress);
+    connect(m_pulseqLoader, &PulseqLoader::trajectoryFinished, this, &MainWindow::onTrajectoryFinished);
 }
 
 // Event handlers are now delegated to the InteractionHandler
@@ -521,6 +537,10 @@ void MainWindow::setupPlotArea(QVBoxLayout* mainLayout)
     m_pShowKtrajAdcCheckBox = new QCheckBox(tr("ktraj_adc"), m_pTrajectoryPanel);
     m_pShowKtrajAdcCheckBox->setChecked(true);
     controlLayout->addWidget(m_pShowKtrajAdcCheckBox);
+    m_pTrajectoryDensityCheckBox = new QCheckBox(tr("Density"), m_pTrajectoryPanel);
+    m_pTrajectoryDensityCheckBox->setChecked(false);
+    m_pTrajectoryDensityCheckBox->setToolTip(tr("Color ktraj_adc by the number of samples per pixel (log scale)"));
+    controlLayout->addWidget(m_pTrajectoryDensityCheckBox);
     m_pTrajectoryCrosshairLabel = new QLabel(m_pTrajectoryPanel);
     m_pTrajectoryCrosshairLabel->setMinimumWidth(180);
     controlLayout->addWidget(m_pTrajectoryCrosshairLabel);
@@ -549,6 +569,8 @@ void MainWindow::setupPlotArea(QVBoxLayout* mainLayout)
     }
     // Initialize trajectory axis labels and remember current trajectory unit
     m_lastTrajectoryUnit = Settings::getInstance().getTrajectoryUnit();
+    m_lastTrajectoryColormap = Settings::getInstance().getTrajectoryColormap();
+    m_lastTrajectoryGamma = Settings::getInstance().getGamma();
     updateTrajectoryAxisLabels();
     // Continuous trajectory curve (blue)
     m_pTrajectoryCurve = new QCPCurve(m_pTrajectoryPlot->xAxis, m_pTrajectoryPlot->yAxis);
@@ -604,6 +626,8 @@ void MainWindow::setupPlotArea(QVBoxLayout* mainLayout)
             this, &MainWindow::onTrajectorySeriesToggled);
     connect(m_pShowKtrajAdcCheckBox, &QCheckBox::toggled,
             this, &MainWindow::onTrajectorySeriesToggled);
+    connect(m_pTrajectoryDensityCheckBox, &QCheckBox::toggled,
+            this, &MainWindow::onTrajectoryDensityToggled);
     connect(m_pTrajectoryPlot, &QCustomPlot::mouseMove,
             this, &MainWindow::onTrajectoryMouseMove);
     m_pTrajectoryCursorMarker = new QWidget(m_pTrajectoryPlot);
@@ -694,6 +718,7 @@ void MainWindow::setTrajectoryVisible(bool show)
 // pixel writes and displays via QCPItemPixmap. This is ~50x faster than QCPCurve
 // scatter (which calls QPainter::drawEllipse per point). Every data point is rendered
 // — no downsampling, no visual loss. Re-called on every axis range change (drag/zoom).
+// In density mode the pixels show sample counts instead (see renderTrajectoryDensity).
 void MainWindow::renderTrajectoryScatter()
 {
     if (!m_pTrajectoryPlot || !m_pTrajectoryScatterItem || !m_showKtrajAdc)
@@ -723,27 +748,34 @@ void MainWindow::renderTrajectoryScatter()
     double ySize = yRange.size();
     if (xSize <= 0 || ySize <= 0) return;
 
-    const double* kxD = m_trajScatterKx.constData();
-    const double* kyD = m_trajScatterKy.constData();
-    const bool hasColors = (m_trajScatterColors.size() == N);
-    const QRgb defaultColor = qRgba(255, 0, 0, 255);
-
-    // Paint 3x3 pixel dots using direct scanLine access (no QPainter overhead)
-    for (int i = 0; i < N; ++i)
+    if (m_showTrajectoryDensity)
+    {
+        renderTrajectoryDensity(img, xRange, yRange);
+    }
+    else
     {
-        int px = static_cast<int>((kxD[i] - xRange.lower) / xSize * w);
-        int py = h - 1 - static_cast<int>((kyD[i] - yRange.lower) / ySize * h);
-        if (px < -1 || px > w || py < -1 || py > h) continue; // quick reject
-        QRgb c = hasColors ? m_trajScatterColors[i] : defaultColor;
-        for (int dy = -1; dy <= 1; ++dy)
+        const double* kxD = m_trajScatterKx.constData();
+        const double* kyD = m_trajScatterKy.constData();
+        const bool hasColors = (m_trajScatterColors.size() == N);
+        const QRgb defaultColor = qRgba(255, 0, 0, 255);
+
+        // Paint 3x3 pixel dots using direct scanLine access (no QPainter overhead)
+        for (int i = 0; i < N; ++i)
         {
-            int y = py + dy;
-            if (y < 0 || y >= h) continue;
-            QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(y));
-            for (int dx = -1; dx <= 1; ++dx)
+            int px = static_cast<int>((kxD[i] - xRange.lower) / xSize * w);
+            int py = h - 1 - static_cast<int>((kyD[i] - yRange.lower) / ySize * h);
+            if (px < -1 || px > w || py < -1 || py > h) continue; // quick reject
+            QRgb c = hasColors ? m_trajScatterColors[i] : defaultColor;
+            for (int dy = -1; dy <= 1; ++dy)
             {
-                int x = px + dx;
-                if (x >= 0 && x < w) scanline[x] = c;
+                int y = py + dy;
+                if (y < 0 || y >= h) continue;
+                QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(y));
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    int x = px + dx;
+                    if (x >= 0 && x < w) scanline[x] = c;
+                }
             }
         }
     }
@@ -754,6 +786,103 @@ void MainWindow::renderTrajectoryScatter()
     m_pTrajectoryScatterItem->setVisible(true);
 }
 
+// Samples per task of the density histogram, and the memory all per-thread tiles may take together
+static constexpr int kDensitySamplesPerTask = 1 << 16;
+static constexpr qsizetype kDensityTileBytes = qsizetype(64) << 20;
+
+// Counts the samples falling on each pixel of a w x h image spanning xRange/yRange (top row first).
+// Tasks of consecutive samples are taken from an atomic counter; every thread counts into its own
+// full-image tile, so no counter is shared, and the tiles are summed into counts at the end.
+// A sample lands on the pixel at the center of the 3x3 dot the scatter renderer paints for it.
+static void accumulateTrajectoryDensity(const double* kx, const double* ky, int n,
+                                        const QCPRange& xRange, const QCPRange& yRange,
+                                        int w, int h, QVector<quint32>& counts)
+{
+    const qsizetype pixels = qsizetype(w) * h;
+    counts.fill(0, pixels);
+    const int taskCount = (n + kDensitySamplesPerTask - 1) / kDensitySamplesPerTask;
+    const int maxTiles = int(std::max<qsizetype>(1, kDensityTileBytes / (pixels * qsizetype(sizeof(quint32)))));
+    const int threadCount = std::min({ int(std::max(1u, std::thread::hardware_concurrency())), taskCount, maxTiles });
+    std::vector<std::vector<quint32>> extraTiles(std::max(0, threadCount - 1), std::vector<quint32>(pixels, 0));
+
+    const double xSize = xRange.size();
+    const double ySize = yRange.size();
+    std::atomic<int> nextTask{0};
+    auto countNextTask = [&](quint32* tile) -> bool {
+        const int task = nextTask.fetch_add(1);
+        if (task >= taskCount) return false;
+        const int end = std::min(n, (task + 1) * kDensitySamplesPerTask);
+        for (int i = task * kDensitySamplesPerTask; i < end; ++i)
+        {
+            const double fx = (kx[i] - xRange.lower) / xSize * w;
+            const double fy = (ky[i] - yRange.lower) / ySize * h;
+            if (!(fx >= 0.0 && fx < w && fy >= 0.0 && fy < h)) continue; // also rejects NaN
+            ++tile[qsizetype(h - 1 - int(fy)) * w + int(fx)];
+        }
+        return true;
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(extraTiles.size());
+    for (std::vector<quint32>& tile : extraTiles)
+    {
+        quint32* tileData = tile.data();
+        workers.emplace_back([&countNextTask, tileData]() { while (countNextTask(tileData)) {} });
+    }
+    quint32* total = counts.data();
+    while (countNextTask(total)) {}
+    for (std::thread& worker : workers)
+        worker.join();
+    for (const std::vector<quint32>& tile : extraTiles)
+        for (qsizetype p = 0; p < pixels; ++p)
+            total[p] += tile[p];
+}
+
+// Density renderer: colors each pixel hit by ADC samples by its sample count through the trajectory
+// colormap on a log scale, so dense centers of k-space stay distinguishable instead of saturating.
+// The counts are only recounted when the scatter data, the axis ranges or the rect size change.
+void MainWindow::renderTrajectoryDensity(QImage& img, const QCPRange& xRange, const QCPRange& yRange)
+{
+    const int w = img.width();
+    const int h = img.height();
+    TrajectoryDensity& density = m_trajDensity;
+    if (!density.valid || density.width != w || density.height != h
+        || !(density.xRange == xRange) || !(density.yRange == yRange))
+    {
+        accumulateTrajectoryDensity(m_trajScatterKx.constData(), m_trajScatterKy.constData(),
+                                    m_trajScatterKx.size(), xRange, yRange, w, h, density.counts);
+        density.maxCount = density.counts.isEmpty()
+            ? 0 : *std::max_element(density.counts.cbegin(), density.counts.cend());
+        density.width = w;
+        density.height = h;
+        density.xRange = xRange;
+        density.yRange = yRange;
+        density.valid = true;
+    }
+    if (density.maxCount == 0)
+        return;
+
+    // One sample maps to the low end of the colormap, the densest pixel to the high end
+    constexpr int kLevels = 256;
+    QRgb lut[kLevels];
+    const Settings::TrajectoryColormap cmap = Settings::getInstance().getTrajectoryColormap();
+    for (int i = 0; i < kLevels; ++i)
+        lut[i] = sampleTrajectoryColormap(cmap, double(i) / (kLevels - 1)).rgba();
+    const double scale = density.maxCount > 1 ? (kLevels - 1) / std::log(double(density.maxCount)) : 0.0;
+
+    const quint32* counts = density.counts.constData();
+    for (int y = 0; y < h; ++y)
+    {
+        QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(y));
+        const quint32* row = counts + qsizetype(y) * w;
+        for (int x = 0; x < w; ++x)
+        {
+            if (row[x] == 0) continue;
+            const int level = std::min(kLevels - 1, static_cast<int>(std::log(double(row[x])) * scale + 0.5));
+            scanline[x] = lut[level];
+        }
+    }
+}
+
 void MainWindow::refreshTrajectoryPlotData()
 {
     if (!m_pTrajectoryCurve)
@@ -1032,6 +1161,8 @@ void MainWindow::refreshTrajectoryPlotData()
         scaleVec(m_trajScatterKy);
     }
 
+    m_trajDensity.valid = false;
+
     // Hide legacy QCPCurve scatter objects (kept for API compat but not rendered)
     if (m_pTrajectorySamplesGraph) m_pTrajectorySamplesGraph->setVisible(false);
     for (QCPCurve* g : m_trajColorGraphs)
@@ -1053,6 +1184,7 @@ void MainWindow::refreshTrajectoryPlotData()
             m_pTrajectoryPlot->yAxis->setRange(m_trajectoryBaseYRange);
         }
         m_trajectoryRangeInitialized = true;
+        m_trajectoryRangeProvisional = !loader->isTrajectoryComplete();
         return true;
     };
 
@@ -1154,6 +1286,45 @@ void MainWindow::refreshTrajectoryPlotData()
     refreshTrajectoryCursor();
 }
 
+void MainWindow::onTrajectoryProgress()
+{
+    PulseqLoader* loader = getPulseqLoader();
+    if (!loader)
+        return;
+    const double availableSec = loader->trajectoryAvailableUntilSec();
+    // A new trajectory (after a reload) starts over
+    const double previousSec = m_trajectoryPublishedSec <= availableSec ? m_trajectoryPublishedSec : 0.0;
+    m_trajectoryPublishedSec = availableSec;
+    if (!m_showTrajectory)
+        return;
+
+    // With the plot limited to the waveform view, redraw only once the new part reaches into it
+    double tFactor = loader->getTFactor();
+    if (!m_showWholeTrajectory && ui && ui->customPlot && tFactor > 0.0)
+    {
+        QCPRange viewRange = ui->customPlot->xAxis->range();
+        const double viewStartSec = std::min(viewRange.lower, viewRange.upper) / (tFactor * 1e6);
+        const double viewEndSec = std::max(viewRange.lower, viewRange.upper) / (tFactor * 1e6);
+        if (previousSec >= viewEndSec || availableSec < viewStartSec)
+            return;
+    }
+    refreshTrajectoryPlotData();
+}
+
+void MainWindow::onTrajectoryFinished()
+{
+    // A range taken from the first part of the trajectory gives way to the one of the whole trajectory
+    if (m_trajectoryRangeProvisional)
+    {
+        m_trajectoryRangeInitialized = false;
+        m_trajectoryRangeProvisional = false;
+    }
+    if (m_showTrajectory)
+        refreshTrajectoryPlotData();
+    else
+        updateTrajectoryExportState();
+}
+
 void MainWindow::enforceTrajectoryAspect(bool queueReplot)
 {
     m_pendingTrajectoryAspectUpdate = false;
@@ -1578,7 +1749,7 @@ void MainWindow::exportTrajectory()
         return;
     }
 
-    loader->ensureTrajectoryPrepared();
+    loader->waitForTrajectory();
     const QVector<double>& ktrajX = loader->getTrajectoryKx();
     const QVector<double>& ktrajY = loader->getTrajectoryKy();
     const QVector<double>& ktrajZ = loader->getTrajectoryKz();
@@ -1637,7 +1808,7 @@ void MainWindow::updateTrajectoryExportState()
     if (!m_pExportTrajectoryButton)
         return;
     PulseqLoader* loader = getPulseqLoader();
-    bool hasData = loader && loader->hasTrajectoryData() &&
+    bool hasData = loader && loader->isTrajectoryComplete() &&
                    !loader->getTrajectoryKx().isEmpty() &&
                    !loader->getTrajectoryKxAdc().isEmpty() &&
                    !loader->getTrajectoryKy().isEmpty() &&
@@ -1669,12 +1840,29 @@ void MainWindow::onSettingsChanged()
 {
     Settings& s = Settings::getInstance();
     Settings::TrajectoryUnit currentUnit = s.getTrajectoryUnit();
+    const bool unitChanged = currentUnit != m_lastTrajectoryUnit;
     // If trajectory unit changed, drop cached base range so it will be recomputed in new units
-    if (currentUnit != m_lastTrajectoryUnit)
+    if (unitChanged)
     {
         m_lastTrajectoryUnit = currentUnit;
         m_trajectoryRangeInitialized = false;
     }
+    const double currentGamma = s.getGamma();
+    const bool gammaChanged = currentGamma != m_lastTrajectoryGamma;
+    m_lastTrajectoryGamma = currentGamma;
+    // One notification may carry several changes (resetToDefaults). If the colormap is the only
+    // change to the trajectory, density mode just maps the cached counts again.
+    Settings::TrajectoryColormap currentColormap = s.getTrajectoryColormap();
+    if (currentColormap != m_lastTrajectoryColormap)
+    {
+        m_lastTrajectoryColormap = currentColormap;
+        if (m_showTrajectoryDensity && !unitChanged && !gammaChanged)
+        {
+            renderTrajectoryScatter();
+            if (m_pTrajectoryPlot) m_pTrajectoryPlot->replot(QCustomPlot::rpQueuedReplot);
+            return;
+        }
+    }
 
     updateTrajectoryAxisLabels();
     refreshTrajectoryPlotData();
@@ -1764,6 +1952,23 @@ void MainWindow::onTrajectorySeriesToggled()
         m_pTrajectoryPlot->replot(QCustomPlot::rpQueuedReplot);
 }
 
+void MainWindow::onTrajectoryDensityToggled(bool checked)
+{
+    if (m_showTrajectoryDensity == checked)
+        return;
+    m_showTrajectoryDensity = checked;
+    if (!checked)
+    {
+        // Release the counts; the per-point colors may predate a colormap change made meanwhile
+        m_trajDensity = TrajectoryDensity();
+        refreshTrajectoryPlotData();
+        return;
+    }
+    renderTrajectoryScatter();
+    if (m_pTrajectoryPlot)
+        m_pTrajectoryPlot->replot(QCustomPlot::rpQueuedReplot);
+}
+
 // Version info is auto-generated from Git metadata via CMake (see version_autogen.h).
 #include <version_autogen.h>
 // Manual app semantic version
@@ -2028,6 +2233,11 @@ void MainWindow::captureSnapshotsAndExit(const QString& outDir)
                 m_interactionHandler->synchronizeXAxes(QCPRange(startMs * tf * 1000.0, endMs * tf * 1000.0));
             }
         }
+        // Build the series synchronously: the snapshot cannot wait for the render worker
+        if (m_waveformDrawer) {
+            m_waveformDrawer->DrawRFWaveform();
+            m_waveformDrawer->DrawGWaveform();
+        }
         ui->customPlot->replot(QCustomPlot::rpImmediateRefresh);
 
         QString seqPath = dir.absoluteFilePath(baseName + "_seq.png");
@@ -2037,7 +2247,8 @@ void MainWindow::captureSnapshotsAndExit(const QString& outDir)
             qWarning() << "Failed to save sequence snapshot to" << seqPath;
         }
 
-        // 2. Trajectory Diagram Snapshot
+        // 2. Trajectory Diagram Snapshot (the whole trajectory, not the part computed so far)
+        if (m_pulseqLoader) m_pulseqLoader->waitForTrajectory();
         setTrajectoryVisible(true);
         // We use a small delay to let the initial rendering and aspect ratio correction kick in
         QTimer::singleShot(300, this, [this, dir, baseName, savePlotDeterministic]() {
@@ -95,6 +95,7 @@ public:
     QLabel* getCoordLabel() const { return m_pCoordLabel; }
     QLabel* getVersionLabel() const { return m_pVersionLabel; }
     QProgressBar* getProgressBar() const { return m_pProgressBar; }
+    QPushButton* getCancelLoadButton() const { return m_pCancelLoadButton; }
 
 protected:
     // Overridden event handlers to delegate to InteractionHandler
@@ -137,10 +138,13 @@ private slots:
     void onShowTrajectoryCursorToggled(bool checked);
     void onTrajectoryRangeModeChanged(int index);
     void onTrajectorySeriesToggled();
+    void onTrajectoryDensityToggled(bool checked);
     void onResetTrajectoryRange();
     void onTrajectoryMouseMove(QMouseEvent* event);
     void onTrajectoryCrosshairToggled(bool checked);
     void onTimeUnitChanged();
+    void onTrajectoryProgress();
+    void onTrajectoryFinished();
 
 public:
     void openFileFromCommandLine(const QString& filePath);
@@ -170,6 +174,7 @@ private:
     // UI elements managed directly by MainWindow (e.g., status bar)
     QLabel* m_pVersionLabel;
     QProgressBar* m_pProgressBar;
+    QPushButton* m_pCancelLoadButton; // Shown next to the progress bar during background loads
     QLabel* m_pCoordLabel; // Used by InteractionHandler and TRManager
     
     // Settings dialog
@@ -177,6 +182,8 @@ private:
 
     // Track last applied trajectory unit so we can recompute default ranges when it changes
     Settings::TrajectoryUnit m_lastTrajectoryUnit { Settings::TrajectoryUnit::PerM };
+    Settings::TrajectoryColormap m_lastTrajectoryColormap { Settings::TrajectoryColormap::Jet };
+    double m_lastTrajectoryGamma {0.0};
 
     // Plot area layout helpers
     QSplitter* m_plotSplitter {nullptr};
@@ -193,13 +200,26 @@ private:
     QCPItemPixmap* m_pTrajectoryScatterItem {nullptr};
     QVector<double> m_trajScatterKx, m_trajScatterKy; // cached scatter coords (display units)
     QVector<QRgb> m_trajScatterColors;                 // per-point color; empty = uniform red
+    // Density mode: ADC samples per pixel of the axis rect, accumulated once per scatter data,
+    // axis ranges and rect size; a colormap change only maps the counts again.
+    struct TrajectoryDensity {
+        QVector<quint32> counts;                       // row-major, top row first
+        quint32 maxCount {0};
+        int width {0};
+        int height {0};
+        QCPRange xRange, yRange;
+        bool valid {false};                            // cleared when the scatter data changes
+    };
+    TrajectoryDensity m_trajDensity;
     void renderTrajectoryScatter();
+    void renderTrajectoryDensity(QImage& img, const QCPRange& xRange, const QCPRange& yRange);
     QPushButton* m_pExportTrajectoryButton {nullptr};
     QPushButton* m_pResetTrajectoryButton {nullptr};
     QCheckBox* m_pShowTrajectoryCursorCheckBox {nullptr};
     QComboBox* m_pTrajectoryRangeCombo {nullptr};
     QCheckBox* m_pShowKtrajCheckBox {nullptr};
     QCheckBox* m_pShowKtrajAdcCheckBox {nullptr};
+    QCheckBox* m_pTrajectoryDensityCheckBox {nullptr};
     QCheckBox* m_pTrajectoryCrosshairCheckBox {nullptr};
     QLabel* m_pTrajectoryCrosshairLabel {nullptr};
     QWidget* m_pTrajectoryCursorMarker {nullptr};
@@ -214,10 +234,13 @@ private:
     bool m_colorCurrentWindow {false};
     bool m_showKtraj {false};
     bool m_showKtrajAdc {true};
+    bool m_showTrajectoryDensity {false};
     bool m_showTrajectoryCrosshair {false};
     double m_currentTrajectoryTimeInternal {0.0};
     bool m_hasTrajectoryCursorTime {false};
     bool m_trajectoryRangeInitialized {false};
+    bool m_trajectoryRangeProvisional {false}; // initialized from part of the trajectory
+    double m_trajectoryPublishedSec {0.0};     // trajectory available up to here at the last progress update
 
     QString m_loadedSeqFilePath;
     QString m_customWindowTitle; // Custom window title set via --name option
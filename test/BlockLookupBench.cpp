@@ -0,0 +1,175 @@
+// Micro-benchmark of time -> block lookups on the block edges (BlockLookup.h) against the
+// linear scans they replaced, for sequences of increasing length. The binary search cost
+// per lookup should stay flat while the scan grows with the number of blocks. The TR -> block
+// index build is timed the same way against the nested scan it replaced.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BlockLookup.h"
+
+static double secondsSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Block edges with random durations, including zero-duration blocks (repeated edges)
+static std::vector<double> makeEdges(int blocks, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> duration(0, 40);
+    std::vector<double> edges(blocks + 1, 0.0);
+    for (int i = 0; i < blocks; ++i)
+        edges[i + 1] = edges[i] + duration(rng) * 10.0;
+    return edges;
+}
+
+static int scanBlockAt(const std::vector<double>& edges, double t)
+{
+    for (int i = 0; i + 1 < int(edges.size()); ++i)
+        if (t >= edges[i] && t < edges[i + 1]) return i;
+    return -1;
+}
+
+static bool scanBlockRange(const std::vector<double>& edges, double tStart, double tEnd, int& first, int& last)
+{
+    first = 0; last = int(edges.size()) - 2;
+    for (int i = 0; i + 1 < int(edges.size()); ++i)
+        if (edges[i + 1] > tStart) { first = i; break; }
+    for (int i = int(edges.size()) - 2; i >= first; --i)
+        if (edges[i] < tEnd) { last = i; break; }
+    // the scan leaves its defaults in place when nothing overlaps
+    return edges[first + 1] > tStart && edges[last] < tEnd && first <= last;
+}
+
+// Nested TR -> block scan that closestBlockStarts replaced: O(TRs x blocks)
+static void scanClosestBlockStarts(const std::vector<double>& edges, const std::vector<double>& times, std::vector<int>& blocks)
+{
+    blocks.clear();
+    for (double t : times) {
+        int closest = 0;
+        double minDistance = 1e300;
+        for (int i = 0; i + 1 < int(edges.size()); ++i) {
+            double distance = std::abs(edges[i] - t);
+            if (distance < minDistance) { minDistance = distance; closest = i; }
+        }
+        blocks.push_back(closest);
+    }
+}
+
+// TR start times n * tr covering the sequence
+static std::vector<double> trStarts(const std::vector<double>& edges, double tr)
+{
+    std::vector<double> times;
+    for (int n = 0; n * tr < edges.back() || n == 0; ++n) times.push_back(n * tr);
+    return times;
+}
+
+// Average time per call of fn over the query times, in nanoseconds
+template <typename Fn>
+static double nsPerLookup(const std::vector<double>& queries, double minSeconds, long long& checksum, Fn fn)
+{
+    long long calls = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    do {
+        for (double t : queries) checksum += fn(t);
+        calls += queries.size();
+    } while (secondsSince(t0) < minSeconds);
+    return secondsSince(t0) * 1e9 / double(calls);
+}
+
+int main(int argc, char** argv)
+{
+    double minSeconds = 0.2;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--seconds" && i + 1 < argc) minSeconds = std::atof(argv[++i]);
+    }
+
+    std::mt19937 rng(12345);
+
+    // The lookups must agree with the scans, including at edges and outside the sequence
+    for (int blocks : {1, 2, 7, 100, 5000}) {
+        std::vector<double> edges = makeEdges(blocks, rng);
+        std::uniform_real_distribution<double> time(-20.0, edges.back() + 20.0);
+        std::vector<double> probes(edges);
+        for (int k = 0; k < 2000; ++k) probes.push_back(time(rng));
+        for (double t : probes) {
+            if (BlockLookup::blockAt(edges, t) != scanBlockAt(edges, t)) {
+                std::cerr << "blockAt mismatch at t=" << t << " (" << blocks << " blocks)" << std::endl;
+                return 1;
+            }
+            for (double w : {0.0, 5.0, 250.0}) {
+                int f0, l0, f1, l1;
+                bool scan = scanBlockRange(edges, t, t + w, f0, l0);
+                bool bin = BlockLookup::blockRange(edges, t, t + w, f1, l1);
+                if (scan != bin || (scan && (f0 != f1 || l0 != l1))) {
+                    std::cerr << "blockRange mismatch at t=" << t << " w=" << w << " (" << blocks << " blocks)" << std::endl;
+                    return 1;
+                }
+            }
+        }
+        for (double tr : {5.0, 37.0, 400.0, 1e9}) {
+            std::vector<int> scan, merged;
+            std::vector<double> times = trStarts(edges, tr);
+            times.push_back(-30.0); // out of order and before the sequence
+            times.push_back(edges.back() + 15.0);
+            scanClosestBlockStarts(edges, times, scan);
+            BlockLookup::closestBlockStarts(edges, times, merged);
+            if (scan != merged) {
+                std::cerr << "closestBlockStarts mismatch for TR=" << tr << " (" << blocks << " blocks)" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    std::cout << "BLOCKS       SCAN_NS   BINARY_NS\n";
+    long long checksum = 0;
+    double nsSmall = 0.0, nsLarge = 0.0;
+    for (int blocks : {1000, 10000, 100000, 1000000, 4000000}) {
+        std::vector<double> edges = makeEdges(blocks, rng);
+        std::uniform_real_distribution<double> time(0.0, edges.back());
+        std::vector<double> queries(4096);
+        for (double& t : queries) t = time(rng);
+
+        // the scan is only timed where it finishes in reasonable time
+        double nsScan = -1.0;
+        if (blocks <= 100000) {
+            std::vector<double> few(queries.begin(), queries.begin() + 64);
+            nsScan = nsPerLookup(few, minSeconds, checksum, [&](double t) { return scanBlockAt(edges, t); });
+        }
+        double nsBinary = nsPerLookup(queries, minSeconds, checksum, [&](double t) { return BlockLookup::blockAt(edges, t); });
+        if (blocks == 1000) nsSmall = nsBinary;
+        nsLarge = nsBinary;
+        std::cout << blocks << "  " << nsScan << "  " << nsBinary << "\n";
+    }
+    std::cout << "LOOKUP_NS_1K: " << nsSmall << "\n";
+    std::cout << "LOOKUP_NS_4M: " << nsLarge << "\n";
+
+    // TR index build, about 20 blocks per TR
+    std::cout << "BLOCKS       TRS   SCAN_MS   MERGE_MS\n";
+    double msTrIndex = 0.0;
+    for (int blocks : {10000, 100000, 1000000, 4000000}) {
+        std::vector<double> edges = makeEdges(blocks, rng);
+        std::vector<double> times = trStarts(edges, 20 * 200.0);
+        std::vector<int> indices;
+        double msScan = -1.0;
+        if (blocks <= 100000) {
+            auto t0 = std::chrono::steady_clock::now();
+            scanClosestBlockStarts(edges, times, indices);
+            msScan = secondsSince(t0) * 1e3;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        BlockLookup::closestBlockStarts(edges, times, indices);
+        msTrIndex = secondsSince(t0) * 1e3;
+        for (int i : indices) checksum += i;
+        std::cout << blocks << "  " << times.size() << "  " << msScan << "  " << msTrIndex << "\n";
+    }
+    std::cout << "TR_INDEX_MS_4M: " << msTrIndex << "\n";
+    std::cout << "CHECKSUM: " << checksum << "\n";
+    return 0;
+}
@@ -0,0 +1,343 @@
+// Micro-benchmark of the decimation kernels (DecimationKernels.h) on the RF and arbitrary gradient
+// shapes of the test/seq_files corpus: per-bucket min/max and LTTB, each path the CPU supports
+// (scalar, SSE4.2, AVX2) against the scalar loops the plots used before. Every path must return
+// exactly the points of the old loops, on the real shapes and on synthetic NaN / tie / inf cases.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "DecimationKernels.h"
+#include "ExternalSequence.h"
+
+namespace fs = std::filesystem;
+using namespace DecimationKernels;
+
+static void quietPrint(const std::string&) {}
+
+static double secondsSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// PulseqLoader::downsampleMinMax before the kernels
+static void refBucketMinMax(const std::vector<float>& src, int buckets, std::vector<int>& outIdxMin, std::vector<int>& outIdxMax)
+{
+    outIdxMin.clear(); outIdxMax.clear();
+    int n = src.size();
+    if (n == 0 || buckets <= 0) return;
+    if (n <= 2 * buckets) {
+        for (int i = 0; i < n; ++i) { outIdxMin.push_back(i); outIdxMax.push_back(i); }
+        return;
+    }
+    double bw = double(n) / double(buckets);
+    for (int b = 0; b < buckets; ++b) {
+        double start = b * bw;
+        double end = (b + 1 == buckets) ? n : (b + 1) * bw;
+        int i0 = int(std::floor(start));
+        int i1 = int(std::floor(end));
+        if (i0 >= n) i0 = n - 1;
+        if (i1 <= i0) i1 = std::min(n, i0 + 1);
+        float mn = std::numeric_limits<float>::infinity(); int iMin = i0;
+        float mx = -std::numeric_limits<float>::infinity(); int iMax = i0;
+        for (int i = i0; i < i1; ++i) {
+            float v = src[i];
+            if (std::isnan(v)) continue;
+            if (v < mn) { mn = v; iMin = i; }
+            if (v > mx) { mx = v; iMax = i; }
+        }
+        outIdxMin.push_back(iMin);
+        outIdxMax.push_back(iMax);
+    }
+}
+
+// PulseqLoader::lttbDownsampleUniform before the kernels
+static void refLttbUniform(const std::vector<float>& src, double tStart, double dt, int targetPoints,
+                           std::vector<double>& tOut, std::vector<double>& vOut)
+{
+    tOut.clear(); vOut.clear();
+    int n = src.size();
+    if (n <= 0 || targetPoints <= 0) return;
+    if (n <= targetPoints) {
+        for (int i = 0; i < n; ++i) { tOut.push_back(tStart + i * dt); vOut.push_back(double(src[i])); }
+        return;
+    }
+    tOut.push_back(tStart); vOut.push_back(double(src[0]));
+    if (targetPoints == 1) return;
+    if (targetPoints == 2) {
+        tOut.push_back(tStart + (n - 1) * dt); vOut.push_back(double(src[n - 1]));
+        return;
+    }
+    int buckets = targetPoints - 2;
+    int bucketSize = (n - 2) / buckets;
+    if (bucketSize <= 0) bucketSize = 1;
+    int a = 0;
+    for (int b = 0; b < buckets; ++b) {
+        int start = 1 + b * bucketSize;
+        int end = (b == buckets - 1 ? n - 1 : std::min(n - 1, start + bucketSize));
+        int nextStart = end;
+        int nextEnd = (b == buckets - 1 ? n - 1 : std::min(n - 1, end + bucketSize));
+        double avgX = 0.0, avgY = 0.0; int count = 0;
+        for (int i = nextStart; i < nextEnd; ++i) { avgX += (tStart + i * dt); avgY += double(src[i]); ++count; }
+        if (count == 0) { avgX = tStart + (nextStart) * dt; avgY = double(src[std::min(nextStart, n - 1)]); }
+        double maxArea = -1.0; int maxIndex = start;
+        double ax = tStart + a * dt; double ay = double(src[a]);
+        for (int i = start; i < end; ++i) {
+            double bx = tStart + i * dt; double by = double(src[i]);
+            double area = std::abs((ax - avgX) * (by - ay) - (ax - bx) * (avgY - ay));
+            if (area > maxArea) { maxArea = area; maxIndex = i; }
+        }
+        tOut.push_back(tStart + maxIndex * dt);
+        vOut.push_back(double(src[maxIndex]));
+        a = maxIndex;
+    }
+    tOut.push_back(tStart + (n - 1) * dt);
+    vOut.push_back(double(src[n - 1]));
+}
+
+// WaveformDrawer::applyLTTBDownsampling before the kernels
+static void refLttb(const std::vector<double>& time, const std::vector<double>& values, int targetPoints,
+                    std::vector<double>& sampledTime, std::vector<double>& sampledValues)
+{
+    sampledTime.clear(); sampledValues.clear();
+    if (time.empty() || time.size() != values.size()) return;
+    if (targetPoints <= 0) targetPoints = 2;
+    if (targetPoints > int(time.size())) targetPoints = time.size();
+    if (int(time.size()) <= targetPoints) { sampledTime = time; sampledValues = values; return; }
+    sampledTime.push_back(time.front()); sampledValues.push_back(values.front());
+    if (targetPoints <= 2) {
+        if (targetPoints == 2) { sampledTime.push_back(time.back()); sampledValues.push_back(values.back()); }
+        return;
+    }
+    int bucketSize = (int(time.size()) - 2) / (targetPoints - 2);
+    for (int i = 1; i < targetPoints - 1; ++i) {
+        int bucketStart = (i - 1) * bucketSize + 1;
+        int bucketEnd = std::min(bucketStart + bucketSize, int(time.size()) - 1);
+        double maxArea = -1.0; int maxIndex = bucketStart;
+        for (int j = bucketStart; j < bucketEnd; ++j) {
+            double x1 = time[i - 1], y1 = values[i - 1], x2 = time[j], y2 = values[j];
+            double x3 = time[bucketEnd], y3 = values[bucketEnd];
+            double area = std::abs((x2 - x1) * (y3 - y1) - (x3 - x1) * (y2 - y1)) / 2.0;
+            if (area > maxArea) { maxArea = area; maxIndex = j; }
+        }
+        sampledTime.push_back(time[maxIndex]); sampledValues.push_back(values[maxIndex]);
+    }
+    sampledTime.push_back(time.back()); sampledValues.push_back(values.back());
+}
+
+// WaveformDrawer::applyMinMaxDownsampling before the kernels
+static void refMinMaxByTime(const std::vector<double>& time, const std::vector<double>& values, int pixelBuckets,
+                            std::vector<double>& outTime, std::vector<double>& outValues)
+{
+    outTime.clear(); outValues.clear();
+    if (time.empty() || time.size() != values.size() || pixelBuckets <= 0) return;
+    int n = time.size();
+    if (n <= 2 * pixelBuckets) { outTime = time; outValues = values; return; }
+    double tMin = time.front(), tMax = time.back();
+    if (tMax <= tMin) { outTime = time; outValues = values; return; }
+    double bucketW = (tMax - tMin) / pixelBuckets;
+    int idx = 0;
+    for (int b = 0; b < pixelBuckets; ++b) {
+        double bx0 = tMin + b * bucketW;
+        double bx1 = (b == pixelBuckets - 1) ? tMax : (bx0 + bucketW);
+        double ymin = std::numeric_limits<double>::infinity();
+        double ymax = -std::numeric_limits<double>::infinity();
+        double txMin = bx0, txMax = bx0;
+        while (idx < n && time[idx] < bx0) ++idx;
+        int j = idx;
+        for (; j < n && time[j] <= bx1; ++j) {
+            double v = values[j];
+            if (std::isnan(v)) continue;
+            if (v < ymin) { ymin = v; txMin = time[j]; }
+            if (v > ymax) { ymax = v; txMax = time[j]; }
+        }
+        if (ymin != std::numeric_limits<double>::infinity()) {
+            outTime.push_back(txMin); outValues.push_back(ymin);
+            if (ymax != ymin) { outTime.push_back(txMax); outValues.push_back(ymax); }
+        }
+        idx = j;
+    }
+}
+
+// Same values, NaN matching NaN
+static bool sameSeries(const std::vector<double>& a, const std::vector<double>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (!(a[i] == b[i] || (std::isnan(a[i]) && std::isnan(b[i])))) return false;
+    return true;
+}
+
+// Every path agrees with the old loops on src at a range of bucket counts / targets
+static bool checkShape(const std::vector<float>& src, const std::vector<Isa>& paths)
+{
+    const double tStart = 12.5, dt = 0.1;
+    std::vector<double> time(src.size()), values(src.size());
+    for (size_t i = 0; i < src.size(); ++i) { time[i] = tStart + i * dt; values[i] = src[i]; }
+    const int n = int(src.size());
+    for (int k : {1, 2, 3, 7, 16, 100, n / 3, n / 2, n - 1, n, n + 5}) {
+        std::vector<int> rMin, rMax, kMin, kMax;
+        std::vector<double> rT, rV, kT, kV;
+        refBucketMinMax(src, k, rMin, rMax);
+        for (Isa isa : paths) {
+            setActiveIsa(isa);
+            bucketMinMax(src, k, kMin, kMax);
+            if (kMin != rMin || kMax != rMax) {
+                std::cerr << "bucketMinMax mismatch (" << isaName(isa) << ", n=" << n << ", buckets=" << k << ")" << std::endl;
+                return false;
+            }
+        }
+        refLttbUniform(src, tStart, dt, k, rT, rV);
+        for (Isa isa : paths) {
+            setActiveIsa(isa);
+            lttbUniform(src, tStart, dt, k, kT, kV);
+            if (!sameSeries(kT, rT) || !sameSeries(kV, rV)) {
+                std::cerr << "lttbUniform mismatch (" << isaName(isa) << ", n=" << n << ", target=" << k << ")" << std::endl;
+                return false;
+            }
+        }
+        refLttb(time, values, k, rT, rV);
+        for (Isa isa : paths) {
+            setActiveIsa(isa);
+            lttb(time, values, k, kT, kV);
+            if (!sameSeries(kT, rT) || !sameSeries(kV, rV)) {
+                std::cerr << "lttb mismatch (" << isaName(isa) << ", n=" << n << ", target=" << k << ")" << std::endl;
+                return false;
+            }
+        }
+        refMinMaxByTime(time, values, k, rT, rV);
+        for (Isa isa : paths) {
+            setActiveIsa(isa);
+            minMaxByTime(time, values, k, kT, kV);
+            if (!sameSeries(kT, rT) || !sameSeries(kV, rV)) {
+                std::cerr << "minMaxByTime mismatch (" << isaName(isa) << ", n=" << n << ", buckets=" << k << ")" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Decoded RF amplitude / phase and arbitrary gradient shapes of every .seq file, each shape once
+static std::vector<std::vector<float>> loadShapes(const std::string& dir, int maxBlocksPerFile)
+{
+    std::vector<std::vector<float>> shapes;
+    for (const auto& e : fs::directory_iterator(dir)) {
+        if (!e.is_regular_file() || e.path().extension() != ".seq") continue;
+        ExternalSequence seq;
+        if (!seq.load(e.path().string())) continue;
+        std::set<const float*> seen;
+        auto take = [&](const float* p, int len) {
+            if (p && len > 1 && seen.insert(p).second) shapes.emplace_back(p, p + len);
+        };
+        const int blocks = std::min(seq.GetNumberOfBlocks(), maxBlocksPerFile);
+        for (int i = 0; i < blocks; ++i) {
+            SeqBlock* block = seq.GetBlock(i);
+            if (block && seq.decodeBlock(block)) {
+                take(block->GetRFAmplitudePtr(), block->GetRFLength());
+                take(block->GetRFPhasePtr(), block->GetRFLength());
+                for (int g = 0; g < NUM_GRADS; ++g)
+                    take(block->GetArbGradShapePtr(g), block->GetArbGradNumSamples(g));
+            }
+            delete block;
+        }
+    }
+    return shapes;
+}
+
+// Million samples per second of fn over `samples` samples per call
+template <typename Fn>
+static double msps(Fn fn, double samples, double minSeconds)
+{
+    int reps = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    do { fn(); ++reps; } while (secondsSince(t0) < minSeconds);
+    return samples * reps / secondsSince(t0) / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    std::string dir;
+    double minSeconds = 0.3;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--dir" && i + 1 < argc) dir = argv[++i];
+        else if (a == "--seconds" && i + 1 < argc) minSeconds = std::atof(argv[++i]);
+    }
+#ifdef SEQEYES_SEQ_FILES_DIR
+    if (dir.empty()) dir = SEQEYES_SEQ_FILES_DIR;
+#endif
+    if (dir.empty() || !fs::is_directory(dir)) {
+        std::cerr << "Could not locate the .seq corpus. Use --dir <path>." << std::endl;
+        return 4;
+    }
+
+    ExternalSequence::SetPrintFunction(&quietPrint);
+    std::vector<std::vector<float>> shapes = loadShapes(dir, 5000);
+    if (shapes.empty()) {
+        std::cerr << "No RF or arbitrary gradient shapes in " << dir << std::endl;
+        return 4;
+    }
+
+    std::vector<Isa> paths;
+    for (Isa isa : {Isa::Scalar, Isa::Sse42, Isa::Avx2})
+        if (int(isa) <= int(supportedIsa())) paths.push_back(isa);
+
+    // Synthetic shapes: NaN breaks, repeated extremes, infinities, lengths around the vector widths
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> level(-3, 3);
+    std::vector<std::vector<float>> checks = shapes;
+    for (int n : {2, 3, 5, 8, 9, 17, 31, 64, 257, 1001}) {
+        std::vector<float> s(n);
+        for (float& v : s) v = float(level(rng));
+        for (int k = 0; k < n; k += 7) s[k] = std::numeric_limits<float>::quiet_NaN();
+        if (n > 4) { s[n / 2] = std::numeric_limits<float>::infinity(); s[n / 3] = -std::numeric_limits<float>::infinity(); }
+        checks.push_back(s);
+        checks.push_back(std::vector<float>(n, std::numeric_limits<float>::quiet_NaN()));
+        checks.push_back(std::vector<float>(n, 1.0f));
+    }
+    for (const std::vector<float>& s : checks)
+        if (!checkShape(s, paths)) return 1;
+
+    // Throughput over all corpus shapes back to back, as a long zoomed-out viewport would see them
+    std::vector<float> signal;
+    while (signal.size() < 4000000)
+        for (const std::vector<float>& s : shapes) signal.insert(signal.end(), s.begin(), s.end());
+    const double samples = double(signal.size());
+    const int buckets = 2000, target = 4000;
+    std::vector<double> time(signal.size()), values(signal.size());
+    for (size_t i = 0; i < signal.size(); ++i) { time[i] = i * 1e-3; values[i] = signal[i]; }
+
+    std::vector<int> iMin, iMax;
+    std::vector<double> tOut, vOut;
+    const double refMinMax = msps([&] { refBucketMinMax(signal, buckets, iMin, iMax); }, samples, minSeconds);
+    const double refLttbU = msps([&] { refLttbUniform(signal, 0.0, 1e-3, target, tOut, vOut); }, samples, minSeconds);
+    const double refMinMaxT = msps([&] { refMinMaxByTime(time, values, buckets, tOut, vOut); }, samples, minSeconds);
+    const double refLttbT = msps([&] { refLttb(time, values, target, tOut, vOut); }, samples, minSeconds);
+
+    std::cout << "SHAPES: " << shapes.size() << " (" << samples / 1e6 << " M samples timed)\n";
+    std::cout << "PATH      MINMAX_MSPS   LTTB_MSPS   MINMAX_T_MSPS   LTTB_T_MSPS\n";
+    std::cout << "old       " << refMinMax << "  " << refLttbU << "  " << refMinMaxT << "  " << refLttbT << "\n";
+    double bestMinMax = 0.0, bestLttb = 0.0;
+    for (Isa isa : paths) {
+        setActiveIsa(isa);
+        const double mm = msps([&] { bucketMinMax(signal, buckets, iMin, iMax); }, samples, minSeconds);
+        const double lt = msps([&] { lttbUniform(signal, 0.0, 1e-3, target, tOut, vOut); }, samples, minSeconds);
+        const double mmT = msps([&] { minMaxByTime(time, values, buckets, tOut, vOut); }, samples, minSeconds);
+        const double ltT = msps([&] { lttb(time, values, target, tOut, vOut); }, samples, minSeconds);
+        bestMinMax = mm; bestLttb = lt;
+        std::cout << isaName(isa) << "  " << mm << "  " << lt << "  " << mmT << "  " << ltT << "\n";
+    }
+    setActiveIsa(supportedIsa());
+    std::cout << "ACTIVE_PATH: " << isaName(activeIsa()) << "\n";
+    std::cout << "MINMAX_SPEEDUP: " << bestMinMax / refMinMax << "\n";
+    std::cout << "LTTB_SPEEDUP: " << bestLttb / refLttbU << "\n";
+    return 0;
+}
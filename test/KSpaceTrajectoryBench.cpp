@@ -0,0 +1,183 @@
+// Benchmark of the k-space trajectory (KSpaceTrajectory::compute) on writeSpiral.seq and on a synthetic
+// EPI-like sequence with ~10M ADC samples written to the temp directory. The ADC sample k-values come
+// out of the integrator's merged walk over the output times; they are checked against, and timed next
+// to, the lookup they replaced: a binary search of the trajectory time grid per sample and channel.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QVector>
+
+#include "DecodedBlockCache.h"
+#include "ExternalSequence.h"
+#include "KSpaceTrajectory.h"
+#include "LoadPipeline.h"
+
+namespace fs = std::filesystem;
+
+static void quietPrint(const std::string&) {}
+
+static double secondsSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// EPI-like sequence: per shot a block-pulse excitation and 64 readouts of alternating polarity with
+// 2560 ADC samples each, phase blips on gy
+static bool writeSyntheticSeq(const std::string& path, int shots)
+{
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "[VERSION]\nmajor 1\nminor 5\nrevision 1\n\n"
+        << "[DEFINITIONS]\nAdcRasterTime 1e-07\nBlockDurationRaster 1e-05\nGradientRasterTime 1e-05\n"
+        << "RadiofrequencyRasterTime 1e-06\n\n"
+        << "# NUM DUR RF  GX  GY  GZ  ADC  EXT\n[BLOCKS]\n";
+    const int readoutsPerShot = 64;
+    int id = 1;
+    for (int s = 0; s < shots; ++s) {
+        out << id++ << " 200 1 0 0 0 0 0\n";
+        for (int r = 0; r < readoutsPerShot; ++r)
+            out << id++ << " 262 0 " << (r % 2 ? 2 : 1) << " 3 0 1 0\n";
+    }
+    out << "\n[RF]\n1 833.333 1 2 3 150 100 0 0 0 0 e\n\n"
+        << "# id amplitude rise flat fall delay\n[TRAP]\n"
+        << "1 100000 20 2560 20 0\n2 -100000 20 2560 20 0\n3 2000 10 0 10 2590\n\n"
+        << "[ADC]\n1 2560 1000 20 0 0 0 0 0\n\n"
+        << "[SHAPES]\n\nshape_id 1\nnum_samples 2\n1\n1\n\n"
+        << "shape_id 2\nnum_samples 2\n0\n0\n\n"
+        << "shape_id 3\nnum_samples 2\n0\n300\n\n";
+    return bool(out);
+}
+
+// The interpolateK lambda of compute() before the merged walk: three binary searches per sample
+static double refInterpolateK(const QVector<double>& timeGrid, const QVector<double>& data, double ta)
+{
+    const double tacc = 1e-10;
+    if (timeGrid.size() == 1)
+        return data.first();
+    auto it = std::lower_bound(timeGrid.begin(), timeGrid.end(), ta);
+    if (it == timeGrid.begin())
+        return data.first();
+    if (it == timeGrid.end())
+        return data.last();
+    int idx1 = int(it - timeGrid.begin());
+    if (std::abs(*it - ta) <= tacc * 0.5)
+        return data[idx1];
+    int idx0 = idx1 - 1;
+    double t0 = timeGrid[idx0];
+    double t1 = timeGrid[idx1];
+    if (t1 <= t0)
+        return data[idx1];
+    double alpha = (ta - t0) / (t1 - t0);
+    return data[idx0] + (data[idx1] - data[idx0]) * alpha;
+}
+
+// Loads path, computes its trajectory and prints one result line; false on a load error or a mismatch
+static bool runCase(const std::string& name, const std::string& path)
+{
+    ExternalSequence seq;
+    if (!seq.load(path)) {
+        std::cerr << "Could not load " << path << std::endl;
+        return false;
+    }
+    const int blockCount = seq.GetNumberOfBlocks();
+    std::vector<SeqBlock*> blocks(blockCount, nullptr);
+    for (int i = 0; i < blockCount; ++i) {
+        blocks[i] = seq.GetBlock(i);
+        if (!seq.decodeBlock(blocks[i])) {
+            std::cerr << "Could not decode block " << i << " of " << path << std::endl;
+            return false;
+        }
+    }
+    DecodedBlockCache cache;
+    cache.setResident(&blocks);
+    const double tFactor = 1.0; // internal time in us
+    QVector<double> edges;
+    LoadPipeline().run(cache, tFactor, edges);
+
+    auto definition = [&](const char* key) {
+        std::vector<double> def = seq.GetDefinition(key);
+        return (!def.empty() && def[0] > 0.0) ? def[0] * 1e6 : -1.0;
+    };
+    KSpaceTrajectory::Input input { cache, edges, tFactor, true,
+                                    definition("RadiofrequencyRasterTime"), definition("GradientRasterTime"), 0.0 };
+
+    auto t0 = std::chrono::steady_clock::now();
+    const KSpaceTrajectory::Result result = KSpaceTrajectory::compute(input);
+    const double computeSec = secondsSince(t0);
+
+    // The old lookup over the same grid; points just before an excitation are NaN in the plotted k
+    const int adcCount = result.t_adc.size();
+    std::vector<double> ref(3 * size_t(adcCount));
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < adcCount; ++i) {
+        ref[3 * i] = refInterpolateK(result.t, result.kx, result.t_adc[i]);
+        ref[3 * i + 1] = refInterpolateK(result.t, result.ky, result.t_adc[i]);
+        ref[3 * i + 2] = refInterpolateK(result.t, result.kz, result.t_adc[i]);
+    }
+    const double lookupSec = secondsSince(t0);
+    // An ADC time within the accuracy past its grid point interpolates towards the next one
+    double kMax = 0.0;
+    for (int i = 0; i < adcCount; ++i)
+        kMax = std::max({kMax, std::abs(result.kx_adc[i]), std::abs(result.ky_adc[i]), std::abs(result.kz_adc[i])});
+    const double tolerance = 1e-9 * std::max(1.0, kMax);
+    int mismatches = 0;
+    for (int i = 0; i < adcCount; ++i) {
+        const double k[3] = { result.kx_adc[i], result.ky_adc[i], result.kz_adc[i] };
+        for (int c = 0; c < 3; ++c)
+            if (!std::isnan(ref[3 * i + c]) && std::abs(ref[3 * i + c] - k[c]) > tolerance) ++mismatches;
+    }
+
+    for (SeqBlock* block : blocks) delete block;
+
+    std::cout << name << "  " << blockCount << "  " << result.t.size() << "  " << adcCount << "  "
+              << computeSec * 1e3 << "  " << adcCount / computeSec / 1e6 << "  " << lookupSec * 1e3 << "\n";
+    if (mismatches > 0) {
+        std::cerr << name << ": " << mismatches << " ADC k-values differ from the grid lookup" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    std::string dir;
+    double syntheticSamples = 10e6;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--dir" && i + 1 < argc) dir = argv[++i];
+        else if (a == "--samples" && i + 1 < argc) syntheticSamples = std::atof(argv[++i]);
+    }
+#ifdef SEQEYES_SEQ_FILES_DIR
+    if (dir.empty()) dir = SEQEYES_SEQ_FILES_DIR;
+#endif
+    const std::string spiral = (fs::path(dir) / "writeSpiral.seq").string();
+    if (dir.empty() || !fs::is_regular_file(spiral)) {
+        std::cerr << "Could not locate writeSpiral.seq. Use --dir <path>." << std::endl;
+        return 4;
+    }
+
+    ExternalSequence::SetPrintFunction(&quietPrint);
+    const std::string synthetic = (fs::temp_directory_path() / "seqeyes_kspace_bench.seq").string();
+    const int shots = std::max(1, int(std::ceil(syntheticSamples / (64.0 * 2560.0))));
+    if (!writeSyntheticSeq(synthetic, shots)) {
+        std::cerr << "Could not write " << synthetic << std::endl;
+        return 4;
+    }
+
+    std::cout << "CASE  BLOCKS  GRID_POINTS  ADC_SAMPLES  COMPUTE_MS  ADC_MSPS  OLD_LOOKUP_MS\n";
+    bool ok = runCase("writeSpiral", spiral);
+    ok = runCase("synthetic", synthetic) && ok;
+    std::error_code ec;
+    fs::remove(synthetic, ec);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+// ExternalSequence::loadWithCache must not trust a damaged .seqcache: a truncated or altered cache
+// is ignored, the .seq file is parsed again and the cache is rewritten.
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "ExternalSequence.h"
+
+namespace fs = std::filesystem;
+
+static bool g_loadedFromCache = false;
+
+static void watchPrint(const std::string& str)
+{
+    if (str.find("Loaded the parsed sequence from") != std::string::npos) g_loadedFromCache = true;
+}
+
+static std::string readFile(const fs::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const fs::path& path, const std::string& data)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+}
+
+// Loads seqPath through the cache; false if the load fails or does not match the parsed sequence
+static bool loadAndCompare(const std::string& seqPath, const fs::path& cachePath, const std::vector<double>& durations,
+                           bool& fromCache)
+{
+    g_loadedFromCache = false;
+    ExternalSequence seq;
+    if (!seq.loadWithCache(seqPath, cachePath.string())) return false;
+    fromCache = g_loadedFromCache;
+    if (seq.GetNumberOfBlocks() != int(durations.size())) return false;
+    for (int i = 0; i < seq.GetNumberOfBlocks(); ++i)
+    {
+        SeqBlock* block = seq.GetBlock(i);
+        const bool decoded = seq.decodeBlock(block);
+        const double duration = block->GetDuration();
+        delete block;
+        if (!decoded || duration != durations[i]) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::string dir = argc > 1 ? argv[1] : "";
+#ifdef SEQEYES_SEQ_FILES_DIR
+    if (dir.empty()) dir = SEQEYES_SEQ_FILES_DIR;
+#endif
+    const fs::path source = fs::path(dir) / "writeGradientEcho.seq";
+    if (!fs::is_regular_file(source)) {
+        std::cerr << "Could not locate " << source.string() << std::endl;
+        return 4;
+    }
+    ExternalSequence::SetPrintFunction(&watchPrint);
+
+    // the cache is keyed by the stamp of the .seq file, so work on a copy that stays untouched
+    const fs::path workDir = fs::temp_directory_path() / "seqeyes_cache_test";
+    fs::remove_all(workDir);
+    fs::create_directories(workDir);
+    const fs::path seqPath = workDir / "seq.seq";
+    const fs::path cachePath = workDir / "seq.seqcache";
+    fs::copy_file(source, seqPath);
+
+    std::vector<double> durations;
+    {
+        ExternalSequence seq;
+        if (!seq.load(seqPath.string())) {
+            std::cerr << "Could not parse " << seqPath.string() << std::endl;
+            return 1;
+        }
+        for (int i = 0; i < seq.GetNumberOfBlocks(); ++i)
+        {
+            SeqBlock* block = seq.GetBlock(i);
+            seq.decodeBlock(block);
+            durations.push_back(block->GetDuration());
+            delete block;
+        }
+    }
+
+    int failures = 0;
+    auto check = [&](const char* what, bool expectFromCache) {
+        bool fromCache = false;
+        if (!loadAndCompare(seqPath.string(), cachePath, durations, fromCache) || fromCache != expectFromCache) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    check("first load parses and writes the cache", false);
+    check("second load reads the cache", true);
+    const std::string cache = readFile(cachePath);
+    if (cache.size() < 64) {
+        std::cerr << "FAIL: no cache written" << std::endl;
+        return 1;
+    }
+
+    writeFile(cachePath, cache.substr(0, cache.size() / 2));
+    check("truncated cache falls back to parsing", false);
+    check("truncated cache is rewritten", true);
+
+    std::string altered = cache;
+    altered[altered.size() * 3 / 4] ^= 0x5a;
+    writeFile(cachePath, altered);
+    check("altered cache falls back to parsing", false);
+    check("altered cache is rewritten", true);
+
+    for (const fs::directory_entry& e : fs::directory_iterator(workDir))
+        if (e.path().extension() == ".tmp") {
+            std::cerr << "FAIL: temporary file left behind: " << e.path().string() << std::endl;
+            ++failures;
+        }
+
+    fs::remove_all(workDir);
+    if (failures == 0) std::cout << "SeqCacheTest passed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+// Micro-benchmark of the .seq field tokenizer: sscanf vs SeqTokenizer (std::from_chars),
+// plus end-to-end ExternalSequence::load throughput over the test/seq_files corpus,
+// parsing the text and restoring it from a .seqcache written to the temp directory.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ExternalSequence.h"
+#include "SeqTokenizer.h"
+
+namespace fs = std::filesystem;
+
+static void quietPrint(const std::string&) {}
+
+static double secondsSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Numeric data lines only: comments, section headers and keyword lines are skipped
+static std::vector<std::string> numericLines(const std::string& text)
+{
+    std::vector<std::string> lines;
+    std::istringstream ss(text);
+    std::string line;
+    while (std::getline(ss, line)) {
+        size_t p = line.find_first_not_of(" \t\r");
+        if (p == std::string::npos) continue;
+        char c = line[p];
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.')
+            lines.push_back(line);
+    }
+    return lines;
+}
+
+static double parseSscanf(const std::vector<std::string>& lines)
+{
+    double sum = 0.0;
+    for (const std::string& line : lines) {
+        const char* p = line.c_str();
+        double v; int n = 0;
+        while (1 == sscanf(p, "%lf%n", &v, &n)) { sum += v; p += n; }
+    }
+    return sum;
+}
+
+static double parseTokenizer(const std::vector<std::string>& lines)
+{
+    double sum = 0.0;
+    for (const std::string& line : lines) {
+        SeqTokenizer tok(line.data(), line.data() + line.size());
+        double v;
+        while (tok >> v) sum += v;
+    }
+    return sum;
+}
+
+// Repeat fn until at least minSeconds elapsed, return throughput in MB/s
+template <typename Fn>
+static double throughputMBps(Fn fn, double bytes, double minSeconds, double& checksum)
+{
+    int reps = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    do { checksum = fn(); ++reps; } while (secondsSince(t0) < minSeconds);
+    return bytes * reps / secondsSince(t0) / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    std::string dir;
+    double minSeconds = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--dir" && i + 1 < argc) dir = argv[++i];
+        else if (a == "--seconds" && i + 1 < argc) minSeconds = std::atof(argv[++i]);
+    }
+#ifdef SEQEYES_SEQ_FILES_DIR
+    if (dir.empty()) dir = SEQEYES_SEQ_FILES_DIR;
+#endif
+    if (dir.empty() || !fs::is_directory(dir)) {
+        std::cerr << "Could not locate the .seq corpus. Use --dir <path>." << std::endl;
+        return 4;
+    }
+
+    ExternalSequence::SetPrintFunction(&quietPrint);
+
+    std::vector<std::string> files;
+    for (const auto& e : fs::directory_iterator(dir))
+        if (e.is_regular_file() && e.path().extension() == ".seq")
+            files.push_back(e.path().string());
+    if (files.empty()) {
+        std::cerr << "No .seq files in " << dir << std::endl;
+        return 4;
+    }
+
+    std::vector<std::string> lines;
+    double lineBytes = 0.0, fileBytes = 0.0;
+    for (const std::string& f : files) {
+        std::ifstream in(f, std::ios::binary);
+        std::stringstream ss; ss << in.rdbuf();
+        std::string text = ss.str();
+        fileBytes += text.size();
+        for (std::string& l : numericLines(text)) { lineBytes += l.size() + 1; lines.push_back(std::move(l)); }
+    }
+
+    double sumSscanf = 0.0, sumTok = 0.0;
+    double mbpsSscanf = throughputMBps([&] { return parseSscanf(lines); }, lineBytes, minSeconds, sumSscanf);
+    double mbpsTok = throughputMBps([&] { return parseTokenizer(lines); }, lineBytes, minSeconds, sumTok);
+
+    double dummy = 0.0;
+    double mbpsLoad = throughputMBps([&] {
+        double blocks = 0.0;
+        for (const std::string& f : files) {
+            ExternalSequence seq;
+            if (seq.load(f)) blocks += seq.GetNumberOfBlocks();
+        }
+        return blocks;
+    }, fileBytes, minSeconds, dummy);
+
+    // cache files are written by the first (missing cache) pass, the timed passes read them
+    const fs::path cacheDir = fs::temp_directory_path() / "seqeyes_parser_bench";
+    fs::create_directories(cacheDir);
+    auto cachePath = [&](size_t i) { return (cacheDir / (std::to_string(i) + ".seqcache")).string(); };
+    double blocksParsed = 0.0, blocksCached = 0.0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        ExternalSequence seq;
+        if (seq.loadWithCache(files[i], cachePath(i))) blocksParsed += seq.GetNumberOfBlocks();
+    }
+    double mbpsCached = throughputMBps([&] {
+        double blocks = 0.0;
+        for (size_t i = 0; i < files.size(); ++i) {
+            ExternalSequence seq;
+            if (seq.loadWithCache(files[i], cachePath(i))) blocks += seq.GetNumberOfBlocks();
+        }
+        return blocks;
+    }, fileBytes, minSeconds, blocksCached);
+    fs::remove_all(cacheDir);
+
+    std::cout << "FILES: " << files.size() << " (" << fileBytes / 1e6 << " MB, " << lines.size() << " numeric lines)\n";
+    std::cout << "TOKENIZE_SSCANF_MBPS: " << mbpsSscanf << "\n";
+    std::cout << "TOKENIZE_FROMCHARS_MBPS: " << mbpsTok << "\n";
+    std::cout << "TOKENIZE_SPEEDUP: " << mbpsTok / mbpsSscanf << "\n";
+    std::cout << "LOAD_MBPS: " << mbpsLoad << "\n";
+    std::cout << "CACHED_LOAD_MBPS: " << mbpsCached << "\n";
+
+    // both parsers must agree on the decoded values
+    if (std::abs(sumSscanf - sumTok) > 1e-9 * std::max(1.0, std::abs(sumSscanf))) {
+        std::cerr << "Checksum mismatch: sscanf " << sumSscanf << " vs tokenizer " << sumTok << std::endl;
+        return 1;
+    }
+    if (blocksParsed != blocksCached) {
+        std::cerr << "Block count mismatch: parsed " << blocksParsed << " vs cached " << blocksCached << std::endl;
+        return 1;
+    }
+    return 0;
+}